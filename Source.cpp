@@ -1,12 +1,48 @@
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 #include <iostream>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
 #include "shader.h"
+#include "job_system.h"
+#include "physics_world.h"
+#include "scene_loader.h"
+#include "body_renderer.h"
+#include "particle_system.h"
+#include "particle_renderer.h"
+#include "soft_body.h"
+#include "soft_body_renderer.h"
+#include "profiler.h"
+#include "perf_overlay.h"
+#include "gpu_timer.h"
+#include "camera.h"
+#include "debug_draw.h"
+#include "replication.h"
 
 using namespace std;
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
+void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
 void processInput(GLFWwindow *window);
+bool keyPressed(GLFWwindow *window, int key);
+int runServer(uint16_t port);
+float fitScene(const BodyStore& bodies);
+
+//port the server listens on unless one is given
+const uint16_t defaultPort = 27015;
+
+//toggled from processInput
+bool showPerfOverlay = false;
+//DebugDrawFlags, F2 AABBs, F3 contacts, F4 normals, F5 joints, F6 level
+int debugDrawFlags = 0;
+
+//what the window shows, panned by dragging with the right mouse button or the
+//arrow keys and zoomed with the wheel, Home fits the whole scene again
+Camera2D camera;
+float sceneHalfSize = 1.0f;
 
 //shader source code in GLSL
 const char *vertexShaderSource = "#version 330 core\n"
@@ -28,8 +64,23 @@ const char *fragmentShaderSource = "#version 330 core\n"
 "	FragColor = vec4(ourColor, 1.0);\n"
 "}\n\0";
 
-int main() {
-	
+//usage: app                         step scene.txt and draw it
+//       app --server [port]           step scene.txt without a window and serve it to clients
+//       app --client address [port]   draw the bodies a server sends
+int main(int argc, char** argv) {
+	const char* clientAddress = nullptr;
+	uint16_t port = defaultPort;
+	if (argc > 1 && strcmp(argv[1], "--server") == 0) {
+		if (argc > 2)
+			port = (uint16_t)atoi(argv[2]);
+		return runServer(port);
+	}
+	if (argc > 2 && strcmp(argv[1], "--client") == 0) {
+		clientAddress = argv[2];
+		if (argc > 3)
+			port = (uint16_t)atoi(argv[3]);
+	}
+
 	//initialize and configure glfw
 	glfwInit();
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
@@ -49,6 +100,7 @@ int main() {
 	//create context and set frame buffer size
 	glfwMakeContextCurrent(window);
 	glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+	glfwSetScrollCallback(window, scroll_callback);
 
 	//check if glad is initialized
 	if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
@@ -59,71 +111,292 @@ int main() {
 	//set viewport
 	glViewport(0, 0, horizontalSize, verticalSize);
 
-	//set verticies of the triangle
-	float vertices[] = {
-		// positions         // colors
-		 0.5f, -0.5f, 0.0f,  1.0f, 0.0f, 0.0f,   // bottom right
-		-0.5f, -0.5f, 0.0f,  0.0f, 1.0f, 0.0f,   // bottom left
-		 0.0f,  0.5f, 0.0f,  0.0f, 0.0f, 1.0f    // top 
-	};
-
-	//create a shader object (referenced by an ID)
-	unsigned int vertexShader;
-	vertexShader = glCreateShader(GL_VERTEX_SHADER);
+	//load the scene into the physics world, stepping on every hardware thread
+	JobSystem jobs((int)thread::hardware_concurrency());
+	PhysicsWorld world;
+	world.setJobSystem(&jobs);
+	ParticleSystem particles;
+	particles.setJobSystem(&jobs);
+	SoftBodySystem softBodies;
+	softBodies.setJobSystem(&jobs);
+	//a client steps nothing itself, it draws the bodies it is sent, interpolated
+	ReplicationClient client;
+	BodyStore clientBodies;
+	bool remote = clientAddress != nullptr;
+	if (remote) {
+		NetAddress server;
+		if (!parseAddress(clientAddress, port, server) || !client.connect(server)) {
+			cout << "Failed to connect to " << clientAddress << endl;
+			return -1;
+		}
+	}
+	else if (!loadScene("scene.txt", world, &particles, &softBodies)) {
+		cout << "Failed to load scene" << endl;
+		return -1;
+	}
+
+	//fit the whole scene (centred on the origin) into the window, a client does
+	//it once the first snapshot is in
+	if (!remote)
+		sceneHalfSize = fitScene(world.bodies);
+	camera.fit(sceneHalfSize);
+	bool fitted = !remote;
+
 	//compile the shader source code
 	Shader ourShader("vertexShader.txt", "fragmentShader.txt");
+	Shader particleShader("particleVertexShader.txt", "fragmentShader.txt");
+	//particle shader sets its own point size
+	glEnable(GL_PROGRAM_POINT_SIZE);
+
+	//instanced renderer for every body in the world
+	BodyRenderer bodyRenderer;
+	//particles streamed as points
+	ParticleRenderer particleRenderer;
+	//deformable meshes, drawn with the body shader
+	SoftBodyRenderer softBodyRenderer;
+	//frame and step timings, toggled with F1
+	PerfOverlay perfOverlay;
+	//GPU time of each render pass, read back a few frames late
+	GpuTimer gpuTimer;
+	//AABBs, contacts, joints and level lines over the scene, toggled with F2-F6
+	DebugRenderer debugRenderer;
 
-	//generate VAO (vertex array object) and VBO (vertex buffer object)
-	unsigned int VAO;
-	unsigned int VBO;
-	glGenVertexArrays(1, &VAO);
-	glGenBuffers(1, &VBO);
-
-	// ..:: Initialization code (done once (unless your object frequently changes)) :: ..
-	// 1. bind Vertex Array Object
-	glBindVertexArray(VAO);
-	// 2. copy our vertices array in a buffer for OpenGL to use
-	glBindBuffer(GL_ARRAY_BUFFER, VBO);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
-	// 3. then set our vertex attributes pointers
-	// position attribute
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0);
-	glEnableVertexAttribArray(0);
-	// color attribute
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)(3 * sizeof(float)));
-	glEnableVertexAttribArray(1);
+	//physics runs at a fixed rate, decoupled from the frame rate
+	const float timeStep = 1.0f / 60.0f;
+	double accumulator = 0.0;
+	double lastTime = glfwGetTime();
 
 	//render loop
-	int i = 0;
 	while (!glfwWindowShouldClose(window)) {
+		PROFILE_ZONE("frame");
 		processInput(window);
-		
-		//cout << "rendering frame " << i << endl;
-		//i++; //count each frame
+
+		double now = glfwGetTime();
+		double frameTime = now - lastTime;
+		accumulator += frameTime;
+		lastTime = now;
+		//don't try to catch up more than a few steps after a stall
+		if (accumulator > 4 * timeStep)
+			accumulator = 4 * timeStep;
+		if (remote) {
+			PROFILE_ZONE("replication");
+			client.update(frameTime);
+			client.interpolate(clientBodies);
+			if (!fitted && client.latest().bodies.size() > 0) {
+				sceneHalfSize = fitScene(clientBodies);
+				camera.fit(sceneHalfSize);
+				fitted = true;
+			}
+			accumulator = 0.0;
+		}
+		else {
+			PROFILE_ZONE("physics");
+			while (accumulator >= timeStep) {
+				world.step(timeStep);
+				particles.step(timeStep, world.bodies);
+				softBodies.step(timeStep, world.bodies);
+				accumulator -= timeStep;
+			}
+		}
 
 		// --- Drawing code (in render loop) ---
-		ourShader.use();
-		glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
-		glClear(GL_COLOR_BUFFER_BIT);
+		{
+			PROFILE_ZONE("draw");
+			gpuTimer.beginFrame();
+
+			gpuTimer.begin(GPU_PASS_CLEAR);
+			glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
+			glClear(GL_COLOR_BUFFER_BIT);
+			gpuTimer.end();
+
+			int width, height;
+			glfwGetFramebufferSize(window, &width, &height);
+			camera.setViewport(width, height);
+			float viewProjection[9];
+			camera.viewProjection(viewProjection);
+			float viewMinX, viewMinY, viewMaxX, viewMaxY;
+			camera.bounds(viewMinX, viewMinY, viewMaxX, viewMaxY);
+			//only bodies in the window are sent once the client knows what it shows
+			if (remote && fitted)
+				client.setView(viewMinX, viewMinY, viewMaxX, viewMaxY);
+			gpuTimer.begin(GPU_PASS_BODIES);
+			ourShader.use();
+			ourShader.setMat3("viewProjection", viewProjection);
+			ourShader.setBool("worldSpaceVertices", false);
+			//only the bodies in view are written to the instance buffers
+			if (remote)
+				bodyRenderer.update(clientBodies, camera);
+			else
+				bodyRenderer.update(world, camera);
+			bodyRenderer.draw();
+			gpuTimer.end();
 
-		glBindVertexArray(VAO);
-		glDrawArrays(GL_TRIANGLES, 0, 3);
+			gpuTimer.begin(GPU_PASS_SOFT_BODIES);
+			ourShader.setBool("worldSpaceVertices", true);
+			softBodyRenderer.update(softBodies);
+			softBodyRenderer.draw();
+			gpuTimer.end();
+
+			gpuTimer.begin(GPU_PASS_PARTICLES);
+			particleShader.use();
+			particleShader.setMat3("viewProjection", viewProjection);
+			//diameter in world units to pixels, at least one pixel so particles never vanish
+			float pointSize = 2.0f * particles.radius * camera.pixelsPerUnit(height);
+			particleShader.setFloat("pointSize", pointSize > 1.0f ? pointSize : 1.0f);
+			particleShader.setVec3("particleColor", 0.35f, 0.6f, 0.95f);
+			particleRenderer.update(particles);
+			particleRenderer.draw();
+			gpuTimer.end();
+
+			gpuTimer.begin(GPU_PASS_DEBUG);
+			//a client has no contacts or broadphase to show
+			debugRenderer.flags = debugDrawFlags;
+			if (!remote)
+				debugRenderer.addWorld(world, camera, height);
+			debugRenderer.flush(camera);
+			gpuTimer.end();
+
+			perfOverlay.record((float)frameTime, (float)(glfwGetTime() - now), world.stats, gpuTimer.stats);
+			perfOverlay.recordParticles(particles.stats);
+			perfOverlay.recordSoftBodies(softBodies.stats);
+			perfOverlay.visible = showPerfOverlay;
+			gpuTimer.begin(GPU_PASS_OVERLAY);
+			perfOverlay.draw(width, height);
+			gpuTimer.end();
+		}
 
 		//swap buffers and poll I/O events
-		glfwSwapBuffers(window);
+		{
+			PROFILE_ZONE("swap");
+			glfwSwapBuffers(window);
+		}
 		glfwPollEvents();
 	}
 
+#ifdef PHYSICS_PROFILE
+	//write the last few thousand frames of zones for chrome://tracing
+	if (!Profiler::instance().exportChromeTrace("trace.json"))
+		cout << "Failed to write trace.json" << endl;
+#endif
+
 	//delete resources
-	glDeleteVertexArrays(1, &VAO);
-	glDeleteBuffers(1, &VBO);
+	bodyRenderer.destroy();
+	particleRenderer.destroy();
+	softBodyRenderer.destroy();
+	perfOverlay.destroy();
+	debugRenderer.destroy();
+	gpuTimer.destroy();
 	glfwTerminate(); //terminate and clear glfw resources
 	return 0;
 }
 
+//step the scene at a fixed rate without a window and send every client that
+//acks a snapshot after each step, until the process is killed
+int runServer(uint16_t port) {
+	JobSystem jobs((int)thread::hardware_concurrency());
+	PhysicsWorld world;
+	world.setJobSystem(&jobs);
+	if (!loadScene("scene.txt", world)) {
+		cout << "Failed to load scene" << endl;
+		return -1;
+	}
+	ReplicationServer server;
+	if (!server.open(port)) {
+		cout << "Failed to open port " << port << endl;
+		return -1;
+	}
+	cout << "Serving scene.txt on port " << server.port() << endl;
+
+	typedef chrono::steady_clock Clock;
+	const chrono::microseconds timeStep(16667);
+	Clock::time_point next = Clock::now();
+	size_t bytes = 0;
+	for (uint32_t step = 1;; step++) {
+		world.step(1.0f / 60.0f);
+		server.update(world, step);
+		bytes += server.stats.bytes;
+		//a line every ten seconds
+		if (step % 600 == 0) {
+			cout << "step " << step << ", " << server.stats.clients << " clients, " << bytes / 10240 << " KiB/s sent" << endl;
+			bytes = 0;
+		}
+		next += timeStep;
+		this_thread::sleep_until(next);
+	}
+	return 0;
+}
+
+//half size of the square around the origin that holds every body, with a margin
+float fitScene(const BodyStore& bodies) {
+	float halfSize = 1.0f;
+	for (size_t b = 0; b < bodies.size(); b++) {
+		float r = bodies.extentX[b] > bodies.extentY[b] ? bodies.extentX[b] : bodies.extentY[b];
+		float x = fabsf(bodies.posX[b]) + r;
+		float y = fabsf(bodies.posY[b]) + r;
+		if (x > halfSize) halfSize = x;
+		if (y > halfSize) halfSize = y;
+	}
+	return halfSize * 1.1f;
+}
+
 void processInput(GLFWwindow *window) {
 	if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
 		glfwSetWindowShouldClose(window, true);
+	if (keyPressed(window, GLFW_KEY_F1))
+		showPerfOverlay = !showPerfOverlay;
+	const int debugKeys[] = { GLFW_KEY_F2, GLFW_KEY_F3, GLFW_KEY_F4, GLFW_KEY_F5, GLFW_KEY_F6 };
+	const int debugFlags[] = { DEBUG_DRAW_AABBS, DEBUG_DRAW_CONTACTS, DEBUG_DRAW_NORMALS, DEBUG_DRAW_JOINTS, DEBUG_DRAW_LEVEL };
+	for (int k = 0; k < 5; k++)
+		if (keyPressed(window, debugKeys[k]))
+			debugDrawFlags ^= debugFlags[k];
+	if (keyPressed(window, GLFW_KEY_HOME))
+		camera.fit(sceneHalfSize);
+
+	//drag with the right mouse button, the world under the cursor follows it
+	static double lastX = 0.0, lastY = 0.0;
+	double x, y;
+	glfwGetCursorPos(window, &x, &y);
+	int width, height;
+	glfwGetFramebufferSize(window, &width, &height);
+	int windowWidth, windowHeight;
+	glfwGetWindowSize(window, &windowWidth, &windowHeight);
+	//cursor positions are in window coordinates, the camera works in pixels
+	float pixelScale = windowHeight > 0 ? (float)height / windowHeight : 1.0f;
+	if (glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_RIGHT) == GLFW_PRESS)
+		camera.pan((x - lastX) * pixelScale, (y - lastY) * pixelScale, height);
+	lastX = x;
+	lastY = y;
+
+	//arrow keys move a screen height per second
+	static double lastTime = glfwGetTime();
+	double now = glfwGetTime();
+	double step = (now - lastTime) * height;
+	lastTime = now;
+	if (glfwGetKey(window, GLFW_KEY_LEFT) == GLFW_PRESS) camera.pan(step, 0.0, height);
+	if (glfwGetKey(window, GLFW_KEY_RIGHT) == GLFW_PRESS) camera.pan(-step, 0.0, height);
+	if (glfwGetKey(window, GLFW_KEY_UP) == GLFW_PRESS) camera.pan(0.0, step, height);
+	if (glfwGetKey(window, GLFW_KEY_DOWN) == GLFW_PRESS) camera.pan(0.0, -step, height);
+}
+
+//each notch of the wheel zooms by a fifth around the cursor
+void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
+{
+	double x, y;
+	glfwGetCursorPos(window, &x, &y);
+	int width, height, windowWidth, windowHeight;
+	glfwGetFramebufferSize(window, &width, &height);
+	glfwGetWindowSize(window, &windowWidth, &windowHeight);
+	float pixelScale = windowHeight > 0 ? (float)height / windowHeight : 1.0f;
+	camera.zoomAt(powf(0.8f, (float)yoffset), x * pixelScale, y * pixelScale, width, height);
+}
+
+//true only on the frame the key goes down, so toggles don't flicker while held
+bool keyPressed(GLFWwindow *window, int key) {
+	static bool wasDown[512] = {};
+	bool down = glfwGetKey(window, key) == GLFW_PRESS;
+	bool pressed = down && !wasDown[key];
+	wasDown[key] = down;
+	return pressed;
 }
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height)
@@ -0,0 +1,1076 @@
+// Benchmarks for the physics engine, runs without a window or GL context.
+// build: g++ -O2 -std=c++17 -pthread bench.cpp -o bench
+// (add -mavx2 to run the circle narrowphase 8 pairs at a time)
+//
+// usage: bench [--scene name[,name...]] [--bodies n[,n...]] [--threads n[,n...]]
+//              [--steps n] [--warmup n] [--sleep 0|1] [--format csv|json] [--trace file]
+//
+// scenes: pyramid, rain, pile, islands, giant, bullets, chains, level, filter, load, particles, soft,
+//         rays, stream, batch, rollback, replication, lean, fixed, sweep (or all, the default)
+// every combination of scene, body count and thread count is run and reported
+// as one row with the mean time per stage, step time percentiles and throughput.
+// --trace writes the profiler zones of the run as Chrome trace JSON, it needs
+// the zones compiled in with -DPHYSICS_PROFILE.
+// The particles scene drops --bodies particles into a static box, its integrate,
+// broadphase, narrowphase and solver columns hold the particle integrate, grid,
+// contact and collide times. The soft scene drops soft boxes of 81 vertices until
+// there are about --bodies vertices, its integrate, narrowphase and solver
+// columns hold the predict, static collision and constraint projection times.
+// The rays scene settles a pile of --bodies bodies and times one batched
+// raycast of --bodies random rays per step, bodies_per_sec is rays per second
+// and contacts the number of rays that hit something.
+// The stream scene spreads --bodies boxes in stacks over a strip of tiles and
+// moves a focus along it at 30 m/s, step times include the streamer update,
+// bodies is the resident count at the end and islands the resident tiles.
+// The batch scene splits --bodies into piles of 64 bodies, every eighth one
+// four times larger, each in its own world, and steps them all in one
+// WorldBatch call. islands holds the number of worlds.
+// The level scene drops boxes and circles on a wavy heightfield scattered with
+// copies of one rock mesh in a baked BVH, all of it quantized static geometry
+// instead of bodies.
+// The filter scene is the pile split into four layers that pass through each
+// other, with a grid of static sensors, contacts counts solver contacts only.
+// The rollback scene runs the pile as a networked game with a late input every
+// frame: step and save, then restore the frame 7 steps back and step and save
+// again up to the present. Step times are whole frames of 8 steps, the
+// integrate and broadphase columns hold the mean save and restore times,
+// contacts the bytes the last save copied and islands the ring's KiB.
+// The replication scene serves the pile to one client over loopback UDP, the
+// client looking at a 40 by 30 m window of it. Step times are the server's
+// encode and send only, contacts holds the mean snapshot bytes and islands the
+// bodies the client holds at the end.
+// The lean scene is the pile in a world configured (DefaultWorldConfig) without
+// sleeping, continuous collision, level geometry, sensors and contact events.
+// The fixed scene is the pile in a world stepped in Q16_16 (DefaultWorldConfig).
+// The sweep scene is the pile with SweepBroadphase in place of the grid.
+// Sleeping is off by default so every step does the same work and stage
+// timings stay comparable between commits.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "job_system.h"
+#include "physics_world.h"
+#include "particle_system.h"
+#include "profiler.h"
+#include "replication.h"
+#include "rollback.h"
+#include "scene_loader.h"
+#include "soft_body.h"
+#include "world_batch.h"
+#include "world_streamer.h"
+
+using namespace std;
+
+static const uint32_t GREY = 0xff5a5a5a;
+static const uint32_t SAND = 0xff41a4d9;
+static const uint32_t BLUE = 0xffe0a040;
+
+template<class World>
+static void addStatic(World& world, float x, float y, float hx, float hy)
+{
+	BodyDef def;
+	def.x = x; def.y = y;
+	def.extentX = hx; def.extentY = hy;
+	def.density = 0.0f;
+	def.color = GREY;
+	world.createBody(def);
+}
+
+template<class World>
+static void addBox(World& world, float x, float y, float h)
+{
+	BodyDef def;
+	def.x = x; def.y = y;
+	def.extentX = def.extentY = h;
+	def.friction = 0.6f;
+	def.color = SAND;
+	world.createBody(def);
+}
+
+template<class World>
+static void addCircle(World& world, float x, float y, float r)
+{
+	BodyDef def;
+	def.shape = SHAPE_CIRCLE;
+	def.x = x; def.y = y;
+	def.extentX = def.extentY = r;
+	def.color = BLUE;
+	world.createBody(def);
+}
+
+// side by side pyramids of 20-box base (210 boxes each) on one ground
+// ------------------------------------------------------------------------
+static void buildPyramids(PhysicsWorld& world, size_t bodyCount)
+{
+	const int base = 20;
+	const size_t perPyramid = base * (base + 1) / 2;
+	size_t pyramids = (bodyCount + perPyramid - 1) / perPyramid;
+	float width = base * 1.0f + 4.0f;
+	float total = width * pyramids;
+	addStatic(world, 0.0f, -0.5f, 0.5f * total + 2.0f, 0.5f);
+	size_t placed = 0;
+	for (size_t p = 0; p < pyramids; p++) {
+		float left = -0.5f * total + width * p + 2.0f;
+		for (int row = 0; row < base; row++)
+			for (int k = 0; k < base - row && placed < bodyCount; k++, placed++)
+				addBox(world, left + 0.5f * row + k * 1.0f + 0.5f, 0.5f + row * 1.0f, 0.5f);
+	}
+}
+
+// circles falling from a sky band onto a floor, no two start touching
+// ------------------------------------------------------------------------
+static void buildRain(PhysicsWorld& world, size_t bodyCount)
+{
+	mt19937 rng(42);
+	uniform_real_distribution<float> jitter(-0.2f, 0.2f);
+	uniform_real_distribution<float> radius(0.2f, 0.4f);
+	size_t columns = (size_t)sqrtf((float)bodyCount) * 2 + 1;
+	float halfWidth = 0.5f * columns;
+	addStatic(world, 0.0f, -0.5f, halfWidth + 2.0f, 0.5f);
+	for (size_t i = 0; i < bodyCount; i++) {
+		size_t col = i % columns, row = i / columns;
+		BodyDef def;
+		def.shape = SHAPE_CIRCLE;
+		def.x = -halfWidth + col + 0.5f + jitter(rng);
+		def.y = 10.0f + row * 1.0f;
+		def.extentX = def.extentY = radius(rng);
+		def.velY = -5.0f;
+		def.color = BLUE;
+		world.createBody(def);
+	}
+}
+
+// mixed boxes and circles dropped into a walled container
+// ------------------------------------------------------------------------
+template<class World>
+static void buildPile(World& world, size_t bodyCount)
+{
+	mt19937 rng(7);
+	uniform_real_distribution<float> jitter(-0.1f, 0.1f);
+	size_t columns = (size_t)sqrtf((float)bodyCount) + 1;
+	float halfWidth = 0.5f * columns * 1.1f;
+	float height = columns * 1.1f + 4.0f;
+	addStatic(world, 0.0f, -0.5f, halfWidth + 1.0f, 0.5f);
+	addStatic(world, -halfWidth - 0.5f, 0.5f * height, 0.5f, 0.5f * height);
+	addStatic(world, halfWidth + 0.5f, 0.5f * height, 0.5f, 0.5f * height);
+	for (size_t i = 0; i < bodyCount; i++) {
+		size_t col = i % columns, row = i / columns;
+		float x = -halfWidth + col * 1.1f + 0.55f + jitter(rng);
+		float y = 1.0f + row * 1.1f;
+		if (i % 3 == 0)
+			addCircle(world, x, y, 0.45f);
+		else
+			addBox(world, x, y, 0.4f);
+	}
+}
+
+// short stacks of four boxes spaced apart on one ground, one island per stack
+// ------------------------------------------------------------------------
+static void buildIslands(PhysicsWorld& world, size_t bodyCount)
+{
+	size_t stacks = (bodyCount + 3) / 4;
+	size_t rows = (size_t)sqrtf((float)stacks / 8.0f) + 1;
+	size_t perRow = (stacks + rows - 1) / rows;
+	float spacing = 2.0f;
+	float halfWidth = 0.5f * perRow * spacing;
+	size_t placed = 0;
+	for (size_t r = 0; r < rows; r++) {
+		float floorY = r * 8.0f;
+		addStatic(world, 0.0f, floorY - 0.5f, halfWidth + 1.0f, 0.5f);
+		for (size_t s = 0; s < perRow; s++)
+			for (int k = 0; k < 4 && placed < bodyCount; k++, placed++)
+				addBox(world, -halfWidth + s * spacing + 1.0f, floorY + 0.5f + k * 1.0f, 0.5f);
+	}
+}
+
+// circles stacked in hexagonal rows inside a container, every body rests on
+// the two below it so the whole scene is one island
+// ------------------------------------------------------------------------
+static void buildGiantIsland(PhysicsWorld& world, size_t bodyCount)
+{
+	size_t columns = (size_t)sqrtf((float)bodyCount) + 1;
+	float halfWidth = 0.5f * columns + 0.25f;
+	float height = (float)(bodyCount / columns + 2);
+	addStatic(world, 0.0f, -0.5f, halfWidth + 1.0f, 0.5f);
+	addStatic(world, -halfWidth - 0.5f, 0.5f * height, 0.5f, 0.5f * height);
+	addStatic(world, halfWidth + 0.5f, 0.5f * height, 0.5f, 0.5f * height);
+	for (size_t i = 0; i < bodyCount; i++) {
+		size_t col = i % columns, row = i / columns;
+		float offset = (row & 1) ? 0.5f : 0.0f;
+		addCircle(world, -halfWidth + col + 0.5f + offset, 0.5f + row * 0.87f, 0.5f);
+	}
+}
+
+// small circles flagged as bullets fired in random directions inside a room of
+// thin walls, fast enough to cross a wall several times over in one step
+// ------------------------------------------------------------------------
+static void buildBullets(PhysicsWorld& world, size_t bodyCount)
+{
+	mt19937 rng(99);
+	uniform_real_distribution<float> unit(0.0f, 1.0f);
+	float half = 0.5f * sqrtf((float)bodyCount) + 2.0f;
+	addStatic(world, 0.0f, -half, half, 0.05f);
+	addStatic(world, 0.0f, half, half, 0.05f);
+	addStatic(world, -half, 0.0f, 0.05f, half);
+	addStatic(world, half, 0.0f, 0.05f, half);
+	for (size_t i = 0; i < bodyCount; i++) {
+		float angle = 6.2831853f * unit(rng);
+		BodyDef def;
+		def.shape = SHAPE_CIRCLE;
+		def.x = (half - 1.0f) * (2.0f * unit(rng) - 1.0f);
+		def.y = (half - 1.0f) * (2.0f * unit(rng) - 1.0f);
+		def.extentX = def.extentY = 0.1f;
+		def.velX = 120.0f * cosf(angle);
+		def.velY = 120.0f * sinf(angle);
+		def.bullet = true;
+		def.color = BLUE;
+		world.createBody(def);
+	}
+}
+
+// chains of 50 links on revolute joints hung side by side from static pegs, each
+// set swinging so every link keeps moving, one island of 50 joints per chain
+// ------------------------------------------------------------------------
+static void buildChains(PhysicsWorld& world, size_t bodyCount)
+{
+	const int links = 50;
+	size_t chains = (bodyCount + links - 1) / links;
+	size_t placed = 0;
+	for (size_t c = 0; c < chains; c++) {
+		float x = 3.0f * c;
+		BodyDef peg;
+		peg.x = x; peg.y = 0.0f;
+		peg.extentX = peg.extentY = 0.1f;
+		peg.density = 0.0f;
+		peg.color = GREY;
+		uint32_t prev = world.createBody(peg);
+		for (int k = 0; k < links && placed < bodyCount; k++, placed++) {
+			BodyDef def;
+			def.x = x; def.y = -0.25f - 0.5f * k;
+			def.extentX = 0.05f; def.extentY = 0.25f;
+			def.velX = 0.05f * k;
+			def.color = SAND;
+			uint32_t link = world.createBody(def);
+			JointDef joint;
+			joint.bodyA = prev;
+			joint.bodyB = link;
+			joint.anchorA = Vec2(x, -0.5f * k);
+			world.createJoint(joint);
+			prev = link;
+		}
+	}
+}
+
+// the pile with its bodies split into four layers that only touch their own
+// layer and the walls, interleaved so most broadphase pairs are filtered out,
+// and a grid of static sensors over the lower half that the bodies sink through
+// ------------------------------------------------------------------------
+static void buildFilter(PhysicsWorld& world, size_t bodyCount)
+{
+	buildPile(world, bodyCount);
+	size_t columns = (size_t)sqrtf((float)bodyCount) + 1;
+	float halfWidth = 0.5f * columns * 1.1f;
+	for (size_t i = 3; i < world.bodyCount(); i++) {
+		uint32_t layer = 1u << (i % 4);
+		world.bodies.categoryBits[i] = layer;
+		world.bodies.maskBits[i] = layer | 0x10;
+	}
+	for (size_t i = 0; i < 3; i++)
+		world.bodies.categoryBits[i] = 0x10;
+	for (float x = -halfWidth + 2.0f; x < halfWidth - 2.0f; x += 4.0f)
+		for (float y = 2.0f; y < 0.5f * columns * 1.1f; y += 4.0f) {
+			BodyDef def;
+			def.x = x; def.y = y;
+			def.extentX = def.extentY = 1.0f;
+			def.density = 0.0f;
+			def.sensor = true;
+			def.color = GREY;
+			world.createBody(def);
+		}
+}
+
+// boxes and circles raining onto a wavy heightfield strewn with rocks, the
+// rocks are instances of one mesh so the level costs little memory
+// ------------------------------------------------------------------------
+static void buildLevel(PhysicsWorld& world, size_t bodyCount)
+{
+	const int columns = 100;
+	float width = (float)columns + 20.0f;
+	vector<float> heights;
+	for (float x = -0.5f * width; x <= 0.5f * width; x += 0.5f)
+		heights.push_back(0.4f * sinf(0.3f * x) + 0.2f * sinf(1.1f * x));
+	StaticGeometry& level = world.editLevel();
+	level.addHeightfield(-0.5f * width, 0.5f, heights.data(), heights.size());
+	// the ends of the terrain turn up into walls
+	Vec2 left[2] = { Vec2(-0.5f * width, heights.front()), Vec2(-0.5f * width, 20.0f) };
+	float endX = -0.5f * width + 0.5f * (heights.size() - 1);
+	Vec2 right[2] = { Vec2(endX, heights.back()), Vec2(endX, 20.0f) };
+	level.addPolyline(left, 2, false);
+	level.addPolyline(right, 2, false);
+	const Vec2 rock[] = { Vec2(-0.8f, 0.0f), Vec2(-0.5f, 0.5f), Vec2(0.1f, 0.7f), Vec2(0.6f, 0.3f), Vec2(0.8f, 0.0f) };
+	uint32_t mesh = level.addMesh(rock, 5, false);
+	for (float x = -0.5f * width + 4.0f; x < 0.5f * width - 4.0f; x += 7.0f)
+		level.addInstance(mesh, Vec2(x, 0.4f * sinf(0.3f * x) + 0.2f * sinf(1.1f * x) - 0.1f), 0.1f * x);
+	level.buildTree();
+
+	for (size_t i = 0; i < bodyCount; i++) {
+		float x = -0.5f * columns + (float)(i % columns) + 0.5f;
+		float y = 3.0f + 1.2f * (float)(i / columns);
+		if (i % 2)
+			addCircle(world, x, y, 0.35f);
+		else
+			addBox(world, x, y, 0.35f);
+	}
+}
+
+// ------------------------------------------------------------------------
+struct BenchScene
+{
+	const char* name;
+	void (*build)(PhysicsWorld&, size_t);
+};
+
+static const BenchScene scenes[] = {
+	{ "pyramid", buildPyramids },
+	{ "rain", buildRain },
+	{ "pile", buildPile<PhysicsWorld> },
+	{ "islands", buildIslands },
+	{ "giant", buildGiantIsland },
+	{ "bullets", buildBullets },
+	{ "chains", buildChains },
+	{ "level", buildLevel },
+	{ "filter", buildFilter },
+};
+
+struct BenchResult
+{
+	string scene;
+	size_t bodies = 0;
+	int threads = 1;
+	int steps = 0;
+	double stageNs[STAGE_COUNT] = {};
+	double p50Us = 0.0, p99Us = 0.0, maxUs = 0.0, meanUs = 0.0;
+	double bodiesPerSec = 0.0;
+	size_t contacts = 0, islands = 0, awake = 0;
+};
+
+// the pile in a world compiled without the stages it doesn't use, against
+// the pile scene it shows what the switched off stages cost when idle
+// ------------------------------------------------------------------------
+struct LeanWorldConfig : DefaultWorldConfig
+{
+	static constexpr bool sleeping = false;
+	static constexpr bool continuous = false;
+	static constexpr bool level = false;
+	static constexpr bool sensors = false;
+	static constexpr bool contactEvents = false;
+};
+
+typedef BasicPhysicsWorld<LeanWorldConfig> LeanWorld;
+
+// the pile again in 16.16 fixed point, what determinism costs over floats
+// ------------------------------------------------------------------------
+struct FixedWorldConfig : DefaultWorldConfig
+{
+	typedef Q16_16 Scalar;
+};
+
+typedef BasicPhysicsWorld<FixedWorldConfig> FixedWorld;
+
+// the pile with sort and sweep instead of the grid, the broadphase column
+// against the pile scene's compares the two
+// ------------------------------------------------------------------------
+struct SweepWorldConfig : DefaultWorldConfig
+{
+	typedef SweepBroadphase Broadphase;
+};
+
+typedef BasicPhysicsWorld<SweepWorldConfig> SweepWorld;
+
+// ------------------------------------------------------------------------
+template<class World>
+static BenchResult runScene(const char* name, void (*build)(World&, size_t), size_t bodyCount, int threads, int warmup, int steps, bool sleep)
+{
+	JobSystem jobs(threads);
+	World world;
+	world.settings.allowSleep = sleep;
+	world.setJobSystem(&jobs);
+	build(world, bodyCount);
+
+	const float dt = 1.0f / 60.0f;
+	for (int s = 0; s < warmup; s++)
+		world.step(dt);
+
+	BenchResult r;
+	r.scene = name;
+	r.bodies = world.bodyCount();
+	r.threads = threads;
+	r.steps = steps;
+	vector<double> stepUs(steps);
+	for (int s = 0; s < steps; s++) {
+		world.step(dt);
+		for (int st = 0; st < STAGE_COUNT; st++)
+			r.stageNs[st] += (double)world.stats.stageNs[st];
+		stepUs[s] = world.stats.totalNs / 1000.0;
+	}
+	for (int st = 0; st < STAGE_COUNT; st++)
+		r.stageNs[st] /= steps;
+
+	double sum = 0.0;
+	for (double us : stepUs)
+		sum += us;
+	sort(stepUs.begin(), stepUs.end());
+	r.meanUs = sum / steps;
+	r.p50Us = stepUs[(size_t)(0.50 * (steps - 1))];
+	r.p99Us = stepUs[(size_t)(0.99 * (steps - 1))];
+	r.maxUs = stepUs.back();
+	r.bodiesPerSec = r.meanUs > 0.0 ? r.bodies / (r.meanUs * 1e-6) : 0.0;
+	r.contacts = world.stats.contacts;
+	r.islands = world.stats.islands;
+	r.awake = world.stats.awakeBodies;
+	return r;
+}
+
+// write a random pile of boxes and circles in the scene text format
+// ------------------------------------------------------------------------
+static bool writeScene(const char* path, size_t bodyCount)
+{
+	FILE* f = fopen(path, "wb");
+	if (!f)
+		return false;
+	mt19937 rng(1234);
+	uniform_real_distribution<float> pos(-500.0f, 500.0f);
+	uniform_real_distribution<float> size(0.2f, 0.8f);
+	fprintf(f, "# generated benchmark scene\ngravity 0 -10\n");
+	for (size_t i = 0; i < bodyCount; i++) {
+		if (i & 1)
+			fprintf(f, "circle %.3f %.3f %.3f 1 #40a0e0\n", pos(rng), pos(rng), size(rng));
+		else
+			fprintf(f, "box %.3f %.3f %.3f %.3f %.3f 1 #d9a441 0.6\n", pos(rng), pos(rng), size(rng), size(rng), pos(rng) * 0.01f);
+	}
+	fclose(f);
+	return true;
+}
+
+// time loading a generated scene file, reported as one step of the "load" scene
+// so it lines up with the other rows; ns/body should stay flat as bodies grow
+// ------------------------------------------------------------------------
+static bool runSceneLoad(size_t bodyCount, int steps, BenchResult& r)
+{
+	const char* path = "bench_scene.txt";
+	if (!writeScene(path, bodyCount)) {
+		cout << "ERROR::BENCH::CANNOT_WRITE_SCENE" << endl;
+		return false;
+	}
+	PhysicsWorld world;
+	vector<double> loadUs;
+	for (int run = 0; run < steps; run++) {
+		auto t0 = chrono::steady_clock::now();
+		bool ok = loadScene(path, world);
+		auto t1 = chrono::steady_clock::now();
+		if (!ok || world.bodyCount() != bodyCount) {
+			cout << "ERROR::BENCH::SCENE_LOAD_FAILED" << endl;
+			remove(path);
+			return false;
+		}
+		loadUs.push_back(chrono::duration<double, micro>(t1 - t0).count());
+	}
+	remove(path);
+
+	r.scene = "load";
+	r.bodies = bodyCount;
+	r.threads = 1;
+	r.steps = steps;
+	double sum = 0.0;
+	for (double us : loadUs)
+		sum += us;
+	sort(loadUs.begin(), loadUs.end());
+	r.meanUs = sum / steps;
+	r.p50Us = loadUs[(size_t)(0.50 * (steps - 1))];
+	r.p99Us = loadUs[(size_t)(0.99 * (steps - 1))];
+	r.maxUs = loadUs.back();
+	r.bodiesPerSec = r.bodies / (r.p50Us * 1e-6);
+	return true;
+}
+
+// a square block of particles falling into a static container
+// ------------------------------------------------------------------------
+static BenchResult runSceneParticles(size_t count, int threads, int warmup, int steps)
+{
+	JobSystem jobs(threads);
+	PhysicsWorld world;
+	ParticleSystem particles;
+	particles.setJobSystem(&jobs);
+	particles.radius = 0.05f;
+	float half = 0.5f * sqrtf((float)count) * 2.0f * particles.radius;
+	addStatic(world, 0.0f, -half - 1.0f, 2.0f * half + 2.0f, 0.5f);
+	addStatic(world, -2.0f * half - 1.5f, half, 0.5f, 2.0f * half + 2.0f);
+	addStatic(world, 2.0f * half + 1.5f, half, 0.5f, 2.0f * half + 2.0f);
+	BodyDef post;
+	post.shape = SHAPE_CIRCLE;
+	post.extentX = post.extentY = 0.2f * half;
+	post.density = 0.0f;
+	post.color = GREY;
+	world.createBody(post);
+	particles.addBlock(0.0f, 1.2f * half, half, half, 2.0f * particles.radius);
+
+	const float dt = 1.0f / 60.0f;
+	for (int s = 0; s < warmup; s++)
+		particles.step(dt, world.bodies);
+
+	BenchResult r;
+	r.scene = "particles";
+	r.bodies = particles.size();
+	r.threads = threads;
+	r.steps = steps;
+	vector<double> stepUs(steps);
+	for (int s = 0; s < steps; s++) {
+		particles.step(dt, world.bodies);
+		r.stageNs[STAGE_INTEGRATE] += (double)particles.stats.integrateNs;
+		r.stageNs[STAGE_BROADPHASE] += (double)particles.stats.gridNs;
+		r.stageNs[STAGE_NARROWPHASE] += (double)particles.stats.contactNs;
+		r.stageNs[STAGE_SOLVER] += (double)particles.stats.collideNs;
+		stepUs[s] = particles.stats.totalNs / 1000.0;
+	}
+	for (int st = 0; st < STAGE_COUNT; st++)
+		r.stageNs[st] /= steps;
+
+	double sum = 0.0;
+	for (double us : stepUs)
+		sum += us;
+	sort(stepUs.begin(), stepUs.end());
+	r.meanUs = sum / steps;
+	r.p50Us = stepUs[(size_t)(0.50 * (steps - 1))];
+	r.p99Us = stepUs[(size_t)(0.99 * (steps - 1))];
+	r.maxUs = stepUs.back();
+	r.bodiesPerSec = r.meanUs > 0.0 ? r.bodies / (r.meanUs * 1e-6) : 0.0;
+	return r;
+}
+
+// a grid of soft boxes falling onto a static floor
+// ------------------------------------------------------------------------
+static BenchResult runSceneSoft(size_t vertexCount, int threads, int warmup, int steps)
+{
+	JobSystem jobs(threads);
+	PhysicsWorld world;
+	SoftBodySystem soft;
+	soft.setJobSystem(&jobs);
+	size_t boxCount = vertexCount / 81 + 1;
+	int columns = (int)sqrtf((float)boxCount) + 1;
+	addStatic(world, 0.0f, -1.0f, 1.5f * columns + 2.0f, 0.5f);
+	SoftBodyDef def;
+	def.halfWidth = def.halfHeight = 0.5f;
+	def.cellsX = def.cellsY = 8;
+	def.stretchCompliance = def.areaCompliance = 1e-4f;
+	def.color = SAND;
+	for (size_t b = 0; b < boxCount; b++) {
+		def.x = 1.5f * ((int)(b % columns) - 0.5f * columns);
+		def.y = 1.0f + 1.5f * (b / columns);
+		soft.createSoftBox(def);
+	}
+
+	const float dt = 1.0f / 60.0f;
+	for (int s = 0; s < warmup; s++)
+		soft.step(dt, world.bodies);
+
+	BenchResult r;
+	r.scene = "soft";
+	r.bodies = soft.vertexCount();
+	r.threads = threads;
+	r.steps = steps;
+	vector<double> stepUs(steps);
+	for (int s = 0; s < steps; s++) {
+		soft.step(dt, world.bodies);
+		r.stageNs[STAGE_INTEGRATE] += (double)soft.stats.predictNs;
+		r.stageNs[STAGE_NARROWPHASE] += (double)soft.stats.collideNs;
+		r.stageNs[STAGE_SOLVER] += (double)soft.stats.solveNs;
+		stepUs[s] = soft.stats.totalNs / 1000.0;
+	}
+	for (int st = 0; st < STAGE_COUNT; st++)
+		r.stageNs[st] /= steps;
+
+	double sum = 0.0;
+	for (double us : stepUs)
+		sum += us;
+	sort(stepUs.begin(), stepUs.end());
+	r.meanUs = sum / steps;
+	r.p50Us = stepUs[(size_t)(0.50 * (steps - 1))];
+	r.p99Us = stepUs[(size_t)(0.99 * (steps - 1))];
+	r.maxUs = stepUs.back();
+	r.bodiesPerSec = r.meanUs > 0.0 ? r.bodies / (r.meanUs * 1e-6) : 0.0;
+	return r;
+}
+
+// random rays of up to 20 metres fired through a settled pile
+// ------------------------------------------------------------------------
+static BenchResult runSceneRays(size_t count, int threads, int warmup, int steps)
+{
+	JobSystem jobs(threads);
+	PhysicsWorld world;
+	world.setJobSystem(&jobs);
+	buildPile(world, count);
+	const float dt = 1.0f / 60.0f;
+	for (int s = 0; s < warmup; s++)
+		world.step(dt);
+
+	float halfWidth = 0.5f * sqrtf((float)count) * 1.1f;
+	mt19937 rng(3);
+	uniform_real_distribution<float> x(-halfWidth, halfWidth), y(0.0f, 2.0f * halfWidth), d(-20.0f, 20.0f);
+	vector<RayInput> rays(count);
+	for (RayInput& ray : rays) {
+		ray.origin = Vec2(x(rng), y(rng));
+		ray.translation = Vec2(d(rng), d(rng));
+	}
+	vector<RayHit> hits(count);
+
+	BenchResult r;
+	r.scene = "rays";
+	r.bodies = count;
+	r.threads = threads;
+	r.steps = steps;
+	vector<double> stepUs(steps);
+	for (int s = 0; s < steps; s++) {
+		auto t0 = chrono::steady_clock::now();
+		world.raycastBatch(rays.data(), hits.data(), rays.size());
+		auto t1 = chrono::steady_clock::now();
+		stepUs[s] = chrono::duration<double, micro>(t1 - t0).count();
+	}
+	for (const RayHit& hit : hits)
+		r.contacts += hit.body != NO_BODY;
+
+	double sum = 0.0;
+	for (double us : stepUs)
+		sum += us;
+	sort(stepUs.begin(), stepUs.end());
+	r.meanUs = sum / steps;
+	r.p50Us = stepUs[(size_t)(0.50 * (steps - 1))];
+	r.p99Us = stepUs[(size_t)(0.99 * (steps - 1))];
+	r.maxUs = stepUs.back();
+	r.bodiesPerSec = r.meanUs > 0.0 ? r.bodies / (r.meanUs * 1e-6) : 0.0;
+	return r;
+}
+
+// stacks of four boxes on a strip of 32 m tiles, each tile with its own ground,
+// paged in and out around a focus that runs along the strip
+// ------------------------------------------------------------------------
+static BenchResult runSceneStream(size_t bodyCount, int threads, int warmup, int steps)
+{
+	JobSystem jobs(threads);
+	PhysicsWorld world;
+	world.settings.allowSleep = false;
+	world.setJobSystem(&jobs);
+	const float tileSize = 32.0f;
+	const size_t stacksPerTile = 8;
+	size_t tiles = (bodyCount + 4 * stacksPerTile - 1) / (4 * stacksPerTile);
+	size_t placed = 0;
+	for (size_t t = 0; t < tiles; t++) {
+		float x0 = t * tileSize;
+		addStatic(world, x0 + 0.5f * tileSize, -0.5f, 0.5f * tileSize, 0.5f);
+		for (size_t s = 0; s < stacksPerTile; s++)
+			for (int k = 0; k < 4 && placed < bodyCount; k++, placed++)
+				addBox(world, x0 + 2.0f + s * 3.5f, 0.5f + k * 1.0f, 0.5f);
+	}
+
+	WorldStreamer streamer(world);
+	streamer.tileSize = tileSize;
+	streamer.pathPrefix = "bench_tile_";
+	const float dt = 1.0f / 60.0f;
+	Vec2 focus(0.0f, 2.0f);
+	float length = tiles * tileSize;
+	auto advance = [&]() {
+		focus.x = fmodf(focus.x + 30.0f * dt, length);
+		auto t0 = chrono::steady_clock::now();
+		world.step(dt);
+		streamer.update(&focus, 1);
+		auto t1 = chrono::steady_clock::now();
+		return chrono::duration<double, micro>(t1 - t0).count();
+	};
+	for (int s = 0; s < warmup; s++)
+		advance();
+
+	BenchResult r;
+	r.scene = "stream";
+	r.threads = threads;
+	r.steps = steps;
+	vector<double> stepUs(steps);
+	for (int s = 0; s < steps; s++) {
+		stepUs[s] = advance();
+		for (int st = 0; st < STAGE_COUNT; st++)
+			r.stageNs[st] += (double)world.stats.stageNs[st];
+	}
+	for (int st = 0; st < STAGE_COUNT; st++)
+		r.stageNs[st] /= steps;
+	r.bodies = world.bodyCount();
+	r.contacts = world.stats.contacts;
+	r.islands = streamer.stats.residentTiles;
+	r.awake = world.stats.awakeBodies;
+
+	double sum = 0.0;
+	for (double us : stepUs)
+		sum += us;
+	sort(stepUs.begin(), stepUs.end());
+	r.meanUs = sum / steps;
+	r.p50Us = stepUs[(size_t)(0.50 * (steps - 1))];
+	r.p99Us = stepUs[(size_t)(0.99 * (steps - 1))];
+	r.maxUs = stepUs.back();
+	r.bodiesPerSec = r.meanUs > 0.0 ? r.bodies / (r.meanUs * 1e-6) : 0.0;
+	return r;
+}
+
+// many small independent piles stepped together, parallel across worlds
+// ------------------------------------------------------------------------
+static BenchResult runSceneBatch(size_t bodyCount, int threads, int warmup, int steps)
+{
+	JobSystem jobs(threads);
+	PhysicsWorld small, large;
+	small.settings.allowSleep = large.settings.allowSleep = false;
+	buildPile(small, 64);
+	buildPile(large, 256);
+	WorldBatch batch(&jobs);
+	for (size_t placed = 0, w = 0; placed < bodyCount; w++) {
+		const PhysicsWorld& prototype = w % 8 == 7 ? large : small;
+		batch.addWorld(prototype);
+		placed += prototype.bodyCount();
+	}
+
+	const float dt = 1.0f / 60.0f;
+	for (int s = 0; s < warmup; s++)
+		batch.step(dt);
+
+	BenchResult r;
+	r.scene = "batch";
+	r.threads = threads;
+	r.steps = steps;
+	vector<double> stepUs(steps);
+	for (int s = 0; s < steps; s++) {
+		batch.step(dt);
+		for (size_t w = 0; w < batch.size(); w++)
+			for (int st = 0; st < STAGE_COUNT; st++)
+				r.stageNs[st] += (double)batch.world(w).stats.stageNs[st];
+		stepUs[s] = batch.stats.totalNs / 1000.0;
+	}
+	for (int st = 0; st < STAGE_COUNT; st++)
+		r.stageNs[st] /= steps;
+	r.bodies = batch.stats.bodies;
+	r.contacts = batch.stats.contacts;
+	r.islands = batch.size();
+	r.awake = batch.stats.awakeBodies;
+
+	double sum = 0.0;
+	for (double us : stepUs)
+		sum += us;
+	sort(stepUs.begin(), stepUs.end());
+	r.meanUs = sum / steps;
+	r.p50Us = stepUs[(size_t)(0.50 * (steps - 1))];
+	r.p99Us = stepUs[(size_t)(0.99 * (steps - 1))];
+	r.maxUs = stepUs.back();
+	r.bodiesPerSec = r.meanUs > 0.0 ? r.bodies / (r.meanUs * 1e-6) : 0.0;
+	return r;
+}
+
+// the pile stepped as a rollback client that resimulates its last 7 frames every frame
+// ------------------------------------------------------------------------
+static BenchResult runSceneRollback(size_t bodyCount, int threads, int warmup, int steps)
+{
+	const uint64_t rollbackFrames = 7;
+	JobSystem jobs(threads);
+	PhysicsWorld world;
+	world.settings.allowSleep = false;
+	world.setJobSystem(&jobs);
+	buildPile(world, bodyCount);
+	RollbackRing ring(rollbackFrames + 1);
+	const float dt = 1.0f / 60.0f;
+	uint64_t frame = 0;
+	ring.save(world, frame);
+	double saveNs = 0.0, restoreNs = 0.0;
+	auto advance = [&]() {
+		auto t0 = chrono::steady_clock::now();
+		world.step(dt);
+		ring.save(world, ++frame);
+		saveNs += ring.stats.saveNs;
+		if (frame >= rollbackFrames) {
+			ring.restore(world, frame - rollbackFrames);
+			restoreNs += ring.stats.restoreNs;
+			for (uint64_t f = frame - rollbackFrames; f < frame; f++) {
+				world.step(dt);
+				ring.save(world, f + 1);
+				saveNs += ring.stats.saveNs;
+			}
+		}
+		auto t1 = chrono::steady_clock::now();
+		return chrono::duration<double, micro>(t1 - t0).count();
+	};
+	for (int s = 0; s < warmup; s++)
+		advance();
+
+	BenchResult r;
+	r.scene = "rollback";
+	r.bodies = world.bodyCount();
+	r.threads = threads;
+	r.steps = steps;
+	saveNs = restoreNs = 0.0;
+	vector<double> stepUs(steps);
+	for (int s = 0; s < steps; s++)
+		stepUs[s] = advance();
+	r.stageNs[STAGE_INTEGRATE] = saveNs / (steps * (rollbackFrames + 1));
+	r.stageNs[STAGE_BROADPHASE] = restoreNs / steps;
+	r.contacts = ring.stats.copiedBytes;
+	r.islands = ring.memoryBytes() / 1024;
+	r.awake = world.stats.awakeBodies;
+
+	double sum = 0.0;
+	for (double us : stepUs)
+		sum += us;
+	sort(stepUs.begin(), stepUs.end());
+	r.meanUs = sum / steps;
+	r.p50Us = stepUs[(size_t)(0.50 * (steps - 1))];
+	r.p99Us = stepUs[(size_t)(0.99 * (steps - 1))];
+	r.maxUs = stepUs.back();
+	r.bodiesPerSec = r.meanUs > 0.0 ? r.bodies / (r.meanUs * 1e-6) : 0.0;
+	return r;
+}
+
+// the pile served to one windowed client over loopback
+// ------------------------------------------------------------------------
+static BenchResult runSceneReplication(size_t bodyCount, int threads, int warmup, int steps)
+{
+	JobSystem jobs(threads);
+	PhysicsWorld world;
+	world.settings.allowSleep = false;
+	world.setJobSystem(&jobs);
+	buildPile(world, bodyCount);
+	ReplicationServer server;
+	ReplicationClient client;
+	NetAddress address;
+	if (!server.open(0) || !parseAddress("127.0.0.1", server.port(), address) || !client.connect(address))
+		return BenchResult();
+	client.setView(-20.0f, 0.0f, 20.0f, 30.0f);
+
+	const float dt = 1.0f / 60.0f;
+	uint32_t step = 0;
+	double bytes = 0.0;
+	size_t packets = 0;
+	auto advance = [&]() {
+		world.step(dt);
+		auto t0 = chrono::steady_clock::now();
+		server.update(world, ++step);
+		auto t1 = chrono::steady_clock::now();
+		client.update(dt);
+		bytes += (double)server.stats.bytes;
+		packets += server.stats.packets;
+		return chrono::duration<double, micro>(t1 - t0).count();
+	};
+	for (int s = 0; s < warmup; s++)
+		advance();
+
+	BenchResult r;
+	r.scene = "replication";
+	r.bodies = world.bodyCount();
+	r.threads = threads;
+	r.steps = steps;
+	bytes = 0.0;
+	packets = 0;
+	vector<double> stepUs(steps);
+	for (int s = 0; s < steps; s++) {
+		stepUs[s] = advance();
+		for (int st = 0; st < STAGE_COUNT; st++)
+			r.stageNs[st] += (double)world.stats.stageNs[st];
+	}
+	for (int st = 0; st < STAGE_COUNT; st++)
+		r.stageNs[st] /= steps;
+	r.contacts = packets > 0 ? (size_t)(bytes / packets) : 0;
+	r.islands = client.latest().bodies.size();
+	r.awake = world.stats.awakeBodies;
+
+	double sum = 0.0;
+	for (double us : stepUs)
+		sum += us;
+	sort(stepUs.begin(), stepUs.end());
+	r.meanUs = sum / steps;
+	r.p50Us = stepUs[(size_t)(0.50 * (steps - 1))];
+	r.p99Us = stepUs[(size_t)(0.99 * (steps - 1))];
+	r.maxUs = stepUs.back();
+	r.bodiesPerSec = r.meanUs > 0.0 ? r.bodies / (r.meanUs * 1e-6) : 0.0;
+	return r;
+}
+
+// ------------------------------------------------------------------------
+static void printCsvHeader()
+{
+	printf("scene,bodies,threads,steps");
+	for (int st = 0; st < STAGE_COUNT; st++)
+		printf(",%s_ns", stageName(st));
+	printf(",mean_us,p50_us,p99_us,max_us,bodies_per_sec,contacts,islands,awake\n");
+}
+
+static void printCsv(const BenchResult& r)
+{
+	printf("%s,%zu,%d,%d", r.scene.c_str(), r.bodies, r.threads, r.steps);
+	for (int st = 0; st < STAGE_COUNT; st++)
+		printf(",%.0f", r.stageNs[st]);
+	printf(",%.1f,%.1f,%.1f,%.1f,%.0f,%zu,%zu,%zu\n", r.meanUs, r.p50Us, r.p99Us, r.maxUs, r.bodiesPerSec, r.contacts, r.islands, r.awake);
+	fflush(stdout);
+}
+
+static void printJson(const BenchResult& r, bool first)
+{
+	printf("%s\n  {\"scene\": \"%s\", \"bodies\": %zu, \"threads\": %d, \"steps\": %d, \"stage_ns\": {",
+		first ? "" : ",", r.scene.c_str(), r.bodies, r.threads, r.steps);
+	for (int st = 0; st < STAGE_COUNT; st++)
+		printf("%s\"%s\": %.0f", st ? ", " : "", stageName(st), r.stageNs[st]);
+	printf("}, \"mean_us\": %.1f, \"p50_us\": %.1f, \"p99_us\": %.1f, \"max_us\": %.1f, \"bodies_per_sec\": %.0f, "
+		"\"contacts\": %zu, \"islands\": %zu, \"awake\": %zu}",
+		r.meanUs, r.p50Us, r.p99Us, r.maxUs, r.bodiesPerSec, r.contacts, r.islands, r.awake);
+	fflush(stdout);
+}
+
+// comma separated list of numbers
+static vector<size_t> parseList(const char* s)
+{
+	vector<size_t> out;
+	while (*s) {
+		char* end;
+		size_t value = (size_t)strtoull(s, &end, 10);
+		if (end == s)
+			break;
+		out.push_back(value);
+		s = *end == ',' ? end + 1 : end;
+	}
+	return out;
+}
+
+int main(int argc, char** argv)
+{
+	string sceneList = "all";
+	vector<size_t> bodyCounts = { 10000 };
+	vector<size_t> threadCounts = { 1 };
+	int steps = 120;
+	int warmup = 30;
+	bool json = false;
+	bool sleep = false;
+	const char* tracePath = nullptr;
+
+	for (int a = 1; a < argc; a++) {
+		string arg = argv[a];
+		const char* value = a + 1 < argc ? argv[a + 1] : "";
+		if (arg == "--scene") { sceneList = value; a++; }
+		else if (arg == "--bodies") { bodyCounts = parseList(value); a++; }
+		else if (arg == "--threads") { threadCounts = parseList(value); a++; }
+		else if (arg == "--steps") { steps = atoi(value); a++; }
+		else if (arg == "--warmup") { warmup = atoi(value); a++; }
+		else if (arg == "--format") { json = strcmp(value, "json") == 0; a++; }
+		else if (arg == "--sleep") { sleep = atoi(value) != 0; a++; }
+		else if (arg == "--trace") { tracePath = value; a++; }
+		else {
+			cout << "usage: bench [--scene name,...] [--bodies n,...] [--threads n,...] [--steps n] [--warmup n] [--sleep 0|1] [--format csv|json] [--trace file]" << endl;
+			return 1;
+		}
+	}
+	if (steps < 1)
+		steps = 1;
+
+	auto selected = [&](const char* name) {
+		if (sceneList == "all")
+			return true;
+		string list = "," + sceneList + ",";
+		return list.find(string(",") + name + ",") != string::npos;
+	};
+
+	bool first = true;
+	auto report = [&](const BenchResult& r) {
+		if (json)
+			printJson(r, first);
+		else
+			printCsv(r);
+		first = false;
+	};
+
+	if (json)
+		printf("[");
+	else
+		printCsvHeader();
+	for (const BenchScene& scene : scenes) {
+		if (!selected(scene.name))
+			continue;
+		for (size_t bodies : bodyCounts)
+			for (size_t threads : threadCounts)
+				report(runScene(scene.name, scene.build, bodies, (int)threads, warmup, steps, sleep));
+	}
+	if (selected("lean")) {
+		for (size_t bodies : bodyCounts)
+			for (size_t threads : threadCounts)
+				report(runScene("lean", buildPile<LeanWorld>, bodies, (int)threads, warmup, steps, sleep));
+	}
+	if (selected("fixed")) {
+		for (size_t bodies : bodyCounts)
+			for (size_t threads : threadCounts)
+				report(runScene("fixed", buildPile<FixedWorld>, bodies, (int)threads, warmup, steps, sleep));
+	}
+	if (selected("sweep")) {
+		for (size_t bodies : bodyCounts)
+			for (size_t threads : threadCounts)
+				report(runScene("sweep", buildPile<SweepWorld>, bodies, (int)threads, warmup, steps, sleep));
+	}
+	if (selected("load")) {
+		for (size_t bodies : bodyCounts) {
+			BenchResult r;
+			if (runSceneLoad(bodies, 5, r))
+				report(r);
+		}
+	}
+	if (selected("particles")) {
+		for (size_t count : bodyCounts)
+			for (size_t threads : threadCounts)
+				report(runSceneParticles(count, (int)threads, warmup, steps));
+	}
+	if (selected("soft")) {
+		for (size_t count : bodyCounts)
+			for (size_t threads : threadCounts)
+				report(runSceneSoft(count, (int)threads, warmup, steps));
+	}
+	if (selected("rays")) {
+		for (size_t count : bodyCounts)
+			for (size_t threads : threadCounts)
+				report(runSceneRays(count, (int)threads, warmup, steps));
+	}
+	if (selected("stream")) {
+		for (size_t bodies : bodyCounts)
+			for (size_t threads : threadCounts)
+				report(runSceneStream(bodies, (int)threads, warmup, steps));
+	}
+	if (selected("batch")) {
+		for (size_t bodies : bodyCounts)
+			for (size_t threads : threadCounts)
+				report(runSceneBatch(bodies, (int)threads, warmup, steps));
+	}
+	if (selected("rollback")) {
+		for (size_t bodies : bodyCounts)
+			for (size_t threads : threadCounts)
+				report(runSceneRollback(bodies, (int)threads, warmup, steps));
+	}
+	if (selected("replication")) {
+		for (size_t bodies : bodyCounts)
+			for (size_t threads : threadCounts)
+				report(runSceneReplication(bodies, (int)threads, warmup, steps));
+	}
+	if (json)
+		printf("\n]\n");
+	if (tracePath) {
+#ifdef PHYSICS_PROFILE
+		if (!Profiler::instance().exportChromeTrace(tracePath))
+			cout << "ERROR::BENCH::CANNOT_WRITE_TRACE" << endl;
+#else
+		cout << "--trace needs a build with -DPHYSICS_PROFILE" << endl;
+#endif
+	}
+	return 0;
+}
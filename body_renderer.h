@@ -0,0 +1,171 @@
+#ifndef BODY_RENDERER_H
+#define BODY_RENDERER_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <vector>
+#include <cmath>
+#include <cstdint>
+#include <cstddef>
+
+#include "camera.h"
+#include "physics_world.h"
+
+// draws every body in view as an instance of a unit box or unit circle mesh
+// one instanced draw call per shape type, instance data streamed each frame
+// ------------------------------------------------------------------------
+class BodyRenderer
+{
+public:
+	static const int CIRCLE_SEGMENTS = 24;
+
+	struct Instance
+	{
+		float x, y, angle;
+		float extentX, extentY;
+		uint32_t color;
+	};
+
+	BodyRenderer()
+	{
+		// unit meshes, boxes span [-1,1] and circles have radius 1 so the
+		// per-instance extents scale them directly
+		std::vector<float> mesh = {
+			-1.0f, -1.0f,  1.0f, -1.0f,  1.0f, 1.0f,
+			-1.0f, -1.0f,  1.0f,  1.0f, -1.0f, 1.0f
+		};
+		for (int k = 0; k < CIRCLE_SEGMENTS; k++)
+		{
+			float a0 = 6.2831853f * k / CIRCLE_SEGMENTS;
+			float a1 = 6.2831853f * (k + 1) / CIRCLE_SEGMENTS;
+			mesh.insert(mesh.end(), { 0.0f, 0.0f, cosf(a0), sinf(a0), cosf(a1), sinf(a1) });
+		}
+		glGenBuffers(1, &meshVBO);
+		glBindBuffer(GL_ARRAY_BUFFER, meshVBO);
+		glBufferData(GL_ARRAY_BUFFER, mesh.size() * sizeof(float), mesh.data(), GL_STATIC_DRAW);
+
+		for (int s = 0; s < 2; s++)
+		{
+			glGenVertexArrays(1, &VAO[s]);
+			glGenBuffers(1, &instanceVBO[s]);
+			glBindVertexArray(VAO[s]);
+			// per-vertex unit shape position
+			glBindBuffer(GL_ARRAY_BUFFER, meshVBO);
+			glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*)0);
+			glEnableVertexAttribArray(0);
+			// per-instance color, transform and extents
+			glBindBuffer(GL_ARRAY_BUFFER, instanceVBO[s]);
+			glVertexAttribPointer(1, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Instance), (void*)offsetof(Instance, color));
+			glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(Instance), (void*)offsetof(Instance, x));
+			glVertexAttribPointer(3, 2, GL_FLOAT, GL_FALSE, sizeof(Instance), (void*)offsetof(Instance, extentX));
+			for (int a = 1; a <= 3; a++)
+			{
+				glEnableVertexAttribArray(a);
+				glVertexAttribDivisor(a, 1);
+			}
+		}
+		glBindVertexArray(0);
+	}
+
+	// release the GL objects, must be called while the context is still current
+	// ------------------------------------------------------------------------
+	void destroy()
+	{
+		glDeleteVertexArrays(2, VAO);
+		glDeleteBuffers(2, instanceVBO);
+		glDeleteBuffers(1, &meshVBO);
+	}
+
+	// gather the bodies the camera sees, split by shape type. The world's
+	// broadphase from the last step finds them, so the cost follows what is on
+	// screen and not the size of the world. Bodies created since that step
+	// aren't in it yet and are always drawn. Any world configuration, bodies
+	// are drawn from float copies.
+	// ------------------------------------------------------------------------
+	template<class World>
+	void update(const World& world, const Camera2D& camera)
+	{
+		const typename World::BodyStore& bodies = world.bodies;
+		clear();
+		// broadphase AABBs cover the speculative reach of the step they were built
+		// in, so bodies that moved since are still found
+		float minX, minY, maxX, maxY;
+		camera.bounds(minX, minY, maxX, maxY);
+		size_t indexed = std::min(world.broadphase.minX.size(), bodies.size());
+		world.queryAABB(minX, minY, maxX, maxY, [&](uint32_t i) {
+			if (i < indexed)
+				add(bodies, i);
+		});
+		for (size_t i = indexed; i < bodies.size(); i++)
+			add(bodies, i);
+		upload();
+	}
+	// the same for bodies that have no broadphase (a replication client), tested
+	// one by one against the view
+	// ------------------------------------------------------------------------
+	void update(const BodyStore& bodies, const Camera2D& camera)
+	{
+		clear();
+		float minX, minY, maxX, maxY;
+		camera.bounds(minX, minY, maxX, maxY);
+		for (size_t i = 0; i < bodies.size(); i++)
+		{
+			// a box reaches at most its diagonal from the centre in any rotation
+			float r = bodies.extentX[i] > bodies.extentY[i] ? bodies.extentX[i] : bodies.extentY[i];
+			if (bodies.shape[i] == SHAPE_BOX)
+				r *= 1.4142136f;
+			if (bodies.posX[i] + r < minX || bodies.posX[i] - r > maxX || bodies.posY[i] + r < minY || bodies.posY[i] - r > maxY)
+				continue;
+			add(bodies, i);
+		}
+		upload();
+	}
+	// instances written by the last update
+	// ------------------------------------------------------------------------
+	size_t visibleCount() const
+	{
+		return instances[SHAPE_CIRCLE].size() + instances[SHAPE_BOX].size();
+	}
+	// ------------------------------------------------------------------------
+	void draw()
+	{
+		glBindVertexArray(VAO[SHAPE_BOX]);
+		glDrawArraysInstanced(GL_TRIANGLES, 0, 6, (GLsizei)instances[SHAPE_BOX].size());
+		glBindVertexArray(VAO[SHAPE_CIRCLE]);
+		glDrawArraysInstanced(GL_TRIANGLES, 6, CIRCLE_SEGMENTS * 3, (GLsizei)instances[SHAPE_CIRCLE].size());
+		glBindVertexArray(0);
+	}
+
+private:
+	void clear()
+	{
+		instances[SHAPE_CIRCLE].clear();
+		instances[SHAPE_BOX].clear();
+	}
+
+	template<class T>
+	void add(const BodyStoreT<T>& bodies, size_t i)
+	{
+		Instance inst = { toFloat(bodies.posX[i]), toFloat(bodies.posY[i]), toFloat(bodies.angle[i]),
+			toFloat(bodies.extentX[i]), toFloat(bodies.extentY[i]), bodies.color[i] };
+		instances[bodies.shape[i]].push_back(inst);
+	}
+
+	void upload()
+	{
+		for (int s = 0; s < 2; s++)
+		{
+			// orphan the old storage so the driver doesn't stall on last frame's draw
+			glBindBuffer(GL_ARRAY_BUFFER, instanceVBO[s]);
+			glBufferData(GL_ARRAY_BUFFER, instances[s].size() * sizeof(Instance), NULL, GL_STREAM_DRAW);
+			glBufferSubData(GL_ARRAY_BUFFER, 0, instances[s].size() * sizeof(Instance), instances[s].data());
+		}
+	}
+
+	unsigned int VAO[2];
+	unsigned int instanceVBO[2];
+	unsigned int meshVBO;
+	std::vector<Instance> instances[2];
+};
+#endif
@@ -0,0 +1,182 @@
+#ifndef BODY_STORE_H
+#define BODY_STORE_H
+
+#include <vector>
+#include <type_traits>
+#include <cstdint>
+#include <cstddef>
+
+enum ShapeType : uint8_t
+{
+	SHAPE_CIRCLE = 0,
+	SHAPE_BOX = 1
+};
+
+// description of a single body, used when creating bodies one at a time
+// a density of zero makes the body static (infinite mass)
+// ------------------------------------------------------------------------
+struct BodyDef
+{
+	ShapeType shape = SHAPE_BOX;
+	float x = 0.0f, y = 0.0f, angle = 0.0f;
+	float velX = 0.0f, velY = 0.0f, angVel = 0.0f;
+	float extentX = 0.5f, extentY = 0.5f; // radius in extentX for circles, half extents for boxes
+	float density = 1.0f;
+	float friction = 0.5f;
+	bool bullet = false; // swept against everything it passes in a step, for small fast bodies
+	// collision filter: two bodies touch when each one's category is in the other's
+	// mask, unless they share a non-zero group, which always touch when positive
+	// and never when negative
+	uint32_t categoryBits = 1;
+	uint32_t maskBits = 0xffffffff;
+	int32_t group = 0;
+	bool sensor = false; // reports overlaps (PhysicsWorld::sensorBegin/sensorEnd) but never pushes
+	uint32_t color = 0xffffffff; // packed as 0xAABBGGRR so it uploads as RGBA bytes
+};
+
+// structure-of-arrays storage for every body in the world
+// each array is indexed by body index, hot fields are kept in their own arrays
+// so that stages only touch the data they actually need. T is the scalar the
+// world steps in, see DefaultWorldConfig, BodyStore the float store.
+// ------------------------------------------------------------------------
+template<class T>
+struct BodyStoreT
+{
+	std::vector<T> posX, posY, angle;
+	std::vector<T> velX, velY, angVel;
+	std::vector<T> invMass, invInertia;
+	std::vector<T> friction;
+	std::vector<T> extentX, extentY;
+	std::vector<uint8_t> shape;
+	std::vector<uint32_t> color;
+	std::vector<uint8_t> bullet;
+	std::vector<uint32_t> categoryBits, maskBits;
+	std::vector<int32_t> group;
+	std::vector<uint8_t> sensor;
+	std::vector<uint8_t> awake;      // static bodies are never awake
+	std::vector<T> sleepTime;        // how long the body has been resting
+	std::vector<uint32_t> handle;    // stable id handed out by the world, UINT32_MAX until then
+
+	size_t size() const { return posX.size(); }
+
+	void reserve(size_t n)
+	{
+		posX.reserve(n); posY.reserve(n); angle.reserve(n);
+		velX.reserve(n); velY.reserve(n); angVel.reserve(n);
+		invMass.reserve(n); invInertia.reserve(n);
+		friction.reserve(n);
+		extentX.reserve(n); extentY.reserve(n);
+		shape.reserve(n);
+		color.reserve(n);
+		bullet.reserve(n);
+		categoryBits.reserve(n); maskBits.reserve(n); group.reserve(n); sensor.reserve(n);
+		awake.reserve(n); sleepTime.reserve(n);
+		handle.reserve(n);
+	}
+
+	void resize(size_t n)
+	{
+		posX.resize(n); posY.resize(n); angle.resize(n);
+		velX.resize(n); velY.resize(n); angVel.resize(n);
+		invMass.resize(n); invInertia.resize(n);
+		friction.resize(n);
+		extentX.resize(n); extentY.resize(n);
+		shape.resize(n);
+		color.resize(n);
+		bullet.resize(n);
+		categoryBits.resize(n); maskBits.resize(n); group.resize(n); sensor.resize(n);
+		awake.resize(n); sleepTime.resize(n);
+		handle.resize(n, UINT32_MAX);
+	}
+
+	// call fn on every per-body array, for code that moves whole bodies around
+	template<class Fn>
+	void forEachField(Fn&& fn)
+	{
+		fn(posX); fn(posY); fn(angle);
+		fn(velX); fn(velY); fn(angVel);
+		fn(invMass); fn(invInertia);
+		fn(friction);
+		fn(extentX); fn(extentY);
+		fn(shape);
+		fn(color);
+		fn(bullet);
+		fn(categoryBits); fn(maskBits); fn(group); fn(sensor);
+		fn(awake); fn(sleepTime);
+		fn(handle);
+	}
+
+	// whether the filters of a and b let them touch, see BodyDef
+	bool shouldCollide(size_t a, size_t b) const
+	{
+		if (group[a] == group[b] && group[a] != 0)
+			return group[a] > 0;
+		return (categoryBits[a] & maskBits[b]) && (categoryBits[b] & maskBits[a]);
+	}
+
+	// move body i to slot remap[i] and drop the ones mapped to UINT32_MAX, the
+	// remap has to keep the bodies in order and count the ones that stay
+	void compact(const std::vector<uint32_t>& remap, size_t count)
+	{
+		forEachField([&](auto& field) {
+			for (size_t i = 0; i < remap.size(); i++)
+				if (remap[i] != UINT32_MAX)
+					field[remap[i]] = field[i];
+			field.resize(count);
+		});
+	}
+
+	// move body order[k] to slot k, order has to name every body once
+	void permute(const std::vector<uint32_t>& order)
+	{
+		forEachField([&](auto& field) {
+			typename std::decay<decltype(field)>::type moved(field.size());
+			for (size_t k = 0; k < order.size(); k++)
+				moved[k] = field[order[k]];
+			field.swap(moved);
+		});
+	}
+
+	// write a body definition into slot i, computing mass properties from the
+	// shape. They are worked out in float and converted once.
+	void set(size_t i, const BodyDef& def)
+	{
+		posX[i] = T(def.x); posY[i] = T(def.y); angle[i] = T(def.angle);
+		velX[i] = T(def.velX); velY[i] = T(def.velY); angVel[i] = T(def.angVel);
+		extentX[i] = T(def.extentX);
+		extentY[i] = T(def.shape == SHAPE_CIRCLE ? def.extentX : def.extentY);
+		shape[i] = def.shape;
+		friction[i] = T(def.friction);
+		color[i] = def.color;
+		bullet[i] = def.bullet;
+		categoryBits[i] = def.categoryBits;
+		maskBits[i] = def.maskBits;
+		group[i] = def.group;
+		sensor[i] = def.sensor;
+		handle[i] = UINT32_MAX;
+
+		float mass, inertia;
+		if (def.shape == SHAPE_CIRCLE)
+		{
+			float r2 = def.extentX * def.extentX;
+			mass = def.density * 3.14159265f * r2;
+			inertia = 0.5f * mass * r2;
+		}
+		else
+		{
+			mass = def.density * 4.0f * def.extentX * def.extentY;
+			inertia = mass * (def.extentX * def.extentX + def.extentY * def.extentY) / 3.0f;
+		}
+		invMass[i] = T(mass > 0.0f ? 1.0f / mass : 0.0f);
+		invInertia[i] = T(inertia > 0.0f ? 1.0f / inertia : 0.0f);
+		awake[i] = invMass[i] > 0.0f;
+		sleepTime[i] = 0.0f;
+		if (!awake[i])
+		{
+			velX[i] = velY[i] = angVel[i] = 0.0f;
+		}
+	}
+};
+
+typedef BodyStoreT<float> BodyStore;
+#endif
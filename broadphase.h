@@ -0,0 +1,542 @@
+#ifndef BROADPHASE_H
+#define BROADPHASE_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "body_store.h"
+#include "job_system.h"
+#include "scalar.h"
+
+// pair of body indices packed with the smaller index in the high word,
+// so sorting the keys orders pairs by (bodyA, bodyB)
+inline uint64_t makePairKey(uint32_t a, uint32_t b)
+{
+	return a < b ? ((uint64_t)a << 32) | b : ((uint64_t)b << 32) | a;
+}
+inline uint32_t pairKeyA(uint64_t key) { return (uint32_t)(key >> 32); }
+inline uint32_t pairKeyB(uint64_t key) { return (uint32_t)key; }
+
+// half size of the AABB of body i, grown by margin and extraMargin[i] when
+// given. Turned in the bodies' scalar, a fixed point world gets the same boxes
+// everywhere and only adds float margins to them.
+template<class T>
+inline void broadphaseExtents(const BodyStoreT<T>& bodies, size_t i, float margin, const T* extraMargin,
+	float& ex, float& ey)
+{
+	T hx = bodies.extentX[i], hy = bodies.extentY[i];
+	if (bodies.shape[i] == SHAPE_BOX)
+	{
+		T c = scalarAbs(scalarCos(bodies.angle[i])), s = scalarAbs(scalarSin(bodies.angle[i]));
+		T rx = c * hx + s * hy;
+		hy = s * hx + c * hy;
+		hx = rx;
+	}
+	float grow = extraMargin ? margin + toFloat(extraMargin[i]) : margin;
+	ex = toFloat(hx) + grow;
+	ey = toFloat(hy) + grow;
+}
+
+// clip [t0, t1] to where p + t * d lies in [lo, hi], false if nothing is left
+inline bool clipToSlab(float p, float d, float lo, float hi, float& t0, float& t1)
+{
+	if (d == 0.0f)
+	{
+		if (p < lo || p > hi)
+		{
+			t0 = INFINITY;
+			return false;
+		}
+		return true;
+	}
+	float inv = 1.0f / d;
+	float ta = (lo - p) * inv, tb = (hi - p) * inv;
+	if (ta > tb)
+		std::swap(ta, tb);
+	t0 = std::max(t0, ta);
+	t1 = std::min(t1, tb);
+	return t0 <= t1;
+}
+
+// A broadphase, the Broadphase of a world configuration (DefaultWorldConfig in
+// physics_world.h), is any class with
+//   update(bodies, margin, extraMargin, jobs, pairs, sensorPairs)
+//       as GridBroadphase::update below,
+//   forEachOverlapping(minX, minY, maxX, maxY, fn) and
+//   forEachAlongRay(px, py, dx, dy, maxT, fn)
+//       the box and ray queries against the AABBs of the last update,
+//   minX, minY, maxX, maxY
+//       those AABBs, one float each per body.
+// The world and the renderers drawing it use nothing else.
+
+// uniform grid rebuilt every step
+// bodies are binned by the cell containing their AABB centre, so two overlapping
+// bodies always sit in neighbouring cells as long as neither is larger than half
+// a cell. Cells are numbered row by row and the bodies radix sorted by cell, so the
+// three cells of a neighbouring row are one contiguous run of the sorted array.
+// Bodies bigger than half a cell are kept in a separate oversized list and walk
+// the rows under their AABB instead.
+// ------------------------------------------------------------------------
+class GridBroadphase
+{
+public:
+	// explicit cell size, zero picks one from the average body size every step
+	float cellSize = 0.0f;
+
+	// per-body AABBs from the last update, indexed by body
+	std::vector<float> minX, minY, maxX, maxY;
+
+	// recompute AABBs (grown by margin on every side, plus extraMargin[i] for body i
+	// when given), rebuild the grid and write every overlapping pair with at least
+	// one awake body that the collision filters let through into pairs, sorted by
+	// key. Pairs of a sensor and a non-sensor body go to sensorPairs instead, so
+	// the narrowphase never sees them, and two sensors are never paired. The
+	// grid is float whatever scalar the bodies are in.
+	// ------------------------------------------------------------------------
+	template<class T>
+	void update(const BodyStoreT<T>& bodies, float margin, const T* extraMargin, JobSystem* jobs,
+		std::vector<uint64_t>& pairs, std::vector<uint64_t>& sensorPairs)
+	{
+		size_t n = bodies.size();
+		minX.resize(n); minY.resize(n); maxX.resize(n); maxY.resize(n);
+		pairs.clear();
+		sensorPairs.clear();
+		sortedBody.clear();
+		cellKey.clear();
+		cellStart.assign(1, 0);
+		oversized.clear();
+		if (n == 0)
+			return;
+
+		// AABBs, and the mean half size to pick a cell size from
+		int threads = jobs ? jobs->threadCount() : 1;
+		std::vector<double> sizeSum(threads, 0.0);
+		forRange(jobs, n, [&](size_t begin, size_t end, int t) {
+			double sum = 0.0;
+			for (size_t i = begin; i < end; i++)
+			{
+				float ex, ey;
+				broadphaseExtents(bodies, i, margin, extraMargin, ex, ey);
+				float x = toFloat(bodies.posX[i]), y = toFloat(bodies.posY[i]);
+				minX[i] = x - ex; maxX[i] = x + ex;
+				minY[i] = y - ey; maxY[i] = y + ey;
+				sum += ex > ey ? ex : ey;
+			}
+			sizeSum[t] += sum;
+		});
+		if (cellSize > 0.0f)
+		{
+			cell = cellSize;
+		}
+		else
+		{
+			double sum = 0.0;
+			for (double s : sizeSum)
+				sum += s;
+			// four times the mean half size keeps bodies up to twice the mean in the grid
+			cell = (float)(4.0 * sum / (double)n);
+			if (!(cell > 0.0f))
+				cell = 1.0f;
+		}
+		invCell = 1.0f / cell;
+
+		// cell coordinates of the normal bodies and the range they cover
+		cellCoord.resize(2 * n);
+		int32_t x0 = INT32_MAX, y0 = INT32_MAX, x1 = INT32_MIN, y1 = INT32_MIN;
+		for (size_t i = 0; i < n; i++)
+		{
+			if (maxX[i] - minX[i] > cell || maxY[i] - minY[i] > cell)
+			{
+				oversized.push_back((uint32_t)i);
+				continue;
+			}
+			int32_t cx = (int32_t)floorf(0.5f * (minX[i] + maxX[i]) * invCell);
+			int32_t cy = (int32_t)floorf(0.5f * (minY[i] + maxY[i]) * invCell);
+			cellCoord[2 * i] = cx;
+			cellCoord[2 * i + 1] = cy;
+			x0 = std::min(x0, cx); x1 = std::max(x1, cx);
+			y0 = std::min(y0, cy); y1 = std::max(y1, cy);
+			sortedBody.push_back((uint32_t)i);
+		}
+		// one empty column on each side so x - 1 and x + 1 never wrap into another row
+		originX = (int64_t)x0 - 1;
+		originY = (int64_t)y0;
+		rowStride = (uint64_t)((int64_t)x1 - x0 + 3);
+		uint64_t maxKey = 0;
+		sortedKey.resize(sortedBody.size());
+		for (size_t k = 0; k < sortedBody.size(); k++)
+		{
+			uint32_t i = sortedBody[k];
+			sortedKey[k] = keyOf(cellCoord[2 * i], cellCoord[2 * i + 1]);
+			maxKey = std::max(maxKey, sortedKey[k]);
+		}
+		radixSort(maxKey);
+
+		// runs of equal keys are the occupied cells
+		for (size_t k = 0; k < sortedKey.size(); k++)
+		{
+			if (k == 0 || sortedKey[k] != sortedKey[k - 1])
+			{
+				cellKey.push_back(sortedKey[k]);
+				if (k > 0)
+					cellStart.push_back((uint32_t)k);
+			}
+		}
+		cellStart.push_back((uint32_t)sortedKey.size());
+
+		// each cell tests itself, the cell to its right and the three cells of the
+		// row above, so every neighbouring pair of cells is visited exactly once
+		threadPairs.resize(threads);
+		threadSensorPairs.resize(threads);
+		for (std::vector<uint64_t>& tp : threadPairs)
+			tp.clear();
+		for (std::vector<uint64_t>& tp : threadSensorPairs)
+			tp.clear();
+		forRange(jobs, cellKey.size(), [&](size_t begin, size_t end, int t) {
+			PairOut out = { threadPairs[t], threadSensorPairs[t] };
+			size_t above = lowerBoundCell(cellKey[begin] + rowStride - 1);
+			for (size_t c = begin; c < end; c++)
+			{
+				uint64_t key = cellKey[c];
+				uint32_t s = cellStart[c], e = cellStart[c + 1];
+				for (uint32_t a = s; a < e; a++)
+					for (uint32_t b = a + 1; b < e; b++)
+						testPair(bodies, sortedBody[a], sortedBody[b], out);
+				if (c + 1 < cellKey.size() && cellKey[c + 1] == key + 1)
+					testRuns(bodies, s, e, cellStart[c + 1], cellStart[c + 2], out);
+				while (above < cellKey.size() && cellKey[above] < key + rowStride - 1)
+					above++;
+				size_t last = above;
+				while (last < cellKey.size() && cellKey[last] <= key + rowStride + 1)
+					last++;
+				if (last > above)
+					testRuns(bodies, s, e, cellStart[above], cellStart[last], out);
+			}
+		});
+
+		// oversized bodies walk the rows under their AABB, grown by half a cell
+		// since that is how far a normal body can reach outside its own cell
+		float reach = 0.5f * cell;
+		forRange(jobs, oversized.size(), [&](size_t begin, size_t end, int t) {
+			PairOut out = { threadPairs[t], threadSensorPairs[t] };
+			for (size_t k = begin; k < end; k++)
+			{
+				uint32_t o = oversized[k];
+				forEachInBox(minX[o] - reach, minY[o] - reach, maxX[o] + reach, maxY[o] + reach, [&](uint32_t j) {
+					testPair(bodies, o, j, out);
+				});
+				for (size_t m = k + 1; m < oversized.size(); m++)
+					testPair(bodies, o, oversized[m], out);
+			}
+		});
+
+		gather(threadPairs, pairs);
+		gather(threadSensorPairs, sensorPairs);
+	}
+	// ------------------------------------------------------------------------
+	float currentCellSize() const
+	{
+		return cell;
+	}
+
+	// call fn for every normal (non-oversized) body whose cell lies under the
+	// box, bodies can reach half a cell outside their own cell so callers that
+	// want overlaps should grow the box by that much
+	// ------------------------------------------------------------------------
+	template<class Fn>
+	void forEachInBox(float bx0, float by0, float bx1, float by1, Fn&& fn) const
+	{
+		if (cellKey.empty())
+			return;
+		int64_t cx0 = (int64_t)floorf(bx0 * invCell) - originX;
+		int64_t cx1 = (int64_t)floorf(bx1 * invCell) - originX;
+		int64_t cy0 = (int64_t)floorf(by0 * invCell) - originY;
+		int64_t cy1 = (int64_t)floorf(by1 * invCell) - originY;
+		int64_t rows = (int64_t)((cellKey.back()) / rowStride);
+		cx0 = std::max<int64_t>(cx0, 0);
+		cx1 = std::min<int64_t>(cx1, (int64_t)rowStride - 1);
+		cy0 = std::max<int64_t>(cy0, 0);
+		cy1 = std::min<int64_t>(cy1, rows);
+		if (cx0 > cx1 || cy0 > cy1)
+			return;
+		for (int64_t y = cy0; y <= cy1; y++)
+		{
+			uint64_t rowBase = (uint64_t)y * rowStride;
+			size_t c = lowerBoundCell(rowBase + (uint64_t)cx0);
+			for (; c < cellKey.size() && cellKey[c] <= rowBase + (uint64_t)cx1; c++)
+				for (uint32_t k = cellStart[c]; k < cellStart[c + 1]; k++)
+					fn(sortedBody[k]);
+		}
+	}
+
+	// call fn for every body, oversized ones included, whose AABB from the last
+	// update overlaps the box
+	// ------------------------------------------------------------------------
+	template<class Fn>
+	void forEachOverlapping(float bx0, float by0, float bx1, float by1, Fn&& fn) const
+	{
+		float reach = 0.5f * cell;
+		forEachInBox(bx0 - reach, by0 - reach, bx1 + reach, by1 + reach, [&](uint32_t j) {
+			if (minX[j] <= bx1 && bx0 <= maxX[j] && minY[j] <= by1 && by0 <= maxY[j])
+				fn(j);
+		});
+		for (uint32_t j : oversized)
+			if (minX[j] <= bx1 && bx0 <= maxX[j] && minY[j] <= by1 && by0 <= maxY[j])
+				fn(j);
+	}
+
+	// call fn(body, maxT) for every body whose AABB the segment p + t * d, t in
+	// [0, maxT], passes through. fn returns the new maxT, a closest-hit search
+	// hands back its best hit so far and the rest of the walk is clipped to it.
+	// Rows of the grid are visited in order along the ray, each as one
+	// contiguous run of cells, then the oversized bodies.
+	// ------------------------------------------------------------------------
+	template<class Fn>
+	void forEachAlongRay(float px, float py, float dx, float dy, float maxT, Fn&& fn) const
+	{
+		auto hitsBox = [&](uint32_t j, float tMax) {
+			float t0 = 0.0f, t1 = tMax;
+			return clipToSlab(px, dx, minX[j], maxX[j], t0, t1) && clipToSlab(py, dy, minY[j], maxY[j], t0, t1);
+		};
+		if (!cellKey.empty())
+		{
+			float reach = 0.5f * cell;
+			int64_t rows = (int64_t)(cellKey.back() / rowStride);
+			float endY = py + maxT * dy;
+			int64_t first = (int64_t)floorf(((dy >= 0.0f ? py : endY) - reach) * invCell) - originY;
+			int64_t last = (int64_t)floorf(((dy >= 0.0f ? endY : py) + reach) * invCell) - originY;
+			first = std::max<int64_t>(first, 0);
+			last = std::min<int64_t>(last, rows);
+			for (int64_t k = 0; k <= last - first; k++)
+			{
+				int64_t y = dy >= 0.0f ? first + k : last - k;
+				// part of the ray within reach of this row
+				float y0 = (float)(y + originY) * cell - reach, y1 = y0 + cell + 2.0f * reach;
+				float t0 = 0.0f, t1 = maxT;
+				if (!clipToSlab(py, dy, y0, y1, t0, t1))
+				{
+					// rows are visited along the ray, once one starts past the end the rest do too
+					if (t0 > maxT)
+						break;
+					continue;
+				}
+				float xa = px + t0 * dx, xb = px + t1 * dx;
+				int64_t cx0 = (int64_t)floorf((std::min(xa, xb) - reach) * invCell) - originX;
+				int64_t cx1 = (int64_t)floorf((std::max(xa, xb) + reach) * invCell) - originX;
+				cx0 = std::max<int64_t>(cx0, 0);
+				cx1 = std::min<int64_t>(cx1, (int64_t)rowStride - 1);
+				uint64_t rowBase = (uint64_t)y * rowStride;
+				for (size_t c = lowerBoundCell(rowBase + (uint64_t)cx0); c < cellKey.size() && cellKey[c] <= rowBase + (uint64_t)cx1; c++)
+					for (uint32_t e = cellStart[c]; e < cellStart[c + 1]; e++)
+						if (hitsBox(sortedBody[e], maxT))
+							maxT = fn(sortedBody[e], maxT);
+			}
+		}
+		for (uint32_t j : oversized)
+			if (hitsBox(j, maxT))
+				maxT = fn(j, maxT);
+	}
+
+private:
+	float cell = 1.0f;
+	float invCell = 1.0f;
+	int64_t originX = 0, originY = 0;
+	uint64_t rowStride = 1;
+
+	std::vector<int32_t> cellCoord;          // x, y cell of each body
+	std::vector<uint32_t> sortedBody;        // normal bodies sorted by cell
+	std::vector<uint64_t> sortedKey;         // cell key of each entry in sortedBody
+	std::vector<uint64_t> cellKey;           // occupied cells in increasing key order
+	std::vector<uint32_t> cellStart;         // first entry of each occupied cell in sortedBody
+	std::vector<uint32_t> oversized;         // bodies too large for the grid
+	std::vector<uint32_t> tempBody;
+	std::vector<uint64_t> tempKey;
+	std::vector<std::vector<uint64_t>> threadPairs, threadSensorPairs;
+
+	uint64_t keyOf(int32_t cx, int32_t cy) const
+	{
+		return (uint64_t)((int64_t)cy - originY) * rowStride + (uint64_t)((int64_t)cx - originX);
+	}
+
+	size_t lowerBoundCell(uint64_t key) const
+	{
+		return std::lower_bound(cellKey.begin(), cellKey.end(), key) - cellKey.begin();
+	}
+
+	bool overlaps(uint32_t a, uint32_t b) const
+	{
+		return minX[a] <= maxX[b] && minX[b] <= maxX[a] && minY[a] <= maxY[b] && minY[b] <= maxY[a];
+	}
+
+	struct PairOut
+	{
+		std::vector<uint64_t>& pairs;
+		std::vector<uint64_t>& sensorPairs;
+	};
+
+	// filtered pairs are dropped here, before anything is stored for them
+	template<class Store>
+	void testPair(const Store& bodies, uint32_t a, uint32_t b, PairOut& out) const
+	{
+		if (!(bodies.awake[a] | bodies.awake[b]) || !overlaps(a, b) || !bodies.shouldCollide(a, b))
+			return;
+		uint8_t sensors = bodies.sensor[a] + bodies.sensor[b];
+		if (sensors == 0)
+			out.pairs.push_back(makePairKey(a, b));
+		else if (sensors == 1)
+			out.sensorPairs.push_back(makePairKey(a, b));
+	}
+
+	template<class Store>
+	void testRuns(const Store& bodies, uint32_t s0, uint32_t e0, uint32_t s1, uint32_t e1, PairOut& out) const
+	{
+		for (uint32_t a = s0; a < e0; a++)
+			for (uint32_t b = s1; b < e1; b++)
+				testPair(bodies, sortedBody[a], sortedBody[b], out);
+	}
+
+	// sorted pairs make the rest of the step independent of the thread count
+	static void gather(const std::vector<std::vector<uint64_t>>& perThread, std::vector<uint64_t>& out)
+	{
+		size_t total = 0;
+		for (const std::vector<uint64_t>& tp : perThread)
+			total += tp.size();
+		out.reserve(total);
+		for (const std::vector<uint64_t>& tp : perThread)
+			out.insert(out.end(), tp.begin(), tp.end());
+		std::sort(out.begin(), out.end());
+	}
+
+	// stable LSD radix sort of sortedBody by sortedKey, only as many 11 bit
+	// passes as the largest key needs
+	void radixSort(uint64_t maxKey)
+	{
+		size_t count = sortedBody.size();
+		tempBody.resize(count);
+		tempKey.resize(count);
+		uint32_t histogram[2048];
+		for (int shift = 0; shift < 64 && (maxKey >> shift) != 0; shift += 11)
+		{
+			std::fill(histogram, histogram + 2048, 0u);
+			for (size_t k = 0; k < count; k++)
+				histogram[(sortedKey[k] >> shift) & 2047]++;
+			uint32_t sum = 0;
+			for (int d = 0; d < 2048; d++)
+			{
+				uint32_t h = histogram[d];
+				histogram[d] = sum;
+				sum += h;
+			}
+			for (size_t k = 0; k < count; k++)
+			{
+				uint32_t dst = histogram[(sortedKey[k] >> shift) & 2047]++;
+				tempKey[dst] = sortedKey[k];
+				tempBody[dst] = sortedBody[k];
+			}
+			sortedKey.swap(tempKey);
+			sortedBody.swap(tempBody);
+		}
+	}
+
+	template<class Fn>
+	static void forRange(JobSystem* jobs, size_t count, Fn&& fn)
+	{
+		if (jobs)
+			jobs->parallelFor(count, fn);
+		else if (count > 0)
+			fn(0, count, 0);
+	}
+};
+
+// sort and sweep along x
+// bodies are sorted by the left edge of their AABB and each is tested against
+// the ones after it until one starts past its right edge. No cell size to pick
+// and no trouble with bodies of very different sizes, but it runs on one thread
+// and tests every pair that overlaps in x, so a tall stack or a long ground
+// body costs more than in the grid. Box queries walk the sorted bodies up to
+// the right edge of the box, rays test every body.
+// ------------------------------------------------------------------------
+class SweepBroadphase
+{
+public:
+	// per-body AABBs from the last update, indexed by body
+	std::vector<float> minX, minY, maxX, maxY;
+
+	// as GridBroadphase::update, jobs are not used
+	// ------------------------------------------------------------------------
+	template<class T>
+	void update(const BodyStoreT<T>& bodies, float margin, const T* extraMargin, JobSystem* jobs,
+		std::vector<uint64_t>& pairs, std::vector<uint64_t>& sensorPairs)
+	{
+		(void)jobs;
+		size_t n = bodies.size();
+		minX.resize(n); minY.resize(n); maxX.resize(n); maxY.resize(n);
+		pairs.clear();
+		sensorPairs.clear();
+		sorted.resize(n);
+		for (size_t i = 0; i < n; i++)
+		{
+			float ex, ey;
+			broadphaseExtents(bodies, i, margin, extraMargin, ex, ey);
+			float x = toFloat(bodies.posX[i]), y = toFloat(bodies.posY[i]);
+			minX[i] = x - ex; maxX[i] = x + ex;
+			minY[i] = y - ey; maxY[i] = y + ey;
+			sorted[i] = (uint32_t)i;
+		}
+		std::sort(sorted.begin(), sorted.end(), [&](uint32_t a, uint32_t b) {
+			return minX[a] < minX[b] || (minX[a] == minX[b] && a < b);
+		});
+
+		for (size_t k = 0; k < n; k++)
+		{
+			uint32_t a = sorted[k];
+			for (size_t m = k + 1; m < n && minX[sorted[m]] <= maxX[a]; m++)
+			{
+				uint32_t b = sorted[m];
+				if (!(bodies.awake[a] | bodies.awake[b]) || minY[a] > maxY[b] || minY[b] > maxY[a] ||
+					!bodies.shouldCollide(a, b))
+					continue;
+				uint8_t sensors = bodies.sensor[a] + bodies.sensor[b];
+				if (sensors == 0)
+					pairs.push_back(makePairKey(a, b));
+				else if (sensors == 1)
+					sensorPairs.push_back(makePairKey(a, b));
+			}
+		}
+		// sorted by key like the grid's, so the step doesn't see which broadphase found them
+		std::sort(pairs.begin(), pairs.end());
+		std::sort(sensorPairs.begin(), sensorPairs.end());
+	}
+
+	// call fn for every body whose AABB from the last update overlaps the box
+	// ------------------------------------------------------------------------
+	template<class Fn>
+	void forEachOverlapping(float bx0, float by0, float bx1, float by1, Fn&& fn) const
+	{
+		for (size_t k = 0; k < sorted.size() && minX[sorted[k]] <= bx1; k++)
+		{
+			uint32_t j = sorted[k];
+			if (bx0 <= maxX[j] && minY[j] <= by1 && by0 <= maxY[j])
+				fn(j);
+		}
+	}
+
+	// as GridBroadphase::forEachAlongRay, bodies in index order
+	// ------------------------------------------------------------------------
+	template<class Fn>
+	void forEachAlongRay(float px, float py, float dx, float dy, float maxT, Fn&& fn) const
+	{
+		for (uint32_t j = 0; j < (uint32_t)sorted.size(); j++)
+		{
+			float t0 = 0.0f, t1 = maxT;
+			if (clipToSlab(px, dx, minX[j], maxX[j], t0, t1) && clipToSlab(py, dy, minY[j], maxY[j], t0, t1))
+				maxT = fn(j, maxT);
+		}
+	}
+
+private:
+	std::vector<uint32_t> sorted;            // bodies in order of minX
+};
+#endif
@@ -0,0 +1,84 @@
+#ifndef CAMERA_H
+#define CAMERA_H
+
+#include <cmath>
+
+// 2D camera looking at (centerX, centerY) from halfHeight world units below the
+// top edge of the window, the width follows the aspect ratio. Screen positions
+// are framebuffer pixels with y down, as GLFW reports the cursor.
+// ------------------------------------------------------------------------
+class Camera2D
+{
+public:
+	float centerX = 0.0f, centerY = 0.0f;
+	float halfHeight = 1.0f;
+	float aspect = 1.0f;
+	// zoom limits, as half heights
+	float minHalfHeight = 0.01f, maxHalfHeight = 1e5f;
+
+	// look at the origin with a square of halfSize around it in view
+	// ------------------------------------------------------------------------
+	void fit(float halfSize)
+	{
+		centerX = centerY = 0.0f;
+		halfHeight = halfSize;
+	}
+	// ------------------------------------------------------------------------
+	void setViewport(int width, int height)
+	{
+		aspect = height > 0 ? (float)width / (float)height : 1.0f;
+	}
+	// move by a distance in pixels, the world under the cursor follows it
+	// ------------------------------------------------------------------------
+	void pan(double dx, double dy, int height)
+	{
+		float unitsPerPixel = height > 0 ? 2.0f * halfHeight / height : 0.0f;
+		centerX -= (float)dx * unitsPerPixel;
+		centerY += (float)dy * unitsPerPixel;
+	}
+	// scale the view by factor (below 1 zooms in), keeping the world point under
+	// the pixel (sx, sy) where it is on screen
+	// ------------------------------------------------------------------------
+	void zoomAt(float factor, double sx, double sy, int width, int height)
+	{
+		float wx, wy;
+		screenToWorld(sx, sy, width, height, wx, wy);
+		float h = fminf(fmaxf(halfHeight * factor, minHalfHeight), maxHalfHeight);
+		float s = h / halfHeight;
+		centerX = wx + (centerX - wx) * s;
+		centerY = wy + (centerY - wy) * s;
+		halfHeight = h;
+	}
+	// ------------------------------------------------------------------------
+	void screenToWorld(double sx, double sy, int width, int height, float& wx, float& wy) const
+	{
+		float nx = width > 0 ? (float)(2.0 * sx / width - 1.0) : 0.0f;
+		float ny = height > 0 ? (float)(1.0 - 2.0 * sy / height) : 0.0f;
+		wx = centerX + nx * halfHeight * aspect;
+		wy = centerY + ny * halfHeight;
+	}
+	// world AABB of what is on screen
+	// ------------------------------------------------------------------------
+	void bounds(float& minX, float& minY, float& maxX, float& maxY) const
+	{
+		float halfWidth = halfHeight * aspect;
+		minX = centerX - halfWidth; maxX = centerX + halfWidth;
+		minY = centerY - halfHeight; maxY = centerY + halfHeight;
+	}
+	// world to clip space as a column major 3x3 matrix, for Shader::setMat3
+	// ------------------------------------------------------------------------
+	void viewProjection(float m[9]) const
+	{
+		float sx = 1.0f / (halfHeight * aspect), sy = 1.0f / halfHeight;
+		m[0] = sx;            m[1] = 0.0f;          m[2] = 0.0f;
+		m[3] = 0.0f;          m[4] = sy;            m[5] = 0.0f;
+		m[6] = -sx * centerX; m[7] = -sy * centerY; m[8] = 1.0f;
+	}
+	// how many pixels one world unit covers
+	// ------------------------------------------------------------------------
+	float pixelsPerUnit(int height) const
+	{
+		return 0.5f * height / halfHeight;
+	}
+};
+#endif
@@ -0,0 +1,615 @@
+#ifndef COLLISION_H
+#define COLLISION_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cmath>
+
+#include "vec2.h"
+
+// one contact point of a manifold, the solver fields are filled in by the contact solver
+// ------------------------------------------------------------------------
+template<class T>
+struct ContactPointT
+{
+	Vec2T<T> point;     // world position, midway between the two surfaces
+	T separation;       // negative when penetrating
+	uint32_t id;        // feature key, matches points across steps for warm starting
+	T normalImpulse;
+	T tangentImpulse;
+	// solver data
+	Vec2T<T> rA, rB;
+	T normalMass, tangentMass, bias;
+};
+
+// up to two contact points between a pair of bodies, the normal points from A to B
+// ------------------------------------------------------------------------
+template<class T>
+struct ManifoldT
+{
+	uint32_t bodyA, bodyB;
+	Vec2T<T> normal;
+	T friction;
+	int pointCount;
+	ContactPointT<T> points[2];
+};
+
+// world-space description of a shape, built from the body store for the narrowphase
+// ------------------------------------------------------------------------
+template<class T>
+struct ShapeTransformT
+{
+	Vec2T<T> p;
+	RotT<T> q;
+	T extentX, extentY;
+};
+
+// the narrowphase tests below take the scalar type of the world, everything
+// from shapeDistance on is float only
+typedef ContactPointT<float> ContactPoint;
+typedef ManifoldT<float> Manifold;
+typedef ShapeTransformT<float> ShapeTransform;
+
+// a line segment is a box of no thickness around it, so the box tests take it as it is
+// ------------------------------------------------------------------------
+inline ShapeTransform segmentTransform(const Vec2& a, const Vec2& b)
+{
+	ShapeTransform t;
+	Vec2 d = b - a;
+	float len = length(d);
+	t.p = 0.5f * (a + b);
+	if (len > 0.0f)
+	{
+		t.q.c = d.x / len;
+		t.q.s = d.y / len;
+	}
+	t.extentX = 0.5f * len;
+	t.extentY = 0.0f;
+	return t;
+}
+
+template<class T>
+inline void clearPoint(ContactPointT<T>& cp, const Vec2T<T>& point, T separation, uint32_t id)
+{
+	cp.point = point;
+	cp.separation = separation;
+	cp.id = id;
+	cp.normalImpulse = 0.0f;
+	cp.tangentImpulse = 0.0f;
+}
+
+// circle A against circle B
+// every test reports points up to margin apart, so resting contacts persist
+// between steps instead of flickering on and off at zero separation
+// ------------------------------------------------------------------------
+template<class T>
+inline void collideCircles(ManifoldT<T>& m, const ShapeTransformT<T>& a, const ShapeTransformT<T>& b, T margin)
+{
+	m.pointCount = 0;
+	Vec2T<T> d = b.p - a.p;
+	T dist2 = lengthSquared(d);
+	T radius = a.extentX + b.extentX;
+	if (dist2 > (radius + margin) * (radius + margin))
+		return;
+	T dist = scalarSqrt(dist2);
+	m.normal = dist > 1e-6f ? (1.0f / dist) * d : Vec2T<T>(0.0f, 1.0f);
+	T separation = dist - radius;
+	Vec2T<T> point = a.p + (a.extentX + 0.5f * separation) * m.normal;
+	clearPoint(m.points[0], point, separation, 0);
+	m.pointCount = 1;
+}
+
+// box A against circle B
+// ------------------------------------------------------------------------
+template<class T>
+inline void collideBoxCircle(ManifoldT<T>& m, const ShapeTransformT<T>& box, const ShapeTransformT<T>& circle, T margin)
+{
+	m.pointCount = 0;
+	T r = circle.extentX;
+	Vec2T<T> c = rotateInv(box.q, circle.p - box.p);
+	T hx = box.extentX, hy = box.extentY;
+
+	Vec2T<T> normal;
+	T separation;
+	uint32_t id;
+	if (scalarAbs(c.x) <= hx && scalarAbs(c.y) <= hy)
+	{
+		// centre inside the box, push out through the nearest face
+		T sx = scalarAbs(c.x) - hx;
+		T sy = scalarAbs(c.y) - hy;
+		if (sx > sy)
+		{
+			normal = Vec2T<T>(c.x < 0.0f ? -1.0f : 1.0f, 0.0f);
+			separation = sx - r;
+			id = c.x < 0.0f ? 2 : 0;
+		}
+		else
+		{
+			normal = Vec2T<T>(0.0f, c.y < 0.0f ? -1.0f : 1.0f);
+			separation = sy - r;
+			id = c.y < 0.0f ? 3 : 1;
+		}
+	}
+	else
+	{
+		Vec2T<T> clamped(scalarMax(-hx, scalarMin(hx, c.x)), scalarMax(-hy, scalarMin(hy, c.y)));
+		Vec2T<T> d = c - clamped;
+		T dist2 = lengthSquared(d);
+		if (dist2 > (r + margin) * (r + margin))
+			return;
+		T dist = scalarSqrt(dist2);
+		if (dist > 0.0f)
+			normal = (1.0f / dist) * d;
+		else if (scalarAbs(d.x) > scalarAbs(d.y))
+			// a gap below the step of a fixed point type squares to zero, it lies
+			// along the axis it is longest on
+			normal = Vec2T<T>(d.x < 0.0f ? -1.0f : 1.0f, 0.0f);
+		else
+			normal = Vec2T<T>(0.0f, d.y < 0.0f ? -1.0f : 1.0f);
+		separation = dist - r;
+		id = 4;
+	}
+	m.normal = rotate(box.q, normal);
+	Vec2T<T> point = circle.p - (r + 0.5f * separation) * m.normal;
+	clearPoint(m.points[0], point, separation, id);
+	m.pointCount = 1;
+}
+
+// corners and outward face normals of a box in world space, counter-clockwise
+// edge i runs from v[i] to v[(i + 1) % 4] and has normal n[i]
+// ------------------------------------------------------------------------
+template<class T>
+struct BoxPolyT
+{
+	Vec2T<T> v[4];
+	Vec2T<T> n[4];
+
+	explicit BoxPolyT(const ShapeTransformT<T>& t)
+	{
+		Vec2T<T> ax = rotate(t.q, Vec2T<T>(t.extentX, 0.0f));
+		Vec2T<T> ay = rotate(t.q, Vec2T<T>(0.0f, t.extentY));
+		v[0] = t.p + ax - ay;
+		v[1] = t.p + ax + ay;
+		v[2] = t.p - ax + ay;
+		v[3] = t.p - ax - ay;
+		n[0] = rotate(t.q, Vec2T<T>(1.0f, 0.0f));
+		n[1] = rotate(t.q, Vec2T<T>(0.0f, 1.0f));
+		n[2] = -n[0];
+		n[3] = -n[1];
+	}
+};
+
+typedef BoxPolyT<float> BoxPoly;
+
+// largest separation of poly B from the faces of poly A
+template<class T>
+inline T maxFaceSeparation(const BoxPolyT<T>& a, const BoxPolyT<T>& b, int& edge)
+{
+	// fixed point has no infinity, so both searches start from their first candidate
+	T best = 0.0f;
+	edge = 0;
+	for (int i = 0; i < 4; i++)
+	{
+		T s = dot(a.n[i], b.v[0] - a.v[i]);
+		for (int j = 1; j < 4; j++)
+			s = scalarMin(s, dot(a.n[i], b.v[j] - a.v[i]));
+		if (i == 0 || s > best)
+		{
+			best = s;
+			edge = i;
+		}
+	}
+	return best;
+}
+
+// edge of the poly whose normal is most anti-parallel to n
+template<class T>
+inline int incidentEdge(const BoxPolyT<T>& poly, const Vec2T<T>& n)
+{
+	int edge = 0;
+	T minDot = dot(n, poly.n[0]);
+	for (int i = 1; i < 4; i++)
+	{
+		T d = dot(n, poly.n[i]);
+		if (d < minDot)
+		{
+			minDot = d;
+			edge = i;
+		}
+	}
+	return edge;
+}
+
+// box A against box B, separating axis test followed by clipping the incident
+// edge against the side planes of the reference edge
+// ------------------------------------------------------------------------
+template<class T>
+inline void collideBoxes(ManifoldT<T>& m, const ShapeTransformT<T>& ta, const ShapeTransformT<T>& tb, T margin)
+{
+	m.pointCount = 0;
+	BoxPolyT<T> a(ta), b(tb);
+	int edgeA, edgeB;
+	T sepA = maxFaceSeparation(a, b, edgeA);
+	if (sepA > margin)
+		return;
+	T sepB = maxFaceSeparation(b, a, edgeB);
+	if (sepB > margin)
+		return;
+
+	// prefer A as the reference so the choice doesn't flicker between frames
+	const BoxPolyT<T>* ref = &a;
+	const BoxPolyT<T>* inc = &b;
+	int refEdge = edgeA;
+	uint32_t flip = 0;
+	if (sepB > 0.98f * sepA + 0.001f)
+	{
+		ref = &b;
+		inc = &a;
+		refEdge = edgeB;
+		flip = 1;
+	}
+
+	Vec2T<T> n = ref->n[refEdge];
+	int incEdge = incidentEdge(*inc, n);
+
+	Vec2T<T> clip[2] = { inc->v[incEdge], inc->v[(incEdge + 1) & 3] };
+	uint32_t clipId[2] = { (uint32_t)incEdge, (uint32_t)((incEdge + 1) & 3) };
+	Vec2T<T> r1 = ref->v[refEdge];
+	Vec2T<T> r2 = ref->v[(refEdge + 1) & 3];
+	Vec2T<T> t = r2 - r1;
+	t *= 1.0f / length(t);
+
+	// clip against the two side planes of the reference edge
+	T lower = dot(t, r1);
+	T upper = dot(t, r2);
+	for (int side = 0; side < 2; side++)
+	{
+		T d0 = side == 0 ? lower - dot(t, clip[0]) : dot(t, clip[0]) - upper;
+		T d1 = side == 0 ? lower - dot(t, clip[1]) : dot(t, clip[1]) - upper;
+		if (d0 > 0.0f && d1 > 0.0f)
+			return;
+		if (d0 > 0.0f || d1 > 0.0f)
+		{
+			int out = d0 > 0.0f ? 0 : 1;
+			T f = d0 / (d0 - d1);
+			clip[out] = clip[0] + f * (clip[1] - clip[0]);
+			clipId[out] = 4 + side + (refEdge << 1);
+		}
+	}
+
+	m.normal = flip ? -n : n;
+	for (int k = 0; k < 2; k++)
+	{
+		T separation = dot(n, clip[k] - r1);
+		if (separation > margin)
+			continue;
+		Vec2T<T> point = clip[k] - (0.5f * separation) * n;
+		uint32_t id = (uint32_t)refEdge | ((uint32_t)incEdge << 4) | (clipId[k] << 8) | (flip << 16);
+		clearPoint(m.points[m.pointCount++], point, separation, id);
+	}
+}
+
+// closest point to p on the segment from a to b
+inline Vec2 closestOnSegment(const Vec2& p, const Vec2& a, const Vec2& b)
+{
+	Vec2 e = b - a;
+	float t = dot(p - a, e) / lengthSquared(e);
+	return a + fmaxf(0.0f, fminf(1.0f, t)) * e;
+}
+
+// normal of the segment from a to b pointing to the side of p, or always to
+// the left of a to b when the segment is one sided
+template<class T>
+inline Vec2T<T> segmentNormal(const Vec2T<T>& a, const Vec2T<T>& b, const Vec2T<T>& p, bool oneSided)
+{
+	Vec2T<T> e = b - a;
+	Vec2T<T> n = (1.0f / length(e)) * Vec2T<T>(-e.y, e.x);
+	return oneSided || dot(n, p - a) >= 0.0f ? n : -n;
+}
+
+// segment A from a to b against box B. Unlike collideBoxes on a flat box the
+// segment face is the only reference, so a box sliding along a chain of
+// segments is never caught on the ends where two of them meet: its bottom edge
+// is clipped to the extent of each segment and pushed out along that segment's
+// normal. A one sided segment pushes out to the left of a to b only, so a body
+// that sinks through terrain comes back up instead of falling out underneath.
+// ------------------------------------------------------------------------
+template<class T>
+inline void collideSegmentBox(ManifoldT<T>& m, const Vec2T<T>& a, const Vec2T<T>& b, const ShapeTransformT<T>& box, bool oneSided, T margin)
+{
+	m.pointCount = 0;
+	if (lengthSquared(b - a) == 0.0f)
+		return;
+	Vec2T<T> n = segmentNormal(a, b, box.p, oneSided);
+	BoxPolyT<T> poly(box);
+	int incEdge = incidentEdge(poly, n);
+
+	Vec2T<T> clip[2] = { poly.v[incEdge], poly.v[(incEdge + 1) & 3] };
+	uint32_t clipId[2] = { (uint32_t)incEdge, (uint32_t)((incEdge + 1) & 3) };
+	Vec2T<T> t = (1.0f / length(b - a)) * (b - a);
+	T lower = dot(t, a);
+	T upper = dot(t, b);
+	for (int side = 0; side < 2; side++)
+	{
+		T d0 = side == 0 ? lower - dot(t, clip[0]) : dot(t, clip[0]) - upper;
+		T d1 = side == 0 ? lower - dot(t, clip[1]) : dot(t, clip[1]) - upper;
+		if (d0 > 0.0f && d1 > 0.0f)
+			return;
+		if (d0 > 0.0f || d1 > 0.0f)
+		{
+			int out = d0 > 0.0f ? 0 : 1;
+			T f = d0 / (d0 - d1);
+			clip[out] = clip[0] + f * (clip[1] - clip[0]);
+			clipId[out] = 4 + side;
+		}
+	}
+
+	m.normal = n;
+	for (int k = 0; k < 2; k++)
+	{
+		T separation = dot(n, clip[k] - a);
+		if (separation > margin)
+			continue;
+		Vec2T<T> point = clip[k] - (0.5f * separation) * n;
+		clearPoint(m.points[m.pointCount++], point, separation, ((uint32_t)incEdge << 4) | (clipId[k] << 8));
+	}
+}
+
+// segment A from a to b against circle B, one sided as for collideSegmentBox
+// ------------------------------------------------------------------------
+template<class T>
+inline void collideSegmentCircle(ManifoldT<T>& m, const Vec2T<T>& a, const Vec2T<T>& b, const ShapeTransformT<T>& circle, bool oneSided, T margin)
+{
+	m.pointCount = 0;
+	Vec2T<T> e = b - a;
+	T len2 = lengthSquared(e);
+	if (len2 == 0.0f)
+		return;
+	T r = circle.extentX;
+	T u = dot(circle.p - a, e) / len2;
+	Vec2T<T> normal;
+	T separation;
+	uint32_t id;
+	if (u > 0.0f && u < 1.0f)
+	{
+		normal = segmentNormal(a, b, circle.p, oneSided);
+		separation = dot(normal, circle.p - a) - r;
+		id = 0;
+	}
+	else
+	{
+		// past an end, the circle touches the end point
+		Vec2T<T> end = u <= 0.0f ? a : b;
+		Vec2T<T> d = circle.p - end;
+		T dist2 = lengthSquared(d);
+		if (dist2 > (r + margin) * (r + margin) || dist2 == 0.0f)
+			return;
+		if (oneSided && dot(d, Vec2T<T>(-e.y, e.x)) < 0.0f)
+			return;
+		T dist = scalarSqrt(dist2);
+		normal = (1.0f / dist) * d;
+		separation = dist - r;
+		id = u <= 0.0f ? 1 : 2;
+	}
+	if (separation > margin)
+		return;
+	m.normal = normal;
+	Vec2T<T> point = circle.p - (r + 0.5f * separation) * normal;
+	clearPoint(m.points[0], point, separation, id);
+	m.pointCount = 1;
+}
+
+// signed distance between two shapes and the direction from A to B along which
+// it is measured. Separated shapes get their exact distance, overlapping ones the
+// negative depth along the axis of least penetration. Used by the time of impact
+// search, which needs a distance that never overestimates the gap.
+// ------------------------------------------------------------------------
+inline float shapeDistance(const ShapeTransform& a, bool circleA, const ShapeTransform& b, bool circleB, Vec2& normal)
+{
+	if (circleA && circleB)
+	{
+		Vec2 d = b.p - a.p;
+		float dist = length(d);
+		normal = dist > 1e-6f ? (1.0f / dist) * d : Vec2(0.0f, 1.0f);
+		return dist - a.extentX - b.extentX;
+	}
+	if (circleA || circleB)
+	{
+		const ShapeTransform& box = circleA ? b : a;
+		const ShapeTransform& circle = circleA ? a : b;
+		Vec2 c = rotateInv(box.q, circle.p - box.p);
+		float sx = fabsf(c.x) - box.extentX, sy = fabsf(c.y) - box.extentY;
+		Vec2 local;
+		float dist;
+		if (sx <= 0.0f && sy <= 0.0f)
+		{
+			local = sx > sy ? Vec2(c.x < 0.0f ? -1.0f : 1.0f, 0.0f) : Vec2(0.0f, c.y < 0.0f ? -1.0f : 1.0f);
+			dist = fmaxf(sx, sy);
+		}
+		else
+		{
+			Vec2 d = c - Vec2(fmaxf(-box.extentX, fminf(box.extentX, c.x)), fmaxf(-box.extentY, fminf(box.extentY, c.y)));
+			dist = length(d);
+			local = (1.0f / dist) * d;
+		}
+		normal = rotate(box.q, circleA ? -local : local);
+		return dist - circle.extentX;
+	}
+
+	BoxPoly pa(a), pb(b);
+	int edgeA, edgeB;
+	float sepA = maxFaceSeparation(pa, pb, edgeA);
+	float sepB = maxFaceSeparation(pb, pa, edgeB);
+	if (sepA <= 0.0f && sepB <= 0.0f)
+	{
+		normal = sepA >= sepB ? pa.n[edgeA] : -pb.n[edgeB];
+		return fmaxf(sepA, sepB);
+	}
+	// separated, the closest pair is a corner of one box against an edge of the other
+	float best2 = INFINITY;
+	for (int i = 0; i < 4; i++)
+		for (int j = 0; j < 4; j++)
+		{
+			Vec2 d = pb.v[i] - closestOnSegment(pb.v[i], pa.v[j], pa.v[(j + 1) & 3]);
+			if (lengthSquared(d) < best2)
+			{
+				best2 = lengthSquared(d);
+				normal = d;
+			}
+			d = closestOnSegment(pa.v[i], pb.v[j], pb.v[(j + 1) & 3]) - pa.v[i];
+			if (lengthSquared(d) < best2)
+			{
+				best2 = lengthSquared(d);
+				normal = d;
+			}
+		}
+	float dist = sqrtf(best2);
+	normal *= 1.0f / dist;
+	return dist;
+}
+
+// ray p + t * d, t in [0, maxT], against a circle or box. Writes the entry
+// fraction and the surface normal there, a ray starting inside the shape
+// doesn't hit it.
+// ------------------------------------------------------------------------
+inline bool rayCastShape(const ShapeTransform& shape, bool circle, const Vec2& p, const Vec2& d, float maxT, float& t, Vec2& normal)
+{
+	if (circle)
+	{
+		Vec2 s = p - shape.p;
+		float r2 = shape.extentX * shape.extentX;
+		float c = lengthSquared(s) - r2;
+		float dd = lengthSquared(d);
+		if (c < 0.0f || dd == 0.0f)
+			return false;
+		float b = dot(s, d);
+		float disc = b * b - dd * c;
+		if (b >= 0.0f || disc < 0.0f)
+			return false;
+		t = (-b - sqrtf(disc)) / dd;
+		if (t > maxT)
+			return false;
+		normal = s + t * d;
+		normal *= 1.0f / length(normal);
+		return true;
+	}
+	Vec2 lp = rotateInv(shape.q, p - shape.p), ld = rotateInv(shape.q, d);
+	float h[2] = { shape.extentX, shape.extentY };
+	float o[2] = { lp.x, lp.y }, v[2] = { ld.x, ld.y };
+	float t0 = -INFINITY, t1 = maxT;
+	int axis = -1;
+	for (int k = 0; k < 2; k++)
+	{
+		if (v[k] == 0.0f)
+		{
+			if (o[k] < -h[k] || o[k] > h[k])
+				return false;
+			continue;
+		}
+		float inv = 1.0f / v[k];
+		float ta = (-h[k] - o[k]) * inv, tb = (h[k] - o[k]) * inv;
+		if (ta > tb)
+			std::swap(ta, tb);
+		if (ta > t0)
+		{
+			t0 = ta;
+			axis = k;
+		}
+		t1 = fminf(t1, tb);
+		if (t0 > t1)
+			return false;
+	}
+	if (axis < 0 || t0 < 0.0f)
+		return false;
+	t = t0;
+	Vec2 local = axis == 0 ? Vec2(v[0] > 0.0f ? -1.0f : 1.0f, 0.0f) : Vec2(0.0f, v[1] > 0.0f ? -1.0f : 1.0f);
+	normal = rotate(shape.q, local);
+	return true;
+}
+
+// point of the shape furthest along direction n
+inline Vec2 supportPoint(const ShapeTransform& shape, bool circle, const Vec2& n)
+{
+	if (circle)
+		return shape.p + shape.extentX * n;
+	Vec2 local = rotateInv(shape.q, n);
+	return shape.p + rotate(shape.q, Vec2(local.x < 0.0f ? -shape.extentX : shape.extentX, local.y < 0.0f ? -shape.extentY : shape.extentY));
+}
+
+// conservative advancement of shape A moving by translation and turning by
+// rotation as t goes from 0 to 1, against B held still. Returns the first t at
+// which the gap closes to target, tMax or more if it doesn't before tMax, and 0
+// if A already starts within target. normal is the direction from A to B there.
+// A is turned with the trig of T, the scalar of the world it belongs to, so the
+// sweeps of a fixed point world don't take their sin and cos from the C library.
+// ------------------------------------------------------------------------
+template<class T = float>
+inline float timeOfImpact(const ShapeTransform& a, bool circleA, const Vec2& translation, float rotation,
+	const ShapeTransform& b, bool circleB, float target, float tMax, Vec2& normal)
+{
+	const int maxIterations = 20;
+	float tolerance = 0.25f * target;
+	T angle0 = scalarAtan2(T(a.q.s), T(a.q.c));
+	// the furthest a point of A can move per unit of t from turning
+	float spin = circleA ? 0.0f : fabsf(rotation) * sqrtf(a.extentX * a.extentX + a.extentY * a.extentY);
+	ShapeTransform s = a;
+	float d = shapeDistance(s, circleA, b, circleB, normal);
+	if (d < target)
+		return 0.0f;
+	float t = 0.0f;
+	for (int it = 0; it < maxIterations; it++)
+	{
+		// fastest the gap can close along the normal
+		float closing = dot(translation, normal) + spin;
+		if (closing <= 0.0f)
+			return tMax;
+		t += (d - target) / closing;
+		if (t >= tMax)
+			return tMax;
+		s.p = a.p + t * translation;
+		if (!circleA)
+		{
+			RotT<T> q(angle0 + T(t * rotation));
+			s.q.c = toFloat(q.c);
+			s.q.s = toFloat(q.s);
+		}
+		d = shapeDistance(s, circleA, b, circleB, normal);
+		if (d < target + tolerance)
+			break;
+	}
+	return t;
+}
+
+// push a point of the given radius out of a circle or box, returns false if it
+// wasn't inside. prev is where the point was before it moved, a box is left
+// through the face the point came in through, or the face of least penetration
+// if it was already inside. Used by the particle and soft body solvers, which
+// only collide against static shapes and need no manifold.
+// ------------------------------------------------------------------------
+inline bool pushPointOut(const ShapeTransform& shape, bool circle, float radius, const Vec2& prev, Vec2& point)
+{
+	Vec2 d = point - shape.p;
+	if (circle)
+	{
+		float r = shape.extentX + radius;
+		float dist2 = lengthSquared(d);
+		if (dist2 >= r * r || dist2 == 0.0f)
+			return false;
+		point = shape.p + (r / sqrtf(dist2)) * d;
+		return true;
+	}
+	float hx = shape.extentX + radius, hy = shape.extentY + radius;
+	Vec2 local = rotateInv(shape.q, d);
+	float ox = hx - fabsf(local.x), oy = hy - fabsf(local.y);
+	if (ox <= 0.0f || oy <= 0.0f)
+		return false;
+	Vec2 before = rotateInv(shape.q, prev - shape.p);
+	bool enteredX = fabsf(before.x) >= hx, enteredY = fabsf(before.y) >= hy;
+	if (enteredX != enteredY ? enteredX : ox < oy)
+		local.x = (enteredX ? before.x : local.x) < 0.0f ? -hx : hx;
+	else
+		local.y = (enteredY ? before.y : local.y) < 0.0f ? -hy : hy;
+	point = shape.p + rotate(shape.q, local);
+	return true;
+}
+#endif
@@ -0,0 +1,292 @@
+#ifndef COLLISION_BATCH_H
+#define COLLISION_BATCH_H
+
+#include <cmath>
+#include <cstdint>
+#include <cstddef>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#include "body_store.h"
+#include "broadphase.h"
+#include "collision.h"
+
+// Batched narrowphase for the pairs that involve a circle. The caller sorts
+// candidate pairs by shape pair and passes the circle-circle and box-circle
+// ones here as lists of slots into the pair and manifold arrays. Both tests run
+// 8 pairs at a time with AVX2 when the build enables it (-mavx2, /arch:AVX2),
+// gathering straight from the body arrays and writing the finished manifold
+// into its pre-sized slot. Without AVX2, and in worlds that don't step in
+// float, the same lists run through the scalar tests in collision.h, one pair
+// at a time.
+//
+// Every written manifold has its bodies, friction and, if touching, its single
+// point filled in, the caller still matches points against the last step.
+// ------------------------------------------------------------------------
+template<class T>
+struct CollideBatchInputT
+{
+	const BodyStoreT<T>* bodies;
+	const T* speculative;       // per body reach added to the contact margin
+	const T* rotC;              // per body cos and sin of the angle, worked out once per step
+	const T* rotS;
+	T contactMargin;
+	const uint64_t* pairs;
+	ManifoldT<T>* manifolds;
+};
+
+typedef CollideBatchInputT<float> CollideBatchInput;
+
+template<class T>
+inline ShapeTransformT<T> batchShapeTransform(const CollideBatchInputT<T>& in, uint32_t i)
+{
+	const BodyStoreT<T>& bodies = *in.bodies;
+	ShapeTransformT<T> t;
+	t.p = Vec2T<T>(bodies.posX[i], bodies.posY[i]);
+	t.q.c = in.rotC[i];
+	t.q.s = in.rotS[i];
+	t.extentX = bodies.extentX[i];
+	t.extentY = bodies.extentY[i];
+	return t;
+}
+
+template<class T>
+inline void beginBatchManifold(const CollideBatchInputT<T>& in, uint32_t slot, uint32_t& a, uint32_t& b, T& margin)
+{
+	const BodyStoreT<T>& bodies = *in.bodies;
+	ManifoldT<T>& m = in.manifolds[slot];
+	a = pairKeyA(in.pairs[slot]);
+	b = pairKeyB(in.pairs[slot]);
+	m.bodyA = a;
+	m.bodyB = b;
+	m.friction = scalarSqrt(bodies.friction[a] * bodies.friction[b]);
+	margin = in.contactMargin + in.speculative[a] + in.speculative[b];
+}
+
+// one pair at a time, for builds without AVX2 and the tail of a batch
+// ------------------------------------------------------------------------
+template<class T>
+inline void collideCirclesScalar(const CollideBatchInputT<T>& in, const uint32_t* slots, size_t count)
+{
+	for (size_t k = 0; k < count; k++)
+	{
+		uint32_t a, b;
+		T margin;
+		beginBatchManifold(in, slots[k], a, b, margin);
+		collideCircles(in.manifolds[slots[k]], batchShapeTransform(in, a), batchShapeTransform(in, b), margin);
+	}
+}
+
+template<class T>
+inline void collideBoxCirclesScalar(const CollideBatchInputT<T>& in, const uint32_t* slots, size_t count)
+{
+	const BodyStoreT<T>& bodies = *in.bodies;
+	for (size_t k = 0; k < count; k++)
+	{
+		uint32_t a, b;
+		T margin;
+		beginBatchManifold(in, slots[k], a, b, margin);
+		ManifoldT<T>& m = in.manifolds[slots[k]];
+		if (bodies.shape[a] == SHAPE_BOX)
+			collideBoxCircle(m, batchShapeTransform(in, a), batchShapeTransform(in, b), margin);
+		else
+		{
+			collideBoxCircle(m, batchShapeTransform(in, b), batchShapeTransform(in, a), margin);
+			m.normal = -m.normal;
+		}
+	}
+}
+
+// a pair at a time, with AVX2 the float overloads below take over for float worlds
+// ------------------------------------------------------------------------
+template<class T>
+inline void collideCirclesBatch(const CollideBatchInputT<T>& in, const uint32_t* slots, size_t count)
+{
+	collideCirclesScalar(in, slots, count);
+}
+
+template<class T>
+inline void collideBoxCirclesBatch(const CollideBatchInputT<T>& in, const uint32_t* slots, size_t count)
+{
+	collideBoxCirclesScalar(in, slots, count);
+}
+
+#if defined(__AVX2__)
+// bodies, friction and contact margin of 8 pairs
+// ------------------------------------------------------------------------
+struct BatchPairs
+{
+	alignas(32) int32_t a[8], b[8];
+	alignas(32) float friction[8];
+	__m256i va, vb;
+	__m256 margin;
+};
+
+inline void loadBatchPairs(const CollideBatchInput& in, const uint32_t* slots, BatchPairs& p)
+{
+	const BodyStore& bodies = *in.bodies;
+	for (int l = 0; l < 8; l++)
+	{
+		uint64_t key = in.pairs[slots[l]];
+		p.a[l] = (int32_t)pairKeyA(key);
+		p.b[l] = (int32_t)pairKeyB(key);
+	}
+	p.va = _mm256_load_si256((const __m256i*)p.a);
+	p.vb = _mm256_load_si256((const __m256i*)p.b);
+	__m256 fa = _mm256_i32gather_ps(bodies.friction.data(), p.va, 4);
+	__m256 fb = _mm256_i32gather_ps(bodies.friction.data(), p.vb, 4);
+	_mm256_store_ps(p.friction, _mm256_sqrt_ps(_mm256_mul_ps(fa, fb)));
+	__m256 sa = _mm256_i32gather_ps(in.speculative, p.va, 4);
+	__m256 sb = _mm256_i32gather_ps(in.speculative, p.vb, 4);
+	p.margin = _mm256_add_ps(_mm256_set1_ps(in.contactMargin), _mm256_add_ps(sa, sb));
+}
+
+// write lane l of a finished batch into its manifold
+inline void storeBatchLane(Manifold& m, const BatchPairs& p, int l, bool hit, float nx, float ny, float px, float py, float separation, uint32_t id)
+{
+	m.bodyA = (uint32_t)p.a[l];
+	m.bodyB = (uint32_t)p.b[l];
+	m.friction = p.friction[l];
+	m.pointCount = 0;
+	if (!hit)
+		return;
+	m.normal = Vec2(nx, ny);
+	clearPoint(m.points[0], Vec2(px, py), separation, id);
+	m.pointCount = 1;
+}
+
+// circle pairs, 8 at a time
+// ------------------------------------------------------------------------
+inline void collideCirclesBatch(const CollideBatchInput& in, const uint32_t* slots, size_t count)
+{
+	const BodyStore& bodies = *in.bodies;
+	const __m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.0f), half = _mm256_set1_ps(0.5f);
+	const __m256 tiny = _mm256_set1_ps(1e-6f);
+	BatchPairs p;
+	alignas(32) float nx[8], ny[8], px[8], py[8], sep[8];
+	size_t k = 0;
+	for (; k + 8 <= count; k += 8)
+	{
+		loadBatchPairs(in, slots + k, p);
+		__m256 ax = _mm256_i32gather_ps(bodies.posX.data(), p.va, 4);
+		__m256 ay = _mm256_i32gather_ps(bodies.posY.data(), p.va, 4);
+		__m256 ar = _mm256_i32gather_ps(bodies.extentX.data(), p.va, 4);
+		__m256 bx = _mm256_i32gather_ps(bodies.posX.data(), p.vb, 4);
+		__m256 by = _mm256_i32gather_ps(bodies.posY.data(), p.vb, 4);
+		__m256 br = _mm256_i32gather_ps(bodies.extentX.data(), p.vb, 4);
+
+		__m256 dx = _mm256_sub_ps(bx, ax), dy = _mm256_sub_ps(by, ay);
+		__m256 dist2 = _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy));
+		__m256 radius = _mm256_add_ps(ar, br);
+		__m256 reach = _mm256_add_ps(radius, p.margin);
+		int hit = _mm256_movemask_ps(_mm256_cmp_ps(dist2, _mm256_mul_ps(reach, reach), _CMP_LE_OQ));
+		if (hit)
+		{
+			__m256 dist = _mm256_sqrt_ps(dist2);
+			__m256 apart = _mm256_cmp_ps(dist, tiny, _CMP_GT_OQ);
+			__m256 inv = _mm256_div_ps(one, dist);
+			// coincident centres push along +y, like the scalar test
+			__m256 vnx = _mm256_blendv_ps(zero, _mm256_mul_ps(inv, dx), apart);
+			__m256 vny = _mm256_blendv_ps(one, _mm256_mul_ps(inv, dy), apart);
+			__m256 vsep = _mm256_sub_ps(dist, radius);
+			__m256 offset = _mm256_add_ps(ar, _mm256_mul_ps(half, vsep));
+			_mm256_store_ps(nx, vnx);
+			_mm256_store_ps(ny, vny);
+			_mm256_store_ps(px, _mm256_add_ps(ax, _mm256_mul_ps(offset, vnx)));
+			_mm256_store_ps(py, _mm256_add_ps(ay, _mm256_mul_ps(offset, vny)));
+			_mm256_store_ps(sep, vsep);
+		}
+		for (int l = 0; l < 8; l++)
+			storeBatchLane(in.manifolds[slots[k + l]], p, l, (hit >> l) & 1, nx[l], ny[l], px[l], py[l], sep[l], 0);
+	}
+	collideCirclesScalar(in, slots + k, count - k);
+}
+
+// box-circle pairs in either order, 8 at a time
+// ------------------------------------------------------------------------
+inline void collideBoxCirclesBatch(const CollideBatchInput& in, const uint32_t* slots, size_t count)
+{
+	const BodyStore& bodies = *in.bodies;
+	const __m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.0f), half = _mm256_set1_ps(0.5f);
+	const __m256 signBit = _mm256_set1_ps(-0.0f);
+	BatchPairs p;
+	alignas(32) float flip[8];
+	alignas(32) float nx[8], ny[8], px[8], py[8], sep[8];
+	alignas(32) int32_t id[8];
+	size_t k = 0;
+	for (; k + 8 <= count; k += 8)
+	{
+		loadBatchPairs(in, slots + k, p);
+		for (int l = 0; l < 8; l++)
+			flip[l] = bodies.shape[p.a[l]] == SHAPE_BOX ? 1.0f : -1.0f;
+		__m256 f = _mm256_load_ps(flip);
+		__m256 boxFirst = _mm256_cmp_ps(f, zero, _CMP_GT_OQ);
+		__m256i vbox = _mm256_castps_si256(_mm256_blendv_ps(_mm256_castsi256_ps(p.vb), _mm256_castsi256_ps(p.va), boxFirst));
+		__m256i vcircle = _mm256_castps_si256(_mm256_blendv_ps(_mm256_castsi256_ps(p.va), _mm256_castsi256_ps(p.vb), boxFirst));
+		__m256 bx = _mm256_i32gather_ps(bodies.posX.data(), vbox, 4);
+		__m256 by = _mm256_i32gather_ps(bodies.posY.data(), vbox, 4);
+		__m256 hx = _mm256_i32gather_ps(bodies.extentX.data(), vbox, 4);
+		__m256 hy = _mm256_i32gather_ps(bodies.extentY.data(), vbox, 4);
+		__m256 c = _mm256_i32gather_ps(in.rotC, vbox, 4);
+		__m256 s = _mm256_i32gather_ps(in.rotS, vbox, 4);
+		__m256 cx = _mm256_i32gather_ps(bodies.posX.data(), vcircle, 4);
+		__m256 cy = _mm256_i32gather_ps(bodies.posY.data(), vcircle, 4);
+		__m256 r = _mm256_i32gather_ps(bodies.extentX.data(), vcircle, 4);
+
+		// circle centre in the box frame
+		__m256 dx = _mm256_sub_ps(cx, bx), dy = _mm256_sub_ps(cy, by);
+		__m256 lx = _mm256_add_ps(_mm256_mul_ps(c, dx), _mm256_mul_ps(s, dy));
+		__m256 ly = _mm256_sub_ps(_mm256_mul_ps(c, dy), _mm256_mul_ps(s, dx));
+		__m256 absX = _mm256_andnot_ps(signBit, lx), absY = _mm256_andnot_ps(signBit, ly);
+		__m256 inside = _mm256_and_ps(_mm256_cmp_ps(absX, hx, _CMP_LE_OQ), _mm256_cmp_ps(absY, hy, _CMP_LE_OQ));
+
+		// centre inside, push out through the nearest face
+		__m256 sx = _mm256_sub_ps(absX, hx), sy = _mm256_sub_ps(absY, hy);
+		__m256 useX = _mm256_cmp_ps(sx, sy, _CMP_GT_OQ);
+		__m256 negX = _mm256_cmp_ps(lx, zero, _CMP_LT_OQ), negY = _mm256_cmp_ps(ly, zero, _CMP_LT_OQ);
+		__m256 signX = _mm256_or_ps(one, _mm256_and_ps(negX, signBit));
+		__m256 signY = _mm256_or_ps(one, _mm256_and_ps(negY, signBit));
+		__m256 inNx = _mm256_and_ps(useX, signX);
+		__m256 inNy = _mm256_andnot_ps(useX, signY);
+		__m256 inSep = _mm256_sub_ps(_mm256_blendv_ps(sy, sx, useX), r);
+		__m256i inId = _mm256_castps_si256(_mm256_blendv_ps(
+			_mm256_blendv_ps(_mm256_castsi256_ps(_mm256_set1_epi32(1)), _mm256_castsi256_ps(_mm256_set1_epi32(3)), negY),
+			_mm256_blendv_ps(_mm256_castsi256_ps(_mm256_set1_epi32(0)), _mm256_castsi256_ps(_mm256_set1_epi32(2)), negX),
+			useX));
+
+		// centre outside, closest point on the box
+		__m256 ox = _mm256_sub_ps(lx, _mm256_max_ps(_mm256_sub_ps(zero, hx), _mm256_min_ps(hx, lx)));
+		__m256 oy = _mm256_sub_ps(ly, _mm256_max_ps(_mm256_sub_ps(zero, hy), _mm256_min_ps(hy, ly)));
+		__m256 dist2 = _mm256_add_ps(_mm256_mul_ps(ox, ox), _mm256_mul_ps(oy, oy));
+		__m256 reach = _mm256_add_ps(r, p.margin);
+		__m256 near = _mm256_cmp_ps(dist2, _mm256_mul_ps(reach, reach), _CMP_LE_OQ);
+		__m256 dist = _mm256_sqrt_ps(dist2);
+		__m256 inv = _mm256_div_ps(one, _mm256_max_ps(dist, _mm256_set1_ps(1e-30f)));
+
+		int hit = _mm256_movemask_ps(_mm256_or_ps(inside, near));
+		if (hit)
+		{
+			__m256 nlx = _mm256_blendv_ps(_mm256_mul_ps(inv, ox), inNx, inside);
+			__m256 nly = _mm256_blendv_ps(_mm256_mul_ps(inv, oy), inNy, inside);
+			__m256 vsep = _mm256_blendv_ps(_mm256_sub_ps(dist, r), inSep, inside);
+			// back to world space, the point sits midway between the surfaces
+			__m256 wx = _mm256_sub_ps(_mm256_mul_ps(c, nlx), _mm256_mul_ps(s, nly));
+			__m256 wy = _mm256_add_ps(_mm256_mul_ps(s, nlx), _mm256_mul_ps(c, nly));
+			__m256 offset = _mm256_add_ps(r, _mm256_mul_ps(half, vsep));
+			_mm256_store_ps(px, _mm256_sub_ps(cx, _mm256_mul_ps(offset, wx)));
+			_mm256_store_ps(py, _mm256_sub_ps(cy, _mm256_mul_ps(offset, wy)));
+			_mm256_store_ps(nx, _mm256_mul_ps(f, wx));
+			_mm256_store_ps(ny, _mm256_mul_ps(f, wy));
+			_mm256_store_ps(sep, vsep);
+			_mm256_store_si256((__m256i*)id, _mm256_castps_si256(_mm256_blendv_ps(
+				_mm256_castsi256_ps(_mm256_set1_epi32(4)), _mm256_castsi256_ps(inId), inside)));
+		}
+		for (int l = 0; l < 8; l++)
+			storeBatchLane(in.manifolds[slots[k + l]], p, l, (hit >> l) & 1, nx[l], ny[l], px[l], py[l], sep[l], (uint32_t)id[l]);
+	}
+	collideBoxCirclesScalar(in, slots + k, count - k);
+}
+#endif
+#endif
@@ -0,0 +1,148 @@
+#ifndef CONTACT_SOLVER_H
+#define CONTACT_SOLVER_H
+
+#include <cmath>
+
+#include "vec2.h"
+#include "collision.h"
+
+// solver tuning shared by every island
+// ------------------------------------------------------------------------
+struct SolverSettings
+{
+	int velocityIterations = 8;
+	float baumgarte = 0.2f;      // fraction of the penetration removed per step
+	float linearSlop = 0.005f;   // penetration allowed before correcting
+	float contactMargin = 0.02f; // gap up to which contacts are kept, see collision.h
+	bool warmStarting = true;
+};
+
+// velocity state of one island body, gathered into a contiguous array so the
+// iterations don't touch the body store. Static bodies share a zero entry.
+// ------------------------------------------------------------------------
+template<class T>
+struct SolverBodyT
+{
+	Vec2T<T> v;
+	T w;
+	T invMass, invInertia;
+};
+
+typedef SolverBodyT<float> SolverBody;
+
+// compute anchors, effective masses and position bias for a manifold
+// ------------------------------------------------------------------------
+template<class T>
+inline void prepareContact(ManifoldT<T>& m, const Vec2T<T>& posA, const Vec2T<T>& posB, const SolverBodyT<T>& a, const SolverBodyT<T>& b,
+	T invDt, const SolverSettings& settings)
+{
+	Vec2T<T> n = m.normal;
+	Vec2T<T> t = cross(n, 1.0f);
+	for (int k = 0; k < m.pointCount; k++)
+	{
+		ContactPointT<T>& cp = m.points[k];
+		cp.rA = cp.point - posA;
+		cp.rB = cp.point - posB;
+		T rnA = cross(cp.rA, n), rnB = cross(cp.rB, n);
+		T kNormal = a.invMass + b.invMass + a.invInertia * rnA * rnA + b.invInertia * rnB * rnB;
+		cp.normalMass = kNormal > 0.0f ? 1.0f / kNormal : 0.0f;
+		T rtA = cross(cp.rA, t), rtB = cross(cp.rB, t);
+		T kTangent = a.invMass + b.invMass + a.invInertia * rtA * rtA + b.invInertia * rtB * rtB;
+		cp.tangentMass = kTangent > 0.0f ? 1.0f / kTangent : 0.0f;
+		// a positive separation is a speculative contact, it only stops the bodies
+		// from closing the remaining gap within this step
+		if (cp.separation > 0.0f)
+			cp.bias = -cp.separation * invDt;
+		else
+			cp.bias = -settings.baumgarte * invDt * scalarMin(T(0.0f), cp.separation + settings.linearSlop);
+		if (!settings.warmStarting)
+		{
+			cp.normalImpulse = 0.0f;
+			cp.tangentImpulse = 0.0f;
+		}
+	}
+}
+
+// apply last step's accumulated impulses
+// ------------------------------------------------------------------------
+template<class T>
+inline void warmStartContact(const ManifoldT<T>& m, SolverBodyT<T>& a, SolverBodyT<T>& b)
+{
+	Vec2T<T> t = cross(m.normal, 1.0f);
+	for (int k = 0; k < m.pointCount; k++)
+	{
+		const ContactPointT<T>& cp = m.points[k];
+		Vec2T<T> P = cp.normalImpulse * m.normal + cp.tangentImpulse * t;
+		a.v -= a.invMass * P;
+		a.w -= a.invInertia * cross(cp.rA, P);
+		b.v += b.invMass * P;
+		b.w += b.invInertia * cross(cp.rB, P);
+	}
+}
+
+// one sequential impulse iteration over a manifold, friction first then the
+// non-penetration constraint
+// ------------------------------------------------------------------------
+template<class T>
+inline void solveContact(ManifoldT<T>& m, SolverBodyT<T>& a, SolverBodyT<T>& b)
+{
+	Vec2T<T> n = m.normal;
+	Vec2T<T> t = cross(n, 1.0f);
+	for (int k = 0; k < m.pointCount; k++)
+	{
+		ContactPointT<T>& cp = m.points[k];
+		Vec2T<T> dv = b.v + cross(b.w, cp.rB) - a.v - cross(a.w, cp.rA);
+
+		T maxFriction = m.friction * cp.normalImpulse;
+		T lambda = -cp.tangentMass * dot(dv, t);
+		T newImpulse = scalarMax(-maxFriction, scalarMin(maxFriction, cp.tangentImpulse + lambda));
+		lambda = newImpulse - cp.tangentImpulse;
+		cp.tangentImpulse = newImpulse;
+		Vec2T<T> P = lambda * t;
+		a.v -= a.invMass * P;
+		a.w -= a.invInertia * cross(cp.rA, P);
+		b.v += b.invMass * P;
+		b.w += b.invInertia * cross(cp.rB, P);
+	}
+	for (int k = 0; k < m.pointCount; k++)
+	{
+		ContactPointT<T>& cp = m.points[k];
+		Vec2T<T> dv = b.v + cross(b.w, cp.rB) - a.v - cross(a.w, cp.rA);
+
+		T lambda = -cp.normalMass * (dot(dv, n) - cp.bias);
+		T newImpulse = scalarMax(cp.normalImpulse + lambda, T(0.0f));
+		lambda = newImpulse - cp.normalImpulse;
+		cp.normalImpulse = newImpulse;
+		Vec2T<T> P = lambda * n;
+		a.v -= a.invMass * P;
+		a.w -= a.invInertia * cross(cp.rA, P);
+		b.v += b.invMass * P;
+		b.w += b.invInertia * cross(cp.rB, P);
+	}
+}
+
+// the functions above as the contact solver of a world configuration (see
+// DefaultWorldConfig in physics_world.h). Another solver is any type with the
+// same three static functions, they are called directly and inline with the
+// scalar type of the world.
+// ------------------------------------------------------------------------
+struct SequentialImpulseSolver
+{
+	template<class T>
+	static void prepare(ManifoldT<T>& m, const Vec2T<T>& posA, const Vec2T<T>& posB, const SolverBodyT<T>& a, const SolverBodyT<T>& b,
+		T invDt, const SolverSettings& settings)
+	{
+		prepareContact(m, posA, posB, a, b, invDt, settings);
+	}
+	template<class T>
+	static void warmStart(const ManifoldT<T>& m, SolverBodyT<T>& a, SolverBodyT<T>& b)
+	{
+		warmStartContact(m, a, b);
+	}
+	template<class T>
+	static void solve(ManifoldT<T>& m, SolverBodyT<T>& a, SolverBodyT<T>& b)
+	{
+		solveContact(m, a, b);
+	}
+};
+#endif
@@ -0,0 +1,234 @@
+#ifndef DEBUG_DRAW_H
+#define DEBUG_DRAW_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "camera.h"
+#include "shader.h"
+#include "physics_world.h"
+
+// what DebugRenderer::addWorld collects, toggled one by one from processInput
+enum DebugDrawFlags
+{
+	DEBUG_DRAW_AABBS = 1 << 0,    // broadphase AABBs of the last step
+	DEBUG_DRAW_CONTACTS = 1 << 1, // contact points, with the level too
+	DEBUG_DRAW_NORMALS = 1 << 2,  // contact normals, scaled by the normal impulse
+	DEBUG_DRAW_JOINTS = 1 << 3,   // body centres to anchors, and anchor to anchor
+	DEBUG_DRAW_LEVEL = 1 << 4     // level segments
+};
+
+// world space lines, points and polygons batched into one streaming vertex
+// buffer and drawn with a single GL_LINES call per frame, however many
+// primitives were added. Points are small crosses and polygons their outlines,
+// so everything is a line. addWorld finds AABBs, contacts and level segments
+// through the broadphase and the level's own queries over the view, so a scene
+// with tens of thousands of contacts costs what is on screen. Joints have no
+// spatial index and are each tested against the view.
+// ------------------------------------------------------------------------
+class DebugRenderer
+{
+public:
+	struct Vertex
+	{
+		float x, y;
+		uint32_t color; // 0xAABBGGRR
+	};
+
+	Shader shader;
+	int flags = 0;
+
+	DebugRenderer() : shader("debugVertexShader.txt", "overlayFragmentShader.txt")
+	{
+		glGenVertexArrays(1, &VAO);
+		glGenBuffers(1, &VBO);
+		glBindVertexArray(VAO);
+		glBindBuffer(GL_ARRAY_BUFFER, VBO);
+		glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, x));
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(1, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Vertex), (void*)offsetof(Vertex, color));
+		glEnableVertexAttribArray(1);
+		glBindVertexArray(0);
+	}
+
+	// release the GL objects, must be called while the context is still current
+	// ------------------------------------------------------------------------
+	void destroy()
+	{
+		glDeleteVertexArrays(1, &VAO);
+		glDeleteBuffers(1, &VBO);
+		glDeleteProgram(shader.ID);
+	}
+	// ------------------------------------------------------------------------
+	void line(float x0, float y0, float x1, float y1, uint32_t color)
+	{
+		vertices.push_back({ x0, y0, color });
+		vertices.push_back({ x1, y1, color });
+	}
+	// a cross of halfSize world units on each side of the point
+	// ------------------------------------------------------------------------
+	void point(float x, float y, float halfSize, uint32_t color)
+	{
+		line(x - halfSize, y, x + halfSize, y, color);
+		line(x, y - halfSize, x, y + halfSize, color);
+	}
+	// outline through count points, closed back to the first
+	// ------------------------------------------------------------------------
+	void polygon(const Vec2* points, size_t count, uint32_t color)
+	{
+		for (size_t k = 0, j = count - 1; k < count; j = k++)
+			line(points[j].x, points[j].y, points[k].x, points[k].y, color);
+	}
+	// ------------------------------------------------------------------------
+	void box(float minX, float minY, float maxX, float maxY, uint32_t color)
+	{
+		Vec2 corners[4] = { Vec2(minX, minY), Vec2(maxX, minY), Vec2(maxX, maxY), Vec2(minX, maxY) };
+		polygon(corners, 4, color);
+	}
+
+	// add the categories in flags for everything the camera sees, from the state
+	// the world was left in by its last step. Any world configuration, its
+	// bodies and contacts are drawn from float copies.
+	// ------------------------------------------------------------------------
+	template<class World>
+	void addWorld(const World& world, const Camera2D& camera, int screenHeight)
+	{
+		typedef typename World::Manifold Manifold;
+		if (flags == 0)
+			return;
+		const uint32_t aabbAwake = 0xff60d060, aabbAsleep = 0xff707070, contact = 0xff4040ff, normal = 0xff40e0ff;
+		const uint32_t joint = 0xffe0c040, level = 0xffd0d0d0;
+		const typename World::BodyStore& bodies = world.bodies;
+		const typename World::Broadphase& broadphase = world.broadphase;
+		float minX, minY, maxX, maxY;
+		camera.bounds(minX, minY, maxX, maxY);
+		// three pixels either side, whatever the zoom
+		float pointSize = 3.0f / camera.pixelsPerUnit(screenHeight > 0 ? screenHeight : 1);
+		auto inView = [&](const Vec2& p) {
+			return p.x >= minX && p.x <= maxX && p.y >= minY && p.y <= maxY;
+		};
+
+		if (flags & DEBUG_DRAW_AABBS)
+		{
+			size_t indexed = std::min(broadphase.minX.size(), bodies.size());
+			world.queryAABB(minX, minY, maxX, maxY, [&](uint32_t i) {
+				if (i < indexed)
+					box(broadphase.minX[i], broadphase.minY[i], broadphase.maxX[i], broadphase.maxY[i],
+						bodies.awake[i] ? aabbAwake : aabbAsleep);
+			});
+		}
+		if (flags & (DEBUG_DRAW_CONTACTS | DEBUG_DRAW_NORMALS))
+		{
+			// normals grow with the normal impulse, up to sixty pixels
+			float normalLength = 20.0f * pointSize;
+			auto addManifold = [&](const Manifold& m) {
+				for (int k = 0; k < m.pointCount; k++)
+				{
+					Vec2 p(toFloat(m.points[k].point.x), toFloat(m.points[k].point.y));
+					if (!inView(p))
+						continue;
+					if (flags & DEBUG_DRAW_CONTACTS)
+						point(p.x, p.y, pointSize, contact);
+					if (flags & DEBUG_DRAW_NORMALS)
+					{
+						// at least a point's length so resting contacts still show which way they push
+						float l = fmaxf(pointSize, fminf(normalLength, normalLength * toFloat(m.points[k].normalImpulse)));
+						Vec2 end = p + l * Vec2(toFloat(m.normal.x), toFloat(m.normal.y));
+						line(p.x, p.y, end.x, end.y, normal);
+					}
+				}
+			};
+			// a contact point lies inside the broadphase AABBs of both its bodies,
+			// so every point in view belongs to a manifold whose body A is in view.
+			// Manifolds are sorted by body A and level manifolds by their body, so
+			// each body found has its contacts in one run.
+			const std::vector<Manifold>& manifolds = world.manifolds;
+			const std::vector<Manifold>& levelManifolds = world.levelManifolds;
+			world.queryAABB(minX, minY, maxX, maxY, [&](uint32_t i) {
+				auto m = std::lower_bound(manifolds.begin(), manifolds.end(), i, [](const Manifold& p, uint32_t b) {
+					return p.bodyA < b;
+				});
+				for (; m != manifolds.end() && m->bodyA == i; ++m)
+					addManifold(*m);
+				auto l = std::lower_bound(levelManifolds.begin(), levelManifolds.end(), i, [](const Manifold& p, uint32_t b) {
+					return p.bodyB < b;
+				});
+				for (; l != levelManifolds.end() && l->bodyB == i; ++l)
+					addManifold(*l);
+			});
+		}
+		if (flags & DEBUG_DRAW_JOINTS)
+		{
+			const typename World::JointStore& joints = world.joints;
+			for (size_t j = 0; j < joints.size(); j++)
+			{
+				if (!joints.alive[j])
+					continue;
+				uint32_t a = joints.bodyA[j], b = joints.bodyB[j];
+				Vec2 pA(toFloat(bodies.posX[a]), toFloat(bodies.posY[a]));
+				Vec2 pB(toFloat(bodies.posX[b]), toFloat(bodies.posY[b]));
+				// the motor joint's anchor A is its target, draw it centre to centre
+				Vec2 anchorA = pA, anchorB = pB;
+				if (joints.type[j] != JOINT_MOTOR)
+				{
+					anchorA = pA + rotate(Rot(toFloat(bodies.angle[a])),
+						Vec2(toFloat(joints.localAnchorAX[j]), toFloat(joints.localAnchorAY[j])));
+					anchorB = pB + rotate(Rot(toFloat(bodies.angle[b])),
+						Vec2(toFloat(joints.localAnchorBX[j]), toFloat(joints.localAnchorBY[j])));
+				}
+				if (!inView(pA) && !inView(pB) && !inView(anchorA) && !inView(anchorB))
+					continue;
+				line(pA.x, pA.y, anchorA.x, anchorA.y, joint);
+				line(anchorA.x, anchorA.y, anchorB.x, anchorB.y, joint);
+				line(anchorB.x, anchorB.y, pB.x, pB.y, joint);
+				point(anchorA.x, anchorA.y, pointSize, joint);
+			}
+		}
+		if (flags & DEBUG_DRAW_LEVEL)
+		{
+			world.level().forEachSegment(minX, minY, maxX, maxY, [&](uint32_t, const Vec2& a, const Vec2& b) {
+				line(a.x, a.y, b.x, b.y, level);
+			});
+		}
+	}
+
+	// upload everything added since the last flush and draw it in one call
+	// ------------------------------------------------------------------------
+	void flush(const Camera2D& camera)
+	{
+		lastVertexCount = vertices.size();
+		if (!vertices.empty())
+		{
+			float viewProjection[9];
+			camera.viewProjection(viewProjection);
+			shader.use();
+			shader.setMat3("viewProjection", viewProjection);
+			glBindVertexArray(VAO);
+			glBindBuffer(GL_ARRAY_BUFFER, VBO);
+			// orphan the old storage so the driver doesn't stall on last frame's draw
+			glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), NULL, GL_STREAM_DRAW);
+			glBufferSubData(GL_ARRAY_BUFFER, 0, vertices.size() * sizeof(Vertex), vertices.data());
+			glDrawArrays(GL_LINES, 0, (GLsizei)vertices.size());
+			glBindVertexArray(0);
+		}
+		vertices.clear();
+	}
+
+	// line vertices drawn by the last flush
+	// ------------------------------------------------------------------------
+	size_t vertexCount() const
+	{
+		return lastVertexCount;
+	}
+
+private:
+	unsigned int VAO, VBO;
+	std::vector<Vertex> vertices;
+	size_t lastVertexCount = 0;
+};
+#endif
@@ -0,0 +1,117 @@
+#ifndef GPU_TIMER_H
+#define GPU_TIMER_H
+
+#include <glad/glad.h>
+
+#include <cstdint>
+
+// render passes timed on the GPU, in the order they are issued each frame
+enum GpuPass
+{
+	GPU_PASS_CLEAR = 0,
+	GPU_PASS_BODIES,
+	GPU_PASS_SOFT_BODIES,
+	GPU_PASS_PARTICLES,
+	GPU_PASS_DEBUG,
+	GPU_PASS_OVERLAY,
+	GPU_PASS_COUNT
+};
+
+inline const char* gpuPassName(int pass)
+{
+	static const char* names[GPU_PASS_COUNT] = { "clear", "bodies", "soft", "particles", "debug", "overlay" };
+	return pass >= 0 && pass < GPU_PASS_COUNT ? names[pass] : "unknown";
+}
+
+// GPU time of each pass for the most recent frame whose results have arrived
+// ------------------------------------------------------------------------
+struct GpuFrameStats
+{
+	uint64_t passNs[GPU_PASS_COUNT] = {};
+	uint64_t totalNs = 0;
+	int latencyFrames = 0; // how many frames old these results are
+};
+
+// GL_TIME_ELAPSED queries around each pass, kept in a ring of several frames so
+// results are read back a few frames late instead of stalling the pipeline
+// waiting for the GPU to catch up. TIME_ELAPSED queries can't nest, so passes
+// have to be issued one after another.
+// ------------------------------------------------------------------------
+class GpuTimer
+{
+public:
+	static const int RING_FRAMES = 4;
+
+	GpuFrameStats stats;
+
+	GpuTimer()
+	{
+		glGenQueries(RING_FRAMES * GPU_PASS_COUNT, &queries[0][0]);
+	}
+
+	// release the GL objects, must be called while the context is still current
+	// ------------------------------------------------------------------------
+	void destroy()
+	{
+		glDeleteQueries(RING_FRAMES * GPU_PASS_COUNT, &queries[0][0]);
+	}
+
+	// collect whatever finished frames are ready and start recording a new one
+	// ------------------------------------------------------------------------
+	void beginFrame()
+	{
+		frame++;
+		int slot = (int)(frame % RING_FRAMES);
+		// this slot was last used RING_FRAMES frames ago, read it if the GPU has
+		// finished with it, otherwise drop it rather than wait
+		if (slotFrame[slot] != 0)
+		{
+			bool ready = true;
+			for (int p = 0; p < GPU_PASS_COUNT && ready; p++)
+			{
+				if (!issued[slot][p])
+					continue;
+				GLint available = 0;
+				glGetQueryObjectiv(queries[slot][p], GL_QUERY_RESULT_AVAILABLE, &available);
+				ready = available != 0;
+			}
+			if (ready)
+			{
+				GpuFrameStats result;
+				for (int p = 0; p < GPU_PASS_COUNT; p++)
+				{
+					if (!issued[slot][p])
+						continue;
+					GLuint64 ns = 0;
+					glGetQueryObjectui64v(queries[slot][p], GL_QUERY_RESULT, &ns);
+					result.passNs[p] = ns;
+					result.totalNs += ns;
+				}
+				result.latencyFrames = (int)(frame - slotFrame[slot]);
+				stats = result;
+			}
+		}
+		slotFrame[slot] = frame;
+		for (int p = 0; p < GPU_PASS_COUNT; p++)
+			issued[slot][p] = false;
+	}
+	// ------------------------------------------------------------------------
+	void begin(GpuPass pass)
+	{
+		int slot = (int)(frame % RING_FRAMES);
+		glBeginQuery(GL_TIME_ELAPSED, queries[slot][pass]);
+		issued[slot][pass] = true;
+	}
+	// ------------------------------------------------------------------------
+	void end()
+	{
+		glEndQuery(GL_TIME_ELAPSED);
+	}
+
+private:
+	unsigned int queries[RING_FRAMES][GPU_PASS_COUNT];
+	bool issued[RING_FRAMES][GPU_PASS_COUNT] = {};
+	uint64_t slotFrame[RING_FRAMES] = {};
+	uint64_t frame = 0;
+};
+#endif
@@ -0,0 +1,136 @@
+#ifndef JOB_SYSTEM_H
+#define JOB_SYSTEM_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "profiler.h"
+
+// fixed pool of worker threads running parallel-for loops
+// the calling thread takes part as thread 0, so a pool of 1 runs everything inline
+// ------------------------------------------------------------------------
+class JobSystem
+{
+public:
+	typedef std::function<void(size_t begin, size_t end, int threadIndex)> RangeFn;
+
+	explicit JobSystem(int threadCount = 1)
+	{
+		count = threadCount < 1 ? 1 : threadCount;
+		for (int t = 1; t < count; t++)
+			workers.emplace_back(&JobSystem::workerLoop, this, t);
+	}
+
+	~JobSystem()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			quit = true;
+			generation++;
+		}
+		wake.notify_all();
+		for (std::thread& w : workers)
+			w.join();
+	}
+
+	JobSystem(const JobSystem&) = delete;
+	JobSystem& operator=(const JobSystem&) = delete;
+
+	int threadCount() const { return count; }
+
+	// split [0, itemCount) into chunks of at most grain items and run fn on
+	// each chunk, returns once every chunk has finished
+	// ------------------------------------------------------------------------
+	void parallelFor(size_t itemCount, size_t grain, const RangeFn& fn)
+	{
+		if (grain == 0)
+			grain = 1;
+		if (count == 1 || itemCount <= grain)
+		{
+			if (itemCount > 0)
+				fn(0, itemCount, 0);
+			return;
+		}
+		task = &fn;
+		taskItems = itemCount;
+		taskGrain = grain;
+		nextChunk.store(0, std::memory_order_relaxed);
+		busyWorkers.store(count - 1, std::memory_order_relaxed);
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			generation++;
+		}
+		wake.notify_all();
+
+		runChunks(0);
+
+		std::unique_lock<std::mutex> lock(mutex);
+		done.wait(lock, [this] { return busyWorkers.load(std::memory_order_acquire) == 0; });
+		task = nullptr;
+	}
+
+	// convenience overload picking a grain that gives each thread a few chunks
+	// ------------------------------------------------------------------------
+	void parallelFor(size_t itemCount, const RangeFn& fn)
+	{
+		size_t grain = itemCount / (size_t)(count * 4) + 1;
+		if (grain < 64)
+			grain = 64;
+		parallelFor(itemCount, grain, fn);
+	}
+
+private:
+	int count;
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable done;
+	unsigned long long generation = 0;
+	bool quit = false;
+
+	const RangeFn* task = nullptr;
+	size_t taskItems = 0;
+	size_t taskGrain = 1;
+	std::atomic<size_t> nextChunk{0};
+	std::atomic<int> busyWorkers{0};
+
+	void runChunks(int threadIndex)
+	{
+		for (;;)
+		{
+			size_t begin = nextChunk.fetch_add(taskGrain, std::memory_order_relaxed);
+			if (begin >= taskItems)
+				break;
+			size_t end = begin + taskGrain < taskItems ? begin + taskGrain : taskItems;
+			PROFILE_ZONE("job");
+			(*task)(begin, end, threadIndex);
+		}
+	}
+
+	void workerLoop(int threadIndex)
+	{
+		unsigned long long seen = 0;
+		for (;;)
+		{
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				wake.wait(lock, [&] { return generation != seen; });
+				seen = generation;
+				if (quit)
+					return;
+			}
+			runChunks(threadIndex);
+			if (busyWorkers.fetch_sub(1, std::memory_order_acq_rel) == 1)
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				done.notify_one();
+			}
+		}
+	}
+};
+#endif
@@ -0,0 +1,192 @@
+#ifndef JOINT_H
+#define JOINT_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+#include "vec2.h"
+
+enum JointType : uint8_t
+{
+	JOINT_REVOLUTE = 0,  // pin, the bodies turn freely about a shared anchor
+	JOINT_PRISMATIC,     // slider, B moves along an axis fixed in A and can't turn relative to it
+	JOINT_DISTANCE,      // rod, or spring when hertz is set, between two anchors
+	JOINT_WELD,          // holds the bodies in their relative pose
+	JOINT_MOTOR,         // drives B towards a pose relative to A with limited force and torque
+	JOINT_TYPE_COUNT
+};
+
+// description of a single joint. Anchors and axis are given in world space and
+// stored relative to the bodies when the joint is created, so the bodies have to
+// be in their assembled pose by then. Revolute, prismatic and weld joints only
+// use anchorA, the motor joint takes the relative pose at creation as its target.
+// ------------------------------------------------------------------------
+struct JointDef
+{
+	JointType type = JOINT_REVOLUTE;
+	uint32_t bodyA = 0, bodyB = 0;
+	Vec2 anchorA, anchorB;
+	Vec2 axis = Vec2(1.0f, 0.0f);     // prismatic slide direction
+	float length = -1.0f;             // distance rest length, negative keeps the current anchor distance
+	float hertz = 0.0f;               // distance spring frequency, zero is a rigid rod
+	float dampingRatio = 0.0f;
+	bool enableLimit = false;
+	float lower = 0.0f, upper = 0.0f; // angle for revolute, translation for prismatic
+	bool enableMotor = false;
+	float motorSpeed = 0.0f;          // rad/s for revolute, m/s for prismatic
+	float maxMotorForce = 0.0f;       // torque for revolute, force for prismatic
+	float maxForce = 1000.0f;         // motor joint
+	float maxTorque = 1000.0f;        // motor joint
+	float correctionFactor = 0.3f;    // motor joint, fraction of the pose error removed per step
+	bool collideConnected = false;    // let the two bodies still touch each other
+};
+
+// structure-of-arrays pool of joints, indexed by joint id. Destroyed slots go on
+// a free list and are handed out again, so ids of live joints never move. T is
+// the scalar the world steps in, JointStore the float pool.
+// ------------------------------------------------------------------------
+template<class T>
+struct JointStoreT
+{
+	std::vector<uint8_t> type;
+	std::vector<uint8_t> alive;
+	std::vector<uint8_t> enableLimit, enableMotor, collideConnected;
+	std::vector<uint32_t> bodyA, bodyB;
+	std::vector<T> localAnchorAX, localAnchorAY; // motor joint: target offset of B in A's frame
+	std::vector<T> localAnchorBX, localAnchorBY;
+	std::vector<T> localAxisX, localAxisY;
+	std::vector<T> referenceAngle;               // motor joint: target angle of B relative to A
+	std::vector<T> length, hertz, dampingRatio;
+	std::vector<T> lower, upper;
+	std::vector<T> motorSpeed, maxMotorForce;
+	std::vector<T> maxForce, maxTorque, correctionFactor;
+	// accumulated impulses, kept between steps for warm starting
+	std::vector<T> impulseX, impulseY, impulseZ;
+	std::vector<T> motorImpulse, lowerImpulse, upperImpulse;
+	std::vector<uint32_t> freeList;
+	size_t liveCount = 0;
+
+	// number of slots, live or free
+	size_t size() const { return type.size(); }
+
+	void resize(size_t n)
+	{
+		type.resize(n); alive.resize(n);
+		enableLimit.resize(n); enableMotor.resize(n); collideConnected.resize(n);
+		bodyA.resize(n); bodyB.resize(n);
+		localAnchorAX.resize(n); localAnchorAY.resize(n);
+		localAnchorBX.resize(n); localAnchorBY.resize(n);
+		localAxisX.resize(n); localAxisY.resize(n);
+		referenceAngle.resize(n);
+		length.resize(n); hertz.resize(n); dampingRatio.resize(n);
+		lower.resize(n); upper.resize(n);
+		motorSpeed.resize(n); maxMotorForce.resize(n);
+		maxForce.resize(n); maxTorque.resize(n); correctionFactor.resize(n);
+		impulseX.resize(n); impulseY.resize(n); impulseZ.resize(n);
+		motorImpulse.resize(n); lowerImpulse.resize(n); upperImpulse.resize(n);
+	}
+
+	// call fn on every per-joint array, for code that moves whole joints around
+	template<class Fn>
+	void forEachField(Fn&& fn)
+	{
+		fn(type); fn(alive);
+		fn(enableLimit); fn(enableMotor); fn(collideConnected);
+		fn(bodyA); fn(bodyB);
+		fn(localAnchorAX); fn(localAnchorAY);
+		fn(localAnchorBX); fn(localAnchorBY);
+		fn(localAxisX); fn(localAxisY);
+		fn(referenceAngle);
+		fn(length); fn(hertz); fn(dampingRatio);
+		fn(lower); fn(upper);
+		fn(motorSpeed); fn(maxMotorForce);
+		fn(maxForce); fn(maxTorque); fn(correctionFactor);
+		fn(impulseX); fn(impulseY); fn(impulseZ);
+		fn(motorImpulse); fn(lowerImpulse); fn(upperImpulse);
+	}
+
+	// take a free slot, or grow by one, and clear its impulses
+	uint32_t allocate()
+	{
+		uint32_t j;
+		if (!freeList.empty())
+		{
+			j = freeList.back();
+			freeList.pop_back();
+		}
+		else
+		{
+			j = (uint32_t)size();
+			resize(j + 1);
+		}
+		alive[j] = 1;
+		impulseX[j] = impulseY[j] = impulseZ[j] = 0.0f;
+		motorImpulse[j] = lowerImpulse[j] = upperImpulse[j] = 0.0f;
+		liveCount++;
+		return j;
+	}
+
+	void release(uint32_t j)
+	{
+		if (j >= size() || !alive[j])
+			return;
+		alive[j] = 0;
+		freeList.push_back(j);
+		liveCount--;
+	}
+
+	void clear()
+	{
+		resize(0);
+		freeList.clear();
+		liveCount = 0;
+	}
+};
+
+typedef JointStoreT<float> JointStore;
+
+// 3-vector and 3x3 matrix for the block solves, stored by column
+// ------------------------------------------------------------------------
+template<class T>
+struct Vec3T
+{
+	T x, y, z;
+
+	Vec3T() : x(0.0f), y(0.0f), z(0.0f) {}
+	Vec3T(T x, T y, T z) : x(x), y(y), z(z) {}
+};
+
+template<class T>
+struct Mat33T
+{
+	Vec3T<T> ex, ey, ez;
+
+	// solve K * x = b, a singular matrix gives zero
+	Vec3T<T> solve33(const Vec3T<T>& b) const
+	{
+		T det = ex.x * (ey.y * ez.z - ey.z * ez.y) - ey.x * (ex.y * ez.z - ex.z * ez.y) + ez.x * (ex.y * ey.z - ex.z * ey.y);
+		if (det == 0.0f)
+			return Vec3T<T>();
+		det = 1.0f / det;
+		Vec3T<T> x;
+		x.x = det * (b.x * (ey.y * ez.z - ey.z * ez.y) - ey.x * (b.y * ez.z - b.z * ez.y) + ez.x * (b.y * ey.z - b.z * ey.y));
+		x.y = det * (ex.x * (b.y * ez.z - b.z * ez.y) - b.x * (ex.y * ez.z - ex.z * ez.y) + ez.x * (ex.y * b.z - ex.z * b.y));
+		x.z = det * (ex.x * (ey.y * b.z - ey.z * b.y) - ey.x * (ex.y * b.z - ex.z * b.y) + b.x * (ex.y * ey.z - ex.z * ey.y));
+		return x;
+	}
+
+	// solve the upper left 2x2 block only
+	Vec2T<T> solve22(const Vec2T<T>& b) const
+	{
+		T det = ex.x * ey.y - ey.x * ex.y;
+		if (det == 0.0f)
+			return Vec2T<T>();
+		det = 1.0f / det;
+		return Vec2T<T>(det * (ey.y * b.x - ey.x * b.y), det * (ex.x * b.y - ex.y * b.x));
+	}
+};
+
+typedef Vec3T<float> Vec3;
+typedef Mat33T<float> Mat33;
+#endif
@@ -0,0 +1,338 @@
+#ifndef JOINT_SOLVER_H
+#define JOINT_SOLVER_H
+
+#include <cmath>
+
+#include "vec2.h"
+#include "joint.h"
+#include "contact_solver.h"
+
+// per-step data of one joint, filled in by prepareJoint
+// ------------------------------------------------------------------------
+template<class T>
+struct JointSolverDataT
+{
+	Vec2T<T> rA, rB;         // anchors relative to the body centres
+	Vec2T<T> axis, perp;     // prismatic axis and its normal, distance direction in axis
+	T a1, a2, s1, s2;        // prismatic lever arms along axis and perp
+	Mat33T<T> K;             // block effective mass, 2x2 solves use the upper left part
+	Vec3T<T> bias;           // position error fed back into the block solve
+	T axialMass;             // effective mass of the motor and limits
+	T lowerBias, upperBias;
+	T gamma;                 // distance spring softness
+	T maxMotorImpulse;
+	T maxLinearImpulse, maxAngularImpulse; // motor joint
+};
+
+typedef JointSolverDataT<float> JointSolverData;
+
+// limit rows work like contacts, a positive gap is only kept from closing
+// within this step and a negative one is pushed back by the Baumgarte fraction
+template<class T>
+inline T limitBias(T C, T invDt, T baumgarte)
+{
+	return C > 0.0f ? C * invDt : baumgarte * invDt * C;
+}
+
+// compute anchors, effective masses and position bias for a joint
+// ------------------------------------------------------------------------
+template<class T>
+inline void prepareJoint(JointStoreT<T>& js, uint32_t j, JointSolverDataT<T>& d, const Vec2T<T>& pA, T angleA, const Vec2T<T>& pB, T angleB,
+	const SolverBodyT<T>& a, const SolverBodyT<T>& b, T dt, const SolverSettings& settings)
+{
+	T invDt = dt > 0.0f ? 1.0f / dt : 0.0f;
+	T beta = settings.baumgarte;
+	T mA = a.invMass, mB = b.invMass, iA = a.invInertia, iB = b.invInertia;
+	RotT<T> qA(angleA), qB(angleB);
+	d.rA = rotate(qA, Vec2T<T>(js.localAnchorAX[j], js.localAnchorAY[j]));
+	d.rB = rotate(qB, Vec2T<T>(js.localAnchorBX[j], js.localAnchorBY[j]));
+	T angle = angleB - angleA - js.referenceAngle[j];
+
+	if (!settings.warmStarting)
+	{
+		js.impulseX[j] = js.impulseY[j] = js.impulseZ[j] = 0.0f;
+		js.motorImpulse[j] = js.lowerImpulse[j] = js.upperImpulse[j] = 0.0f;
+	}
+	if (!js.enableLimit[j])
+		js.lowerImpulse[j] = js.upperImpulse[j] = 0.0f;
+	if (!js.enableMotor[j])
+		js.motorImpulse[j] = 0.0f;
+	d.maxMotorImpulse = js.maxMotorForce[j] * dt;
+
+	switch (js.type[j])
+	{
+	case JOINT_REVOLUTE:
+	case JOINT_WELD:
+	{
+		Vec2T<T> rA = d.rA, rB = d.rB;
+		d.K.ex = Vec3T<T>(mA + mB + rA.y * rA.y * iA + rB.y * rB.y * iB, -rA.y * rA.x * iA - rB.y * rB.x * iB, -rA.y * iA - rB.y * iB);
+		d.K.ey = Vec3T<T>(d.K.ex.y, mA + mB + rA.x * rA.x * iA + rB.x * rB.x * iB, rA.x * iA + rB.x * iB);
+		d.K.ez = Vec3T<T>(d.K.ex.z, d.K.ey.z, iA + iB);
+		Vec2T<T> C = (pB + rB) - (pA + rA);
+		d.bias = Vec3T<T>(beta * invDt * C.x, beta * invDt * C.y, beta * invDt * angle);
+		d.axialMass = iA + iB > 0.0f ? 1.0f / (iA + iB) : 0.0f;
+		d.lowerBias = limitBias(angle - js.lower[j], invDt, beta);
+		d.upperBias = limitBias(js.upper[j] - angle, invDt, beta);
+		break;
+	}
+	case JOINT_PRISMATIC:
+	{
+		Vec2T<T> dp = (pB + d.rB) - (pA + d.rA);
+		d.axis = rotate(qA, Vec2T<T>(js.localAxisX[j], js.localAxisY[j]));
+		d.perp = cross(1.0f, d.axis);
+		d.a1 = cross(dp + d.rA, d.axis);
+		d.a2 = cross(d.rB, d.axis);
+		d.s1 = cross(dp + d.rA, d.perp);
+		d.s2 = cross(d.rB, d.perp);
+		T k = mA + mB + iA * d.a1 * d.a1 + iB * d.a2 * d.a2;
+		d.axialMass = k > 0.0f ? 1.0f / k : 0.0f;
+		T k22 = iA + iB;
+		d.K.ex = Vec3T<T>(mA + mB + iA * d.s1 * d.s1 + iB * d.s2 * d.s2, iA * d.s1 + iB * d.s2, 0.0f);
+		// with neither body able to turn the angular row is free, keep the block invertible
+		d.K.ey = Vec3T<T>(d.K.ex.y, k22 > 0.0f ? k22 : 1.0f, 0.0f);
+		d.bias = Vec3T<T>(beta * invDt * dot(d.perp, dp), beta * invDt * angle, 0.0f);
+		T translation = dot(d.axis, dp);
+		d.lowerBias = limitBias(translation - js.lower[j], invDt, beta);
+		d.upperBias = limitBias(js.upper[j] - translation, invDt, beta);
+		break;
+	}
+	case JOINT_DISTANCE:
+	{
+		Vec2T<T> u = (pB + d.rB) - (pA + d.rA);
+		T len = length(u);
+		d.axis = len > 1e-6f ? (1.0f / len) * u : Vec2T<T>();
+		T crA = cross(d.rA, d.axis), crB = cross(d.rB, d.axis);
+		T k = mA + mB + iA * crA * crA + iB * crB * crB;
+		T C = len - js.length[j];
+		d.gamma = 0.0f;
+		if (js.hertz[j] > 0.0f && k > 0.0f)
+		{
+			// spring as a soft constraint, stiffness and damping from the frequency
+			// and damping ratio of the pair's effective mass
+			T mass = 1.0f / k;
+			T omega = 2.0f * 3.14159265f * js.hertz[j];
+			T damping = 2.0f * mass * js.dampingRatio[j] * omega;
+			T stiffness = mass * omega * omega;
+			d.gamma = dt * (damping + dt * stiffness);
+			d.gamma = d.gamma > 0.0f ? 1.0f / d.gamma : 0.0f;
+			d.bias.x = C * dt * stiffness * d.gamma;
+			k += d.gamma;
+		}
+		else
+		{
+			d.bias.x = beta * invDt * C;
+		}
+		d.axialMass = k > 0.0f ? 1.0f / k : 0.0f;
+		break;
+	}
+	case JOINT_MOTOR:
+	{
+		// the motor joint works on the body centres
+		d.rA = d.rB = Vec2T<T>();
+		Vec2T<T> target = rotate(qA, Vec2T<T>(js.localAnchorAX[j], js.localAnchorAY[j]));
+		Vec2T<T> C = pB - pA - target;
+		T factor = js.correctionFactor[j] * invDt;
+		d.bias = Vec3T<T>(factor * C.x, factor * C.y, factor * angle);
+		d.K.ex = Vec3T<T>(mA + mB, 0.0f, 0.0f);
+		d.K.ey = Vec3T<T>(0.0f, mA + mB, 0.0f);
+		d.axialMass = iA + iB > 0.0f ? 1.0f / (iA + iB) : 0.0f;
+		d.maxLinearImpulse = js.maxForce[j] * dt;
+		d.maxAngularImpulse = js.maxTorque[j] * dt;
+		break;
+	}
+	}
+}
+
+// apply last step's accumulated impulses
+// ------------------------------------------------------------------------
+template<class T>
+inline void warmStartJoint(const JointStoreT<T>& js, uint32_t j, const JointSolverDataT<T>& d, SolverBodyT<T>& a, SolverBodyT<T>& b)
+{
+	Vec2T<T> P;
+	T LA, LB;
+	switch (js.type[j])
+	{
+	case JOINT_PRISMATIC:
+	{
+		T axial = js.motorImpulse[j] + js.lowerImpulse[j] - js.upperImpulse[j];
+		P = js.impulseX[j] * d.perp + axial * d.axis;
+		LA = js.impulseX[j] * d.s1 + js.impulseY[j] + axial * d.a1;
+		LB = js.impulseX[j] * d.s2 + js.impulseY[j] + axial * d.a2;
+		break;
+	}
+	case JOINT_DISTANCE:
+		P = js.impulseX[j] * d.axis;
+		LA = cross(d.rA, P);
+		LB = cross(d.rB, P);
+		break;
+	default:
+	{
+		// revolute, weld and motor all carry a point impulse plus an angular one
+		T axial = js.impulseZ[j] + js.motorImpulse[j] + js.lowerImpulse[j] - js.upperImpulse[j];
+		P = Vec2T<T>(js.impulseX[j], js.impulseY[j]);
+		LA = cross(d.rA, P) + axial;
+		LB = cross(d.rB, P) + axial;
+		break;
+	}
+	}
+	a.v -= a.invMass * P;
+	a.w -= a.invInertia * LA;
+	b.v += b.invMass * P;
+	b.w += b.invInertia * LB;
+}
+
+// accumulate an angular impulse that may only push one way
+template<class T>
+inline T solveLimitRow(T Cdot, T bias, T mass, T& accumulated)
+{
+	T lambda = -mass * (Cdot + bias);
+	T newImpulse = scalarMax(accumulated + lambda, T(0.0f));
+	lambda = newImpulse - accumulated;
+	accumulated = newImpulse;
+	return lambda;
+}
+
+// one sequential impulse iteration over a joint, motor and limits first so the
+// point or block constraint gets the last word
+// ------------------------------------------------------------------------
+template<class T>
+inline void solveJoint(JointStoreT<T>& js, uint32_t j, const JointSolverDataT<T>& d, SolverBodyT<T>& a, SolverBodyT<T>& b)
+{
+	T mA = a.invMass, mB = b.invMass, iA = a.invInertia, iB = b.invInertia;
+	switch (js.type[j])
+	{
+	case JOINT_REVOLUTE:
+	{
+		if (js.enableMotor[j])
+		{
+			T lambda = -d.axialMass * (b.w - a.w - js.motorSpeed[j]);
+			T old = js.motorImpulse[j];
+			js.motorImpulse[j] = scalarMax(-d.maxMotorImpulse, scalarMin(d.maxMotorImpulse, old + lambda));
+			lambda = js.motorImpulse[j] - old;
+			a.w -= iA * lambda;
+			b.w += iB * lambda;
+		}
+		if (js.enableLimit[j])
+		{
+			T lambda = solveLimitRow(b.w - a.w, d.lowerBias, d.axialMass, js.lowerImpulse[j]);
+			a.w -= iA * lambda;
+			b.w += iB * lambda;
+			lambda = solveLimitRow(a.w - b.w, d.upperBias, d.axialMass, js.upperImpulse[j]);
+			a.w += iA * lambda;
+			b.w -= iB * lambda;
+		}
+		Vec2T<T> Cdot = b.v + cross(b.w, d.rB) - a.v - cross(a.w, d.rA);
+		Vec2T<T> impulse = d.K.solve22(-Vec2T<T>(Cdot.x + d.bias.x, Cdot.y + d.bias.y));
+		js.impulseX[j] += impulse.x;
+		js.impulseY[j] += impulse.y;
+		a.v -= mA * impulse;
+		a.w -= iA * cross(d.rA, impulse);
+		b.v += mB * impulse;
+		b.w += iB * cross(d.rB, impulse);
+		break;
+	}
+	case JOINT_PRISMATIC:
+	{
+		if (js.enableMotor[j])
+		{
+			T Cdot = dot(d.axis, b.v - a.v) + d.a2 * b.w - d.a1 * a.w;
+			T lambda = d.axialMass * (js.motorSpeed[j] - Cdot);
+			T old = js.motorImpulse[j];
+			js.motorImpulse[j] = scalarMax(-d.maxMotorImpulse, scalarMin(d.maxMotorImpulse, old + lambda));
+			lambda = js.motorImpulse[j] - old;
+			a.v -= (mA * lambda) * d.axis;
+			a.w -= iA * lambda * d.a1;
+			b.v += (mB * lambda) * d.axis;
+			b.w += iB * lambda * d.a2;
+		}
+		if (js.enableLimit[j])
+		{
+			T Cdot = dot(d.axis, b.v - a.v) + d.a2 * b.w - d.a1 * a.w;
+			T lambda = solveLimitRow(Cdot, d.lowerBias, d.axialMass, js.lowerImpulse[j]);
+			a.v -= (mA * lambda) * d.axis;
+			a.w -= iA * lambda * d.a1;
+			b.v += (mB * lambda) * d.axis;
+			b.w += iB * lambda * d.a2;
+			Cdot = dot(d.axis, a.v - b.v) + d.a1 * a.w - d.a2 * b.w;
+			lambda = solveLimitRow(Cdot, d.upperBias, d.axialMass, js.upperImpulse[j]);
+			a.v += (mA * lambda) * d.axis;
+			a.w += iA * lambda * d.a1;
+			b.v -= (mB * lambda) * d.axis;
+			b.w -= iB * lambda * d.a2;
+		}
+		// 2x2 block over the perpendicular offset and the relative angle
+		Vec2T<T> Cdot(dot(d.perp, b.v - a.v) + d.s2 * b.w - d.s1 * a.w, b.w - a.w);
+		Vec2T<T> impulse = d.K.solve22(-Vec2T<T>(Cdot.x + d.bias.x, Cdot.y + d.bias.y));
+		js.impulseX[j] += impulse.x;
+		js.impulseY[j] += impulse.y;
+		Vec2T<T> P = impulse.x * d.perp;
+		a.v -= mA * P;
+		a.w -= iA * (impulse.x * d.s1 + impulse.y);
+		b.v += mB * P;
+		b.w += iB * (impulse.x * d.s2 + impulse.y);
+		break;
+	}
+	case JOINT_DISTANCE:
+	{
+		Vec2T<T> dv = b.v + cross(b.w, d.rB) - a.v - cross(a.w, d.rA);
+		T lambda = -d.axialMass * (dot(d.axis, dv) + d.bias.x + d.gamma * js.impulseX[j]);
+		js.impulseX[j] += lambda;
+		Vec2T<T> P = lambda * d.axis;
+		a.v -= mA * P;
+		a.w -= iA * cross(d.rA, P);
+		b.v += mB * P;
+		b.w += iB * cross(d.rB, P);
+		break;
+	}
+	case JOINT_WELD:
+	{
+		// 3x3 block over the point and the angle, a pair that can't turn only needs the point
+		Vec2T<T> Cdot1 = b.v + cross(b.w, d.rB) - a.v - cross(a.w, d.rA);
+		Vec3T<T> impulse;
+		if (d.K.ez.z > 0.0f)
+		{
+			Vec3T<T> rhs(-(Cdot1.x + d.bias.x), -(Cdot1.y + d.bias.y), -(b.w - a.w + d.bias.z));
+			impulse = d.K.solve33(rhs);
+		}
+		else
+		{
+			Vec2T<T> p = d.K.solve22(-Vec2T<T>(Cdot1.x + d.bias.x, Cdot1.y + d.bias.y));
+			impulse = Vec3T<T>(p.x, p.y, 0.0f);
+		}
+		js.impulseX[j] += impulse.x;
+		js.impulseY[j] += impulse.y;
+		js.impulseZ[j] += impulse.z;
+		Vec2T<T> P(impulse.x, impulse.y);
+		a.v -= mA * P;
+		a.w -= iA * (cross(d.rA, P) + impulse.z);
+		b.v += mB * P;
+		b.w += iB * (cross(d.rB, P) + impulse.z);
+		break;
+	}
+	case JOINT_MOTOR:
+	{
+		T lambda = -d.axialMass * (b.w - a.w + d.bias.z);
+		T old = js.impulseZ[j];
+		js.impulseZ[j] = scalarMax(-d.maxAngularImpulse, scalarMin(d.maxAngularImpulse, old + lambda));
+		lambda = js.impulseZ[j] - old;
+		a.w -= iA * lambda;
+		b.w += iB * lambda;
+
+		// the linear impulse is clamped as a vector so the force keeps its direction
+		Vec2T<T> Cdot = b.v - a.v;
+		Vec2T<T> impulse = d.K.solve22(-Vec2T<T>(Cdot.x + d.bias.x, Cdot.y + d.bias.y));
+		Vec2T<T> oldImpulse(js.impulseX[j], js.impulseY[j]);
+		Vec2T<T> accumulated = oldImpulse + impulse;
+		T len = length(accumulated);
+		if (len > d.maxLinearImpulse)
+			accumulated *= d.maxLinearImpulse / len;
+		js.impulseX[j] = accumulated.x;
+		js.impulseY[j] = accumulated.y;
+		impulse = accumulated - oldImpulse;
+		a.v -= mA * impulse;
+		b.v += mB * impulse;
+		break;
+	}
+	}
+}
+#endif
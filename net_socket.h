@@ -0,0 +1,180 @@
+#ifndef NET_SOCKET_H
+#define NET_SOCKET_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <iostream>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "ws2_32.lib")
+#else
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+// IPv4 address and port, both in host byte order
+// ------------------------------------------------------------------------
+struct NetAddress
+{
+	uint32_t ip = 0;
+	uint16_t port = 0;
+
+	bool operator==(const NetAddress& o) const { return ip == o.ip && port == o.port; }
+	bool operator!=(const NetAddress& o) const { return !(*this == o); }
+};
+
+// dotted quad host ("127.0.0.1") and port, false if host isn't one
+// ------------------------------------------------------------------------
+inline bool parseAddress(const char* host, uint16_t port, NetAddress& out)
+{
+	in_addr addr;
+	if (inet_pton(AF_INET, host, &addr) != 1)
+		return false;
+	out.ip = ntohl(addr.s_addr);
+	out.port = port;
+	return true;
+}
+
+// Non-blocking UDP socket. Datagrams either arrive whole or not at all, which
+// is what snapshot replication wants: a lost snapshot is never resent, the
+// next one is encoded against whatever the other side acknowledged instead.
+// ------------------------------------------------------------------------
+class UdpSocket
+{
+public:
+	UdpSocket() {}
+	~UdpSocket() { close(); }
+	UdpSocket(const UdpSocket&) = delete;
+	UdpSocket& operator=(const UdpSocket&) = delete;
+
+	// bind to port on every interface, 0 lets the system pick one
+	// ------------------------------------------------------------------------
+	bool open(uint16_t port = 0)
+	{
+		close();
+#ifdef _WIN32
+		WSADATA wsa;
+		if (WSAStartup(MAKEWORD(2, 2), &wsa) != 0)
+		{
+			std::cout << "ERROR::SOCKET::STARTUP_FAILED" << std::endl;
+			return false;
+		}
+		started = true;
+#endif
+		handle = ::socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+		if (handle == INVALID)
+		{
+			std::cout << "ERROR::SOCKET::CREATE_FAILED" << std::endl;
+			close();
+			return false;
+		}
+		sockaddr_in addr;
+		memset(&addr, 0, sizeof(addr));
+		addr.sin_family = AF_INET;
+		addr.sin_addr.s_addr = htonl(INADDR_ANY);
+		addr.sin_port = htons(port);
+		if (::bind(handle, (const sockaddr*)&addr, sizeof(addr)) != 0)
+		{
+			std::cout << "ERROR::SOCKET::BIND_FAILED port " << port << std::endl;
+			close();
+			return false;
+		}
+#ifdef _WIN32
+		u_long nonBlocking = 1;
+		bool ok = ioctlsocket(handle, FIONBIO, &nonBlocking) == 0;
+#else
+		bool ok = fcntl(handle, F_SETFL, fcntl(handle, F_GETFL, 0) | O_NONBLOCK) == 0;
+#endif
+		if (!ok)
+		{
+			std::cout << "ERROR::SOCKET::NON_BLOCKING_FAILED" << std::endl;
+			close();
+			return false;
+		}
+		return true;
+	}
+
+	void close()
+	{
+		if (handle != INVALID)
+		{
+#ifdef _WIN32
+			closesocket(handle);
+#else
+			::close(handle);
+#endif
+		}
+		handle = INVALID;
+#ifdef _WIN32
+		if (started)
+			WSACleanup();
+		started = false;
+#endif
+	}
+
+	bool isOpen() const
+	{
+		return handle != INVALID;
+	}
+
+	// port the socket is bound to, in host byte order
+	// ------------------------------------------------------------------------
+	uint16_t port() const
+	{
+		sockaddr_in addr;
+		socklen_t length = sizeof(addr);
+		if (handle == INVALID || getsockname(handle, (sockaddr*)&addr, &length) != 0)
+			return 0;
+		return ntohs(addr.sin_port);
+	}
+
+	// ------------------------------------------------------------------------
+	bool send(const NetAddress& to, const void* data, size_t bytes)
+	{
+		sockaddr_in addr;
+		memset(&addr, 0, sizeof(addr));
+		addr.sin_family = AF_INET;
+		addr.sin_addr.s_addr = htonl(to.ip);
+		addr.sin_port = htons(to.port);
+		return ::sendto(handle, (const char*)data, (int)bytes, 0, (const sockaddr*)&addr, sizeof(addr)) == (int)bytes;
+	}
+
+	// next waiting datagram, its size or -1 if there is none. Datagrams longer
+	// than capacity are cut short.
+	// ------------------------------------------------------------------------
+	int receive(void* data, size_t capacity, NetAddress& from)
+	{
+		sockaddr_in addr;
+		socklen_t length = sizeof(addr);
+		int bytes = (int)::recvfrom(handle, (char*)data, (int)capacity, 0, (sockaddr*)&addr, &length);
+		if (bytes < 0)
+			return -1;
+		from.ip = ntohl(addr.sin_addr.s_addr);
+		from.port = ntohs(addr.sin_port);
+		return bytes;
+	}
+
+private:
+#ifdef _WIN32
+	typedef SOCKET Handle;
+	static const Handle INVALID = INVALID_SOCKET;
+	bool started = false;
+#else
+	typedef int Handle;
+	static const Handle INVALID = -1;
+#endif
+	Handle handle = INVALID;
+};
+#endif
@@ -0,0 +1,113 @@
+#ifndef PARTICLE_RENDERER_H
+#define PARTICLE_RENDERER_H
+
+#include <glad/glad.h>
+
+#include <cstddef>
+
+#include "particle_system.h"
+
+// draws every particle as a GL_POINTS vertex streamed straight from the particle
+// arrays. The vertex buffer is split into RING_REGIONS regions written through an
+// unsynchronized mapping, each guarded by a fence so a region is only rewritten
+// once the GPU has finished drawing from it, no orphaning and no stall on the
+// frame in flight.
+// ------------------------------------------------------------------------
+class ParticleRenderer
+{
+public:
+	static const int RING_REGIONS = 3;
+
+	ParticleRenderer()
+	{
+		glGenVertexArrays(1, &VAO);
+		glGenBuffers(1, &VBO);
+	}
+
+	// release the GL objects, must be called while the context is still current
+	// ------------------------------------------------------------------------
+	void destroy()
+	{
+		for (int r = 0; r < RING_REGIONS; r++)
+			if (fences[r])
+				glDeleteSync(fences[r]);
+		glDeleteVertexArrays(1, &VAO);
+		glDeleteBuffers(1, &VBO);
+	}
+
+	// write the particle positions into the next free region
+	// ------------------------------------------------------------------------
+	void update(const ParticleSystem& particles)
+	{
+		count = particles.size();
+		if (count == 0)
+			return;
+		if (count > capacity)
+			grow(count);
+
+		region = (region + 1) % RING_REGIONS;
+		if (fences[region])
+		{
+			// normally signalled long ago, only waits if the GPU is RING_REGIONS frames behind
+			glClientWaitSync(fences[region], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ull);
+			glDeleteSync(fences[region]);
+			fences[region] = 0;
+		}
+		glBindBuffer(GL_ARRAY_BUFFER, VBO);
+		float* dst = (float*)glMapBufferRange(GL_ARRAY_BUFFER, region * capacity * 2 * sizeof(float),
+			count * 2 * sizeof(float), GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+		if (!dst)
+		{
+			count = 0;
+			return;
+		}
+		const float* x = particles.posX.data();
+		const float* y = particles.posY.data();
+		for (size_t i = 0; i < count; i++)
+		{
+			dst[2 * i] = x[i];
+			dst[2 * i + 1] = y[i];
+		}
+		glUnmapBuffer(GL_ARRAY_BUFFER);
+	}
+	// ------------------------------------------------------------------------
+	void draw()
+	{
+		if (count == 0)
+			return;
+		glBindVertexArray(VAO);
+		glDrawArrays(GL_POINTS, (GLint)(region * capacity), (GLsizei)count);
+		glBindVertexArray(0);
+		fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	}
+
+private:
+	unsigned int VAO, VBO;
+	GLsync fences[RING_REGIONS] = {};
+	size_t capacity = 0;
+	size_t count = 0;
+	int region = 0;
+
+	// reallocate with room for at least n particles per region, the old storage
+	// may still be in use so every fence is waited on first
+	// ------------------------------------------------------------------------
+	void grow(size_t n)
+	{
+		for (int r = 0; r < RING_REGIONS; r++)
+		{
+			if (!fences[r])
+				continue;
+			glClientWaitSync(fences[r], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ull);
+			glDeleteSync(fences[r]);
+			fences[r] = 0;
+		}
+		capacity = n + n / 2;
+		glBindVertexArray(VAO);
+		glBindBuffer(GL_ARRAY_BUFFER, VBO);
+		glBufferData(GL_ARRAY_BUFFER, RING_REGIONS * capacity * 2 * sizeof(float), NULL, GL_STREAM_DRAW);
+		glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*)0);
+		glEnableVertexAttribArray(0);
+		glBindVertexArray(0);
+	}
+};
+#endif
@@ -0,0 +1,405 @@
+#ifndef PARTICLE_SYSTEM_H
+#define PARTICLE_SYSTEM_H
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "body_store.h"
+#include "collision.h"
+#include "job_system.h"
+#include "profiler.h"
+
+// timings and counts for the most recent particle step
+// ------------------------------------------------------------------------
+struct ParticleStats
+{
+	uint64_t integrateNs = 0;
+	uint64_t gridNs = 0;
+	uint64_t contactNs = 0;
+	uint64_t collideNs = 0;
+	uint64_t totalNs = 0;
+	size_t particles = 0;
+	size_t cells = 0;
+};
+
+// Position-based point masses, kept apart from the rigid bodies so they never
+// go through the broadphase, manifolds or islands. Each step counting-sorts the
+// particles into a density grid one diameter across, then every substep predicts
+// positions, pushes overlapping neighbours apart with Gauss-Seidel passes over
+// the grid, projects the particles out of the static bodies of the rigid world
+// and derives velocities from the change in position. Particles don't push
+// back on the rigid bodies.
+// ------------------------------------------------------------------------
+class ParticleSystem
+{
+public:
+	// structure of arrays, indexed by particle
+	std::vector<float> posX, posY;
+	std::vector<float> velX, velY;
+
+	float radius = 0.05f;
+	float gravityX = 0.0f, gravityY = -10.0f;
+	float damping = 0.999f;          // velocity kept per substep
+	float maxPushSpeed = 1.0f;       // fastest overlap is allowed to push particles apart
+	float relaxation = 1.0f;         // fraction of each overlap resolved per iteration
+	int substeps = 4;
+	int iterations = 1;              // contact iterations per substep
+	int reorderInterval = 16;        // steps between sorting the arrays into grid order
+	float boundsMin = -1e4f, boundsMax = 1e4f;
+	ParticleStats stats;
+
+	size_t size() const { return posX.size(); }
+
+	// ------------------------------------------------------------------------
+	void add(float x, float y, float vx = 0.0f, float vy = 0.0f)
+	{
+		posX.push_back(x); posY.push_back(y);
+		velX.push_back(vx); velY.push_back(vy);
+	}
+	// fill a rectangle with particles on a square lattice
+	// ------------------------------------------------------------------------
+	void addBlock(float cx, float cy, float halfWidth, float halfHeight, float spacing)
+	{
+		int nx = (int)(2.0f * halfWidth / spacing);
+		int ny = (int)(2.0f * halfHeight / spacing);
+		reserve(size() + (size_t)nx * ny);
+		for (int j = 0; j < ny; j++)
+			for (int i = 0; i < nx; i++)
+				add(cx - halfWidth + (i + 0.5f) * spacing, cy - halfHeight + (j + 0.5f) * spacing);
+	}
+	// ------------------------------------------------------------------------
+	void reserve(size_t n)
+	{
+		posX.reserve(n); posY.reserve(n);
+		velX.reserve(n); velY.reserve(n);
+	}
+	// ------------------------------------------------------------------------
+	void clear()
+	{
+		posX.clear(); posY.clear();
+		velX.clear(); velY.clear();
+	}
+	// ------------------------------------------------------------------------
+	void setJobSystem(JobSystem* jobSystem)
+	{
+		jobs = jobSystem;
+	}
+
+	// advance the particles by dt, colliding with the static bodies in statics
+	// ------------------------------------------------------------------------
+	void step(float dt, const BodyStore& statics)
+	{
+		PROFILE_ZONE("particles");
+		typedef std::chrono::steady_clock Clock;
+		auto ns = [](Clock::time_point a, Clock::time_point b) {
+			return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(b - a).count();
+		};
+		Clock::time_point t0 = Clock::now();
+		size_t n = size();
+		stats.particles = n;
+		if (n == 0 || dt <= 0.0f)
+			return;
+
+		// small substeps sharing one grid, a particle moves far less than a cell
+		// per substep so the binning stays good enough, and resolving overlap in
+		// small steps keeps piles from storing up energy that a single big step
+		// would release as a jump
+		prevX.resize(n);
+		prevY.resize(n);
+		int substepCount = std::max(1, substeps);
+		float h = dt / substepCount;
+		uint64_t integrateNs = 0, gridNs = 0, contactNs = 0, collideNs = 0;
+		for (int sub = 0; sub < substepCount; sub++)
+		{
+			Clock::time_point s0 = Clock::now();
+			{
+				PROFILE_ZONE("particle integrate");
+				float gx = gravityX * h, gy = gravityY * h;
+				forRange(n, [&](size_t begin, size_t end, int) {
+					for (size_t i = begin; i < end; i++)
+					{
+						prevX[i] = posX[i];
+						prevY[i] = posY[i];
+						velX[i] = (velX[i] + gx) * damping;
+						velY[i] = (velY[i] + gy) * damping;
+						posX[i] = std::min(boundsMax, std::max(boundsMin, posX[i] + velX[i] * h));
+						posY[i] = std::min(boundsMax, std::max(boundsMin, posY[i] + velY[i] * h));
+					}
+				});
+			}
+			Clock::time_point s1 = Clock::now();
+
+			if (sub == 0)
+			{
+				PROFILE_ZONE("particle grid");
+				buildGrid();
+				if (reorderInterval > 0 && ++stepCount % reorderInterval == 0)
+				{
+					reorder();
+					buildGrid();
+				}
+			}
+			Clock::time_point s2 = Clock::now();
+
+			{
+				PROFILE_ZONE("particle contacts");
+				for (int it = 0; it < iterations; it++)
+					separate();
+			}
+			Clock::time_point s3 = Clock::now();
+
+			{
+				PROFILE_ZONE("particle collide");
+				collideStatics(statics);
+				// the velocity the corrections added can cancel the approach speed but
+				// push apart at no more than maxPushSpeed, otherwise overlap a deep pile
+				// couldn't resolve in one substep comes back out as a jump
+				float invH = 1.0f / h;
+				float maxPush = maxPushSpeed;
+				forRange(n, [&](size_t begin, size_t end, int) {
+					for (size_t i = begin; i < end; i++)
+					{
+						float vx = (posX[i] - prevX[i]) * invH;
+						float vy = (posY[i] - prevY[i]) * invH;
+						float cx = vx - velX[i], cy = vy - velY[i];
+						float c2 = cx * cx + cy * cy;
+						if (c2 > maxPush * maxPush)
+						{
+							float c = sqrtf(c2);
+							float approach = std::max(0.0f, -(velX[i] * cx + velY[i] * cy) / c);
+							if (c > approach + maxPush)
+							{
+								float f = (approach + maxPush) / c;
+								vx = velX[i] + cx * f;
+								vy = velY[i] + cy * f;
+							}
+						}
+						velX[i] = vx;
+						velY[i] = vy;
+					}
+				});
+			}
+			Clock::time_point s4 = Clock::now();
+
+			integrateNs += ns(s0, s1);
+			gridNs += ns(s1, s2);
+			contactNs += ns(s2, s3);
+			collideNs += ns(s3, s4);
+		}
+
+		stats.integrateNs = integrateNs;
+		stats.gridNs = gridNs;
+		stats.contactNs = contactNs;
+		stats.collideNs = collideNs;
+		stats.totalNs = ns(t0, Clock::now());
+		stats.cells = cellCount.size();
+	}
+
+private:
+	JobSystem* jobs = nullptr;
+	std::vector<float> prevX, prevY;
+	unsigned stepCount = 0;
+
+	// grid over the particle bounds, cellCount is the number of particles in each
+	// cell and cellStart/sorted list them
+	float cell = 0.1f, invCell = 10.0f;
+	float originX = 0.0f, originY = 0.0f;
+	int gridW = 0, gridH = 0;
+	std::vector<uint32_t> cellOf;
+	std::vector<uint32_t> cellCount;
+	std::vector<uint32_t> cellStart;
+	std::vector<uint32_t> sorted;
+	std::vector<float> scratch;
+
+	template<class Fn>
+	void forRange(size_t count, Fn&& fn)
+	{
+		if (jobs)
+			jobs->parallelFor(count, fn);
+		else if (count > 0)
+			fn(0, count, 0);
+	}
+
+	// ------------------------------------------------------------------------
+	void buildGrid()
+	{
+		size_t n = size();
+		float x0 = posX[0], x1 = posX[0], y0 = posY[0], y1 = posY[0];
+		for (size_t i = 1; i < n; i++)
+		{
+			x0 = std::min(x0, posX[i]); x1 = std::max(x1, posX[i]);
+			y0 = std::min(y0, posY[i]); y1 = std::max(y1, posY[i]);
+		}
+		// one diameter per cell so every contact is within the 3x3 cells around a
+		// particle, coarsen if the particles are so spread out the grid would dwarf
+		// the particle count (the 3x3 cells still cover every contact)
+		cell = 2.0f * radius;
+		for (;;)
+		{
+			gridW = (int)((x1 - x0) / cell) + 3;
+			gridH = (int)((y1 - y0) / cell) + 3;
+			if ((double)gridW * gridH <= 4.0 * n + 64.0)
+				break;
+			cell *= 2.0f;
+		}
+		invCell = 1.0f / cell;
+		// one empty ring of cells around the particles so neighbour lookups never leave the grid
+		originX = x0 - cell;
+		originY = y0 - cell;
+
+		cellCount.assign((size_t)gridW * gridH, 0);
+		cellOf.resize(n);
+		for (size_t i = 0; i < n; i++)
+		{
+			int cx = (int)((posX[i] - originX) * invCell);
+			int cy = (int)((posY[i] - originY) * invCell);
+			uint32_t c = (uint32_t)(cy * gridW + cx);
+			cellOf[i] = c;
+			cellCount[c]++;
+		}
+		cellStart.resize(cellCount.size() + 1);
+		uint32_t sum = 0;
+		for (size_t c = 0; c < cellCount.size(); c++)
+		{
+			cellStart[c] = sum;
+			sum += cellCount[c];
+		}
+		cellStart[cellCount.size()] = sum;
+		sorted.resize(n);
+		// cellStart doubles as the write cursor of each cell while scattering and
+		// ends up at the end of each cell, so shift it back afterwards
+		for (size_t i = 0; i < n; i++)
+			sorted[cellStart[cellOf[i]]++] = (uint32_t)i;
+		for (size_t c = cellCount.size(); c > 0; c--)
+			cellStart[c] = cellStart[c - 1];
+		cellStart[0] = 0;
+	}
+
+	// permute every array into grid order so neighbouring particles share cache lines
+	// ------------------------------------------------------------------------
+	void reorder()
+	{
+		size_t n = size();
+		scratch.resize(n);
+		std::vector<float>* arrays[] = { &posX, &posY, &velX, &velY, &prevX, &prevY };
+		for (std::vector<float>* a : arrays)
+		{
+			std::vector<float>& v = *a;
+			for (size_t k = 0; k < n; k++)
+				scratch[k] = v[sorted[k]];
+			v.swap(scratch);
+		}
+	}
+
+	// one Gauss-Seidel pass over the grid, every overlapping pair is pushed apart
+	// once, half each, from the particle that comes first in grid order. A particle
+	// only pairs with the rest of its own row of cells and the row above, so all
+	// odd rows run in parallel, then all even rows, without two threads ever
+	// touching the same particle.
+	// ------------------------------------------------------------------------
+	void separate()
+	{
+		float diameter = 2.0f * radius;
+		float d2Max = diameter * diameter;
+		for (int parity = 1; parity <= 2; parity++)
+		{
+			// rows parity, parity + 2, ... up to the last row that holds particles
+			if (gridH - 2 < parity)
+				continue;
+			size_t rows = (size_t)(gridH - 2 - parity) / 2 + 1;
+			forRange(rows, [&](size_t begin, size_t end, int) {
+				for (size_t r = begin; r < end; r++)
+				{
+					int cy = parity + 2 * (int)r;
+					for (int cx = 1; cx < gridW - 1; cx++)
+					{
+						size_t c = (size_t)cy * gridW + cx;
+						for (uint32_t k = cellStart[c]; k < cellStart[c + 1]; k++)
+							separateParticle(k, cx, cy, diameter, d2Max);
+					}
+				}
+			});
+		}
+	}
+	// ------------------------------------------------------------------------
+	void separateParticle(uint32_t k, int cx, int cy, float diameter, float d2Max)
+	{
+		uint32_t i = sorted[k];
+		for (int row = cy; row <= cy + 1; row++)
+		{
+			// the three cells of a row are contiguous in sorted order, in the
+			// particle's own row only the ones after it
+			size_t rowBase = (size_t)row * gridW;
+			uint32_t first = row == cy ? k + 1 : cellStart[rowBase + cx - 1];
+			for (uint32_t m = first; m < cellStart[rowBase + cx + 2]; m++)
+			{
+				uint32_t j = sorted[m];
+				float dx = posX[i] - posX[j], dy = posY[i] - posY[j];
+				float d2 = dx * dx + dy * dy;
+				if (d2 >= d2Max)
+					continue;
+				if (d2 < 1e-12f)
+				{
+					// coincident, split them along a fixed direction
+					dx = 1e-3f;
+					dy = 0.0f;
+					d2 = 1e-6f;
+				}
+				float d = sqrtf(d2);
+				float push = relaxation * 0.5f * (diameter - d) / d;
+				posX[i] += dx * push;
+				posY[i] += dy * push;
+				posX[j] -= dx * push;
+				posY[j] -= dy * push;
+			}
+		}
+	}
+
+	// project particles out of every static body, a body only visits the grid
+	// rows under its AABB and the rows are split across threads
+	// ------------------------------------------------------------------------
+	void collideStatics(const BodyStore& statics)
+	{
+		float r = radius;
+		for (size_t b = 0; b < statics.size(); b++)
+		{
+			if (statics.invMass[b] != 0.0f || statics.sensor[b])
+				continue;
+			ShapeTransform shape;
+			shape.p = Vec2(statics.posX[b], statics.posY[b]);
+			shape.q = Rot(statics.angle[b]);
+			shape.extentX = statics.extentX[b];
+			shape.extentY = statics.extentY[b];
+			bool circle = statics.shape[b] == SHAPE_CIRCLE;
+			float ex = circle ? shape.extentX : fabsf(shape.q.c) * shape.extentX + fabsf(shape.q.s) * shape.extentY;
+			float ey = circle ? shape.extentX : fabsf(shape.q.s) * shape.extentX + fabsf(shape.q.c) * shape.extentY;
+			// the particles moved since the grid was built, so look one cell further out
+			int cx0 = std::max(0, (int)((shape.p.x - ex - r - originX) * invCell) - 1);
+			int cx1 = std::min(gridW - 1, (int)((shape.p.x + ex + r - originX) * invCell) + 1);
+			int cy0 = std::max(0, (int)((shape.p.y - ey - r - originY) * invCell) - 1);
+			int cy1 = std::min(gridH - 1, (int)((shape.p.y + ey + r - originY) * invCell) + 1);
+			if (cx0 > cx1 || cy0 > cy1)
+				continue;
+			forRange((size_t)(cy1 - cy0 + 1), [&](size_t begin, size_t end, int) {
+				for (size_t row = begin; row < end; row++)
+				{
+					size_t rowBase = (size_t)(cy0 + (int)row) * gridW;
+					for (uint32_t k = cellStart[rowBase + cx0]; k < cellStart[rowBase + cx1 + 1]; k++)
+					{
+						uint32_t i = sorted[k];
+						Vec2 point(posX[i], posY[i]);
+						if (pushPointOut(shape, circle, r, Vec2(prevX[i], prevY[i]), point))
+						{
+							posX[i] = point.x;
+							posY[i] = point.y;
+						}
+					}
+				}
+			});
+		}
+	}
+};
+#endif
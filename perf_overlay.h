@@ -0,0 +1,265 @@
+#ifndef PERF_OVERLAY_H
+#define PERF_OVERLAY_H
+
+#include <glad/glad.h>
+
+#include <cstdarg>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+#include "shader.h"
+#include "physics_world.h"
+#include "particle_system.h"
+#include "soft_body.h"
+#include "gpu_timer.h"
+
+// 3x5 pixel font for ASCII 32..95, one bit per pixel, rows top to bottom and
+// the leftmost pixel in the highest bit of each 3 bit row
+static const uint16_t overlayFont[64] = {
+	0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x52a5, 0x0000, 0x0000, //  !"#$%&'
+	0x1491, 0x4494, 0x0000, 0x05d0, 0x0014, 0x01c0, 0x0002, 0x12a4, // ()*+,-./
+	0x7b6f, 0x2c97, 0x73e7, 0x73cf, 0x5bc9, 0x79cf, 0x79ef, 0x7249, // 01234567
+	0x7bef, 0x7bcf, 0x0410, 0x0000, 0x0000, 0x0e38, 0x0000, 0x0000, // 89:;<=>?
+	0x0000, 0x2bed, 0x6bae, 0x3923, 0x6b6e, 0x79a7, 0x79a4, 0x396b, // @ABCDEFG
+	0x5bed, 0x7497, 0x126a, 0x5bad, 0x4927, 0x5fed, 0x6b6d, 0x2b6a, // HIJKLMNO
+	0x6ba4, 0x2b73, 0x6bad, 0x388e, 0x7492, 0x5b6f, 0x5b6a, 0x5bfd, // PQRSTUVW
+	0x5aad, 0x5a92, 0x72a7, 0x0000, 0x0000, 0x0000, 0x0000, 0x0007, // XYZ[\]^_
+};
+
+// batches screen-space quads and lines into one streaming buffer and draws
+// them with two calls, coordinates are pixels from the top left corner
+// ------------------------------------------------------------------------
+class OverlayBatch
+{
+public:
+	struct Vertex
+	{
+		float x, y;
+		uint32_t color; // 0xAABBGGRR
+	};
+
+	Shader shader;
+
+	OverlayBatch() : shader("overlayVertexShader.txt", "overlayFragmentShader.txt")
+	{
+		glGenVertexArrays(1, &VAO);
+		glGenBuffers(1, &VBO);
+		glBindVertexArray(VAO);
+		glBindBuffer(GL_ARRAY_BUFFER, VBO);
+		glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, x));
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(1, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Vertex), (void*)offsetof(Vertex, color));
+		glEnableVertexAttribArray(1);
+		glBindVertexArray(0);
+	}
+
+	// release the GL objects, must be called while the context is still current
+	// ------------------------------------------------------------------------
+	void destroy()
+	{
+		glDeleteVertexArrays(1, &VAO);
+		glDeleteBuffers(1, &VBO);
+		glDeleteProgram(shader.ID);
+	}
+	// ------------------------------------------------------------------------
+	void quad(float x0, float y0, float x1, float y1, uint32_t color)
+	{
+		triangles.insert(triangles.end(), {
+			{ x0, y0, color }, { x1, y0, color }, { x1, y1, color },
+			{ x0, y0, color }, { x1, y1, color }, { x0, y1, color } });
+	}
+	// ------------------------------------------------------------------------
+	void line(float x0, float y0, float x1, float y1, uint32_t color)
+	{
+		lines.push_back({ x0, y0, color });
+		lines.push_back({ x1, y1, color });
+	}
+
+	// text in the built-in font, each font pixel becomes scale x scale screen
+	// pixels, lower case is drawn as upper case
+	// ------------------------------------------------------------------------
+	void text(float x, float y, float scale, uint32_t color, const char* str)
+	{
+		for (const char* c = str; *c; c++, x += 4.0f * scale)
+		{
+			int ch = *c >= 'a' && *c <= 'z' ? *c - 32 : *c;
+			if (ch < 32 || ch > 95)
+				continue;
+			uint16_t glyph = overlayFont[ch - 32];
+			for (int row = 0; row < 5; row++)
+			{
+				// merge horizontal runs so most glyph rows are a single quad
+				int bits = (glyph >> (3 * (4 - row))) & 7;
+				for (int col = 0; col < 3; col++)
+				{
+					if (!(bits & (4 >> col)))
+						continue;
+					int run = col;
+					while (run + 1 < 3 && (bits & (4 >> (run + 1))))
+						run++;
+					quad(x + col * scale, y + row * scale, x + (run + 1) * scale, y + (row + 1) * scale, color);
+					col = run;
+				}
+			}
+		}
+	}
+	// ------------------------------------------------------------------------
+	void textf(float x, float y, float scale, uint32_t color, const char* format, ...)
+	{
+		char buffer[256];
+		va_list args;
+		va_start(args, format);
+		vsnprintf(buffer, sizeof(buffer), format, args);
+		va_end(args);
+		text(x, y, scale, color, buffer);
+	}
+
+	// upload everything added since the last flush and draw it in two calls
+	// ------------------------------------------------------------------------
+	void flush(int screenWidth, int screenHeight)
+	{
+		size_t triangleCount = triangles.size();
+		triangles.insert(triangles.end(), lines.begin(), lines.end());
+		if (!triangles.empty())
+		{
+			shader.use();
+			shader.setVec2("screenSize", (float)screenWidth, (float)screenHeight);
+			glEnable(GL_BLEND);
+			glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+			glBindVertexArray(VAO);
+			glBindBuffer(GL_ARRAY_BUFFER, VBO);
+			glBufferData(GL_ARRAY_BUFFER, triangles.size() * sizeof(Vertex), NULL, GL_STREAM_DRAW);
+			glBufferSubData(GL_ARRAY_BUFFER, 0, triangles.size() * sizeof(Vertex), triangles.data());
+			glDrawArrays(GL_TRIANGLES, 0, (GLsizei)triangleCount);
+			glDrawArrays(GL_LINES, (GLint)triangleCount, (GLsizei)lines.size());
+			glBindVertexArray(0);
+			glDisable(GL_BLEND);
+		}
+		triangles.clear();
+		lines.clear();
+	}
+
+private:
+	unsigned int VAO, VBO;
+	std::vector<Vertex> triangles;
+	std::vector<Vertex> lines;
+};
+
+// frame and step timings drawn in the top left corner of the window
+// ------------------------------------------------------------------------
+class PerfOverlay
+{
+public:
+	static const int HISTORY = 240;
+
+	bool visible = false;
+
+	PerfOverlay() : frameMs(HISTORY, 0.0f) {}
+
+	void destroy()
+	{
+		batch.destroy();
+	}
+
+	// record one frame, cpuSeconds is the frame's CPU work up to the swap and
+	// the step stats are from the last physics step of the frame
+	// ------------------------------------------------------------------------
+	void record(float frameSeconds, float cpuSeconds, const StepStats& stepStats, const GpuFrameStats& gpuFrameStats)
+	{
+		frameMs[head] = frameSeconds * 1000.0f;
+		head = (head + 1) % HISTORY;
+		cpuMs = cpuSeconds * 1000.0f;
+		stats = stepStats;
+		gpuStats = gpuFrameStats;
+	}
+	// ------------------------------------------------------------------------
+	void recordParticles(const ParticleStats& particleStats)
+	{
+		particles = particleStats;
+	}
+	// ------------------------------------------------------------------------
+	void recordSoftBodies(const SoftBodyStats& softBodyStats)
+	{
+		softBodies = softBodyStats;
+	}
+	// ------------------------------------------------------------------------
+	void draw(int screenWidth, int screenHeight)
+	{
+		if (!visible)
+			return;
+		const float s = 2.0f;           // font pixel size
+		const float lineHeight = 7.0f * s;
+		const float x = 10.0f, width = HISTORY * 1.5f + 80.0f;
+		const uint32_t white = 0xffffffff, grey = 0xffa0a0a0, red = 0xff4040ff, green = 0xff60d060;
+		float y = 10.0f;
+
+		float last = frameMs[(head + HISTORY - 1) % HISTORY];
+		float worst = 0.0f, sum = 0.0f;
+		for (float ms : frameMs)
+		{
+			worst = ms > worst ? ms : worst;
+			sum += ms;
+		}
+
+		float panelHeight = (10 + STAGE_COUNT + GPU_PASS_COUNT) * lineHeight + GRAPH_HEIGHT + 30.0f;
+		batch.quad(x - 6.0f, y - 6.0f, x + width, y + panelHeight, 0xb0000000);
+
+		batch.textf(x, y, s, last > 33.4f ? red : white, "FRAME %6.2f MS  AVG %6.2f  MAX %6.2f", last, sum / HISTORY, worst);
+		y += lineHeight;
+		// whichever side takes longer per frame is the one holding the frame rate back
+		float gpuMs = gpuStats.totalNs * 1e-6f;
+		batch.textf(x, y, s, white, "CPU %6.2f MS  GPU %6.2f MS  %s BOUND", cpuMs, gpuMs, gpuMs > cpuMs ? "GPU" : "CPU");
+		y += lineHeight;
+		for (int p = 0; p < GPU_PASS_COUNT; p++)
+		{
+			batch.textf(x + 4.0f * s * 2.0f, y, s, grey, "GPU %-8s %6.3f MS", gpuPassName(p), gpuStats.passNs[p] * 1e-6);
+			y += lineHeight;
+		}
+		batch.textf(x, y, s, white, "STEP  %6.3f MS", stats.totalNs * 1e-6);
+		y += lineHeight;
+		for (int st = 0; st < STAGE_COUNT; st++)
+		{
+			batch.textf(x + 4.0f * s * 2.0f, y, s, grey, "%-12s %6.3f MS", stageName(st), stats.stageNs[st] * 1e-6);
+			y += lineHeight;
+		}
+		batch.textf(x, y, s, white, "BODIES %zu  AWAKE %zu  JOINTS %zu", stats.bodies, stats.awakeBodies, stats.joints);
+		y += lineHeight;
+		batch.textf(x, y, s, white, "PAIRS %zu  CONTACTS %zu  ISLANDS %zu", stats.pairs, stats.contacts, stats.islands);
+		y += lineHeight;
+		batch.textf(x, y, s, white, "PARTICLES %zu  %6.3f MS", particles.particles, particles.totalNs * 1e-6);
+		y += lineHeight;
+		batch.textf(x, y, s, white, "SOFT %zu VERTS %zu CONSTRAINTS %d COLORS %6.3f MS", softBodies.vertices,
+			softBodies.constraints, softBodies.colors, softBodies.totalNs * 1e-6);
+		y += lineHeight + 6.0f;
+
+		// rolling frame time graph, oldest on the left, with 60 and 30 fps guides
+		float graphTop = y, graphBottom = y + GRAPH_HEIGHT;
+		float msToPixels = GRAPH_HEIGHT / 50.0f;
+		batch.line(x, graphBottom - 16.7f * msToPixels, x + HISTORY * 1.5f, graphBottom - 16.7f * msToPixels, green);
+		batch.line(x, graphBottom - 33.3f * msToPixels, x + HISTORY * 1.5f, graphBottom - 33.3f * msToPixels, red);
+		for (int k = 0; k < HISTORY; k++)
+		{
+			float ms = frameMs[(head + k) % HISTORY];
+			float top = graphBottom - (ms < 50.0f ? ms : 50.0f) * msToPixels;
+			batch.quad(x + k * 1.5f, top < graphTop ? graphTop : top, x + (k + 1) * 1.5f, graphBottom, ms > 33.4f ? red : grey);
+		}
+		batch.text(x, graphBottom + 4.0f, s, grey, "F1 HIDE");
+
+		batch.flush(screenWidth, screenHeight);
+	}
+
+private:
+	static constexpr float GRAPH_HEIGHT = 80.0f;
+
+	OverlayBatch batch;
+	std::vector<float> frameMs;
+	int head = 0;
+	float cpuMs = 0.0f;
+	StepStats stats;
+	ParticleStats particles;
+	SoftBodyStats softBodies;
+	GpuFrameStats gpuStats;
+};
+#endif
@@ -0,0 +1,1632 @@
+#ifndef PHYSICS_WORLD_H
+#define PHYSICS_WORLD_H
+
+#include <algorithm>
+#include <chrono>
+#include <cfloat>
+#include <cmath>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <type_traits>
+
+#include "body_store.h"
+#include "broadphase.h"
+#include "collision.h"
+#include "collision_batch.h"
+#include "contact_solver.h"
+#include "job_system.h"
+#include "joint.h"
+#include "joint_solver.h"
+#include "profiler.h"
+#include "static_geometry.h"
+
+// stages of a step, in the order they run
+enum PhysicsStage
+{
+	STAGE_INTEGRATE = 0,   // apply gravity to awake bodies
+	STAGE_BROADPHASE,      // AABBs and candidate pairs
+	STAGE_NARROWPHASE,     // contact manifolds and warm start matching
+	STAGE_ISLANDS,         // wake touched bodies and group them into islands
+	STAGE_SOLVER,          // velocity iterations, position update and sleeping per island
+	STAGE_CONTINUOUS,      // time of impact sweeps for fast bullets
+	STAGE_COUNT
+};
+
+inline const char* stageName(int stage)
+{
+	static const char* names[STAGE_COUNT] = { "integrate", "broadphase", "narrowphase", "islands", "solver", "continuous" };
+	return stage >= 0 && stage < STAGE_COUNT ? names[stage] : "unknown";
+}
+
+// timings and counts for the most recent step
+// ------------------------------------------------------------------------
+struct StepStats
+{
+	uint64_t stageNs[STAGE_COUNT] = {};
+	uint64_t totalNs = 0;
+	size_t bodies = 0;
+	size_t awakeBodies = 0;
+	size_t pairs = 0;
+	size_t contacts = 0;
+	size_t islands = 0;
+	size_t joints = 0;
+	size_t bulletHits = 0;  // bullets pulled back to their time of impact
+	size_t levelContacts = 0;
+	size_t sensorOverlaps = 0;
+};
+
+// a ray from origin to origin + translation
+// ------------------------------------------------------------------------
+struct RayInput
+{
+	Vec2 origin;
+	Vec2 translation;
+};
+
+static const uint32_t NO_BODY = UINT32_MAX;
+
+// closest hit of a ray or shape cast, body is NO_BODY when nothing was hit.
+// Rays also hit the level, then body is NO_BODY and segment holds the segment
+// id, otherwise it is NO_SEGMENT. fraction is how far along the translation
+// the hit is, normal points out of whatever was hit
+// ------------------------------------------------------------------------
+struct RayHit
+{
+	uint32_t body;
+	uint32_t segment;
+	Vec2 point;
+	Vec2 normal;
+	float fraction;
+};
+
+// a sensor body and a body overlapping it
+// ------------------------------------------------------------------------
+struct SensorEvent
+{
+	uint32_t sensor;
+	uint32_t visitor;
+};
+
+// two bodies that started, kept or stopped touching, bodyA < bodyB. manifold
+// is the index of their manifold in PhysicsWorld::manifolds, UINT32_MAX for
+// end events
+// ------------------------------------------------------------------------
+struct ContactEvent
+{
+	uint32_t bodyA, bodyB;
+	uint32_t manifold;
+};
+
+// ------------------------------------------------------------------------
+struct WorldSettings
+{
+	SolverSettings solver;
+	bool allowSleep = true;
+	float sleepLinearVelocity = 0.05f;
+	float sleepAngularVelocity = 0.035f;
+	float timeToSleep = 0.5f;
+	// contacts of moving bodies are searched up to the distance they can cover in
+	// one step, capped here, so the solver stops them before they pass through
+	float maxSpeculativeDistance = 1.0f;
+	// sweep bullets that move further than half their size in a step
+	bool continuous = true;
+	// steps between sorting the bodies into Morton order of their position, so
+	// bodies that touch sit close together in memory, 0 keeps creation order
+	int reorderInterval = 64;
+	// fill PhysicsWorld::contactBegin, contactPersist and contactEnd every step
+	bool contactEvents = true;
+};
+
+// Compile time configuration of a BasicPhysicsWorld. The broadphase and the
+// contact solver are used through their concrete types, broadphase.h and
+// contact_solver.h say what either has to provide. A stage switched off here
+// is cut out of step() altogether, where the WorldSettings switches are only
+// checked at run time. A configuration derives from this one and overrides
+// what it changes:
+//
+//     struct PuzzleConfig : DefaultWorldConfig
+//     {
+//         static constexpr bool continuous = false;
+//         static constexpr bool level = false;
+//     };
+//     typedef BasicPhysicsWorld<PuzzleConfig> PuzzleWorld;
+//
+// Without sleeping every body stays awake, without level geometry or sensors
+// the level is never collided or swept against (queries still see it) and
+// sensor bodies never report overlaps, and without contact events the three
+// event arrays stay empty.
+//
+// Scalar is what bodies, joints and contacts are stored and stepped in: float,
+// double or the fixed point Q16_16 and Q32_32 of scalar.h. The broadphase,
+// queries, level and bullet sweeps stay float and see the bodies converted,
+// turned with the world's own trig. A fixed point world without level geometry
+// or bullets steps the same bit for bit on every machine and thread count with
+// no build flags. The level and the sweeps' time of impact are float math, so
+// with either it also needs the float rules of scalar.h.
+// ------------------------------------------------------------------------
+struct DefaultWorldConfig
+{
+	typedef GridBroadphase Broadphase;
+	typedef SequentialImpulseSolver Solver;
+	typedef float Scalar;
+	static constexpr bool sleeping = true;
+	static constexpr bool continuous = true;
+	static constexpr bool level = true;
+	static constexpr bool sensors = true;
+	static constexpr bool contactEvents = true;
+	static constexpr bool reorder = true;
+};
+
+template<class Config>
+class BasicPhysicsWorld
+{
+	static_assert(std::is_same<typename Config::Scalar, float>::value || std::is_same<typename Config::Scalar, double>::value ||
+		std::is_same<typename Config::Scalar, Q16_16>::value || std::is_same<typename Config::Scalar, Q32_32>::value,
+		"BasicPhysicsWorld steps float, double, Q16_16 or Q32_32 bodies");
+
+public:
+	typedef typename Config::Broadphase Broadphase;
+	typedef typename Config::Solver Solver;
+	typedef typename Config::Scalar Scalar;
+	// bodies, joints and contacts in the scalar of the world, the float ones
+	// for PhysicsWorld
+	typedef BodyStoreT<Scalar> BodyStore;
+	typedef JointStoreT<Scalar> JointStore;
+	typedef ManifoldT<Scalar> Manifold;
+
+	float gravityX = 0.0f;
+	float gravityY = -10.0f;
+	WorldSettings settings;
+	BodyStore bodies;
+	Broadphase broadphase;
+	// manifolds with at least one point from the last step, sorted by body pair
+	std::vector<Manifold> manifolds;
+	JointStore joints;
+	// contacts of bodies with the level, bodyA holds the segment id and bodyB the
+	// body, sorted by body then segment
+	std::vector<Manifold> levelManifolds;
+	// pair keys (see makePairKey) of every sensor overlapping a body, sorted, and
+	// the overlaps that began and ended in the last step. Sensors have no
+	// manifolds and push nothing, and they don't see level geometry.
+	std::vector<uint64_t> sensorOverlaps;
+	std::vector<SensorEvent> sensorBegin, sensorEnd;
+	// Contacts between bodies that began, continued and ended in the last step,
+	// in pair order, for game code to walk after step() instead of being called
+	// back from inside the solver threads. Each narrowphase thread marks the
+	// pairs it collides and the marks are gathered into these arrays in one pass
+	// at the end of the stage. Pairs that fall asleep touching stay touching
+	// without persist events until they wake. Contacts with the level aren't
+	// reported. The events hold body indices, which removeBodies and
+	// reorderBodies change, so read them before either.
+	std::vector<ContactEvent> contactBegin, contactPersist, contactEnd;
+	StepStats stats;
+
+	// immovable level geometry, see static_geometry.h. It is only read while
+	// stepping, so copies of a world (WorldBatch, rollback prototypes) share
+	// one level instead of each holding its meshes, terrain and tree
+	// ------------------------------------------------------------------------
+	const StaticGeometry& level() const
+	{
+		return *levelData;
+	}
+	// the level to add geometry to, copied first if other worlds share it
+	// ------------------------------------------------------------------------
+	StaticGeometry& editLevel()
+	{
+		if (levelData.use_count() > 1)
+			levelData = std::make_shared<StaticGeometry>(*levelData);
+		return *levelData;
+	}
+
+	// add a single body and return its current index, see bodyHandle
+	// ------------------------------------------------------------------------
+	uint32_t createBody(const BodyDef& def)
+	{
+		size_t i = bodies.size();
+		bodies.resize(i + 1);
+		bodies.set(i, def);
+		return (uint32_t)i;
+	}
+	// ------------------------------------------------------------------------
+	void reserveBodies(size_t n)
+	{
+		bodies.reserve(n);
+	}
+	// ------------------------------------------------------------------------
+	size_t bodyCount() const
+	{
+		return bodies.size();
+	}
+	// body indices change when bodies are removed or reordered, the handle of a
+	// body stays the same for its whole life and maps back to its index
+	// ------------------------------------------------------------------------
+	uint32_t bodyHandle(uint32_t index)
+	{
+		syncHandles();
+		return bodies.handle[index];
+	}
+	// index of the body with this handle, NO_BODY once it is gone
+	// ------------------------------------------------------------------------
+	uint32_t bodyIndex(uint32_t handle)
+	{
+		syncHandles();
+		return handle < handleIndex.size() ? handleIndex[handle] : NO_BODY;
+	}
+	// add a joint between two existing bodies and return its id, see JointDef
+	// ------------------------------------------------------------------------
+	uint32_t createJoint(const JointDef& def)
+	{
+		uint32_t j = joints.allocate();
+		uint32_t a = def.bodyA, b = def.bodyB;
+		// worked out in the scalar of the world, the local frames are part of its state
+		Vec2T<Scalar> pA(bodies.posX[a], bodies.posY[a]), pB(bodies.posX[b], bodies.posY[b]);
+		RotT<Scalar> qA(bodies.angle[a]), qB(bodies.angle[b]);
+		Vec2T<Scalar> anchorA(def.anchorA.x, def.anchorA.y);
+		Vec2T<Scalar> anchorB = def.type == JOINT_DISTANCE ? Vec2T<Scalar>(def.anchorB.x, def.anchorB.y) : anchorA;
+		// the motor joint targets B's current offset from A
+		Vec2T<Scalar> localA = rotateInv(qA, (def.type == JOINT_MOTOR ? pB : anchorA) - pA);
+		Vec2T<Scalar> localB = rotateInv(qB, anchorB - pB);
+		Vec2T<Scalar> direction(def.axis.x, def.axis.y);
+		Scalar axisLength = length(direction);
+		Vec2T<Scalar> axis = rotateInv(qA, axisLength > 0.0f ? (1.0f / axisLength) * direction : Vec2T<Scalar>(1.0f, 0.0f));
+		bool limited = def.type == JOINT_REVOLUTE || def.type == JOINT_PRISMATIC;
+
+		joints.type[j] = def.type;
+		joints.bodyA[j] = a;
+		joints.bodyB[j] = b;
+		joints.localAnchorAX[j] = localA.x; joints.localAnchorAY[j] = localA.y;
+		joints.localAnchorBX[j] = localB.x; joints.localAnchorBY[j] = localB.y;
+		joints.localAxisX[j] = axis.x; joints.localAxisY[j] = axis.y;
+		joints.referenceAngle[j] = bodies.angle[b] - bodies.angle[a];
+		joints.length[j] = def.length >= 0.0f ? Scalar(def.length) : length(anchorB - anchorA);
+		joints.hertz[j] = def.hertz;
+		joints.dampingRatio[j] = def.dampingRatio;
+		joints.enableLimit[j] = limited && def.enableLimit;
+		joints.lower[j] = def.lower;
+		joints.upper[j] = def.upper;
+		joints.enableMotor[j] = limited && def.enableMotor;
+		joints.motorSpeed[j] = def.motorSpeed;
+		joints.maxMotorForce[j] = def.maxMotorForce;
+		joints.maxForce[j] = def.maxForce;
+		joints.maxTorque[j] = def.maxTorque;
+		joints.correctionFactor[j] = def.correctionFactor;
+		joints.collideConnected[j] = def.collideConnected;
+		wakeBody(a);
+		wakeBody(b);
+		return j;
+	}
+	// ------------------------------------------------------------------------
+	void destroyJoint(uint32_t j)
+	{
+		if (j >= joints.size() || !joints.alive[j])
+			return;
+		wakeBody(joints.bodyA[j]);
+		wakeBody(joints.bodyB[j]);
+		joints.release(j);
+	}
+	// remove every body with remove[i] set, the rest keep their order and move
+	// down. remap receives the new index of each old body, UINT32_MAX for removed
+	// ones. Joints on removed bodies go with them, contacts are carried over so
+	// the bodies that stay keep warm starting.
+	// ------------------------------------------------------------------------
+	size_t removeBodies(const std::vector<uint8_t>& remove, std::vector<uint32_t>& remap)
+	{
+		syncHandles();
+		size_t n = bodies.size();
+		remap.resize(n);
+		uint32_t count = 0;
+		for (size_t i = 0; i < n; i++)
+		{
+			remap[i] = i < remove.size() && remove[i] ? UINT32_MAX : count++;
+			if (remap[i] == UINT32_MAX)
+				handleIndex[bodies.handle[i]] = NO_BODY;
+		}
+		if (count == n)
+			return 0;
+		bodies.compact(remap, count);
+		for (uint32_t i = 0; i < count; i++)
+			handleIndex[bodies.handle[i]] = i;
+		handledBodies = count;
+
+		for (size_t j = 0; j < joints.size(); j++)
+		{
+			if (!joints.alive[j])
+				continue;
+			uint32_t a = remap[joints.bodyA[j]], b = remap[joints.bodyB[j]];
+			if (a == UINT32_MAX || b == UINT32_MAX)
+			{
+				if (a != UINT32_MAX)
+					wakeBody(a);
+				if (b != UINT32_MAX)
+					wakeBody(b);
+				joints.release((uint32_t)j);
+				continue;
+			}
+			joints.bodyA[j] = a;
+			joints.bodyB[j] = b;
+		}
+		// the remap keeps the order, so the manifolds stay sorted by pair
+		size_t kept = 0;
+		for (size_t k = 0; k < manifolds.size(); k++)
+		{
+			Manifold& m = manifolds[k];
+			uint32_t a = remap[m.bodyA], b = remap[m.bodyB];
+			if (a == UINT32_MAX || b == UINT32_MAX)
+				continue;
+			m.bodyA = a;
+			m.bodyB = b;
+			manifolds[kept++] = m;
+		}
+		manifolds.resize(kept);
+		previous.clear();
+		kept = 0;
+		for (size_t k = 0; k < levelManifolds.size(); k++)
+		{
+			Manifold& m = levelManifolds[k];
+			if (remap[m.bodyB] == UINT32_MAX)
+				continue;
+			m.bodyB = remap[m.bodyB];
+			levelManifolds[kept++] = m;
+		}
+		levelManifolds.resize(kept);
+		levelPrevious.clear();
+		// overlaps with removed bodies go without an end event
+		kept = 0;
+		for (uint64_t key : sensorOverlaps)
+		{
+			uint32_t a = remap[pairKeyA(key)], b = remap[pairKeyB(key)];
+			if (a != UINT32_MAX && b != UINT32_MAX)
+				sensorOverlaps[kept++] = makePairKey(a, b);
+		}
+		sensorOverlaps.resize(kept);
+		sensorBegin.clear();
+		sensorEnd.clear();
+		kept = 0;
+		for (uint64_t key : touching)
+		{
+			uint32_t a = remap[pairKeyA(key)], b = remap[pairKeyB(key)];
+			if (a != UINT32_MAX && b != UINT32_MAX)
+				touching[kept++] = makePairKey(a, b);
+		}
+		touching.resize(kept);
+		clearContactEvents();
+		return n - count;
+	}
+	// ------------------------------------------------------------------------
+	void clear()
+	{
+		bodies.resize(0);
+		joints.clear();
+		manifolds.clear();
+		previous.clear();
+		handleIndex.clear();
+		handledBodies = 0;
+		stepCount = 0;
+		levelData = std::make_shared<StaticGeometry>();
+		levelManifolds.clear();
+		levelPrevious.clear();
+		sensorOverlaps.clear();
+		sensorBegin.clear();
+		sensorEnd.clear();
+		touching.clear();
+		clearContactEvents();
+	}
+	// sort the bodies into Morton (Z) order of their position so that bodies close
+	// in space are close in memory, and remap joints, contacts and handles. Runs
+	// by itself every settings.reorderInterval steps.
+	// ------------------------------------------------------------------------
+	void reorderBodies()
+	{
+		size_t n = bodies.size();
+		if (n < 2)
+			return;
+		syncHandles();
+
+		float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX;
+		for (size_t i = 0; i < n; i++)
+		{
+			minX = fminf(minX, toFloat(bodies.posX[i]));
+			maxX = fmaxf(maxX, toFloat(bodies.posX[i]));
+			minY = fminf(minY, toFloat(bodies.posY[i]));
+			maxY = fmaxf(maxY, toFloat(bodies.posY[i]));
+		}
+		float scaleX = 65535.0f / fmaxf(maxX - minX, 1e-6f);
+		float scaleY = 65535.0f / fmaxf(maxY - minY, 1e-6f);
+		// code in the high half, index in the low half keeps ties in their old order
+		mortonKeys.resize(n);
+		for (size_t i = 0; i < n; i++)
+		{
+			uint32_t x = (uint32_t)fminf(fmaxf((toFloat(bodies.posX[i]) - minX) * scaleX, 0.0f), 65535.0f);
+			uint32_t y = (uint32_t)fminf(fmaxf((toFloat(bodies.posY[i]) - minY) * scaleY, 0.0f), 65535.0f);
+			mortonKeys[i] = ((uint64_t)(spreadBits(x) | (spreadBits(y) << 1)) << 32) | i;
+		}
+		radixSortHigh(mortonKeys, mortonScratch);
+
+		bool ordered = true;
+		reorderMap.resize(n);
+		bodyOrder.resize(n);
+		for (size_t k = 0; k < n; k++)
+		{
+			uint32_t i = (uint32_t)mortonKeys[k];
+			bodyOrder[k] = i;
+			reorderMap[i] = (uint32_t)k;
+			ordered = ordered && i == k;
+		}
+		if (ordered)
+			return;
+		bodies.permute(bodyOrder);
+
+		for (size_t j = 0; j < joints.size(); j++)
+		{
+			if (!joints.alive[j])
+				continue;
+			joints.bodyA[j] = reorderMap[joints.bodyA[j]];
+			joints.bodyB[j] = reorderMap[joints.bodyB[j]];
+		}
+		// manifolds keep the lower index as body A, so pairs that swap order flip
+		// their normal, the impulses stay valid as they are
+		for (Manifold& m : manifolds)
+		{
+			uint32_t a = reorderMap[m.bodyA], b = reorderMap[m.bodyB];
+			if (a > b)
+			{
+				std::swap(a, b);
+				m.normal = -m.normal;
+			}
+			m.bodyA = a;
+			m.bodyB = b;
+		}
+		std::sort(manifolds.begin(), manifolds.end(), [](const Manifold& p, const Manifold& q) {
+			return makePairKey(p.bodyA, p.bodyB) < makePairKey(q.bodyA, q.bodyB);
+		});
+		previous.clear();
+		for (Manifold& m : levelManifolds)
+			m.bodyB = reorderMap[m.bodyB];
+		std::sort(levelManifolds.begin(), levelManifolds.end(), [](const Manifold& p, const Manifold& q) {
+			return levelKey(p) < levelKey(q);
+		});
+		levelPrevious.clear();
+		for (uint64_t& key : sensorOverlaps)
+			key = makePairKey(reorderMap[pairKeyA(key)], reorderMap[pairKeyB(key)]);
+		std::sort(sensorOverlaps.begin(), sensorOverlaps.end());
+		sensorBegin.clear();
+		sensorEnd.clear();
+		for (uint64_t& key : touching)
+			key = makePairKey(reorderMap[pairKeyA(key)], reorderMap[pairKeyB(key)]);
+		std::sort(touching.begin(), touching.end());
+		clearContactEvents();
+		for (uint32_t i = 0; i < n; i++)
+			handleIndex[bodies.handle[i]] = i;
+	}
+	// run the step stages on this job system, nullptr runs everything on the calling thread
+	// the job system is not owned and has to outlive the world or be reset
+	// ------------------------------------------------------------------------
+	void setJobSystem(JobSystem* jobSystem)
+	{
+		jobs = jobSystem;
+	}
+
+	JobSystem* jobSystem() const
+	{
+		return jobs;
+	}
+
+	// advance the world by dt seconds
+	// ------------------------------------------------------------------------
+	void step(float dt)
+	{
+		typedef std::chrono::steady_clock Clock;
+		Clock::time_point stageStart = Clock::now();
+		Clock::time_point stepStart = stageStart;
+		auto endStage = [&](int stage) {
+			Clock::time_point now = Clock::now();
+			stats.stageNs[stage] = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(now - stageStart).count();
+			stageStart = now;
+		};
+
+		PROFILE_ZONE("step");
+		syncHandles();
+		{
+			PROFILE_ZONE("integrate");
+			integrateVelocities(dt);
+		}
+		endStage(STAGE_INTEGRATE);
+		{
+			PROFILE_ZONE("broadphase");
+			// the reorder is paid for in the broadphase stage, where most of its win is
+			if constexpr (Config::reorder)
+				if (settings.reorderInterval > 0 && ++stepCount % settings.reorderInterval == 0)
+					reorderBodies();
+			broadphase.update(bodies, 0.5f * settings.solver.contactMargin, speculative.data(), jobs, pairs, sensorPairs);
+		}
+		endStage(STAGE_BROADPHASE);
+		{
+			PROFILE_ZONE("narrowphase");
+			collide();
+			if constexpr (Config::level)
+				collideLevel();
+			if constexpr (Config::sensors)
+				updateSensors();
+		}
+		endStage(STAGE_NARROWPHASE);
+		{
+			PROFILE_ZONE("islands");
+			buildIslands();
+		}
+		endStage(STAGE_ISLANDS);
+		{
+			PROFILE_ZONE("solver");
+			solveIslands(dt);
+		}
+		endStage(STAGE_SOLVER);
+		{
+			PROFILE_ZONE("continuous");
+			if constexpr (Config::continuous)
+				solveContinuous(dt);
+		}
+		endStage(STAGE_CONTINUOUS);
+
+		stats.totalNs = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(stageStart - stepStart).count();
+		stats.bodies = bodies.size();
+		stats.pairs = pairs.size();
+		stats.contacts = manifolds.size();
+		stats.levelContacts = levelManifolds.size();
+		stats.sensorOverlaps = sensorOverlaps.size();
+		stats.islands = islandCount();
+		stats.joints = joints.liveCount;
+		stats.awakeBodies = islandBodies.size();
+	}
+	// Queries run against the broadphase of the last step, a body that moved
+	// further than its speculative margin in that step may be missed. Ray and
+	// shape casts pass through sensors. None of them allocate, so they can be
+	// called from any number of threads between steps.
+
+	// closest body or level segment along the ray, false if it hits nothing
+	// ------------------------------------------------------------------------
+	bool raycast(const RayInput& ray, RayHit& hit) const
+	{
+		hit.body = NO_BODY;
+		hit.segment = NO_SEGMENT;
+		hit.fraction = 1.0f;
+		const Vec2& o = ray.origin;
+		const Vec2& d = ray.translation;
+		broadphase.forEachAlongRay(o.x, o.y, d.x, d.y, 1.0f, [&](uint32_t j, float maxT) {
+			float t;
+			Vec2 n;
+			if (bodies.sensor[j] || !rayCastShape(shapeTransform(j), bodies.shape[j] == SHAPE_CIRCLE, o, d, maxT, t, n))
+				return maxT;
+			hit.body = j;
+			hit.point = o + t * d;
+			hit.normal = n;
+			hit.fraction = t;
+			return t;
+		});
+		float t;
+		Vec2 n;
+		uint32_t segment;
+		if (level().raycast(o, d, hit.fraction, t, n, segment))
+		{
+			hit.body = NO_BODY;
+			hit.point = o + t * d;
+			hit.normal = n;
+			hit.fraction = t;
+		}
+		hit.segment = segment;
+		return hit.body != NO_BODY || hit.segment != NO_SEGMENT;
+	}
+	// closest hit of every ray, written to hits[k] for rays[k] and spread over
+	// the job system. hits must have room for count entries.
+	// ------------------------------------------------------------------------
+	void raycastBatch(const RayInput* rays, RayHit* hits, size_t count)
+	{
+		struct Batch
+		{
+			const RayInput* rays;
+			RayHit* hits;
+		} batch = { rays, hits };
+		// two pointers of capture stay inside std::function's small buffer, so
+		// handing the loop to the job system doesn't allocate either
+		forRange(count, [this, &batch](size_t begin, size_t end, int) {
+			for (size_t k = begin; k < end; k++)
+				raycast(batch.rays[k], batch.hits[k]);
+		});
+	}
+	// call fn(body) for every body whose broadphase AABB overlaps the box
+	// ------------------------------------------------------------------------
+	template<class Fn>
+	void queryAABB(float minX, float minY, float maxX, float maxY, Fn&& fn) const
+	{
+		broadphase.forEachOverlapping(minX, minY, maxX, maxY, fn);
+	}
+	// call fn(body) for every body overlapping the shape
+	// ------------------------------------------------------------------------
+	template<class Fn>
+	void overlapShape(const ShapeTransform& shape, bool circle, Fn&& fn) const
+	{
+		float r = circle ? shape.extentX : sqrtf(shape.extentX * shape.extentX + shape.extentY * shape.extentY);
+		broadphase.forEachOverlapping(shape.p.x - r, shape.p.y - r, shape.p.x + r, shape.p.y + r, [&](uint32_t j) {
+			Vec2 n;
+			if (shapeDistance(shape, circle, shapeTransform(j), bodies.shape[j] == SHAPE_CIRCLE, n) < 0.0f)
+				fn(j);
+		});
+	}
+	// first body the shape runs into when moved by translation without turning.
+	// The hit stops the linear slop short of touching, so the shape fits at
+	// shape.p + fraction * translation. A shape that starts overlapping a body
+	// hits it at fraction 0.
+	// ------------------------------------------------------------------------
+	bool shapeCast(const ShapeTransform& shape, bool circle, const Vec2& translation, RayHit& hit) const
+	{
+		hit.body = NO_BODY;
+		hit.segment = NO_SEGMENT;
+		hit.fraction = 1.0f;
+		float r = circle ? shape.extentX : sqrtf(shape.extentX * shape.extentX + shape.extentY * shape.extentY);
+		Vec2 end = shape.p + translation;
+		float target = settings.solver.linearSlop;
+		broadphase.forEachOverlapping(fminf(shape.p.x, end.x) - r, fminf(shape.p.y, end.y) - r,
+			fmaxf(shape.p.x, end.x) + r, fmaxf(shape.p.y, end.y) + r, [&](uint32_t j) {
+			if (bodies.sensor[j])
+				return;
+			Vec2 n;
+			float t = timeOfImpact(shape, circle, translation, 0.0f, shapeTransform(j), bodies.shape[j] == SHAPE_CIRCLE,
+				target, hit.fraction, n);
+			if (t >= hit.fraction)
+				return;
+			ShapeTransform moved = shape;
+			moved.p = shape.p + t * translation;
+			hit.body = j;
+			hit.point = supportPoint(moved, circle, n);
+			hit.normal = -n;
+			hit.fraction = t;
+		});
+		return hit.body != NO_BODY;
+	}
+
+	// ------------------------------------------------------------------------
+	size_t islandCount() const
+	{
+		return islandBodyStart.empty() ? 0 : islandBodyStart.size() - 1;
+	}
+
+	// call fn on every array and value that carries over from one step to the
+	// next, everything else step() rebuilds from these. All of it is trivially
+	// copyable, so a saved copy put back with the same settings, level and thread
+	// count steps on exactly as the original did, see rollback.h. Events and
+	// stats describe the last step and are not part of it.
+	// ------------------------------------------------------------------------
+	template<class Fn>
+	void forEachState(Fn&& fn)
+	{
+		fn(gravityX); fn(gravityY);
+		bodies.forEachField(fn);
+		joints.forEachField(fn);
+		fn(joints.freeList); fn(joints.liveCount);
+		fn(manifolds);
+		fn(levelManifolds);
+		fn(sensorOverlaps);
+		fn(touching);
+		fn(handleIndex); fn(handledBodies);
+		fn(stepCount);
+	}
+
+private:
+	static constexpr uint32_t LARGE_ISLAND_CONTACTS = 64;
+	static constexpr size_t COLLIDE_BLOCK = 256;
+
+	JobSystem* jobs = nullptr;
+	std::shared_ptr<StaticGeometry> levelData = std::make_shared<StaticGeometry>();
+	std::vector<uint64_t> pairs;
+	std::vector<Manifold> previous;
+	typedef SolverBodyT<Scalar> SolverBody;
+	typedef JointSolverDataT<Scalar> JointSolverData;
+
+	// how far each body can move this step, added to its contact margin
+	std::vector<Scalar> speculative;
+	std::vector<uint32_t> bullets;
+	std::vector<size_t> threadHits;
+	// per thread queues of circle pairs for the batched narrowphase
+	std::vector<std::vector<uint32_t>> circleSlots, boxCircleSlots;
+	std::vector<Scalar> rotC, rotS;
+	// handle -> body index, bodies from handledBodies on have not been seen yet
+	std::vector<uint32_t> handleIndex;
+	size_t handledBodies = 0;
+	uint64_t stepCount = 0;
+	std::vector<uint64_t> mortonKeys, mortonScratch;
+	std::vector<uint32_t> bodyOrder, reorderMap;
+	std::vector<Manifold> levelPrevious;
+	std::vector<std::vector<Manifold>> threadLevel;
+	std::vector<uint32_t> islandLevelStart, islandLevel;
+	std::vector<uint64_t> sensorPairs, sensorPrevious;
+	// pair keys of bodies touching at the end of the last step, for the contact events
+	std::vector<uint64_t> touching, touchingPrevious;
+	std::vector<uint8_t> contactState;
+	std::vector<uint8_t> sensorHit;
+
+	// islands are stored as ranges into flat body and contact lists
+	std::vector<uint32_t> parent;
+	std::vector<uint32_t> islandOf;
+	std::vector<uint32_t> islandBodyStart, islandBodies;
+	std::vector<uint32_t> islandContactStart, islandContacts;
+	std::vector<uint32_t> islandJointStart, islandJoints;
+	std::vector<uint8_t> rootAwake;
+	std::vector<JointSolverData> jointData;
+	// jointed body pairs that must not collide, sorted
+	std::vector<uint64_t> noCollide;
+	std::vector<uint32_t> islandOrder;
+	size_t largeIslands = 0;
+	std::vector<uint32_t> localIndex;
+	std::vector<std::vector<SolverBody>> solverScratch;
+
+	template<class Fn>
+	void forRange(size_t count, Fn&& fn)
+	{
+		if (jobs)
+			jobs->parallelFor(count, fn);
+		else if (count > 0)
+			fn(0, count, 0);
+	}
+
+	// hand out handles to bodies added since the last call, bodies coming back
+	// with a handle (streamed tiles) get their old one back. Bodies are only ever
+	// appended, removal and reordering fix the table themselves.
+	void syncHandles()
+	{
+		size_t n = bodies.size();
+		if (handledBodies > n)
+			handledBodies = n;
+		for (size_t i = handledBodies; i < n; i++)
+		{
+			uint32_t& h = bodies.handle[i];
+			if (h == UINT32_MAX)
+			{
+				h = (uint32_t)handleIndex.size();
+				handleIndex.push_back((uint32_t)i);
+			}
+			else
+			{
+				if (h >= handleIndex.size())
+					handleIndex.resize(h + 1, NO_BODY);
+				handleIndex[h] = (uint32_t)i;
+			}
+		}
+		handledBodies = n;
+	}
+
+	// spread the low 16 bits of v out to the even bits
+	static uint32_t spreadBits(uint32_t v)
+	{
+		v &= 0xffff;
+		v = (v | (v << 8)) & 0x00ff00ff;
+		v = (v | (v << 4)) & 0x0f0f0f0f;
+		v = (v | (v << 2)) & 0x33333333;
+		v = (v | (v << 1)) & 0x55555555;
+		return v;
+	}
+
+	// stable sort by the high 32 bits, four 8-bit counting passes
+	static void radixSortHigh(std::vector<uint64_t>& keys, std::vector<uint64_t>& scratch)
+	{
+		scratch.resize(keys.size());
+		for (int shift = 32; shift < 64; shift += 8)
+		{
+			size_t count[257] = {};
+			for (uint64_t k : keys)
+				count[((k >> shift) & 0xff) + 1]++;
+			for (int b = 0; b < 256; b++)
+				count[b + 1] += count[b];
+			for (uint64_t k : keys)
+				scratch[count[(k >> shift) & 0xff]++] = k;
+			keys.swap(scratch);
+		}
+	}
+
+	// without sleeping every dynamic body is awake from creation on
+	void wakeBody(uint32_t b)
+	{
+		if constexpr (Config::sleeping)
+		{
+			if (bodies.invMass[b] > 0.0f)
+			{
+				bodies.awake[b] = 1;
+				bodies.sleepTime[b] = 0.0f;
+			}
+		}
+	}
+
+	// radius of the circle around the body centre that holds the whole shape
+	Scalar boundingRadius(uint32_t i) const
+	{
+		Scalar ex = bodies.extentX[i], ey = bodies.extentY[i];
+		return bodies.shape[i] == SHAPE_CIRCLE ? ex : scalarSqrt(ex * ex + ey * ey);
+	}
+
+	// apply gravity and work out how far each body can travel this step
+	// ------------------------------------------------------------------------
+	void integrateVelocities(float dt)
+	{
+		Scalar h = dt;
+		Scalar gx = gravityX * dt, gy = gravityY * dt;
+		Scalar maxDistance = settings.maxSpeculativeDistance;
+		speculative.resize(bodies.size());
+		forRange(bodies.size(), [&](size_t begin, size_t end, int) {
+			// Q16_16 has a wide kernel for the gravity, 8 bodies to an AVX2 add
+			constexpr bool wide = std::is_same<Scalar, Q16_16>::value;
+			if constexpr (wide)
+			{
+				fixedAddMasked(&bodies.velX[begin], &bodies.awake[begin], gx, end - begin);
+				fixedAddMasked(&bodies.velY[begin], &bodies.awake[begin], gy, end - begin);
+			}
+			for (size_t i = begin; i < end; i++)
+			{
+				// awake is 0 or 1, so this skips sleeping and static bodies without a branch
+				Scalar a = bodies.awake[i];
+				if constexpr (!wide)
+				{
+					bodies.velX[i] += a * gx;
+					bodies.velY[i] += a * gy;
+				}
+				// circles look the same at any angle, so only boxes add their spin
+				Scalar spin = bodies.shape[i] == SHAPE_CIRCLE ? 0.0f : scalarAbs(bodies.angVel[i]) * boundingRadius((uint32_t)i);
+				Scalar reach = h * (scalarSqrt(bodies.velX[i] * bodies.velX[i] + bodies.velY[i] * bodies.velY[i]) + spin);
+				speculative[i] = a * scalarMin(reach, maxDistance);
+			}
+		});
+	}
+
+	// the float shape of a body, for the queries, sensors and sweeps. It is
+	// turned in the world's scalar, with the same trig as the narrowphase.
+	ShapeTransform shapeTransform(uint32_t i) const
+	{
+		ShapeTransform t;
+		RotT<Scalar> q(bodies.angle[i]);
+		t.p = Vec2(toFloat(bodies.posX[i]), toFloat(bodies.posY[i]));
+		t.q.c = toFloat(q.c);
+		t.q.s = toFloat(q.s);
+		t.extentX = toFloat(bodies.extentX[i]);
+		t.extentY = toFloat(bodies.extentY[i]);
+		return t;
+	}
+
+	// ------------------------------------------------------------------------
+	void collide()
+	{
+		noCollide.clear();
+		for (size_t j = 0; j < joints.size(); j++)
+			if (joints.alive[j] && !joints.collideConnected[j])
+				noCollide.push_back(makePairKey(joints.bodyA[j], joints.bodyB[j]));
+		std::sort(noCollide.begin(), noCollide.end());
+
+		manifolds.swap(previous);
+		manifolds.resize(pairs.size());
+		const bool events = Config::contactEvents && settings.contactEvents;
+		if (events)
+		{
+			touching.swap(touchingPrevious);
+			contactState.resize(pairs.size());
+		}
+		size_t threads = jobs ? (size_t)jobs->threadCount() : 1;
+		if (circleSlots.size() < threads)
+		{
+			circleSlots.resize(threads);
+			boxCircleSlots.resize(threads);
+		}
+		// every body sits in several pairs, so work out each rotation once
+		rotC.resize(bodies.size());
+		rotS.resize(bodies.size());
+		forRange(bodies.size(), [this](size_t begin, size_t end, int) {
+			for (size_t i = begin; i < end; i++)
+			{
+				bool box = bodies.shape[i] == SHAPE_BOX;
+				rotC[i] = box ? scalarCos(bodies.angle[i]) : 1.0f;
+				rotS[i] = box ? scalarSin(bodies.angle[i]) : 0.0f;
+			}
+		});
+		CollideBatchInputT<Scalar> batch;
+		batch.bodies = &bodies;
+		batch.speculative = speculative.data();
+		batch.rotC = rotC.data();
+		batch.rotS = rotS.data();
+		batch.contactMargin = settings.solver.contactMargin;
+		batch.pairs = pairs.data();
+		batch.manifolds = manifolds.data();
+		forRange(pairs.size(), [this, &batch, events](size_t begin, size_t end, int thread) {
+			// pairs with a circle are queued by shape pair and run in batches,
+			// box pairs go straight through the clipping test. Blocks are small
+			// enough that their manifolds are still in cache for the matching.
+			std::vector<uint32_t>& circles = circleSlots[thread];
+			std::vector<uint32_t>& boxCircles = boxCircleSlots[thread];
+			// pairs and last step's manifolds are both sorted by key, so the
+			// search for the previous manifold only ever moves forward
+			size_t cursor = begin < end ? findPrevious(pairs[begin]) : 0;
+			size_t touchCursor = 0;
+			if (events && begin < end)
+				touchCursor = std::lower_bound(touchingPrevious.begin(), touchingPrevious.end(), pairs[begin]) - touchingPrevious.begin();
+			for (size_t block = begin; block < end; block += COLLIDE_BLOCK)
+			{
+				size_t blockEnd = std::min(end, block + COLLIDE_BLOCK);
+				circles.clear();
+				boxCircles.clear();
+				for (size_t k = block; k < blockEnd; k++)
+				{
+					Manifold& m = manifolds[k];
+					if (!noCollide.empty() && std::binary_search(noCollide.begin(), noCollide.end(), pairs[k]))
+					{
+						m.pointCount = 0;
+						continue;
+					}
+					uint32_t a = pairKeyA(pairs[k]), b = pairKeyB(pairs[k]);
+					int type = bodies.shape[a] * 2 + bodies.shape[b];
+					if (type == SHAPE_CIRCLE * 2 + SHAPE_CIRCLE)
+						circles.push_back((uint32_t)k);
+					else if (type != SHAPE_BOX * 2 + SHAPE_BOX)
+						boxCircles.push_back((uint32_t)k);
+					else
+					{
+						m.bodyA = a;
+						m.bodyB = b;
+						m.friction = scalarSqrt(bodies.friction[a] * bodies.friction[b]);
+						Scalar margin = batch.contactMargin + speculative[a] + speculative[b];
+						collideBoxes(m, batchShapeTransform(batch, a), batchShapeTransform(batch, b), margin);
+					}
+				}
+				collideCirclesBatch(batch, circles.data(), circles.size());
+				collideBoxCirclesBatch(batch, boxCircles.data(), boxCircles.size());
+				for (size_t k = block; k < blockEnd; k++)
+				{
+					if (manifolds[k].pointCount > 0)
+						matchPrevious(manifolds[k], pairs[k], cursor);
+					if (events)
+						contactState[k] = markContact(manifolds[k].pointCount > 0, pairs[k], touchCursor);
+				}
+			}
+		});
+		// keep only touching pairs, order stays sorted by pair key
+		if (events)
+		{
+			clearContactEvents();
+			touching.clear();
+		}
+		size_t count = 0;
+		for (size_t k = 0; k < manifolds.size(); k++)
+		{
+			if (manifolds[k].pointCount == 0)
+				continue;
+			if (events)
+			{
+				ContactEvent e = { manifolds[k].bodyA, manifolds[k].bodyB, (uint32_t)count };
+				(contactState[k] == CONTACT_BEGIN ? contactBegin : contactPersist).push_back(e);
+				touching.push_back(pairs[k]);
+			}
+			manifolds[count++] = manifolds[k];
+		}
+		manifolds.resize(count);
+		if (events)
+			endContacts();
+		else
+		{
+			touching.clear();
+			clearContactEvents();
+		}
+	}
+
+	enum ContactState : uint8_t
+	{
+		CONTACT_NONE = 0,
+		CONTACT_BEGIN,
+		CONTACT_PERSIST
+	};
+
+	// whether a pair that touches now also touched last step, the cursor walks
+	// last step's touching pairs forward as matchPrevious does
+	ContactState markContact(bool touches, uint64_t key, size_t& cursor) const
+	{
+		if (!touches)
+			return CONTACT_NONE;
+		while (cursor < touchingPrevious.size() && touchingPrevious[cursor] < key)
+			cursor++;
+		return cursor < touchingPrevious.size() && touchingPrevious[cursor] == key ? CONTACT_PERSIST : CONTACT_BEGIN;
+	}
+
+	// pairs that touched last step and don't now, except those with no awake
+	// body, which weren't collided and still touch
+	// ------------------------------------------------------------------------
+	void endContacts()
+	{
+		size_t current = touching.size();
+		for (uint64_t key : touchingPrevious)
+			if (!(bodies.awake[pairKeyA(key)] | bodies.awake[pairKeyB(key)]))
+				touching.push_back(key);
+		std::inplace_merge(touching.begin(), touching.begin() + current, touching.end());
+		size_t c = 0;
+		for (uint64_t key : touchingPrevious)
+		{
+			while (c < touching.size() && touching[c] < key)
+				c++;
+			if (c == touching.size() || touching[c] != key)
+				contactEnd.push_back(ContactEvent{ pairKeyA(key), pairKeyB(key), UINT32_MAX });
+		}
+	}
+
+	void clearContactEvents()
+	{
+		contactBegin.clear();
+		contactPersist.clear();
+		contactEnd.clear();
+	}
+
+	// index of the first manifold of last step with a pair key not below key
+	size_t findPrevious(uint64_t key) const
+	{
+		auto it = std::lower_bound(previous.begin(), previous.end(), key, [](const Manifold& p, uint64_t k) {
+			return makePairKey(p.bodyA, p.bodyB) < k;
+		});
+		return (size_t)(it - previous.begin());
+	}
+
+	// copy accumulated impulses from last step's manifold for the same pair,
+	// cursor is a position in the previous manifolds at or before the pair and
+	// is moved up to it, so calls with increasing keys walk the list once
+	// ------------------------------------------------------------------------
+	void matchPrevious(Manifold& m, uint64_t key, size_t& cursor) const
+	{
+		while (cursor < previous.size() && makePairKey(previous[cursor].bodyA, previous[cursor].bodyB) < key)
+			cursor++;
+		if (cursor == previous.size() || makePairKey(previous[cursor].bodyA, previous[cursor].bodyB) != key)
+			return;
+		const Manifold& p = previous[cursor];
+		for (int k = 0; k < m.pointCount; k++)
+			for (int j = 0; j < p.pointCount; j++)
+				if (p.points[j].id == m.points[k].id)
+				{
+					m.points[k].normalImpulse = p.points[j].normalImpulse;
+					m.points[k].tangentImpulse = p.points[j].tangentImpulse;
+					break;
+				}
+	}
+
+	static uint64_t levelKey(const Manifold& m)
+	{
+		return ((uint64_t)m.bodyB << 32) | m.bodyA;
+	}
+
+	// contacts of every awake body with the level segments around it
+	// ------------------------------------------------------------------------
+	void collideLevel()
+	{
+		levelManifolds.swap(levelPrevious);
+		levelManifolds.clear();
+		if (level().segmentCount() == 0)
+			return;
+		size_t threads = jobs ? (size_t)jobs->threadCount() : 1;
+		if (threadLevel.size() < threads)
+			threadLevel.resize(threads);
+		for (std::vector<Manifold>& out : threadLevel)
+			out.clear();
+		forRange(bodies.size(), [this](size_t begin, size_t end, int thread) {
+			std::vector<Manifold>& out = threadLevel[thread];
+			for (size_t i = begin; i < end; i++)
+			{
+				uint32_t b = (uint32_t)i;
+				if (bodies.sensor[b])
+					continue;
+				if (!bodies.awake[b])
+				{
+					// sleeping bodies keep their contacts so they are in place when
+					// something wakes them, static bodies have none
+					if (bodies.invMass[b] > 0.0f)
+						keepLevelPrevious(b, out);
+					continue;
+				}
+				ShapeTransformT<Scalar> body;
+				body.p = Vec2T<Scalar>(bodies.posX[b], bodies.posY[b]);
+				body.q.c = rotC[b];
+				body.q.s = rotS[b];
+				body.extentX = bodies.extentX[b];
+				body.extentY = bodies.extentY[b];
+				bool circle = bodies.shape[b] == SHAPE_CIRCLE;
+				Scalar margin = settings.solver.contactMargin + speculative[b];
+				Scalar friction = scalarSqrt(level().friction * bodies.friction[b]);
+				// the level is float, the segments around the body are found in
+				// float and collided in the scalar of the world
+				float x = toFloat(body.p.x), y = toFloat(body.p.y), reach = toFloat(boundingRadius(b) + margin);
+				level().forEachSegment(x - reach, y - reach, x + reach, y + reach, [&](uint32_t id, const Vec2& a, const Vec2& c) {
+					Manifold m;
+					Vec2T<Scalar> sa(a.x, a.y), sc(c.x, c.y);
+					bool oneSided = (id & StaticGeometry::TERRAIN_SEGMENT) != 0;
+					if (circle)
+						collideSegmentCircle(m, sa, sc, body, oneSided, margin);
+					else
+						collideSegmentBox(m, sa, sc, body, oneSided, margin);
+					if (m.pointCount == 0)
+						return;
+					m.bodyA = id;
+					m.bodyB = b;
+					m.friction = friction;
+					matchLevelPrevious(m);
+					out.push_back(m);
+				});
+			}
+		});
+		for (const std::vector<Manifold>& out : threadLevel)
+			levelManifolds.insert(levelManifolds.end(), out.begin(), out.end());
+		std::sort(levelManifolds.begin(), levelManifolds.end(), [](const Manifold& p, const Manifold& q) {
+			return levelKey(p) < levelKey(q);
+		});
+	}
+
+	void keepLevelPrevious(uint32_t b, std::vector<Manifold>& out) const
+	{
+		auto it = std::lower_bound(levelPrevious.begin(), levelPrevious.end(), (uint64_t)b << 32, [](const Manifold& p, uint64_t k) {
+			return levelKey(p) < k;
+		});
+		for (; it != levelPrevious.end() && it->bodyB == b; ++it)
+			out.push_back(*it);
+	}
+
+	void matchLevelPrevious(Manifold& m) const
+	{
+		uint64_t key = levelKey(m);
+		auto it = std::lower_bound(levelPrevious.begin(), levelPrevious.end(), key, [](const Manifold& p, uint64_t k) {
+			return levelKey(p) < k;
+		});
+		if (it == levelPrevious.end() || levelKey(*it) != key)
+			return;
+		for (int k = 0; k < m.pointCount; k++)
+			for (int j = 0; j < it->pointCount; j++)
+				if (it->points[j].id == m.points[k].id)
+				{
+					m.points[k].normalImpulse = it->points[j].normalImpulse;
+					m.points[k].tangentImpulse = it->points[j].tangentImpulse;
+					break;
+				}
+	}
+
+	// which sensor pairs from the broadphase really overlap, and the begin and
+	// end events against last step's overlaps
+	// ------------------------------------------------------------------------
+	void updateSensors()
+	{
+		sensorBegin.clear();
+		sensorEnd.clear();
+		if (sensorPairs.empty() && sensorOverlaps.empty())
+			return;
+		sensorOverlaps.swap(sensorPrevious);
+		sensorOverlaps.clear();
+		sensorHit.resize(sensorPairs.size());
+		forRange(sensorPairs.size(), [this](size_t begin, size_t end, int) {
+			for (size_t k = begin; k < end; k++)
+			{
+				uint32_t a = pairKeyA(sensorPairs[k]), b = pairKeyB(sensorPairs[k]);
+				Vec2 n;
+				sensorHit[k] = shapeDistance(shapeTransform(a), bodies.shape[a] == SHAPE_CIRCLE,
+					shapeTransform(b), bodies.shape[b] == SHAPE_CIRCLE, n) < 0.0f;
+			}
+		});
+		// pairs with no awake body aren't in the broadphase pairs, they stay as they were
+		for (uint64_t key : sensorPrevious)
+			if (!(bodies.awake[pairKeyA(key)] | bodies.awake[pairKeyB(key)]))
+				sensorOverlaps.push_back(key);
+		size_t kept = sensorOverlaps.size();
+		for (size_t k = 0; k < sensorPairs.size(); k++)
+			if (sensorHit[k])
+				sensorOverlaps.push_back(sensorPairs[k]);
+		std::inplace_merge(sensorOverlaps.begin(), sensorOverlaps.begin() + kept, sensorOverlaps.end());
+
+		auto event = [this](uint64_t key) {
+			uint32_t a = pairKeyA(key), b = pairKeyB(key);
+			return bodies.sensor[a] ? SensorEvent{ a, b } : SensorEvent{ b, a };
+		};
+		size_t p = 0, c = 0;
+		while (p < sensorPrevious.size() || c < sensorOverlaps.size())
+		{
+			if (c == sensorOverlaps.size() || (p < sensorPrevious.size() && sensorPrevious[p] < sensorOverlaps[c]))
+				sensorEnd.push_back(event(sensorPrevious[p++]));
+			else if (p == sensorPrevious.size() || sensorOverlaps[c] < sensorPrevious[p])
+				sensorBegin.push_back(event(sensorOverlaps[c++]));
+			else
+			{
+				p++;
+				c++;
+			}
+		}
+	}
+
+	uint32_t findRoot(uint32_t i)
+	{
+		while (parent[i] != i)
+		{
+			parent[i] = parent[parent[i]];
+			i = parent[i];
+		}
+		return i;
+	}
+
+	// ------------------------------------------------------------------------
+	void buildIslands()
+	{
+		size_t n = bodies.size();
+		// any contact has at least one awake body, so it wakes the other one
+		if constexpr (Config::sleeping)
+		{
+			for (const Manifold& m : manifolds)
+			{
+				uint32_t ab[2] = { m.bodyA, m.bodyB };
+				for (uint32_t b : ab)
+					if (bodies.invMass[b] > 0.0f && !bodies.awake[b])
+					{
+						bodies.awake[b] = 1;
+						bodies.sleepTime[b] = 0.0f;
+					}
+			}
+		}
+
+		parent.resize(n);
+		for (size_t i = 0; i < n; i++)
+			parent[i] = (uint32_t)i;
+		auto join = [&](uint32_t a, uint32_t b) {
+			if (bodies.invMass[a] == 0.0f || bodies.invMass[b] == 0.0f)
+				return;
+			uint32_t ra = findRoot(a), rb = findRoot(b);
+			if (ra != rb)
+				parent[ra > rb ? ra : rb] = ra < rb ? ra : rb;
+		};
+		for (const Manifold& m : manifolds)
+			join(m.bodyA, m.bodyB);
+		if (joints.liveCount > 0)
+		{
+			for (size_t j = 0; j < joints.size(); j++)
+				if (joints.alive[j])
+					join(joints.bodyA[j], joints.bodyB[j]);
+			// jointed bodies sleep and wake together, so wake every body joined to an awake one
+			if constexpr (Config::sleeping)
+			{
+				rootAwake.assign(n, 0);
+				for (size_t i = 0; i < n; i++)
+					if (bodies.awake[i])
+						rootAwake[findRoot((uint32_t)i)] = 1;
+				for (size_t i = 0; i < n; i++)
+					if (!bodies.awake[i] && bodies.invMass[i] > 0.0f && rootAwake[findRoot((uint32_t)i)])
+						wakeBody((uint32_t)i);
+			}
+		}
+
+		// number the islands in order of their lowest body and count bodies per island
+		islandOf.assign(n, UINT32_MAX);
+		islandBodyStart.assign(1, 0);
+		for (size_t i = 0; i < n; i++)
+		{
+			if (!bodies.awake[i])
+				continue;
+			uint32_t root = findRoot((uint32_t)i);
+			if (islandOf[root] == UINT32_MAX)
+			{
+				islandOf[root] = (uint32_t)islandBodyStart.size() - 1;
+				islandBodyStart.push_back(0);
+			}
+			islandOf[i] = islandOf[root];
+			islandBodyStart[islandOf[i] + 1]++;
+		}
+		size_t islands = islandBodyStart.size() - 1;
+		for (size_t k = 0; k < islands; k++)
+			islandBodyStart[k + 1] += islandBodyStart[k];
+		islandBodies.resize(islandBodyStart[islands]);
+		{
+			std::vector<uint32_t> fill(islandBodyStart.begin(), islandBodyStart.end() - 1);
+			for (size_t i = 0; i < n; i++)
+				if (bodies.awake[i])
+					islandBodies[fill[islandOf[i]]++] = (uint32_t)i;
+		}
+
+		// contacts go to the island of their dynamic body
+		islandContactStart.assign(islands + 1, 0);
+		for (const Manifold& m : manifolds)
+		{
+			uint32_t b = bodies.invMass[m.bodyA] > 0.0f ? m.bodyA : m.bodyB;
+			islandContactStart[islandOf[b] + 1]++;
+		}
+		for (size_t k = 0; k < islands; k++)
+			islandContactStart[k + 1] += islandContactStart[k];
+		islandContacts.resize(manifolds.size());
+		{
+			std::vector<uint32_t> fill(islandContactStart.begin(), islandContactStart.end() - 1);
+			for (size_t c = 0; c < manifolds.size(); c++)
+			{
+				const Manifold& m = manifolds[c];
+				uint32_t b = bodies.invMass[m.bodyA] > 0.0f ? m.bodyA : m.bodyB;
+				islandContacts[fill[islandOf[b]]++] = (uint32_t)c;
+			}
+		}
+
+		// level contacts go to the island of their body, those kept for sleeping
+		// bodies belong to none
+		islandLevelStart.assign(islands + 1, 0);
+		for (const Manifold& m : levelManifolds)
+			if (bodies.awake[m.bodyB])
+				islandLevelStart[islandOf[m.bodyB] + 1]++;
+		for (size_t k = 0; k < islands; k++)
+			islandLevelStart[k + 1] += islandLevelStart[k];
+		islandLevel.resize(islandLevelStart[islands]);
+		{
+			std::vector<uint32_t> fill(islandLevelStart.begin(), islandLevelStart.end() - 1);
+			for (size_t c = 0; c < levelManifolds.size(); c++)
+				if (bodies.awake[levelManifolds[c].bodyB])
+					islandLevel[fill[islandOf[levelManifolds[c].bodyB]]++] = (uint32_t)c;
+		}
+
+		// joints likewise, a joint on two sleeping bodies belongs to no island
+		auto jointIsland = [&](size_t j) -> uint32_t {
+			if (!joints.alive[j])
+				return UINT32_MAX;
+			uint32_t b = bodies.invMass[joints.bodyA[j]] > 0.0f ? joints.bodyA[j] : joints.bodyB[j];
+			return bodies.awake[b] ? islandOf[b] : UINT32_MAX;
+		};
+		islandJointStart.assign(islands + 1, 0);
+		for (size_t j = 0; j < joints.size(); j++)
+		{
+			uint32_t island = jointIsland(j);
+			if (island != UINT32_MAX)
+				islandJointStart[island + 1]++;
+		}
+		for (size_t k = 0; k < islands; k++)
+			islandJointStart[k + 1] += islandJointStart[k];
+		islandJoints.resize(islandJointStart[islands]);
+		{
+			std::vector<uint32_t> fill(islandJointStart.begin(), islandJointStart.end() - 1);
+			for (size_t j = 0; j < joints.size(); j++)
+			{
+				uint32_t island = jointIsland(j);
+				if (island != UINT32_MAX)
+					islandJoints[fill[island]++] = (uint32_t)j;
+			}
+		}
+
+		// hand out the biggest islands first so one large island doesn't finish last,
+		// the many small ones after that keep their natural order
+		auto islandWork = [&](uint32_t k) {
+			return islandContactStart[k + 1] - islandContactStart[k] + islandJointStart[k + 1] - islandJointStart[k]
+				+ islandLevelStart[k + 1] - islandLevelStart[k];
+		};
+		islandOrder.clear();
+		for (size_t k = 0; k < islands; k++)
+			if (islandWork((uint32_t)k) >= LARGE_ISLAND_CONTACTS)
+				islandOrder.push_back((uint32_t)k);
+		largeIslands = islandOrder.size();
+		std::stable_sort(islandOrder.begin(), islandOrder.end(), [&](uint32_t x, uint32_t y) {
+			return islandWork(x) > islandWork(y);
+		});
+		for (size_t k = 0; k < islands; k++)
+			if (islandWork((uint32_t)k) < LARGE_ISLAND_CONTACTS)
+				islandOrder.push_back((uint32_t)k);
+	}
+
+	// ------------------------------------------------------------------------
+	void solveIslands(float dt)
+	{
+		localIndex.resize(bodies.size());
+		jointData.resize(joints.size());
+		solverScratch.resize(jobs ? jobs->threadCount() : 1);
+		if (jobs && jobs->threadCount() > 1)
+		{
+			// large islands one at a time, small ones in batches
+			jobs->parallelFor(largeIslands, 1, [&](size_t begin, size_t end, int t) {
+				for (size_t k = begin; k < end; k++)
+					solveIsland(islandOrder[k], dt, solverScratch[t]);
+			});
+			jobs->parallelFor(islandOrder.size() - largeIslands, [&](size_t begin, size_t end, int t) {
+				for (size_t k = begin; k < end; k++)
+					solveIsland(islandOrder[largeIslands + k], dt, solverScratch[t]);
+			});
+		}
+		else
+		{
+			for (uint32_t island : islandOrder)
+				solveIsland(island, dt, solverScratch[0]);
+		}
+	}
+
+	// ------------------------------------------------------------------------
+	void solveIsland(uint32_t island, float dt, std::vector<SolverBody>& solverBodies)
+	{
+		uint32_t bodyBegin = islandBodyStart[island], bodyEnd = islandBodyStart[island + 1];
+		uint32_t contactBegin = islandContactStart[island], contactEnd = islandContactStart[island + 1];
+		uint32_t jointBegin = islandJointStart[island], jointEnd = islandJointStart[island + 1];
+		uint32_t levelBegin = islandLevelStart[island], levelEnd = islandLevelStart[island + 1];
+		uint32_t count = bodyEnd - bodyBegin;
+		Scalar h = dt;
+
+		// gather, the last entry stands in for every static body
+		solverBodies.resize(count + 1);
+		for (uint32_t k = 0; k < count; k++)
+		{
+			uint32_t b = islandBodies[bodyBegin + k];
+			localIndex[b] = k;
+			SolverBody& sb = solverBodies[k];
+			sb.v = Vec2T<Scalar>(bodies.velX[b], bodies.velY[b]);
+			sb.w = bodies.angVel[b];
+			sb.invMass = bodies.invMass[b];
+			sb.invInertia = bodies.invInertia[b];
+		}
+		SolverBody& ground = solverBodies[count];
+		auto solverBody = [&](uint32_t b) -> SolverBody& {
+			return bodies.invMass[b] > 0.0f ? solverBodies[localIndex[b]] : ground;
+		};
+
+		if (contactEnd > contactBegin || jointEnd > jointBegin || levelEnd > levelBegin)
+		{
+			ground = SolverBody();
+			Scalar invDt = dt > 0.0f ? 1.0f / dt : 0.0f;
+			const SolverSettings& solver = settings.solver;
+			for (uint32_t k = jointBegin; k < jointEnd; k++)
+			{
+				uint32_t j = islandJoints[k];
+				uint32_t ba = joints.bodyA[j], bb = joints.bodyB[j];
+				SolverBody& a = solverBody(ba);
+				SolverBody& b = solverBody(bb);
+				prepareJoint(joints, j, jointData[j], Vec2T<Scalar>(bodies.posX[ba], bodies.posY[ba]), bodies.angle[ba],
+					Vec2T<Scalar>(bodies.posX[bb], bodies.posY[bb]), bodies.angle[bb], a, b, h, solver);
+				warmStartJoint(joints, j, jointData[j], a, b);
+			}
+			for (uint32_t c = contactBegin; c < contactEnd; c++)
+			{
+				Manifold& m = manifolds[islandContacts[c]];
+				SolverBody& a = solverBody(m.bodyA);
+				SolverBody& b = solverBody(m.bodyB);
+				Solver::prepare(m, Vec2T<Scalar>(bodies.posX[m.bodyA], bodies.posY[m.bodyA]),
+					Vec2T<Scalar>(bodies.posX[m.bodyB], bodies.posY[m.bodyB]), a, b, invDt, solver);
+				if (solver.warmStarting)
+					Solver::warmStart(m, a, b);
+			}
+			// the level is static, its side of each contact is the ground entry
+			for (uint32_t c = levelBegin; c < levelEnd; c++)
+			{
+				Manifold& m = levelManifolds[islandLevel[c]];
+				SolverBody& b = solverBody(m.bodyB);
+				Solver::prepare(m, Vec2T<Scalar>(), Vec2T<Scalar>(bodies.posX[m.bodyB], bodies.posY[m.bodyB]), ground, b, invDt, solver);
+				if (solver.warmStarting)
+					Solver::warmStart(m, ground, b);
+			}
+			for (int it = 0; it < solver.velocityIterations; it++)
+			{
+				for (uint32_t k = jointBegin; k < jointEnd; k++)
+				{
+					uint32_t j = islandJoints[k];
+					solveJoint(joints, j, jointData[j], solverBody(joints.bodyA[j]), solverBody(joints.bodyB[j]));
+				}
+				for (uint32_t c = contactBegin; c < contactEnd; c++)
+				{
+					Manifold& m = manifolds[islandContacts[c]];
+					Solver::solve(m, solverBody(m.bodyA), solverBody(m.bodyB));
+				}
+				for (uint32_t c = levelBegin; c < levelEnd; c++)
+				{
+					Manifold& m = levelManifolds[islandLevel[c]];
+					Solver::solve(m, ground, solverBody(m.bodyB));
+				}
+			}
+		}
+
+		// scatter velocities, integrate positions and track how long the island has rested
+		Scalar linTol2 = settings.sleepLinearVelocity * settings.sleepLinearVelocity;
+		Scalar angTol2 = settings.sleepAngularVelocity * settings.sleepAngularVelocity;
+		Scalar timeToSleep = settings.timeToSleep;
+		bool rested = true;
+		for (uint32_t k = 0; k < count; k++)
+		{
+			uint32_t b = islandBodies[bodyBegin + k];
+			const SolverBody& sb = solverBodies[k];
+			bodies.velX[b] = sb.v.x;
+			bodies.velY[b] = sb.v.y;
+			bodies.angVel[b] = sb.w;
+			bodies.posX[b] += h * sb.v.x;
+			bodies.posY[b] += h * sb.v.y;
+			bodies.angle[b] += h * sb.w;
+			if constexpr (Config::sleeping)
+			{
+				if (lengthSquared(sb.v) > linTol2 || sb.w * sb.w > angTol2)
+					bodies.sleepTime[b] = 0.0f;
+				else
+					bodies.sleepTime[b] += h;
+				rested = rested && bodies.sleepTime[b] >= timeToSleep;
+			}
+		}
+		if constexpr (Config::sleeping)
+		{
+			if (settings.allowSleep && rested)
+			{
+				for (uint32_t k = 0; k < count; k++)
+				{
+					uint32_t b = islandBodies[bodyBegin + k];
+					bodies.awake[b] = 0;
+					bodies.velX[b] = bodies.velY[b] = bodies.angVel[b] = 0.0f;
+				}
+			}
+		}
+	}
+	// ------------------------------------------------------------------------
+	void solveContinuous(float dt)
+	{
+		stats.bulletHits = 0;
+		if (!settings.continuous)
+			return;
+		bullets.clear();
+		for (size_t i = 0; i < bodies.size(); i++)
+			if (bodies.bullet[i] && bodies.awake[i] && !bodies.sensor[i])
+				bullets.push_back((uint32_t)i);
+		threadHits.assign(jobs ? jobs->threadCount() : 1, 0);
+		// bullets only move themselves and skip other bullets, so they sweep independently
+		forRange(bullets.size(), [&](size_t begin, size_t end, int t) {
+			for (size_t k = begin; k < end; k++)
+				threadHits[t] += sweepBullet(bullets[k], dt) ? 1 : 0;
+		});
+		for (size_t hits : threadHits)
+			stats.bulletHits += hits;
+	}
+
+	// conservative advancement of a bullet from its pose at the start of the step
+	// against every non-bullet body it passes, each held at its end of step pose.
+	// The bullet is moved back to the earliest time it comes within a small
+	// distance of one of them and keeps its velocity, next step's contact stops it.
+	// ------------------------------------------------------------------------
+	bool sweepBullet(uint32_t i, float dt)
+	{
+		bool circle = bodies.shape[i] == SHAPE_CIRCLE;
+		Scalar h = dt;
+		Vec2T<Scalar> velocity(bodies.velX[i], bodies.velY[i]);
+		Scalar w = bodies.angVel[i];
+		Scalar spin = circle ? 0.0f : scalarAbs(w) * boundingRadius(i);
+		Scalar motion = h * (length(velocity) + spin);
+		// slower bodies can't skip past anything, the speculative contacts hold them
+		if (motion < 0.5f * scalarMin(bodies.extentX[i], bodies.extentY[i]))
+			return false;
+
+		// the search runs on float copies, what goes back into the body is worked
+		// out in the world's scalar
+		Vec2 v(toFloat(velocity.x), toFloat(velocity.y));
+		float radius = toFloat(boundingRadius(i));
+		Scalar angle0 = bodies.angle[i] - h * w;
+		RotT<Scalar> q0(angle0);
+		ShapeTransform start = shapeTransform(i);
+		start.p -= dt * v;
+		start.q.c = toFloat(q0.c);
+		start.q.s = toFloat(q0.s);
+		Vec2 p0 = start.p, p1(toFloat(bodies.posX[i]), toFloat(bodies.posY[i]));
+		float target = 0.25f * settings.solver.contactMargin;
+
+		float tMin = 1.0f;
+		broadphase.forEachOverlapping(fminf(p0.x, p1.x) - radius, fminf(p0.y, p1.y) - radius,
+			fmaxf(p0.x, p1.x) + radius, fmaxf(p0.y, p1.y) + radius, [&](uint32_t j) {
+			if (j == i || (bodies.bullet[j] && bodies.invMass[j] > 0.0f) || bodies.sensor[j] || !bodies.shouldCollide(i, j))
+				return;
+			Vec2 n;
+			float t = timeOfImpact<Scalar>(start, circle, dt * v, dt * toFloat(w), shapeTransform(j), bodies.shape[j] == SHAPE_CIRCLE,
+				target, tMin, n);
+			// already touching at the start of the step, the contact handles it
+			if (t > 0.0f && t < tMin)
+				tMin = t;
+		});
+		// a world without level contacts mustn't hold bullets in front of segments
+		// that would never stop them
+		if constexpr (Config::level)
+		{
+			level().forEachSegment(fminf(p0.x, p1.x) - radius, fminf(p0.y, p1.y) - radius,
+				fmaxf(p0.x, p1.x) + radius, fmaxf(p0.y, p1.y) + radius, [&](uint32_t, const Vec2& a, const Vec2& b) {
+				Vec2 n;
+				float t = timeOfImpact<Scalar>(start, circle, dt * v, dt * toFloat(w), segmentTransform(a, b), false, target, tMin, n);
+				if (t > 0.0f && t < tMin)
+					tMin = t;
+			});
+		}
+		if (tMin >= 1.0f)
+			return false;
+		Scalar t = tMin * dt;
+		bodies.posX[i] = bodies.posX[i] - h * velocity.x + t * velocity.x;
+		bodies.posY[i] = bodies.posY[i] - h * velocity.y + t * velocity.y;
+		bodies.angle[i] = angle0 + t * w;
+		return true;
+	}
+};
+
+typedef BasicPhysicsWorld<DefaultWorldConfig> PhysicsWorld;
+#endif
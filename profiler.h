@@ -0,0 +1,158 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+// Scoped timing zones written to per-thread ring buffers and exported as Chrome
+// trace_event JSON (open the file in chrome://tracing or ui.perfetto.dev).
+//
+// Zones are only compiled in when PHYSICS_PROFILE is defined, otherwise
+// PROFILE_ZONE expands to nothing and this header adds no code to the hot paths.
+//
+//   PROFILE_ZONE("broadphase");   // times the rest of the enclosing scope
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// one finished zone, name must be a string literal (or otherwise outlive the profiler)
+struct ProfileEvent
+{
+	const char* name;
+	uint64_t startNs;
+	uint64_t endNs;
+};
+
+// events recorded by one thread, only that thread writes to it so no locking is
+// needed, old events are overwritten once the ring is full
+// ------------------------------------------------------------------------
+struct ProfileThreadBuffer
+{
+	static const uint32_t CAPACITY = 1 << 16;
+
+	int threadId;
+	std::vector<ProfileEvent> events;
+	std::atomic<uint64_t> written{0};
+
+	explicit ProfileThreadBuffer(int id) : threadId(id), events(CAPACITY) {}
+
+	void push(const char* name, uint64_t startNs, uint64_t endNs)
+	{
+		uint64_t w = written.load(std::memory_order_relaxed);
+		ProfileEvent& e = events[w & (CAPACITY - 1)];
+		e.name = name;
+		e.startNs = startNs;
+		e.endNs = endNs;
+		written.store(w + 1, std::memory_order_release);
+	}
+};
+
+// registry of every thread's buffer
+// ------------------------------------------------------------------------
+class Profiler
+{
+public:
+	static Profiler& instance()
+	{
+		static Profiler profiler;
+		return profiler;
+	}
+
+	// monotonic clock (clock_gettime / QueryPerformanceCounter underneath)
+	static uint64_t now()
+	{
+		return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	// buffer of the calling thread, created the first time a thread records a zone
+	ProfileThreadBuffer& threadBuffer()
+	{
+		thread_local ProfileThreadBuffer* buffer = nullptr;
+		if (!buffer)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			buffers.emplace_back(new ProfileThreadBuffer((int)buffers.size()));
+			buffer = buffers.back().get();
+		}
+		return *buffer;
+	}
+
+	// drop everything recorded so far
+	// ------------------------------------------------------------------------
+	void clear()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		for (std::unique_ptr<ProfileThreadBuffer>& b : buffers)
+			b->written.store(0, std::memory_order_relaxed);
+	}
+
+	// write the recorded zones of every thread as Chrome trace_event JSON
+	// call it while no zones are being recorded (between steps or at exit),
+	// returns false if the file can't be written
+	// ------------------------------------------------------------------------
+	bool exportChromeTrace(const char* path)
+	{
+		FILE* f = fopen(path, "wb");
+		if (!f)
+			return false;
+		std::lock_guard<std::mutex> lock(mutex);
+		uint64_t origin = UINT64_MAX;
+		for (std::unique_ptr<ProfileThreadBuffer>& b : buffers)
+		{
+			uint64_t w = b->written.load(std::memory_order_acquire);
+			uint64_t first = w > ProfileThreadBuffer::CAPACITY ? w - ProfileThreadBuffer::CAPACITY : 0;
+			for (uint64_t k = first; k < w; k++)
+				if (b->events[k & (ProfileThreadBuffer::CAPACITY - 1)].startNs < origin)
+					origin = b->events[k & (ProfileThreadBuffer::CAPACITY - 1)].startNs;
+		}
+		fprintf(f, "{\"traceEvents\":[\n");
+		bool first = true;
+		for (std::unique_ptr<ProfileThreadBuffer>& b : buffers)
+		{
+			fprintf(f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"thread %d\"}}",
+				first ? "" : ",\n", b->threadId, b->threadId);
+			first = false;
+			uint64_t w = b->written.load(std::memory_order_acquire);
+			uint64_t begin = w > ProfileThreadBuffer::CAPACITY ? w - ProfileThreadBuffer::CAPACITY : 0;
+			for (uint64_t k = begin; k < w; k++)
+			{
+				const ProfileEvent& e = b->events[k & (ProfileThreadBuffer::CAPACITY - 1)];
+				fprintf(f, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+					e.name, b->threadId, (e.startNs - origin) / 1000.0, (e.endNs - e.startNs) / 1000.0);
+			}
+		}
+		fprintf(f, "\n]}\n");
+		return fclose(f) == 0;
+	}
+
+private:
+	std::mutex mutex;
+	std::vector<std::unique_ptr<ProfileThreadBuffer>> buffers;
+};
+
+// records the time between construction and destruction
+// ------------------------------------------------------------------------
+class ProfileZone
+{
+public:
+	explicit ProfileZone(const char* name) : name(name), start(Profiler::now()) {}
+	~ProfileZone() { Profiler::instance().threadBuffer().push(name, start, Profiler::now()); }
+	ProfileZone(const ProfileZone&) = delete;
+	ProfileZone& operator=(const ProfileZone&) = delete;
+
+private:
+	const char* name;
+	uint64_t start;
+};
+
+#ifdef PHYSICS_PROFILE
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_ZONE(name) ProfileZone PROFILE_CONCAT(profileZone, __LINE__)(name)
+#else
+#define PROFILE_ZONE(name) ((void)0)
+#endif
+#endif
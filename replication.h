@@ -0,0 +1,757 @@
+#ifndef REPLICATION_H
+#define REPLICATION_H
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+#include "body_store.h"
+#include "net_socket.h"
+#include "physics_world.h"
+
+// Server to client replication of the bodies of a world over UDP, for clients
+// that only draw the world. The server steps the world and sends each
+// client a snapshot every sendInterval updates, the client shows the bodies a
+// few steps in the past, interpolated between the two snapshots around that
+// time, so lost and late packets don't show as stutter.
+//
+// Snapshots are quantized (positions and extents in 1/512 m, angles in 1/65536
+// turn) and delta encoded against a baseline: the newest snapshot the client
+// has acknowledged, which the server keeps a copy of per client. A body that
+// hasn't changed since the baseline costs nothing, one that has sends only the
+// fields that changed, as small zigzag varints. Lost snapshots are never
+// resent, the next one is simply encoded against an older baseline.
+//
+// Each client sends its view rectangle with every ack and only gets bodies
+// overlapping it (plus viewMargin), found with the broadphase. A snapshot is
+// at most maxPacketBytes: when more bodies changed than fit, the ones the client
+// has most wrong go first, weighted by how long they have waited, and the rest
+// in later snapshots, so bandwidth per
+// client is bounded by maxPacketBytes and the send rate whatever the body
+// count. Everything the client holds is in the server's copy of the baseline,
+// so a snapshot that leaves bodies out is still exact about what it sends.
+//
+// Bodies are named by their handles (BasicPhysicsWorld::bodyHandle), which
+// survive removal and reordering on the server. The server takes any world
+// configuration, clients always get float bodies. Joints, particles, soft
+// bodies and the level are not replicated. Integers on the wire are little
+// endian.
+// ------------------------------------------------------------------------
+static const uint32_t NO_SEQUENCE = UINT32_MAX;
+
+// a body as a client sees it, quantized
+// ------------------------------------------------------------------------
+struct NetBody
+{
+	uint32_t handle;
+	int32_t x, y;               // 1/512 m
+	uint16_t angle;             // 1/65536 turn
+	uint8_t shape;
+	uint32_t extentX, extentY;  // 1/512 m
+	uint32_t color;
+};
+
+// the bodies a client holds after applying one snapshot, sorted by handle.
+// step is the server step the snapshot was taken at
+// ------------------------------------------------------------------------
+struct NetView
+{
+	uint32_t sequence = NO_SEQUENCE;
+	uint32_t step = 0;
+	std::vector<NetBody> bodies;
+};
+
+// ------------------------------------------------------------------------
+struct ReplicationStats
+{
+	size_t clients = 0;
+	size_t packets = 0;       // snapshots sent or received in the last update
+	size_t bytes = 0;         // their total size
+	size_t bodies = 0;        // body updates in them
+	size_t pending = 0;       // changed bodies that didn't fit and wait for a later snapshot
+};
+
+static const float NET_POSITION_SCALE = 512.0f;
+static const uint32_t NET_HISTORY = 32;   // snapshots remembered on both sides, a power of two
+
+enum NetPacketType : uint8_t
+{
+	NET_SNAPSHOT = 1,  // server -> client
+	NET_ACK            // client -> server: newest held snapshot and view rectangle
+};
+
+// fields of a body update
+enum NetBodyFlags : uint8_t
+{
+	NET_NEW = 1,       // not in the baseline, every field follows
+	NET_X = 2,
+	NET_Y = 4,
+	NET_ANGLE = 8
+};
+
+// wrap-around safe sequence order
+inline bool sequenceNewer(uint32_t a, uint32_t b)
+{
+	return b == NO_SEQUENCE || (a != NO_SEQUENCE && (int32_t)(a - b) > 0);
+}
+
+// ------------------------------------------------------------------------
+template<class T>
+inline NetBody quantizeBody(const BodyStoreT<T>& bodies, size_t i, uint32_t handle)
+{
+	const float limit = 2147483000.0f;
+	auto position = [&](float v) {
+		float q = v * NET_POSITION_SCALE;
+		return (int32_t)lrintf(q < -limit ? -limit : (q > limit ? limit : q));
+	};
+	auto extent = [&](float v) {
+		float q = v * NET_POSITION_SCALE;
+		return (uint32_t)lrintf(q > limit ? limit : q);
+	};
+	NetBody b;
+	b.handle = handle;
+	b.x = position(toFloat(bodies.posX[i]));
+	b.y = position(toFloat(bodies.posY[i]));
+	float turns = toFloat(bodies.angle[i]) * (1.0f / 6.28318531f);
+	turns -= floorf(turns);
+	b.angle = (uint16_t)((uint32_t)lrintf(turns * 65536.0f) & 0xffff);
+	b.shape = bodies.shape[i];
+	b.extentX = extent(toFloat(bodies.extentX[i]));
+	b.extentY = extent(toFloat(bodies.extentY[i]));
+	b.color = bodies.color[i];
+	return b;
+}
+
+// bytes written into a fixed buffer, writes past the end fail and leave ok false
+// ------------------------------------------------------------------------
+struct NetWriter
+{
+	uint8_t* data;
+	size_t capacity;
+	size_t size = 0;
+	bool ok = true;
+
+	NetWriter(uint8_t* data, size_t capacity) : data(data), capacity(capacity) {}
+
+	void u8(uint8_t v)
+	{
+		if (size >= capacity)
+		{
+			ok = false;
+			return;
+		}
+		data[size++] = v;
+	}
+	void u16(uint16_t v) { u8((uint8_t)v); u8((uint8_t)(v >> 8)); }
+	void u32(uint32_t v) { u16((uint16_t)v); u16((uint16_t)(v >> 16)); }
+	void f32(float v)
+	{
+		uint32_t bits;
+		memcpy(&bits, &v, sizeof(bits));
+		u32(bits);
+	}
+	void varint(uint32_t v)
+	{
+		while (v >= 0x80)
+		{
+			u8((uint8_t)(v | 0x80));
+			v >>= 7;
+		}
+		u8((uint8_t)v);
+	}
+	// small values of either sign in few bytes
+	void svarint(int32_t v) { varint(((uint32_t)v << 1) ^ (uint32_t)(v >> 31)); }
+};
+
+// ------------------------------------------------------------------------
+struct NetReader
+{
+	const uint8_t* data;
+	size_t size;
+	size_t offset = 0;
+	bool ok = true;
+
+	NetReader(const uint8_t* data, size_t size) : data(data), size(size) {}
+
+	uint8_t u8()
+	{
+		if (offset >= size)
+		{
+			ok = false;
+			return 0;
+		}
+		return data[offset++];
+	}
+	uint16_t u16() { uint16_t lo = u8(); return (uint16_t)(lo | (u8() << 8)); }
+	uint32_t u32() { uint32_t lo = u16(); return lo | ((uint32_t)u16() << 16); }
+	float f32()
+	{
+		uint32_t bits = u32();
+		float v;
+		memcpy(&v, &bits, sizeof(v));
+		return v;
+	}
+	uint32_t varint()
+	{
+		uint32_t v = 0;
+		for (int shift = 0; shift < 35; shift += 7)
+		{
+			uint8_t b = u8();
+			v |= (uint32_t)(b & 0x7f) << shift;
+			if (!(b & 0x80))
+				return v;
+		}
+		ok = false;
+		return 0;
+	}
+	int32_t svarint()
+	{
+		uint32_t v = varint();
+		return (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+	}
+};
+
+// ------------------------------------------------------------------------
+class ReplicationServer
+{
+public:
+	// largest snapshot, under the payload that crosses the internet unfragmented
+	size_t maxPacketBytes = 1200;
+	// send every client a snapshot every this many calls to update()
+	int sendInterval = 1;
+	// clients not heard from for this many updates are dropped
+	uint32_t clientTimeout = 300;
+	// how far outside its view rectangle a client still gets bodies
+	float viewMargin = 2.0f;
+	static const size_t MAX_CLIENTS = 64;
+
+	ReplicationStats stats;
+
+	// ------------------------------------------------------------------------
+	bool open(uint16_t port)
+	{
+		return socket.open(port);
+	}
+	uint16_t port() const
+	{
+		return socket.port();
+	}
+	size_t clientCount() const
+	{
+		return clients.size();
+	}
+
+	// read acks from clients and send the ones due a snapshot of world, taken
+	// as the given step. Call after every step, bodies are found with the
+	// broadphase of the last step.
+	// ------------------------------------------------------------------------
+	template<class World>
+	void update(World& world, uint32_t step)
+	{
+		updates++;
+		receive();
+		clients.erase(std::remove_if(clients.begin(), clients.end(), [&](const Client& c) {
+			return updates - c.lastHeard > clientTimeout;
+		}), clients.end());
+		stats = ReplicationStats();
+		stats.clients = clients.size();
+		if (sendInterval > 1 && updates % sendInterval != 0)
+			return;
+		for (Client& c : clients)
+			sendSnapshot(world, step, c);
+	}
+
+private:
+	struct Client
+	{
+		NetAddress address;
+		float view[4];
+		uint32_t acked = NO_SEQUENCE;
+		uint32_t nextSequence = 0;
+		uint32_t lastHeard = 0;
+		std::vector<NetView> sent;       // by sequence % NET_HISTORY
+		std::vector<float> priority;     // by handle, grows while a changed body is left out
+	};
+
+	struct Candidate
+	{
+		uint32_t handle;
+		float priority;
+		const NetBody* base;   // nullptr for bodies new to the client
+		const NetBody* body;
+	};
+
+	UdpSocket socket;
+	std::vector<Client> clients;
+	uint32_t updates = 0;
+	std::vector<NetBody> target;
+	std::vector<uint32_t> removed, found;
+	std::vector<Candidate> candidates;
+	std::vector<uint8_t> packet;
+	NetView next;
+
+	void receive()
+	{
+		uint8_t buffer[64];
+		NetAddress from;
+		int bytes;
+		while ((bytes = socket.receive(buffer, sizeof(buffer), from)) >= 0)
+		{
+			NetReader in(buffer, (size_t)bytes);
+			if (in.u8() != NET_ACK)
+				continue;
+			uint32_t sequence = in.u32();
+			float view[4];
+			for (float& v : view)
+				v = in.f32();
+			if (!in.ok)
+				continue;
+			Client* c = nullptr;
+			for (Client& existing : clients)
+				if (existing.address == from)
+					c = &existing;
+			if (!c)
+			{
+				if (clients.size() >= MAX_CLIENTS)
+					continue;
+				clients.emplace_back();
+				c = &clients.back();
+				c->address = from;
+				c->sent.resize(NET_HISTORY);
+			}
+			c->lastHeard = updates;
+			memcpy(c->view, view, sizeof(view));
+			// only snapshots the server still has a copy of can be baselines
+			if (sequence != NO_SEQUENCE && c->sent[sequence % NET_HISTORY].sequence == sequence && sequenceNewer(sequence, c->acked))
+				c->acked = sequence;
+		}
+	}
+
+	static size_t varintBytes(uint32_t v)
+	{
+		size_t n = 1;
+		for (; v >= 0x80; v >>= 7)
+			n++;
+		return n;
+	}
+	static uint32_t zigzag(int32_t v)
+	{
+		return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+	}
+
+	// bytes of a body update, with the handle gap at its longest (the handle itself)
+	static size_t updateBytes(const Candidate& k)
+	{
+		const NetBody& b = *k.body;
+		size_t n = varintBytes(b.handle) + 1;
+		if (!k.base)
+			return n + varintBytes(zigzag(b.x)) + varintBytes(zigzag(b.y)) + 2 + 1 + varintBytes(b.extentX) + varintBytes(b.extentY) + 4;
+		if (b.x != k.base->x)
+			n += varintBytes(zigzag((int32_t)((uint32_t)b.x - (uint32_t)k.base->x)));
+		if (b.y != k.base->y)
+			n += varintBytes(zigzag((int32_t)((uint32_t)b.y - (uint32_t)k.base->y)));
+		if (b.angle != k.base->angle)
+			n += 2;
+		return n;
+	}
+
+	// ------------------------------------------------------------------------
+	template<class World>
+	void sendSnapshot(World& world, uint32_t step, Client& c)
+	{
+		static const NetView empty;
+		const NetView& base = c.acked != NO_SEQUENCE ? c.sent[c.acked % NET_HISTORY] : empty;
+		uint32_t baseline = c.acked != NO_SEQUENCE ? c.acked : NO_SEQUENCE;
+
+		// the bodies the client should hold, sorted by handle
+		found.clear();
+		world.queryAABB(c.view[0] - viewMargin, c.view[1] - viewMargin, c.view[2] + viewMargin, c.view[3] + viewMargin, [&](uint32_t i) {
+			found.push_back(i);
+		});
+		target.clear();
+		for (uint32_t i : found)
+			target.push_back(quantizeBody(world.bodies, i, world.bodyHandle(i)));
+		std::sort(target.begin(), target.end(), [](const NetBody& a, const NetBody& b) { return a.handle < b.handle; });
+
+		// what changed since the baseline
+		removed.clear();
+		candidates.clear();
+		size_t p = 0, t = 0;
+		while (p < base.bodies.size() || t < target.size())
+		{
+			if (t == target.size() || (p < base.bodies.size() && base.bodies[p].handle < target[t].handle))
+			{
+				removed.push_back(base.bodies[p++].handle);
+				continue;
+			}
+			const NetBody& b = target[t++];
+			const NetBody* old = nullptr;
+			if (p < base.bodies.size() && base.bodies[p].handle == b.handle)
+			{
+				old = &base.bodies[p++];
+				if (old->x == b.x && old->y == b.y && old->angle == b.angle)
+					continue;
+			}
+			// one per snapshot waited, plus one per 1/8 m or 1/64 turn the client is off
+			float error = 64.0f;
+			if (old)
+			{
+				float dx = fabsf((float)b.x - (float)old->x), dy = fabsf((float)b.y - (float)old->y);
+				float da = fabsf((float)(int16_t)(b.angle - old->angle));
+				error = std::max(std::max(dx, dy) / 64.0f, da / 1024.0f);
+			}
+			if (b.handle >= c.priority.size())
+				c.priority.resize(b.handle + 1, 0.0f);
+			float& priority = c.priority[b.handle];
+			priority += 1.0f + error;
+			candidates.push_back(Candidate{ b.handle, priority, old, &b });
+		}
+
+		packet.resize(maxPacketBytes);
+		NetWriter out(packet.data(), packet.size());
+		uint32_t sequence = c.nextSequence++;
+		out.u8(NET_SNAPSHOT);
+		out.u32(sequence);
+		out.u32(baseline);
+		out.u32(step);
+
+		// removals, at most a quarter of the packet so moving bodies still get through
+		size_t removeCount = std::min(removed.size(), (maxPacketBytes / 4) / 5);
+		out.u16((uint16_t)removeCount);
+		uint32_t previous = 0;
+		for (size_t k = 0; k < removeCount; k++)
+		{
+			out.varint(k == 0 ? removed[k] : removed[k] - previous - 1);
+			previous = removed[k];
+		}
+
+		// the most urgent bodies first, then written in handle order
+		std::sort(candidates.begin(), candidates.end(), [](const Candidate& a, const Candidate& b) {
+			return a.priority != b.priority ? a.priority > b.priority : a.handle < b.handle;
+		});
+		size_t room = out.size + 2 <= maxPacketBytes ? maxPacketBytes - out.size - 2 : 0;
+		size_t chosen = 0;
+		while (chosen < candidates.size() && updateBytes(candidates[chosen]) <= room)
+			room -= updateBytes(candidates[chosen++]);
+		std::sort(candidates.begin(), candidates.begin() + chosen, [](const Candidate& a, const Candidate& b) {
+			return a.handle < b.handle;
+		});
+		out.u16((uint16_t)chosen);
+		for (size_t k = 0; k < chosen; k++)
+		{
+			const Candidate& u = candidates[k];
+			out.varint(k == 0 ? u.handle : u.handle - candidates[k - 1].handle - 1);
+			const NetBody& b = *u.body;
+			if (!u.base)
+			{
+				out.u8(NET_NEW);
+				out.svarint(b.x);
+				out.svarint(b.y);
+				out.u16(b.angle);
+				out.u8(b.shape);
+				out.varint(b.extentX);
+				out.varint(b.extentY);
+				out.u32(b.color);
+			}
+			else
+			{
+				uint8_t flags = (b.x != u.base->x ? NET_X : 0) | (b.y != u.base->y ? NET_Y : 0) | (b.angle != u.base->angle ? NET_ANGLE : 0);
+				out.u8(flags);
+				if (flags & NET_X)
+					out.svarint((int32_t)((uint32_t)b.x - (uint32_t)u.base->x));
+				if (flags & NET_Y)
+					out.svarint((int32_t)((uint32_t)b.y - (uint32_t)u.base->y));
+				if (flags & NET_ANGLE)
+					out.u16(b.angle);
+			}
+			c.priority[u.handle] = 0.0f;
+		}
+		if (!out.ok)
+		{
+			std::cout << "ERROR::REPLICATION::SNAPSHOT_OVERFLOW" << std::endl;
+			return;
+		}
+
+		// keep what the client will hold once it has this snapshot, as a future baseline
+		next.sequence = sequence;
+		next.step = step;
+		next.bodies.clear();
+		size_t r = 0, u = 0;
+		for (p = 0; p < base.bodies.size() || u < chosen;)
+		{
+			uint32_t hb = p < base.bodies.size() ? base.bodies[p].handle : UINT32_MAX;
+			uint32_t hu = u < chosen ? candidates[u].handle : UINT32_MAX;
+			if (hu <= hb)
+			{
+				next.bodies.push_back(*candidates[u++].body);
+				p += hu == hb;
+				continue;
+			}
+			while (r < removeCount && removed[r] < hb)
+				r++;
+			if (r < removeCount && removed[r] == hb)
+				p++;
+			else
+				next.bodies.push_back(base.bodies[p++]);
+		}
+		std::swap(c.sent[sequence % NET_HISTORY], next);
+		// a baseline about to be overwritten is no use any more
+		if (c.acked != NO_SEQUENCE && c.sent[c.acked % NET_HISTORY].sequence != c.acked)
+			c.acked = NO_SEQUENCE;
+
+		socket.send(c.address, packet.data(), out.size);
+		stats.packets++;
+		stats.bytes += out.size;
+		stats.bodies += chosen;
+		stats.pending += candidates.size() - chosen;
+	}
+};
+
+// ------------------------------------------------------------------------
+class ReplicationClient
+{
+public:
+	// how far behind the newest snapshot bodies are shown, in steps, enough to
+	// still have a snapshot on either side after one or two are lost
+	float interpolationDelay = 3.0f;
+	float stepsPerSecond = 60.0f;
+
+	ReplicationStats stats;
+
+	// ------------------------------------------------------------------------
+	bool connect(const NetAddress& address)
+	{
+		server = address;
+		views.assign(NET_HISTORY, NetView());
+		newest = NO_SEQUENCE;
+		return socket.open(0);
+	}
+
+	// the rectangle the server should send bodies for
+	// ------------------------------------------------------------------------
+	void setView(float minX, float minY, float maxX, float maxY)
+	{
+		view[0] = minX; view[1] = minY; view[2] = maxX; view[3] = maxY;
+	}
+
+	bool hasSnapshot() const
+	{
+		return newest != NO_SEQUENCE;
+	}
+	// ------------------------------------------------------------------------
+	const NetView& latest() const
+	{
+		static const NetView empty;
+		return newest != NO_SEQUENCE ? views[newest % NET_HISTORY] : empty;
+	}
+
+	// read waiting snapshots, move the playback time on by dt seconds and
+	// acknowledge the newest snapshot, which also tells the server where to look.
+	// Call once per frame.
+	// ------------------------------------------------------------------------
+	void update(double dt)
+	{
+		stats = ReplicationStats();
+		// room for the largest datagram, whatever maxPacketBytes the server uses
+		buffer.resize(65536);
+		NetAddress from;
+		int bytes;
+		while ((bytes = socket.receive(buffer.data(), buffer.size(), from)) >= 0)
+		{
+			if (from != server)
+				continue;
+			if (decode(buffer.data(), (size_t)bytes))
+			{
+				stats.packets++;
+				stats.bytes += (size_t)bytes;
+			}
+		}
+
+		if (hasSnapshot())
+		{
+			double target = (double)latest().step - interpolationDelay;
+			playback += dt * stepsPerSecond;
+			// a long stall or the first snapshot jumps, small drift is eased out
+			if (fabs(playback - target) > 4.0 * interpolationDelay + 4.0)
+				playback = target;
+			else
+				playback += 0.05 * (target - playback);
+			if (playback > latest().step)
+				playback = latest().step;
+		}
+
+		uint8_t ack[32];
+		NetWriter out(ack, sizeof(ack));
+		out.u8(NET_ACK);
+		out.u32(newest);
+		for (float v : view)
+			out.f32(v);
+		socket.send(server, ack, out.size);
+	}
+
+	// the bodies at the playback time, interpolated between the snapshots on
+	// either side of it. Bodies that only the later one holds appear as they
+	// are there. Returns the number of bodies.
+	// ------------------------------------------------------------------------
+	size_t interpolate(BodyStore& out) const
+	{
+		const NetView* a = nullptr;
+		const NetView* b = nullptr;
+		for (const NetView& v : views)
+		{
+			if (v.sequence == NO_SEQUENCE)
+				continue;
+			if (v.step <= playback && (!a || v.step > a->step))
+				a = &v;
+			if (v.step >= playback && (!b || v.step < b->step))
+				b = &v;
+		}
+		if (!b)
+			b = a;
+		if (!a)
+			a = b;
+		if (!b)
+		{
+			out.resize(0);
+			return 0;
+		}
+		float t = b->step > a->step ? (float)((playback - a->step) / (double)(b->step - a->step)) : 1.0f;
+		const float inv = 1.0f / NET_POSITION_SCALE;
+		out.resize(b->bodies.size());
+		size_t k = 0;
+		for (size_t i = 0; i < b->bodies.size(); i++)
+		{
+			const NetBody& nb = b->bodies[i];
+			while (k < a->bodies.size() && a->bodies[k].handle < nb.handle)
+				k++;
+			float x = (float)nb.x, y = (float)nb.y;
+			float turns = nb.angle * (1.0f / 65536.0f);
+			if (k < a->bodies.size() && a->bodies[k].handle == nb.handle)
+			{
+				const NetBody& na = a->bodies[k];
+				x = na.x + t * (float)(nb.x - na.x);
+				y = na.y + t * (float)(nb.y - na.y);
+				// the short way round
+				turns = (na.angle + t * (float)(int16_t)(nb.angle - na.angle)) * (1.0f / 65536.0f);
+			}
+			out.posX[i] = x * inv;
+			out.posY[i] = y * inv;
+			out.angle[i] = turns * 6.28318531f;
+			out.velX[i] = out.velY[i] = out.angVel[i] = 0.0f;
+			out.invMass[i] = out.invInertia[i] = 0.0f;
+			out.shape[i] = nb.shape;
+			out.extentX[i] = nb.extentX * inv;
+			out.extentY[i] = nb.extentY * inv;
+			out.color[i] = nb.color;
+			out.awake[i] = 0;
+			out.handle[i] = nb.handle;
+		}
+		return out.size();
+	}
+
+private:
+	UdpSocket socket;
+	NetAddress server;
+	float view[4] = { -FLT_MAX, -FLT_MAX, FLT_MAX, FLT_MAX };
+	std::vector<NetView> views;   // by sequence % NET_HISTORY
+	uint32_t newest = NO_SEQUENCE;
+	double playback = 0.0;
+	NetView next;
+	std::vector<NetBody> merged;
+	std::vector<uint8_t> buffer;
+
+	// apply a snapshot to its baseline and keep the result, false if it is
+	// malformed, older than the newest one or its baseline is gone
+	// ------------------------------------------------------------------------
+	bool decode(const uint8_t* data, size_t size)
+	{
+		NetReader in(data, size);
+		if (in.u8() != NET_SNAPSHOT)
+			return false;
+		uint32_t sequence = in.u32();
+		uint32_t baseline = in.u32();
+		uint32_t step = in.u32();
+		if (!in.ok || sequence == NO_SEQUENCE || !sequenceNewer(sequence, newest))
+			return false;
+		static const NetView empty;
+		const NetView* base = &empty;
+		if (baseline != NO_SEQUENCE)
+		{
+			base = &views[baseline % NET_HISTORY];
+			if (base->sequence != baseline)
+				return false;
+		}
+
+		next.sequence = sequence;
+		next.step = step;
+		next.bodies.clear();
+		size_t p = 0;
+		// bodies of the baseline before handle stay as they are
+		auto keepUntil = [&](uint32_t handle) {
+			while (p < base->bodies.size() && base->bodies[p].handle < handle)
+				next.bodies.push_back(base->bodies[p++]);
+		};
+		// removals and updates are each in handle order, so apply them in two passes
+		uint16_t removeCount = in.u16();
+		uint32_t handle = 0;
+		for (uint16_t k = 0; k < removeCount && in.ok; k++)
+		{
+			handle = k == 0 ? in.varint() : handle + 1 + in.varint();
+			keepUntil(handle);
+			if (p < base->bodies.size() && base->bodies[p].handle == handle)
+				p++;
+		}
+		keepUntil(UINT32_MAX);
+		next.bodies.swap(merged);
+		next.bodies.clear();
+		p = 0;
+		uint16_t updateCount = in.u16();
+		for (uint16_t k = 0; k < updateCount && in.ok; k++)
+		{
+			handle = k == 0 ? in.varint() : handle + 1 + in.varint();
+			while (p < merged.size() && merged[p].handle < handle)
+				next.bodies.push_back(merged[p++]);
+			bool held = p < merged.size() && merged[p].handle == handle;
+			uint8_t flags = in.u8();
+			NetBody b;
+			if (flags & NET_NEW)
+			{
+				b.handle = handle;
+				b.x = in.svarint();
+				b.y = in.svarint();
+				b.angle = in.u16();
+				b.shape = in.u8();
+				b.extentX = in.varint();
+				b.extentY = in.varint();
+				b.color = in.u32();
+			}
+			else
+			{
+				if (!held)
+					return false;
+				b = merged[p];
+				if (flags & NET_X)
+					b.x = (int32_t)((uint32_t)b.x + (uint32_t)in.svarint());
+				if (flags & NET_Y)
+					b.y = (int32_t)((uint32_t)b.y + (uint32_t)in.svarint());
+				if (flags & NET_ANGLE)
+					b.angle = in.u16();
+			}
+			next.bodies.push_back(b);
+			p += held;
+		}
+		while (p < merged.size())
+			next.bodies.push_back(merged[p++]);
+		if (!in.ok)
+			return false;
+		stats.bodies += updateCount;
+		std::swap(views[sequence % NET_HISTORY], next);
+		newest = sequence;
+		return true;
+	}
+};
+#endif
@@ -0,0 +1,261 @@
+#ifndef ROLLBACK_H
+#define ROLLBACK_H
+
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+#include "physics_world.h"
+
+// Ring of the last few world states for rollback networking: save after every
+// step, and when a late input arrives restore the frame it belongs to and step
+// forward again. Frame f lives in slot f % capacity, so saving a frame again
+// while re-simulating overwrites the stale copy in place.
+//
+// The state (BasicPhysicsWorld::forEachState) is a list of flat trivially
+// copyable arrays, saved as a list of byte streams cut into 4 KiB pages. A page
+// that is byte for byte the same as the same page of the previous save is
+// shared with it instead of copied, as a dirty page tracker would, so sleeping
+// and resting bodies, joints and handle tables cost memory once however many
+// frames are kept. Restoring is a plain copy of every page back into the
+// arrays.
+//
+// Any world configuration can be saved, one with a fixed point Scalar is the
+// usual choice for lockstep rollback. Only the world is saved. Particle
+// systems, soft bodies and streamed tiles are separate objects and have to be
+// rolled back, or kept out of the rolled back part of the game, on their own.
+// ------------------------------------------------------------------------
+struct RollbackStats
+{
+	uint64_t saveNs = 0;      // last save
+	uint64_t restoreNs = 0;   // last restore
+	size_t savedBytes = 0;    // size of the last saved frame
+	size_t copiedBytes = 0;   // bytes of it that differed from the frame before
+	size_t pages = 0;         // pages held by the whole ring
+};
+
+class RollbackRing
+{
+public:
+	static const size_t PAGE_BYTES = 4096;
+
+	RollbackStats stats;
+
+	explicit RollbackRing(size_t capacity = 8) : slots(capacity > 0 ? capacity : 1) {}
+
+	// ------------------------------------------------------------------------
+	size_t capacity() const
+	{
+		return slots.size();
+	}
+	// whether frame is still held by the ring
+	// ------------------------------------------------------------------------
+	bool has(uint64_t frame) const
+	{
+		return frame != NO_FRAME && slots[frame % slots.size()].frame == frame;
+	}
+	// ------------------------------------------------------------------------
+	size_t memoryBytes() const
+	{
+		return pages.size() * PAGE_BYTES;
+	}
+
+	// save the state of world as frame, over whatever was in its slot
+	// ------------------------------------------------------------------------
+	template<class World>
+	void save(World& world, uint64_t frame)
+	{
+		typedef std::chrono::steady_clock Clock;
+		Clock::time_point start = Clock::now();
+		base = lastSaved != NO_SLOT && slots[lastSaved].frame != NO_FRAME ? &slots[lastSaved] : nullptr;
+		scratch.frame = frame;
+		scratch.streamBytes.clear();
+		scratch.streamFirst.clear();
+		scratch.pages.clear();
+		stats.savedBytes = 0;
+		stats.copiedBytes = 0;
+		world.forEachState([this](auto& field) { saveField(field); });
+
+		// the slot's old pages go only now, when it is also the base they were compared against
+		size_t slot = frame % slots.size();
+		releaseFrame(slots[slot]);
+		std::swap(slots[slot], scratch);
+		lastSaved = slot;
+		base = nullptr;
+		stats.pages = pages.size() - freePages.size();
+		stats.saveNs = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+	}
+
+	// put world back into the state saved as frame and clear the events of the
+	// step it last took, false if frame is no longer held. Queries see the old
+	// broadphase until the next step.
+	// ------------------------------------------------------------------------
+	template<class World>
+	bool restore(World& world, uint64_t frame)
+	{
+		if (!has(frame))
+		{
+			std::cout << "ERROR::ROLLBACK::FRAME_NOT_HELD" << std::endl;
+			return false;
+		}
+		typedef std::chrono::steady_clock Clock;
+		Clock::time_point start = Clock::now();
+		restoring = &slots[frame % slots.size()];
+		stream = 0;
+		world.forEachState([this](auto& field) { restoreField(field); });
+		restoring = nullptr;
+		// the frames saved next start from this state, so compare them against it
+		lastSaved = frame % slots.size();
+		world.contactBegin.clear();
+		world.contactPersist.clear();
+		world.contactEnd.clear();
+		world.sensorBegin.clear();
+		world.sensorEnd.clear();
+		stats.restoreNs = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+		return true;
+	}
+
+	// drop every saved frame and give the pages back
+	// ------------------------------------------------------------------------
+	void clear()
+	{
+		for (Frame& f : slots)
+			f = Frame();
+		scratch = Frame();
+		pages.clear();
+		refs.clear();
+		freePages.clear();
+		lastSaved = NO_SLOT;
+		stats = RollbackStats();
+	}
+
+private:
+	static const uint64_t NO_FRAME = UINT64_MAX;
+	static const size_t NO_SLOT = SIZE_MAX;
+
+	struct Page
+	{
+		uint8_t bytes[PAGE_BYTES];
+	};
+
+	// streams in forEachState order, stream s is streamBytes[s] bytes held in
+	// pages[streamFirst[s]] onwards
+	struct Frame
+	{
+		uint64_t frame = NO_FRAME;
+		std::vector<size_t> streamBytes;
+		std::vector<uint32_t> streamFirst;
+		std::vector<uint32_t> pages;
+	};
+
+	std::vector<Frame> slots;
+	Frame scratch;
+	const Frame* base = nullptr;
+	const Frame* restoring = nullptr;
+	size_t stream = 0;
+	size_t lastSaved = NO_SLOT;
+	std::vector<std::unique_ptr<Page>> pages;
+	std::vector<uint32_t> refs;
+	std::vector<uint32_t> freePages;
+
+	template<class T>
+	void saveField(const std::vector<T>& field)
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "rollback state has to be trivially copyable");
+		saveBytes(field.data(), field.size() * sizeof(T));
+	}
+
+	template<class T>
+	void saveField(const T& value)
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "rollback state has to be trivially copyable");
+		saveBytes(&value, sizeof(T));
+	}
+
+	template<class T>
+	void restoreField(std::vector<T>& field)
+	{
+		field.resize(restoring->streamBytes[stream] / sizeof(T));
+		restoreBytes(field.data());
+	}
+
+	template<class T>
+	void restoreField(T& value)
+	{
+		restoreBytes(&value);
+	}
+
+	// ------------------------------------------------------------------------
+	void saveBytes(const void* data, size_t bytes)
+	{
+		size_t s = scratch.streamBytes.size();
+		scratch.streamBytes.push_back(bytes);
+		scratch.streamFirst.push_back((uint32_t)scratch.pages.size());
+		stats.savedBytes += bytes;
+		// pages of the base can only be shared while the stream has the same length there
+		bool comparable = base && base->streamBytes[s] == bytes;
+		const uint8_t* src = (const uint8_t*)data;
+		for (size_t offset = 0, k = 0; offset < bytes; offset += PAGE_BYTES, k++)
+		{
+			size_t n = bytes - offset < PAGE_BYTES ? bytes - offset : PAGE_BYTES;
+			if (comparable)
+			{
+				uint32_t shared = base->pages[base->streamFirst[s] + k];
+				if (memcmp(pages[shared]->bytes, src + offset, n) == 0)
+				{
+					refs[shared]++;
+					scratch.pages.push_back(shared);
+					continue;
+				}
+			}
+			uint32_t page = allocatePage();
+			memcpy(pages[page]->bytes, src + offset, n);
+			scratch.pages.push_back(page);
+			stats.copiedBytes += n;
+		}
+	}
+
+	// ------------------------------------------------------------------------
+	void restoreBytes(void* data)
+	{
+		size_t bytes = restoring->streamBytes[stream];
+		const uint32_t* page = restoring->pages.data() + restoring->streamFirst[stream];
+		uint8_t* dst = (uint8_t*)data;
+		for (size_t offset = 0; offset < bytes; offset += PAGE_BYTES)
+			memcpy(dst + offset, pages[*page++]->bytes, bytes - offset < PAGE_BYTES ? bytes - offset : PAGE_BYTES);
+		stream++;
+	}
+
+	uint32_t allocatePage()
+	{
+		uint32_t page;
+		if (!freePages.empty())
+		{
+			page = freePages.back();
+			freePages.pop_back();
+		}
+		else
+		{
+			page = (uint32_t)pages.size();
+			pages.emplace_back(new Page);
+			refs.push_back(0);
+		}
+		refs[page] = 1;
+		return page;
+	}
+
+	void releaseFrame(Frame& f)
+	{
+		for (uint32_t page : f.pages)
+			if (--refs[page] == 0)
+				freePages.push_back(page);
+		f.frame = NO_FRAME;
+	}
+};
+
+#endif
@@ -0,0 +1,329 @@
+#ifndef SCALAR_H
+#define SCALAR_H
+
+#include <cmath>
+#include <cstdint>
+#include <cstddef>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+// Scalar types and the math functions the physics needs, for lockstep games
+// where every peer has to compute the same bits.
+//
+// float and double already give the same results everywhere for + - * / and
+// sqrt, which IEEE 754 rounds exactly, as long as the compiler doesn't fuse or
+// reorder them: build without -ffast-math, with -ffp-contract=off (GCC and
+// Clang fuse into FMA by default when the target has it, MSVC with /fp:fast)
+// and for SSE2 rather than x87. What differs is the C library's sin, cos and
+// atan2, so with PHYSICS_DETERMINISTIC defined the engine takes those from the
+// polynomials below, built from + - * / only. Peers also have to step with the
+// same number of threads and the same AVX2 setting.
+//
+// Fixed<> is a signed fixed point number, Q16_16 (range +-32768, step 1.5e-5)
+// and Q32_32 (+-2e9, step 2.3e-10). Integer arithmetic is exact on every CPU
+// and compiler, so a world stepped in one of these (DefaultWorldConfig::Scalar)
+// agrees bit for bit without any build flags, trig included, as long as it has
+// no level geometry and no bullets. Those two stay float: the level decodes and
+// places its segments in float, and a bullet's time of impact is searched for
+// in float, so with either the world needs the float rules above as well.
+// Game logic that runs alongside can use the same types with Vec2T and RotT.
+// Ints and floats convert to Fixed on their own, which lets the engine's
+// templated code keep its float constants. A constant below the step, like
+// 1e-6 in Q16_16, becomes zero.
+// ------------------------------------------------------------------------
+
+// wide products and quotients of the raw fixed point values
+// ------------------------------------------------------------------------
+template<class Int>
+struct FixedOps;
+
+template<>
+struct FixedOps<int32_t>
+{
+	static int32_t mul(int32_t a, int32_t b, int frac)
+	{
+		// >> of a negative value rounds to minus infinity on every compiler we build with
+		return (int32_t)(((int64_t)a * b) >> frac);
+	}
+	static int32_t div(int32_t a, int32_t b, int frac)
+	{
+		return (int32_t)(((int64_t)a * ((int64_t)1 << frac)) / b);
+	}
+};
+
+template<>
+struct FixedOps<int64_t>
+{
+#if defined(__SIZEOF_INT128__)
+	static int64_t mul(int64_t a, int64_t b, int frac)
+	{
+		return (int64_t)(((__int128)a * b) >> frac);
+	}
+	static int64_t div(int64_t a, int64_t b, int frac)
+	{
+		return (int64_t)(((__int128)a * ((__int128)1 << frac)) / b);
+	}
+#else
+	// 128 bit product of the magnitudes in 32 bit halves, for compilers without __int128
+	static void mulWide(uint64_t a, uint64_t b, uint64_t& hi, uint64_t& lo)
+	{
+		uint64_t a0 = (uint32_t)a, a1 = a >> 32, b0 = (uint32_t)b, b1 = b >> 32;
+		uint64_t p00 = a0 * b0, p01 = a0 * b1, p10 = a1 * b0, p11 = a1 * b1;
+		uint64_t mid = (p00 >> 32) + (uint32_t)p01 + (uint32_t)p10;
+		lo = (mid << 32) | (uint32_t)p00;
+		hi = p11 + (p01 >> 32) + (p10 >> 32) + (mid >> 32);
+	}
+	static int64_t mul(int64_t a, int64_t b, int frac)
+	{
+		bool negative = (a < 0) != (b < 0);
+		uint64_t hi, lo;
+		mulWide(a < 0 ? 0 - (uint64_t)a : (uint64_t)a, b < 0 ? 0 - (uint64_t)b : (uint64_t)b, hi, lo);
+		if (negative)
+		{
+			// two's complement of the 128 bit value, so the shift rounds down like >> does
+			lo = ~lo + 1;
+			hi = ~hi + (lo == 0);
+		}
+		return (int64_t)((hi << (64 - frac)) | (lo >> frac));
+	}
+	static int64_t div(int64_t a, int64_t b, int frac)
+	{
+		// long division of |a| << frac by |b|, truncating like integer division
+		bool negative = (a < 0) != (b < 0);
+		uint64_t n = a < 0 ? 0 - (uint64_t)a : (uint64_t)a;
+		uint64_t d = b < 0 ? 0 - (uint64_t)b : (uint64_t)b;
+		uint64_t hi = n >> (64 - frac), lo = n << frac, q = 0, r = 0;
+		for (int bit = 127; bit >= 0; bit--)
+		{
+			uint64_t top = r >> 63;
+			r = (r << 1) | ((bit >= 64 ? hi >> (bit - 64) : lo >> bit) & 1);
+			q <<= 1;
+			if (top || r >= d)
+			{
+				r -= d;
+				q |= 1;
+			}
+		}
+		return negative ? (int64_t)(0 - q) : (int64_t)q;
+	}
+#endif
+};
+
+// ------------------------------------------------------------------------
+template<int FRAC, class Int>
+struct Fixed
+{
+	static const int FRACTION_BITS = FRAC;
+	Int raw;
+
+	Fixed() : raw(0) {}
+	Fixed(int v) : raw((Int)v * ((Int)1 << FRAC)) {}
+	// exact for constants, the rounding of doubles is the same everywhere
+	Fixed(double v) : raw((Int)llround(v * (double)((Int)1 << FRAC))) {}
+
+	static Fixed fromRaw(Int r) { Fixed f; f.raw = r; return f; }
+	float toFloat() const { return (float)raw * (1.0f / (float)((Int)1 << FRAC)); }
+	double toDouble() const { return (double)raw * (1.0 / (double)((Int)1 << FRAC)); }
+
+	Fixed operator-() const { return fromRaw(-raw); }
+	Fixed& operator+=(Fixed o) { raw += o.raw; return *this; }
+	Fixed& operator-=(Fixed o) { raw -= o.raw; return *this; }
+	Fixed& operator*=(Fixed o) { raw = FixedOps<Int>::mul(raw, o.raw, FRAC); return *this; }
+	Fixed& operator/=(Fixed o) { raw = FixedOps<Int>::div(raw, o.raw, FRAC); return *this; }
+
+	friend Fixed operator+(Fixed a, Fixed b) { return fromRaw(a.raw + b.raw); }
+	friend Fixed operator-(Fixed a, Fixed b) { return fromRaw(a.raw - b.raw); }
+	friend Fixed operator*(Fixed a, Fixed b) { return fromRaw(FixedOps<Int>::mul(a.raw, b.raw, FRAC)); }
+	friend Fixed operator/(Fixed a, Fixed b) { return fromRaw(FixedOps<Int>::div(a.raw, b.raw, FRAC)); }
+	friend bool operator==(Fixed a, Fixed b) { return a.raw == b.raw; }
+	friend bool operator!=(Fixed a, Fixed b) { return a.raw != b.raw; }
+	friend bool operator<(Fixed a, Fixed b) { return a.raw < b.raw; }
+	friend bool operator>(Fixed a, Fixed b) { return a.raw > b.raw; }
+	friend bool operator<=(Fixed a, Fixed b) { return a.raw <= b.raw; }
+	friend bool operator>=(Fixed a, Fixed b) { return a.raw >= b.raw; }
+};
+
+typedef Fixed<16, int32_t> Q16_16;
+typedef Fixed<32, int64_t> Q32_32;
+
+// ------------------------------------------------------------------------
+inline float detFloor(float x) { return floorf(x); }
+inline double detFloor(double x) { return floor(x); }
+template<int FRAC, class Int>
+inline Fixed<FRAC, Int> detFloor(Fixed<FRAC, Int> x)
+{
+	return Fixed<FRAC, Int>::fromRaw(x.raw & ~(((Int)1 << FRAC) - 1));
+}
+
+inline float detSqrt(float x) { return sqrtf(x); }
+inline double detSqrt(double x) { return sqrt(x); }
+// Newton's iteration on the raw value, started above the root so it falls
+// monotonically and stops when it no longer does
+template<int FRAC, class Int>
+inline Fixed<FRAC, Int> detSqrt(Fixed<FRAC, Int> x)
+{
+	typedef Fixed<FRAC, Int> F;
+	if (x.raw <= 0)
+		return F();
+	int bits = 0;
+	for (Int v = x.raw; v; v >>= 1)
+		bits++;
+	// raw sqrt(raw * 2^FRAC) is at most 2^((bits + FRAC + 1) / 2)
+	int shift = (bits + FRAC + 1) / 2;
+	F r = F::fromRaw(shift < (int)sizeof(Int) * 8 - 1 ? (Int)1 << shift : ~((Int)1 << (sizeof(Int) * 8 - 1)));
+	for (;;)
+	{
+		F next = F::fromRaw((r.raw + (x / r).raw) >> 1);
+		if (next >= r)
+			return r;
+		r = next;
+	}
+}
+
+// sine on [-pi/2, pi/2], odd Taylor polynomial to x^11 (error under 6e-8)
+template<class T>
+inline T detSinReduced(T x)
+{
+	T x2 = x * x;
+	T p = T(-2.5052108385441720e-8);
+	p = p * x2 + T(2.7557319223985893e-6);
+	p = p * x2 + T(-1.9841269841269841e-4);
+	p = p * x2 + T(8.3333333333333333e-3);
+	p = p * x2 + T(-1.6666666666666667e-1);
+	return x + x * x2 * p;
+}
+
+// ------------------------------------------------------------------------
+template<class T>
+inline T detSin(T x)
+{
+	const T pi = T(3.14159265358979323846), halfPi = T(1.57079632679489661923);
+	const T twoPi = T(6.28318530717958647692);
+	// 2 pi in two parts, the first exact in a few bits, so turns come off
+	// without the rounding of 2 pi growing with the number of turns
+	const T twoPiHigh = T(6.28125), twoPiLow = T(0.00193530717958647692);
+	// into [-pi, pi], then folded into [-pi/2, pi/2] where sin is odd and monotonic
+	T turns = detFloor(x / twoPi + T(0.5));
+	x = (x - turns * twoPiHigh) - turns * twoPiLow;
+	if (x > halfPi)
+		x = pi - x;
+	else if (x < -halfPi)
+		x = -pi - x;
+	return detSinReduced(x);
+}
+
+template<class T>
+inline T detCos(T x)
+{
+	return detSin(x + T(1.57079632679489661923));
+}
+
+// ------------------------------------------------------------------------
+template<class T>
+inline T detAtan2(T y, T x)
+{
+	const T zero = T(0.0), quarterPi = T(0.78539816339744830962);
+	const T halfPi = T(1.57079632679489661923), pi = T(3.14159265358979323846);
+	T ay = y < zero ? -y : y, ax = x < zero ? -x : x;
+	if (ax == zero && ay == zero)
+		return zero;
+	// atan of the smaller over the larger, in [0, 1], then past tan(pi/8) turned
+	// by pi/4 so the series only sees |t| <= 0.42 (error under 2e-8)
+	bool swap = ay > ax;
+	T z = swap ? ax / ay : ay / ax;
+	T offset = zero;
+	if (z > T(0.41421356237309504880))
+	{
+		z = (z - T(1.0)) / (z + T(1.0));
+		offset = quarterPi;
+	}
+	T z2 = z * z;
+	T p = T(1.0 / 15.0);
+	p = T(-1.0 / 13.0) + z2 * p;
+	p = T(1.0 / 11.0) + z2 * p;
+	p = T(-1.0 / 9.0) + z2 * p;
+	p = T(1.0 / 7.0) + z2 * p;
+	p = T(-1.0 / 5.0) + z2 * p;
+	p = T(1.0 / 3.0) + z2 * p;
+	T a = offset + z - z * z2 * p;
+	if (swap)
+		a = halfPi - a;
+	if (x < zero)
+		a = pi - a;
+	return y < zero ? -a : a;
+}
+
+// what the engine calls for its float math, the C library unless every peer
+// has to agree
+// ------------------------------------------------------------------------
+#if defined(PHYSICS_DETERMINISTIC)
+inline float scalarSin(float x) { return detSin(x); }
+inline float scalarCos(float x) { return detCos(x); }
+inline float scalarAtan2(float y, float x) { return detAtan2(y, x); }
+inline double scalarSin(double x) { return detSin(x); }
+inline double scalarCos(double x) { return detCos(x); }
+inline double scalarAtan2(double y, double x) { return detAtan2(y, x); }
+#else
+inline float scalarSin(float x) { return sinf(x); }
+inline float scalarCos(float x) { return cosf(x); }
+inline float scalarAtan2(float y, float x) { return atan2f(y, x); }
+inline double scalarSin(double x) { return sin(x); }
+inline double scalarCos(double x) { return cos(x); }
+inline double scalarAtan2(double y, double x) { return atan2(y, x); }
+#endif
+inline float scalarSqrt(float x) { return sqrtf(x); }
+inline double scalarSqrt(double x) { return sqrt(x); }
+template<int FRAC, class Int>
+inline Fixed<FRAC, Int> scalarSin(Fixed<FRAC, Int> x) { return detSin(x); }
+template<int FRAC, class Int>
+inline Fixed<FRAC, Int> scalarCos(Fixed<FRAC, Int> x) { return detCos(x); }
+template<int FRAC, class Int>
+inline Fixed<FRAC, Int> scalarAtan2(Fixed<FRAC, Int> y, Fixed<FRAC, Int> x) { return detAtan2(y, x); }
+template<int FRAC, class Int>
+inline Fixed<FRAC, Int> scalarSqrt(Fixed<FRAC, Int> x) { return detSqrt(x); }
+
+// the same for floats and doubles as the C library, and for every scalar type
+// in the engine's templated code
+// ------------------------------------------------------------------------
+inline float scalarMin(float a, float b) { return fminf(a, b); }
+inline float scalarMax(float a, float b) { return fmaxf(a, b); }
+inline float scalarAbs(float x) { return fabsf(x); }
+inline double scalarMin(double a, double b) { return fmin(a, b); }
+inline double scalarMax(double a, double b) { return fmax(a, b); }
+inline double scalarAbs(double x) { return fabs(x); }
+template<int FRAC, class Int>
+inline Fixed<FRAC, Int> scalarMin(Fixed<FRAC, Int> a, Fixed<FRAC, Int> b) { return b < a ? b : a; }
+template<int FRAC, class Int>
+inline Fixed<FRAC, Int> scalarMax(Fixed<FRAC, Int> a, Fixed<FRAC, Int> b) { return a < b ? b : a; }
+template<int FRAC, class Int>
+inline Fixed<FRAC, Int> scalarAbs(Fixed<FRAC, Int> x) { return x.raw < 0 ? -x : x; }
+
+// for the parts that stay float whatever a world steps in, the broadphase,
+// queries, level and time of impact sweeps
+inline float toFloat(float x) { return x; }
+inline float toFloat(double x) { return (float)x; }
+template<int FRAC, class Int>
+inline float toFloat(Fixed<FRAC, Int> x) { return x.toFloat(); }
+
+// out[i] += s for every i with mask[i] set, masks are 0 or 1. Gravity on the
+// awake bodies of a Q16_16 world, 8 at a time with AVX2 and bit for bit the
+// same as without.
+// ------------------------------------------------------------------------
+inline void fixedAddMasked(Q16_16* out, const uint8_t* mask, Q16_16 s, size_t n)
+{
+	size_t i = 0;
+#if defined(__AVX2__)
+	__m256i vs = _mm256_set1_epi32(s.raw);
+	for (; i + 8 <= n; i += 8)
+	{
+		__m256i m = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)&mask[i]));
+		__m256i sum = _mm256_add_epi32(_mm256_loadu_si256((const __m256i*)&out[i].raw), _mm256_mullo_epi32(m, vs));
+		_mm256_storeu_si256((__m256i*)&out[i].raw, sum);
+	}
+#endif
+	for (; i < n; i++)
+		out[i].raw += (int32_t)mask[i] * s.raw;
+}
+#endif
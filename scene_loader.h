@@ -0,0 +1,388 @@
+#ifndef SCENE_LOADER_H
+#define SCENE_LOADER_H
+
+#include <cmath>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <iostream>
+
+#include "mapped_file.h"
+#include "physics_world.h"
+#include "particle_system.h"
+#include "soft_body.h"
+
+// Scene files are plain text, one record per line:
+//
+//   # comment
+//   gravity <x> <y>
+//   box     <x> <y> <halfWidth> <halfHeight> <angle> <density> <#rrggbb> [friction]
+//   circle  <x> <y> <radius> <density> <#rrggbb> [friction]
+//   bullet  <x> <y> <radius> <density> <#rrggbb> <velX> <velY> [friction]
+//   particles <x> <y> <halfWidth> <halfHeight> <spacing>
+//   softbox <x> <y> <halfWidth> <halfHeight> <cellsX> <cellsY> <density> <#rrggbb> [compliance]
+//   cloth   <x> <y> <halfWidth> <halfHeight> <cellsX> <cellsY> <density> <#rrggbb> [compliance]
+//   revolute  <bodyA> <bodyB> <x> <y> [limit <lower> <upper>] [motor <speed> <maxTorque>]
+//   prismatic <bodyA> <bodyB> <x> <y> <axisX> <axisY> [limit <lower> <upper>] [motor <speed> <maxForce>]
+//   weld      <bodyA> <bodyB> <x> <y>
+//   distance  <bodyA> <bodyB> <xA> <yA> <xB> <yB> [<hertz> <dampingRatio>]
+//   motor     <bodyA> <bodyB> <maxForce> <maxTorque>
+//
+// a density of 0 makes the body static. A bullet is a circle launched with the
+// given velocity and swept every step so it can't pass through thin walls. A particles record fills a rectangle
+// with particles of diameter <spacing>. softbox and cloth records add soft
+// bodies, compliance softens their edges (0, the default, is stiff). Particle
+// and soft body records are skipped when the caller doesn't pass a system for
+// them. Joints name their bodies by the position of the body record in the file,
+// counting from 0, and may only refer to bodies above them. Anchors are world
+// positions in the scene as written, angles are in radians. The file is mapped into memory and parsed in place, nothing is copied
+// into intermediate strings.
+
+// cursor over a mapped buffer, all parse functions advance it in place
+// ------------------------------------------------------------------------
+struct SceneCursor
+{
+	const char* p;
+	const char* end;
+	int line;
+
+	void skipSpace()
+	{
+		while (p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+			p++;
+	}
+
+	void skipLine()
+	{
+		const char* nl = (const char*)memchr(p, '\n', end - p);
+		p = nl ? nl + 1 : end;
+		line++;
+	}
+
+	bool atLineEnd()
+	{
+		skipSpace();
+		return p >= end || *p == '\n';
+	}
+
+	bool keyword(const char* word, size_t len)
+	{
+		if ((size_t)(end - p) < len || memcmp(p, word, len) != 0)
+			return false;
+		if (p + len < end && p[len] != ' ' && p[len] != '\t')
+			return false;
+		p += len;
+		return true;
+	}
+
+	// decimal float with optional sign, fraction and exponent
+	bool number(float& out)
+	{
+		skipSpace();
+		const char* s = p;
+		bool negative = false;
+		if (s < end && (*s == '-' || *s == '+'))
+			negative = *s++ == '-';
+		double value = 0.0;
+		int digits = 0;
+		while (s < end && (unsigned)(*s - '0') < 10)
+		{
+			value = value * 10.0 + (*s++ - '0');
+			digits++;
+		}
+		if (s < end && *s == '.')
+		{
+			s++;
+			double scale = 0.1;
+			while (s < end && (unsigned)(*s - '0') < 10)
+			{
+				value += (*s++ - '0') * scale;
+				scale *= 0.1;
+				digits++;
+			}
+		}
+		if (digits == 0)
+			return false;
+		if (s < end && (*s == 'e' || *s == 'E'))
+		{
+			s++;
+			bool negativeExp = false;
+			if (s < end && (*s == '-' || *s == '+'))
+				negativeExp = *s++ == '-';
+			// anything past a few hundred is zero or infinite as a float anyway,
+			// stop counting there so long exponents can't overflow
+			int exponent = 0;
+			while (s < end && (unsigned)(*s - '0') < 10)
+			{
+				if (exponent < 1000)
+					exponent = exponent * 10 + (*s - '0');
+				s++;
+			}
+			if (value != 0.0)
+				value *= pow(10.0, negativeExp ? -exponent : exponent);
+		}
+		out = (float)(negative ? -value : value);
+		p = s;
+		return true;
+	}
+
+	// #rrggbb, stored as 0xAABBGGRR with full alpha
+	bool color(uint32_t& out)
+	{
+		skipSpace();
+		if (end - p < 7 || *p != '#')
+			return false;
+		uint32_t rgb = 0;
+		for (int k = 1; k <= 6; k++)
+		{
+			char c = p[k];
+			uint32_t nibble;
+			if (c >= '0' && c <= '9') nibble = c - '0';
+			else if (c >= 'a' && c <= 'f') nibble = c - 'a' + 10;
+			else if (c >= 'A' && c <= 'F') nibble = c - 'A' + 10;
+			else return false;
+			rgb = (rgb << 4) | nibble;
+		}
+		p += 7;
+		out = 0xff000000u | ((rgb & 0xff) << 16) | (rgb & 0xff00) | ((rgb >> 16) & 0xff);
+		return true;
+	}
+};
+
+// load a scene file into the world (and particles and soft bodies, if given),
+// replacing whatever was in them, returns false (and leaves them empty) if the
+// file can't be read or parsed. Any world configuration loads the same file.
+// ------------------------------------------------------------------------
+template<class World>
+inline bool loadScene(const char* path, World& world, ParticleSystem* particles = nullptr,
+	SoftBodySystem* softBodies = nullptr)
+{
+	world.clear();
+	if (particles)
+		particles->clear();
+	if (softBodies)
+		softBodies->clear();
+	MappedFile file;
+	if (!file.open(path))
+	{
+		std::cout << "ERROR::SCENE::FILE_NOT_SUCCESFULLY_READ: " << path << std::endl;
+		return false;
+	}
+	if (file.size == 0)
+		return true;
+
+	// every body needs its own line, so the line count bounds the body count
+	// and the store can be sized once and filled in place
+	size_t maxBodies = 1;
+	for (const char* nl = file.data; (nl = (const char*)memchr(nl, '\n', file.data + file.size - nl)) != nullptr; nl++)
+		maxBodies++;
+	typename World::BodyStore& bodies = world.bodies;
+	bodies.resize(maxBodies);
+
+	SceneCursor in = { file.data, file.data + file.size, 1 };
+	auto fail = [&]() {
+		std::cout << "ERROR::SCENE::PARSE_ERROR at line " << in.line << std::endl;
+		world.clear();
+		if (particles)
+			particles->clear();
+		if (softBodies)
+			softBodies->clear();
+		return false;
+	};
+	auto parseSoftBody = [&](bool cloth) {
+		SoftBodyDef soft;
+		float cellsX, cellsY;
+		if (!in.number(soft.x) || !in.number(soft.y) || !in.number(soft.halfWidth) || !in.number(soft.halfHeight)
+			|| !in.number(cellsX) || !in.number(cellsY) || cellsX < 1.0f || cellsY < 1.0f
+			|| !in.number(soft.density) || soft.density <= 0.0f || !in.color(soft.color))
+			return false;
+		if (!in.atLineEnd() && (!in.number(soft.stretchCompliance) || !in.atLineEnd()))
+			return false;
+		soft.cellsX = (int)cellsX;
+		soft.cellsY = (int)cellsY;
+		soft.areaCompliance = soft.stretchCompliance;
+		if (softBodies && cloth)
+			softBodies->createCloth(soft);
+		else if (softBodies)
+			softBodies->createSoftBox(soft);
+		in.skipLine();
+		return true;
+	};
+	size_t count = 0;
+	auto parseJoint = [&](JointType type) {
+		JointDef joint;
+		joint.type = type;
+		float a, b;
+		if (!in.number(a) || !in.number(b) || a < 0.0f || b < 0.0f || a >= (float)count || b >= (float)count || a == b)
+			return false;
+		joint.bodyA = (uint32_t)a;
+		joint.bodyB = (uint32_t)b;
+		if (type == JOINT_MOTOR)
+		{
+			if (!in.number(joint.maxForce) || !in.number(joint.maxTorque))
+				return false;
+		}
+		else if (!in.number(joint.anchorA.x) || !in.number(joint.anchorA.y))
+		{
+			return false;
+		}
+		if (type == JOINT_PRISMATIC && (!in.number(joint.axis.x) || !in.number(joint.axis.y)))
+			return false;
+		if (type == JOINT_DISTANCE)
+		{
+			if (!in.number(joint.anchorB.x) || !in.number(joint.anchorB.y))
+				return false;
+			if (!in.atLineEnd() && (!in.number(joint.hertz) || !in.number(joint.dampingRatio)))
+				return false;
+		}
+		while ((type == JOINT_REVOLUTE || type == JOINT_PRISMATIC) && !in.atLineEnd())
+		{
+			if (in.keyword("limit", 5))
+			{
+				joint.enableLimit = in.number(joint.lower) && in.number(joint.upper);
+				if (!joint.enableLimit)
+					return false;
+			}
+			else if (in.keyword("motor", 5))
+			{
+				joint.enableMotor = in.number(joint.motorSpeed) && in.number(joint.maxMotorForce);
+				if (!joint.enableMotor)
+					return false;
+			}
+			else
+			{
+				return false;
+			}
+		}
+		if (!in.atLineEnd())
+			return false;
+		world.createJoint(joint);
+		in.skipLine();
+		return true;
+	};
+	BodyDef def;
+	while (in.p < in.end)
+	{
+		in.skipSpace();
+		if (in.atLineEnd() || *in.p == '#')
+		{
+			in.skipLine();
+			continue;
+		}
+
+		bool ok;
+		def.friction = 0.5f;
+		def.velX = def.velY = 0.0f;
+		def.bullet = false;
+		if (in.keyword("box", 3))
+		{
+			def.shape = SHAPE_BOX;
+			ok = in.number(def.x) && in.number(def.y) && in.number(def.extentX) && in.number(def.extentY)
+				&& in.number(def.angle) && in.number(def.density) && in.color(def.color);
+		}
+		else if (in.keyword("circle", 6))
+		{
+			def.shape = SHAPE_CIRCLE;
+			def.angle = 0.0f;
+			ok = in.number(def.x) && in.number(def.y) && in.number(def.extentX)
+				&& in.number(def.density) && in.color(def.color);
+			def.extentY = def.extentX;
+		}
+		else if (in.keyword("bullet", 6))
+		{
+			def.shape = SHAPE_CIRCLE;
+			def.angle = 0.0f;
+			def.bullet = true;
+			ok = in.number(def.x) && in.number(def.y) && in.number(def.extentX)
+				&& in.number(def.density) && in.color(def.color) && in.number(def.velX) && in.number(def.velY);
+			def.extentY = def.extentX;
+		}
+		else if (in.keyword("gravity", 7))
+		{
+			if (!in.number(world.gravityX) || !in.number(world.gravityY) || !in.atLineEnd())
+				return fail();
+			in.skipLine();
+			continue;
+		}
+		else if (in.keyword("particles", 9))
+		{
+			float x, y, halfWidth, halfHeight, spacing;
+			if (!in.number(x) || !in.number(y) || !in.number(halfWidth) || !in.number(halfHeight)
+				|| !in.number(spacing) || spacing <= 0.0f || !in.atLineEnd())
+				return fail();
+			if (particles)
+			{
+				particles->radius = 0.5f * spacing;
+				particles->addBlock(x, y, halfWidth, halfHeight, spacing);
+			}
+			in.skipLine();
+			continue;
+		}
+		else if (in.keyword("softbox", 7))
+		{
+			if (!parseSoftBody(false))
+				return fail();
+			continue;
+		}
+		else if (in.keyword("cloth", 5))
+		{
+			if (!parseSoftBody(true))
+				return fail();
+			continue;
+		}
+		else if (in.keyword("revolute", 8))
+		{
+			if (!parseJoint(JOINT_REVOLUTE))
+				return fail();
+			continue;
+		}
+		else if (in.keyword("prismatic", 9))
+		{
+			if (!parseJoint(JOINT_PRISMATIC))
+				return fail();
+			continue;
+		}
+		else if (in.keyword("weld", 4))
+		{
+			if (!parseJoint(JOINT_WELD))
+				return fail();
+			continue;
+		}
+		else if (in.keyword("distance", 8))
+		{
+			if (!parseJoint(JOINT_DISTANCE))
+				return fail();
+			continue;
+		}
+		else if (in.keyword("motor", 5))
+		{
+			if (!parseJoint(JOINT_MOTOR))
+				return fail();
+			continue;
+		}
+		else
+		{
+			ok = false;
+		}
+
+		if (ok && !in.atLineEnd())
+			ok = in.number(def.friction) && in.atLineEnd();
+		if (!ok)
+			return fail();
+		bodies.set(count++, def);
+		in.skipLine();
+	}
+	bodies.resize(count);
+	if (particles)
+	{
+		particles->gravityX = world.gravityX;
+		particles->gravityY = world.gravityY;
+	}
+	if (softBodies)
+	{
+		softBodies->gravityX = world.gravityX;
+		softBodies->gravityY = world.gravityY;
+	}
+	return true;
+}
+#endif
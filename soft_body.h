@@ -0,0 +1,505 @@
+#ifndef SOFT_BODY_H
+#define SOFT_BODY_H
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "body_store.h"
+#include "collision.h"
+#include "job_system.h"
+#include "profiler.h"
+
+enum SoftConstraintType : uint8_t
+{
+	SOFT_DISTANCE = 0, // keeps two vertices at their rest distance
+	SOFT_BENDING,      // distance across two edges, soft enough to let the mesh fold
+	SOFT_AREA          // keeps a triangle at its rest (signed) area
+};
+
+// description of a soft body, the rectangle is split into cellsX * cellsY cells
+// with a vertex at every corner. A compliance of 0 is rigid, larger is softer
+// (inverse stiffness, metres per newton).
+// ------------------------------------------------------------------------
+struct SoftBodyDef
+{
+	float x = 0.0f, y = 0.0f;              // centre
+	float halfWidth = 0.5f, halfHeight = 0.5f;
+	int cellsX = 4, cellsY = 4;
+	float density = 1.0f;
+	float stretchCompliance = 0.0f;
+	float areaCompliance = 0.0f;
+	float bendCompliance = 1e-3f;
+	uint32_t color = 0xffffffff;           // 0xAABBGGRR
+};
+
+// vertices and triangles of one body, for rendering and lookups
+struct SoftBody
+{
+	uint32_t firstVertex, vertexCount;
+	uint32_t firstTriangle, triangleCount;
+};
+
+// timings and counts for the most recent soft body step
+// ------------------------------------------------------------------------
+struct SoftBodyStats
+{
+	uint64_t predictNs = 0;
+	uint64_t solveNs = 0;
+	uint64_t collideNs = 0;
+	uint64_t totalNs = 0;
+	size_t vertices = 0;
+	size_t constraints = 0;
+	int colors = 0;
+};
+
+// Extended position based dynamics (XPBD) for deformable bodies and cloth.
+// Vertices and constraints are kept in SoA arrays shared by every soft body.
+// Constraints are greedily graph coloured so no two of one colour share a
+// vertex, then sorted by colour: each colour is projected in parallel on the
+// job system and the colours run one after another, which is Gauss-Seidel
+// between colours and exact within one. Each step is split into small substeps
+// of one projection pass each (so no lambdas have to be carried between
+// iterations). Soft bodies collide with the static bodies of the rigid world
+// only, not with each other or with dynamic bodies.
+// ------------------------------------------------------------------------
+class SoftBodySystem
+{
+public:
+	// vertices
+	std::vector<float> posX, posY;
+	std::vector<float> velX, velY;
+	std::vector<float> invMass;
+	std::vector<uint32_t> color;
+
+	// constraints, reordered by colour whenever bodies are added
+	std::vector<uint8_t> type;
+	std::vector<uint32_t> indexA, indexB, indexC;
+	std::vector<float> rest;
+	std::vector<float> compliance;
+
+	// three vertex indices per triangle
+	std::vector<uint32_t> triangles;
+	std::vector<SoftBody> bodies;
+
+	float gravityX = 0.0f, gravityY = -10.0f;
+	float vertexRadius = 0.02f;   // collision thickness against static shapes
+	float friction = 0.3f;        // fraction of sliding removed per substep while touching
+	float damping = 0.9995f;      // velocity kept per substep
+	int substeps = 8;
+	SoftBodyStats stats;
+
+	size_t vertexCount() const { return posX.size(); }
+	size_t constraintCount() const { return type.size(); }
+
+	// ------------------------------------------------------------------------
+	void setJobSystem(JobSystem* jobSystem)
+	{
+		jobs = jobSystem;
+	}
+	// ------------------------------------------------------------------------
+	void clear()
+	{
+		std::vector<float>* vertexArrays[] = { &posX, &posY, &velX, &velY, &invMass };
+		for (std::vector<float>* a : vertexArrays)
+			a->clear();
+		color.clear();
+		type.clear();
+		indexA.clear(); indexB.clear(); indexC.clear();
+		rest.clear();
+		compliance.clear();
+		triangles.clear();
+		bodies.clear();
+		colorStart.assign(1, 0);
+		colored = true;
+	}
+
+	// a solid deformable block, triangulated with distance constraints on every
+	// edge, an area constraint per triangle and bending across pairs of edges
+	// returns the index of the body
+	// ------------------------------------------------------------------------
+	uint32_t createSoftBox(const SoftBodyDef& def)
+	{
+		uint32_t b = createGrid(def, false);
+		const SoftBody& body = bodies[b];
+		for (uint32_t t = body.firstTriangle; t < body.firstTriangle + body.triangleCount; t++)
+			addArea(triangles[3 * t], triangles[3 * t + 1], triangles[3 * t + 2], def.areaCompliance);
+		return b;
+	}
+	// a sheet hanging from its two top corners, which are pinned in place. With
+	// no area or diagonal constraints its cells can shear, so it sags and folds
+	// like a net (a fully triangulated mesh of stiff edges is rigid in 2D)
+	// returns the index of the body
+	// ------------------------------------------------------------------------
+	uint32_t createCloth(const SoftBodyDef& def)
+	{
+		return createGrid(def, true);
+	}
+
+	// advance every soft body by dt, colliding with the static bodies in statics
+	// ------------------------------------------------------------------------
+	void step(float dt, const BodyStore& statics)
+	{
+		PROFILE_ZONE("soft bodies");
+		typedef std::chrono::steady_clock Clock;
+		auto ns = [](Clock::time_point a, Clock::time_point b) {
+			return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(b - a).count();
+		};
+		Clock::time_point t0 = Clock::now();
+		size_t n = vertexCount();
+		stats.vertices = n;
+		stats.constraints = constraintCount();
+		if (n == 0 || dt <= 0.0f)
+			return;
+		if (!colored)
+			colorConstraints();
+		stats.colors = (int)colorStart.size() - 1;
+		gatherStatics(statics);
+
+		prevX.resize(n);
+		prevY.resize(n);
+		int substepCount = std::max(1, substeps);
+		float h = dt / substepCount;
+		float invH2 = 1.0f / (h * h);
+		uint64_t predictNs = 0, solveNs = 0, collideNs = 0;
+		for (int sub = 0; sub < substepCount; sub++)
+		{
+			Clock::time_point s0 = Clock::now();
+			{
+				PROFILE_ZONE("soft predict");
+				float gx = gravityX * h, gy = gravityY * h;
+				forRange(n, [&](size_t begin, size_t end, int) {
+					for (size_t i = begin; i < end; i++)
+					{
+						prevX[i] = posX[i];
+						prevY[i] = posY[i];
+						if (invMass[i] == 0.0f)
+							continue;
+						velX[i] = (velX[i] + gx) * damping;
+						velY[i] = (velY[i] + gy) * damping;
+						posX[i] += velX[i] * h;
+						posY[i] += velY[i] * h;
+					}
+				});
+			}
+			Clock::time_point s1 = Clock::now();
+
+			{
+				PROFILE_ZONE("soft solve");
+				for (size_t c = 0; c + 1 < colorStart.size(); c++)
+				{
+					// the last colour collects whatever the greedy colouring couldn't
+					// place and may share vertices, so it runs on one thread
+					uint32_t first = colorStart[c], last = colorStart[c + 1];
+					auto solve = [&](size_t begin, size_t end, int) {
+						for (size_t k = first + begin; k < first + end; k++)
+						{
+							if (type[k] == SOFT_AREA)
+								solveArea(k, invH2);
+							else
+								solveDistance(k, invH2);
+						}
+					};
+					if (c + 2 == colorStart.size() && overflowColor)
+						solve(0, last - first, 0);
+					else
+						forRange(last - first, solve);
+				}
+			}
+			Clock::time_point s2 = Clock::now();
+
+			{
+				PROFILE_ZONE("soft collide");
+				float invH = 1.0f / h;
+				forRange(n, [&](size_t begin, size_t end, int) {
+					for (size_t i = begin; i < end; i++)
+					{
+						if (invMass[i] == 0.0f)
+							continue;
+						collideVertex(i);
+						velX[i] = (posX[i] - prevX[i]) * invH;
+						velY[i] = (posY[i] - prevY[i]) * invH;
+					}
+				});
+			}
+			Clock::time_point s3 = Clock::now();
+			predictNs += ns(s0, s1);
+			solveNs += ns(s1, s2);
+			collideNs += ns(s2, s3);
+		}
+		stats.predictNs = predictNs;
+		stats.solveNs = solveNs;
+		stats.collideNs = collideNs;
+		stats.totalNs = ns(t0, Clock::now());
+	}
+
+private:
+	static const int MAX_COLORS = 64;
+
+	JobSystem* jobs = nullptr;
+	std::vector<float> prevX, prevY;
+	std::vector<uint32_t> colorStart = std::vector<uint32_t>(1, 0);
+	bool colored = true;
+	bool overflowColor = false;
+
+	// static shapes of the rigid world with their bounds, refreshed every step
+	std::vector<ShapeTransform> shapes;
+	std::vector<uint8_t> shapeIsCircle;
+	std::vector<float> shapeBounds; // minX, minY, maxX, maxY per shape
+
+	template<class Fn>
+	void forRange(size_t count, Fn&& fn)
+	{
+		if (jobs)
+			jobs->parallelFor(count, fn);
+		else if (count > 0)
+			fn(0, count, 0);
+	}
+
+	// ------------------------------------------------------------------------
+	uint32_t addVertex(float x, float y, float mass, uint32_t rgba)
+	{
+		posX.push_back(x); posY.push_back(y);
+		velX.push_back(0.0f); velY.push_back(0.0f);
+		invMass.push_back(mass > 0.0f ? 1.0f / mass : 0.0f);
+		color.push_back(rgba);
+		return (uint32_t)(posX.size() - 1);
+	}
+	// ------------------------------------------------------------------------
+	void addConstraint(SoftConstraintType t, uint32_t a, uint32_t b, uint32_t c, float restValue, float alpha)
+	{
+		type.push_back(t);
+		indexA.push_back(a); indexB.push_back(b); indexC.push_back(c);
+		rest.push_back(restValue);
+		compliance.push_back(alpha);
+		colored = false;
+	}
+	// ------------------------------------------------------------------------
+	void addDistance(SoftConstraintType t, uint32_t a, uint32_t b, float alpha)
+	{
+		float dx = posX[b] - posX[a], dy = posY[b] - posY[a];
+		addConstraint(t, a, b, b, sqrtf(dx * dx + dy * dy), alpha);
+	}
+	// ------------------------------------------------------------------------
+	void addArea(uint32_t a, uint32_t b, uint32_t c, float alpha)
+	{
+		addConstraint(SOFT_AREA, a, b, c, triangleArea(a, b, c), alpha);
+	}
+	float triangleArea(uint32_t a, uint32_t b, uint32_t c) const
+	{
+		return 0.5f * ((posX[b] - posX[a]) * (posY[c] - posY[a]) - (posY[b] - posY[a]) * (posX[c] - posX[a]));
+	}
+
+	// vertices on a (cellsX + 1) x (cellsY + 1) lattice, two counter-clockwise
+	// triangles per cell with alternating diagonals so the mesh has no preferred
+	// shear direction, distance constraints on every triangle edge (cloth leaves
+	// out the diagonals) and bending constraints two vertices apart along rows
+	// and columns
+	// ------------------------------------------------------------------------
+	uint32_t createGrid(const SoftBodyDef& def, bool cloth)
+	{
+		int cx = std::max(1, def.cellsX), cy = std::max(1, def.cellsY);
+		int w = cx + 1;
+		float vertexMass = def.density * 4.0f * def.halfWidth * def.halfHeight / (float)(w * (cy + 1));
+		SoftBody body;
+		body.firstVertex = (uint32_t)vertexCount();
+		body.vertexCount = (uint32_t)(w * (cy + 1));
+		body.firstTriangle = (uint32_t)(triangles.size() / 3);
+		body.triangleCount = (uint32_t)(2 * cx * cy);
+		for (int j = 0; j <= cy; j++)
+			for (int i = 0; i <= cx; i++)
+			{
+				float x = def.x - def.halfWidth + 2.0f * def.halfWidth * i / cx;
+				float y = def.y - def.halfHeight + 2.0f * def.halfHeight * j / cy;
+				bool pinned = cloth && j == cy && (i == 0 || i == cx);
+				addVertex(x, y, pinned ? 0.0f : vertexMass, def.color);
+			}
+		auto v = [&](int i, int j) { return body.firstVertex + (uint32_t)(j * w + i); };
+
+		for (int j = 0; j < cy; j++)
+			for (int i = 0; i < cx; i++)
+			{
+				uint32_t a = v(i, j), b = v(i + 1, j), c = v(i + 1, j + 1), d = v(i, j + 1);
+				if ((i + j) % 2 == 0)
+				{
+					triangles.insert(triangles.end(), { a, b, c, a, c, d });
+					if (!cloth)
+						addDistance(SOFT_DISTANCE, a, c, def.stretchCompliance);
+				}
+				else
+				{
+					triangles.insert(triangles.end(), { a, b, d, b, c, d });
+					if (!cloth)
+						addDistance(SOFT_DISTANCE, b, d, def.stretchCompliance);
+				}
+			}
+		for (int j = 0; j <= cy; j++)
+			for (int i = 0; i < cx; i++)
+				addDistance(SOFT_DISTANCE, v(i, j), v(i + 1, j), def.stretchCompliance);
+		for (int j = 0; j < cy; j++)
+			for (int i = 0; i <= cx; i++)
+				addDistance(SOFT_DISTANCE, v(i, j), v(i, j + 1), def.stretchCompliance);
+		for (int j = 0; j <= cy; j++)
+			for (int i = 0; i + 2 <= cx; i++)
+				addDistance(SOFT_BENDING, v(i, j), v(i + 2, j), def.bendCompliance);
+		for (int j = 0; j + 2 <= cy; j++)
+			for (int i = 0; i <= cx; i++)
+				addDistance(SOFT_BENDING, v(i, j), v(i, j + 2), def.bendCompliance);
+
+		bodies.push_back(body);
+		return (uint32_t)(bodies.size() - 1);
+	}
+
+	// greedy colouring, each constraint takes the lowest colour none of its
+	// vertices is in yet, then the constraint arrays are sorted by colour
+	// ------------------------------------------------------------------------
+	void colorConstraints()
+	{
+		size_t count = constraintCount();
+		std::vector<uint64_t> used(vertexCount(), 0);
+		std::vector<uint8_t> colorOf(count);
+		std::vector<uint32_t> colorCount(MAX_COLORS + 1, 0);
+		overflowColor = false;
+		for (size_t k = 0; k < count; k++)
+		{
+			uint64_t taken = used[indexA[k]] | used[indexB[k]] | used[indexC[k]];
+			int c = 0;
+			while (c < MAX_COLORS && (taken >> c) & 1)
+				c++;
+			if (c < MAX_COLORS)
+			{
+				used[indexA[k]] |= 1ull << c;
+				used[indexB[k]] |= 1ull << c;
+				used[indexC[k]] |= 1ull << c;
+			}
+			else
+			{
+				overflowColor = true;
+			}
+			colorOf[k] = (uint8_t)c;
+			colorCount[c]++;
+		}
+
+		// drop empty colours, keeping the overflow bucket last
+		colorStart.assign(1, 0);
+		std::vector<uint32_t> slot(MAX_COLORS + 1);
+		for (int c = 0; c <= MAX_COLORS; c++)
+		{
+			if (colorCount[c] == 0)
+				continue;
+			slot[c] = colorStart.back();
+			colorStart.push_back(colorStart.back() + colorCount[c]);
+		}
+		std::vector<uint32_t> order(count);
+		for (size_t k = 0; k < count; k++)
+			order[slot[colorOf[k]]++] = (uint32_t)k;
+		permute(type, order);
+		permute(indexA, order);
+		permute(indexB, order);
+		permute(indexC, order);
+		permute(rest, order);
+		permute(compliance, order);
+		colored = true;
+	}
+	template<class T>
+	static void permute(std::vector<T>& v, const std::vector<uint32_t>& order)
+	{
+		std::vector<T> out(v.size());
+		for (size_t k = 0; k < order.size(); k++)
+			out[k] = v[order[k]];
+		v.swap(out);
+	}
+
+	// ------------------------------------------------------------------------
+	void solveDistance(size_t k, float invH2)
+	{
+		uint32_t a = indexA[k], b = indexB[k];
+		float wa = invMass[a], wb = invMass[b];
+		float dx = posX[a] - posX[b], dy = posY[a] - posY[b];
+		float len = sqrtf(dx * dx + dy * dy);
+		if (len < 1e-9f)
+			return;
+		float alpha = compliance[k] * invH2;
+		float w = wa + wb + alpha;
+		if (w == 0.0f)
+			return;
+		float lambda = -(len - rest[k]) / w;
+		float nx = dx / len, ny = dy / len;
+		posX[a] += wa * lambda * nx; posY[a] += wa * lambda * ny;
+		posX[b] -= wb * lambda * nx; posY[b] -= wb * lambda * ny;
+	}
+	// ------------------------------------------------------------------------
+	void solveArea(size_t k, float invH2)
+	{
+		uint32_t a = indexA[k], b = indexB[k], c = indexC[k];
+		float wa = invMass[a], wb = invMass[b], wc = invMass[c];
+		// gradients of the signed area with respect to each vertex
+		float gbx = 0.5f * (posY[c] - posY[a]), gby = -0.5f * (posX[c] - posX[a]);
+		float gcx = -0.5f * (posY[b] - posY[a]), gcy = 0.5f * (posX[b] - posX[a]);
+		float gax = -gbx - gcx, gay = -gby - gcy;
+		float alpha = compliance[k] * invH2;
+		float w = wa * (gax * gax + gay * gay) + wb * (gbx * gbx + gby * gby) + wc * (gcx * gcx + gcy * gcy) + alpha;
+		if (w < 1e-12f)
+			return;
+		float lambda = -(triangleArea(a, b, c) - rest[k]) / w;
+		posX[a] += wa * lambda * gax; posY[a] += wa * lambda * gay;
+		posX[b] += wb * lambda * gbx; posY[b] += wb * lambda * gby;
+		posX[c] += wc * lambda * gcx; posY[c] += wc * lambda * gcy;
+	}
+
+	// ------------------------------------------------------------------------
+	void gatherStatics(const BodyStore& statics)
+	{
+		shapes.clear();
+		shapeIsCircle.clear();
+		shapeBounds.clear();
+		for (size_t b = 0; b < statics.size(); b++)
+		{
+			if (statics.invMass[b] != 0.0f || statics.sensor[b])
+				continue;
+			ShapeTransform shape;
+			shape.p = Vec2(statics.posX[b], statics.posY[b]);
+			shape.q = Rot(statics.angle[b]);
+			shape.extentX = statics.extentX[b];
+			shape.extentY = statics.extentY[b];
+			bool circle = statics.shape[b] == SHAPE_CIRCLE;
+			float ex = circle ? shape.extentX : fabsf(shape.q.c) * shape.extentX + fabsf(shape.q.s) * shape.extentY;
+			float ey = circle ? shape.extentX : fabsf(shape.q.s) * shape.extentX + fabsf(shape.q.c) * shape.extentY;
+			shapes.push_back(shape);
+			shapeIsCircle.push_back(circle ? 1 : 0);
+			shapeBounds.insert(shapeBounds.end(), { shape.p.x - ex - vertexRadius, shape.p.y - ey - vertexRadius,
+				shape.p.x + ex + vertexRadius, shape.p.y + ey + vertexRadius });
+		}
+	}
+	// push a vertex out of every static shape it ended up in, and take away part
+	// of its sliding along the surface
+	// ------------------------------------------------------------------------
+	void collideVertex(size_t i)
+	{
+		Vec2 prev(prevX[i], prevY[i]);
+		for (size_t s = 0; s < shapes.size(); s++)
+		{
+			const float* box = &shapeBounds[4 * s];
+			if (posX[i] < box[0] || posY[i] < box[1] || posX[i] > box[2] || posY[i] > box[3])
+				continue;
+			Vec2 inside(posX[i], posY[i]);
+			Vec2 point = inside;
+			if (!pushPointOut(shapes[s], shapeIsCircle[s] != 0, vertexRadius, prev, point))
+				continue;
+			Vec2 n = point - inside;
+			float len = length(n);
+			if (len > 1e-9f)
+			{
+				n = (1.0f / len) * n;
+				Vec2 moved = point - prev;
+				Vec2 slide = moved - dot(moved, n) * n;
+				point -= friction * slide;
+			}
+			posX[i] = point.x;
+			posY[i] = point.y;
+		}
+	}
+};
+#endif
@@ -0,0 +1,86 @@
+#ifndef SOFT_BODY_RENDERER_H
+#define SOFT_BODY_RENDERER_H
+
+#include <glad/glad.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "soft_body.h"
+
+// draws every soft body as one indexed triangle mesh through the body shader
+// with worldSpaceVertices set. Vertex positions are streamed each frame, the
+// index buffer is only uploaded again when bodies are added or removed.
+// ------------------------------------------------------------------------
+class SoftBodyRenderer
+{
+public:
+	struct Vertex
+	{
+		float x, y;
+		uint32_t color;
+	};
+
+	SoftBodyRenderer()
+	{
+		glGenVertexArrays(1, &VAO);
+		glGenBuffers(1, &VBO);
+		glGenBuffers(1, &EBO);
+		glBindVertexArray(VAO);
+		glBindBuffer(GL_ARRAY_BUFFER, VBO);
+		glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, x));
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(1, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Vertex), (void*)offsetof(Vertex, color));
+		glEnableVertexAttribArray(1);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+		glBindVertexArray(0);
+	}
+
+	// release the GL objects, must be called while the context is still current
+	// ------------------------------------------------------------------------
+	void destroy()
+	{
+		glDeleteVertexArrays(1, &VAO);
+		glDeleteBuffers(1, &VBO);
+		glDeleteBuffers(1, &EBO);
+	}
+
+	// ------------------------------------------------------------------------
+	void update(const SoftBodySystem& soft)
+	{
+		vertices.resize(soft.vertexCount());
+		for (size_t i = 0; i < vertices.size(); i++)
+		{
+			Vertex v = { soft.posX[i], soft.posY[i], soft.color[i] };
+			vertices[i] = v;
+		}
+		// orphan the old storage so the driver doesn't stall on last frame's draw
+		glBindBuffer(GL_ARRAY_BUFFER, VBO);
+		glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), NULL, GL_STREAM_DRAW);
+		glBufferSubData(GL_ARRAY_BUFFER, 0, vertices.size() * sizeof(Vertex), vertices.data());
+
+		if (soft.triangles.size() != indexCount)
+		{
+			indexCount = soft.triangles.size();
+			glBindVertexArray(VAO);
+			glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * sizeof(uint32_t), soft.triangles.data(), GL_STATIC_DRAW);
+			glBindVertexArray(0);
+		}
+	}
+	// ------------------------------------------------------------------------
+	void draw()
+	{
+		if (indexCount == 0)
+			return;
+		glBindVertexArray(VAO);
+		glDrawElements(GL_TRIANGLES, (GLsizei)indexCount, GL_UNSIGNED_INT, (void*)0);
+		glBindVertexArray(0);
+	}
+
+private:
+	unsigned int VAO, VBO, EBO;
+	std::vector<Vertex> vertices;
+	size_t indexCount = 0;
+};
+#endif
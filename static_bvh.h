@@ -0,0 +1,378 @@
+#ifndef STATIC_BVH_H
+#define STATIC_BVH_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include "mapped_file.h"
+
+// bounds of one primitive handed to StaticBvh::build
+struct BvhBounds
+{
+	float minX, minY, maxX, maxY;
+};
+
+// node of the flattened tree. Nodes are stored depth first, so the first child
+// of an inner node is the node right after it and skip is the node after its
+// whole subtree, which is where a walk goes when the bounds miss.
+// ------------------------------------------------------------------------
+struct BvhNode
+{
+	float minX, minY, maxX, maxY;
+	uint32_t skip;
+	uint32_t leaf;  // first primitive << 4 | primitive count, 0 for inner nodes
+};
+
+// Bounding volume hierarchy over primitives that never move, built once with
+// the surface area heuristic and then only read. There is nothing to refit or
+// rebalance, so the tree is one flat array of 24-byte nodes walked front to
+// back without a stack, and a built tree can be saved and mapped back into
+// memory as it is on the next start instead of being rebuilt.
+//
+// Splits are chosen among 16 bins of primitive centres along the longer axis of
+// the node, by the perimeter of the two halves (the 2D surface area) times the
+// primitives in them. Nodes of up to 15 primitives become leaves when no split
+// is expected to be cheaper than testing them all.
+//
+// Saved trees are in native byte order, like the other scratch files, and are
+// checked on load against the primitive count they were built for.
+// ------------------------------------------------------------------------
+class StaticBvh
+{
+public:
+	static const uint32_t MAX_LEAF_PRIMITIVES = 15;
+	static const uint32_t FILE_MAGIC = 0x48564253;  // "SBVH"
+	static const uint32_t FILE_VERSION = 1;
+
+	StaticBvh() {}
+	// copies share a mapped file, built arrays are copied and pointed at again
+	StaticBvh(const StaticBvh& other) { *this = other; }
+	StaticBvh& operator=(const StaticBvh& other)
+	{
+		if (this == &other)
+			return *this;
+		ownNodes = other.ownNodes;
+		ownPrimitives = other.ownPrimitives;
+		mapping = other.mapping;
+		nodeCount = other.nodeCount;
+		primitiveCount = other.primitiveCount;
+		nodes = mapping ? other.nodes : ownNodes.data();
+		primitives = mapping ? other.primitives : ownPrimitives.data();
+		return *this;
+	}
+
+	// build the tree over count primitives, primitive k has bounds[k]
+	// ------------------------------------------------------------------------
+	void build(const BvhBounds* bounds, size_t count)
+	{
+		clear();
+		if (count == 0)
+			return;
+		if (count >= (1u << 28))
+		{
+			std::cout << "ERROR::STATIC_BVH::TOO_MANY_PRIMITIVES " << count << std::endl;
+			return;
+		}
+		ownPrimitives.resize(count);
+		centreX.resize(count);
+		centreY.resize(count);
+		for (size_t k = 0; k < count; k++)
+		{
+			ownPrimitives[k] = (uint32_t)k;
+			centreX[k] = 0.5f * (bounds[k].minX + bounds[k].maxX);
+			centreY[k] = 0.5f * (bounds[k].minY + bounds[k].maxY);
+		}
+		buildNode(bounds, 0, (uint32_t)count);
+		std::vector<float>().swap(centreX);
+		std::vector<float>().swap(centreY);
+		nodes = ownNodes.data();
+		nodeCount = ownNodes.size();
+		primitives = ownPrimitives.data();
+		primitiveCount = count;
+	}
+
+	void clear()
+	{
+		ownNodes.clear();
+		ownPrimitives.clear();
+		mapping.reset();
+		nodes = nullptr;
+		primitives = nullptr;
+		nodeCount = primitiveCount = 0;
+	}
+
+	bool empty() const { return nodeCount == 0; }
+	size_t size() const { return nodeCount; }
+	size_t primitiveSize() const { return primitiveCount; }
+	// bytes of nodes and primitive ids, whether built or mapped
+	size_t memoryBytes() const { return nodeCount * sizeof(BvhNode) + primitiveCount * sizeof(uint32_t); }
+
+	// write the tree to path, a header followed by the node and primitive arrays
+	// ------------------------------------------------------------------------
+	bool save(const char* path) const
+	{
+		uint32_t header[4] = { FILE_MAGIC, FILE_VERSION, (uint32_t)nodeCount, (uint32_t)primitiveCount };
+		FILE* file = fopen(path, "wb");
+		bool ok = file && fwrite(header, sizeof(header), 1, file) == 1
+			&& fwrite(nodes, sizeof(BvhNode), nodeCount, file) == nodeCount
+			&& fwrite(primitives, sizeof(uint32_t), primitiveCount, file) == primitiveCount;
+		if (file)
+			ok = fclose(file) == 0 && ok;
+		if (!ok)
+			std::cout << "ERROR::STATIC_BVH::FILE_NOT_SUCCESFULLY_WRITTEN: " << path << std::endl;
+		return ok;
+	}
+
+	// map a tree saved for expectedPrimitives primitives, the nodes are used in place
+	// and stay mapped for as long as this tree or a copy of it holds them
+	// ------------------------------------------------------------------------
+	bool load(const char* path, size_t expectedPrimitives)
+	{
+		clear();
+		std::shared_ptr<MappedFile> file = std::make_shared<MappedFile>();
+		if (!file->open(path, false))
+		{
+			std::cout << "ERROR::STATIC_BVH::FILE_NOT_SUCCESFULLY_READ: " << path << std::endl;
+			return false;
+		}
+		uint32_t header[4] = {};
+		if (file->size >= sizeof(header))
+			memcpy(header, file->data, sizeof(header));
+		size_t bytes = sizeof(header) + header[2] * sizeof(BvhNode) + header[3] * sizeof(uint32_t);
+		if (header[0] != FILE_MAGIC || header[1] != FILE_VERSION || file->size != bytes || header[3] != expectedPrimitives)
+		{
+			std::cout << "ERROR::STATIC_BVH::FILE_DOES_NOT_MATCH: " << path << std::endl;
+			return false;
+		}
+		const BvhNode* n = (const BvhNode*)(file->data + sizeof(header));
+		const uint32_t* p = (const uint32_t*)(n + header[2]);
+		if (!valid(n, header[2], p, header[3]))
+		{
+			std::cout << "ERROR::STATIC_BVH::FILE_CORRUPT: " << path << std::endl;
+			return false;
+		}
+		mapping = file;
+		nodes = n;
+		nodeCount = header[2];
+		primitives = p;
+		primitiveCount = header[3];
+		return true;
+	}
+
+	// call fn(primitive) for every primitive in a leaf whose bounds overlap the box
+	// ------------------------------------------------------------------------
+	template<class Fn>
+	void forEachOverlapping(float x0, float y0, float x1, float y1, Fn&& fn) const
+	{
+		uint32_t i = 0;
+		while (i < nodeCount)
+		{
+			const BvhNode& node = nodes[i];
+			if (node.maxX < x0 || node.minX > x1 || node.maxY < y0 || node.minY > y1)
+			{
+				i = node.skip;
+				continue;
+			}
+			if (node.leaf)
+			{
+				const uint32_t* p = primitives + (node.leaf >> 4);
+				for (uint32_t k = 0; k < (node.leaf & 15); k++)
+					fn(p[k]);
+			}
+			i++;
+		}
+	}
+
+	// call fn(primitive, maxT) for every primitive in a leaf whose bounds the
+	// segment p + t * d, t in [0, maxT], passes through. fn returns the new maxT,
+	// as for GridBroadphase::forEachAlongRay.
+	// ------------------------------------------------------------------------
+	template<class Fn>
+	void forEachAlongRay(float px, float py, float dx, float dy, float maxT, Fn&& fn) const
+	{
+		float invX = dx != 0.0f ? 1.0f / dx : INFINITY, invY = dy != 0.0f ? 1.0f / dy : INFINITY;
+		uint32_t i = 0;
+		while (i < nodeCount)
+		{
+			const BvhNode& node = nodes[i];
+			if (!slab(px, dx, invX, node.minX, node.maxX, py, dy, invY, node.minY, node.maxY, maxT))
+			{
+				i = node.skip;
+				continue;
+			}
+			if (node.leaf)
+			{
+				const uint32_t* p = primitives + (node.leaf >> 4);
+				for (uint32_t k = 0; k < (node.leaf & 15); k++)
+					maxT = fn(p[k], maxT);
+			}
+			i++;
+		}
+	}
+
+private:
+	static const int BINS = 16;
+
+	const BvhNode* nodes = nullptr;
+	const uint32_t* primitives = nullptr;
+	size_t nodeCount = 0, primitiveCount = 0;
+	std::vector<BvhNode> ownNodes;
+	std::vector<uint32_t> ownPrimitives;
+	std::shared_ptr<MappedFile> mapping;
+	std::vector<float> centreX, centreY;
+
+	static bool slab(float px, float dx, float invX, float x0, float x1, float py, float dy, float invY, float y0, float y1, float maxT)
+	{
+		float t0 = 0.0f, t1 = maxT;
+		if (dx == 0.0f)
+		{
+			if (px < x0 || px > x1)
+				return false;
+		}
+		else
+		{
+			float ta = (x0 - px) * invX, tb = (x1 - px) * invX;
+			t0 = std::max(t0, std::min(ta, tb));
+			t1 = std::min(t1, std::max(ta, tb));
+		}
+		if (dy == 0.0f)
+		{
+			if (py < y0 || py > y1)
+				return false;
+		}
+		else
+		{
+			float ta = (y0 - py) * invY, tb = (y1 - py) * invY;
+			t0 = std::max(t0, std::min(ta, tb));
+			t1 = std::min(t1, std::max(ta, tb));
+		}
+		return t0 <= t1;
+	}
+
+	static float perimeter(const BvhBounds& b)
+	{
+		return (b.maxX - b.minX) + (b.maxY - b.minY);
+	}
+
+	static void grow(BvhBounds& b, const BvhBounds& o)
+	{
+		b.minX = fminf(b.minX, o.minX);
+		b.minY = fminf(b.minY, o.minY);
+		b.maxX = fmaxf(b.maxX, o.maxX);
+		b.maxY = fmaxf(b.maxY, o.maxY);
+	}
+
+	// emit the node for primitives [begin, end) and its subtree
+	// ------------------------------------------------------------------------
+	void buildNode(const BvhBounds* bounds, uint32_t begin, uint32_t end)
+	{
+		uint32_t index = (uint32_t)ownNodes.size();
+		BvhBounds box = { INFINITY, INFINITY, -INFINITY, -INFINITY };
+		float cx0 = INFINITY, cy0 = INFINITY, cx1 = -INFINITY, cy1 = -INFINITY;
+		for (uint32_t k = begin; k < end; k++)
+		{
+			uint32_t p = ownPrimitives[k];
+			grow(box, bounds[p]);
+			cx0 = fminf(cx0, centreX[p]);
+			cx1 = fmaxf(cx1, centreX[p]);
+			cy0 = fminf(cy0, centreY[p]);
+			cy1 = fmaxf(cy1, centreY[p]);
+		}
+		BvhNode node = { box.minX, box.minY, box.maxX, box.maxY, 0, 0 };
+		ownNodes.push_back(node);
+
+		uint32_t count = end - begin;
+		bool alongX = cx1 - cx0 >= cy1 - cy0;
+		float lo = alongX ? cx0 : cy0, extent = alongX ? cx1 - cx0 : cy1 - cy0;
+		const std::vector<float>& centre = alongX ? centreX : centreY;
+		uint32_t middle = begin;
+		if (count > 1 && extent > 0.0f)
+		{
+			// bin the centres and sweep for the cheapest split between bins
+			uint32_t binCount[BINS] = {};
+			BvhBounds binBox[BINS];
+			for (BvhBounds& b : binBox)
+				b = { INFINITY, INFINITY, -INFINITY, -INFINITY };
+			float scale = BINS / extent;
+			auto binOf = [&](uint32_t p) {
+				return std::min(BINS - 1, (int)((centre[p] - lo) * scale));
+			};
+			for (uint32_t k = begin; k < end; k++)
+			{
+				uint32_t p = ownPrimitives[k];
+				int b = binOf(p);
+				binCount[b]++;
+				grow(binBox[b], bounds[p]);
+			}
+			float rightCost[BINS];
+			BvhBounds right = { INFINITY, INFINITY, -INFINITY, -INFINITY };
+			uint32_t rightCount = 0;
+			for (int b = BINS - 1; b > 0; b--)
+			{
+				grow(right, binBox[b]);
+				rightCount += binCount[b];
+				rightCost[b] = rightCount ? perimeter(right) * rightCount : 0.0f;
+			}
+			BvhBounds left = { INFINITY, INFINITY, -INFINITY, -INFINITY };
+			uint32_t leftCount = 0;
+			float bestCost = INFINITY;
+			int best = 0;
+			for (int b = 0; b < BINS - 1; b++)
+			{
+				grow(left, binBox[b]);
+				leftCount += binCount[b];
+				float cost = (leftCount ? perimeter(left) * leftCount : 0.0f) + rightCost[b + 1];
+				if (leftCount && leftCount < count && cost < bestCost)
+				{
+					bestCost = cost;
+					best = b;
+				}
+			}
+			// a visit costs about as much as testing one primitive
+			float splitCost = 1.0f + bestCost / perimeter(box);
+			if (count > MAX_LEAF_PRIMITIVES || splitCost < (float)count)
+				middle = (uint32_t)(std::partition(ownPrimitives.begin() + begin, ownPrimitives.begin() + end,
+					[&](uint32_t p) { return binOf(p) <= best; }) - ownPrimitives.begin());
+		}
+		else if (count > MAX_LEAF_PRIMITIVES)
+		{
+			// every centre in one spot, halve the list
+			middle = begin + count / 2;
+		}
+
+		if (middle == begin || middle == end)
+		{
+			ownNodes[index].leaf = begin << 4 | count;
+			ownNodes[index].skip = index + 1;
+			return;
+		}
+		buildNode(bounds, begin, middle);
+		buildNode(bounds, middle, end);
+		ownNodes[index].skip = (uint32_t)ownNodes.size();
+	}
+
+	// every skip points forward and inside the tree and every leaf inside the
+	// primitive list, so a walk over a damaged file still can't run off
+	static bool valid(const BvhNode* n, size_t count, const uint32_t* p, size_t primitiveCount)
+	{
+		for (size_t i = 0; i < count; i++)
+		{
+			if (n[i].skip <= i || n[i].skip > count)
+				return false;
+			if (n[i].leaf && (n[i].leaf >> 4) + (n[i].leaf & 15) > primitiveCount)
+				return false;
+		}
+		for (size_t k = 0; k < primitiveCount; k++)
+			if (p[k] >= primitiveCount)
+				return false;
+		return true;
+	}
+};
+#endif
@@ -0,0 +1,563 @@
+#ifndef STATIC_GEOMETRY_H
+#define STATIC_GEOMETRY_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <iostream>
+#include <unordered_map>
+#include <vector>
+
+#include "static_bvh.h"
+#include "vec2.h"
+
+static const uint32_t NO_SEGMENT = UINT32_MAX;
+
+// one vertex of a mesh, quantized to 16 bits per axis inside the mesh bounds
+struct QuantizedVertex
+{
+	uint16_t x, y;
+};
+
+// Immovable level geometry made of line segments, kept out of the body store.
+// Segments are grouped into meshes (polylines) whose vertices are stored as
+// 16-bit offsets inside the mesh bounds, and meshes are placed in the world as
+// instances with a position and angle. Adding a polyline identical to one
+// already stored reuses its mesh, so repeated props cost one instance each.
+// A segment takes 4 bytes of indices plus its share of 4-byte vertices instead
+// of two float points, and the narrowphase rejects most segments on the
+// quantized values without decoding them.
+//
+// Vertices snap to 1/65535 of the mesh size in each axis, so a 100 m mesh is
+// exact to about a millimetre. A mesh holds at most 65536 vertices, longer
+// polylines have to be split. Segments are two sided, with no thickness.
+// Every placed segment has a global id, counted through the instances in order.
+//
+// Terrain comes in two shapes of its own that need no tree: heightfields,
+// heights sampled at a fixed spacing along x, and chains, polylines whose x
+// never decreases. Both find the segments under a box by index arithmetic on
+// the box's x range, heightfield cells directly and chain cells through a
+// table of the first segment reaching each cell. Terrain is solid below its
+// line and pushes bodies up, mesh segments push them to whichever side they
+// are on. Terrain segment ids have TERRAIN_SEGMENT set. Heightfield heights
+// are quantized like mesh vertices, chain points are kept as floats so long
+// chains stay exact.
+//
+// Queries scan the instance bounds until buildTree() has been called, which
+// bakes every placed segment into a StaticBvh. A level that doesn't change
+// can save its tree next to the scene and map it back with loadTree() instead
+// of building it on every start. Adding meshes or instances drops the tree.
+// ------------------------------------------------------------------------
+class StaticGeometry
+{
+public:
+	static const uint32_t MAX_MESH_VERTICES = 65536;
+	static const uint32_t TERRAIN_SEGMENT = 0x80000000u;
+
+	float friction = 0.6f;
+
+	// store a polyline through count points, closed back to the first one when
+	// loop is set, and return its mesh id, UINT32_MAX if it can't be stored
+	// ------------------------------------------------------------------------
+	uint32_t addMesh(const Vec2* points, size_t count, bool loop)
+	{
+		if (count < 2 || count > MAX_MESH_VERTICES)
+		{
+			std::cout << "ERROR::STATIC_GEOMETRY::MESH_VERTEX_COUNT " << count << std::endl;
+			return UINT32_MAX;
+		}
+		float minX = points[0].x, minY = points[0].y, maxX = minX, maxY = minY;
+		for (size_t i = 1; i < count; i++)
+		{
+			minX = fminf(minX, points[i].x);
+			maxX = fmaxf(maxX, points[i].x);
+			minY = fminf(minY, points[i].y);
+			maxY = fmaxf(maxY, points[i].y);
+		}
+		float scaleX = (maxX - minX) / 65535.0f, scaleY = (maxY - minY) / 65535.0f;
+		quantized.resize(count);
+		for (size_t i = 0; i < count; i++)
+		{
+			quantized[i].x = scaleX > 0.0f ? (uint16_t)lroundf((points[i].x - minX) / scaleX) : 0;
+			quantized[i].y = scaleY > 0.0f ? (uint16_t)lroundf((points[i].y - minY) / scaleY) : 0;
+		}
+
+		// duplicates have the same bounds and the same quantized vertices
+		uint64_t hash = 1469598103934665603ull;
+		auto mix = [&hash](const void* data, size_t bytes) {
+			const uint8_t* p = (const uint8_t*)data;
+			for (size_t i = 0; i < bytes; i++)
+				hash = (hash ^ p[i]) * 1099511628211ull;
+		};
+		float bounds[4] = { minX, minY, scaleX, scaleY };
+		mix(bounds, sizeof(bounds));
+		mix(&loop, sizeof(loop));
+		mix(quantized.data(), count * sizeof(QuantizedVertex));
+		auto range = meshByHash.equal_range(hash);
+		for (auto it = range.first; it != range.second; ++it)
+			if (sameMesh(it->second, bounds, loop))
+				return it->second;
+
+		uint32_t mesh = (uint32_t)meshMinX.size();
+		meshMinX.push_back(minX);
+		meshMinY.push_back(minY);
+		meshScaleX.push_back(scaleX);
+		meshScaleY.push_back(scaleY);
+		meshLoop.push_back(loop);
+		meshVertexStart.push_back((uint32_t)vertices.size());
+		vertices.insert(vertices.end(), quantized.begin(), quantized.end());
+		meshSegmentStart.push_back((uint32_t)(segmentIndex.size() / 2));
+		size_t segments = loop && count > 2 ? count : count - 1;
+		for (size_t s = 0; s < segments; s++)
+		{
+			segmentIndex.push_back((uint16_t)s);
+			segmentIndex.push_back((uint16_t)((s + 1) % count));
+		}
+		meshByHash.insert(std::make_pair(hash, mesh));
+		return mesh;
+	}
+
+	// place a mesh in the world and return the instance index
+	// ------------------------------------------------------------------------
+	uint32_t addInstance(uint32_t mesh, const Vec2& position, float angle)
+	{
+		tree.clear();
+		uint32_t instance = (uint32_t)instanceMesh.size();
+		instanceMesh.push_back(mesh);
+		instanceX.push_back(position.x);
+		instanceY.push_back(position.y);
+		instanceC.push_back(scalarCos(angle));
+		instanceS.push_back(scalarSin(angle));
+		instanceSegmentStart.push_back(placedSegments);
+		placedSegments += meshSegments(mesh);
+
+		// world bounds from the corners of the mesh bounds
+		float x0 = meshMinX[mesh], y0 = meshMinY[mesh];
+		float x1 = x0 + 65535.0f * meshScaleX[mesh], y1 = y0 + 65535.0f * meshScaleY[mesh];
+		Vec2 corners[4] = { Vec2(x0, y0), Vec2(x1, y0), Vec2(x1, y1), Vec2(x0, y1) };
+		float minX = 1e30f, minY = 1e30f, maxX = -1e30f, maxY = -1e30f;
+		for (const Vec2& c : corners)
+		{
+			Vec2 w = toWorld(instance, c);
+			minX = fminf(minX, w.x);
+			maxX = fmaxf(maxX, w.x);
+			minY = fminf(minY, w.y);
+			maxY = fmaxf(maxY, w.y);
+		}
+		instanceMinX.push_back(minX);
+		instanceMinY.push_back(minY);
+		instanceMaxX.push_back(maxX);
+		instanceMaxY.push_back(maxY);
+		return instance;
+	}
+
+	// add a polyline placed as it is, the shorthand for one-off geometry
+	// ------------------------------------------------------------------------
+	uint32_t addPolyline(const Vec2* points, size_t count, bool loop)
+	{
+		uint32_t mesh = addMesh(points, count, loop);
+		return mesh == UINT32_MAX ? UINT32_MAX : addInstance(mesh, Vec2(), 0.0f);
+	}
+
+	void clear()
+	{
+		meshMinX.clear(); meshMinY.clear(); meshScaleX.clear(); meshScaleY.clear();
+		meshLoop.clear();
+		meshVertexStart.clear(); meshSegmentStart.clear();
+		vertices.clear();
+		segmentIndex.clear();
+		meshByHash.clear();
+		instanceMesh.clear();
+		instanceX.clear(); instanceY.clear(); instanceC.clear(); instanceS.clear();
+		instanceSegmentStart.clear();
+		instanceMinX.clear(); instanceMinY.clear(); instanceMaxX.clear(); instanceMaxY.clear();
+		placedSegments = 0;
+		tree.clear();
+		terrainChain.clear();
+		terrainOriginX.clear(); terrainCellWidth.clear();
+		terrainMinY.clear(); terrainScaleY.clear();
+		terrainMaxX.clear(); terrainMaxY.clear();
+		terrainCells.clear(); terrainPointStart.clear(); terrainCellStart.clear(); terrainSegmentStart.clear();
+		heights.clear();
+		chainPoints.clear();
+		chainCellFirst.clear();
+		terrainSegments = 0;
+	}
+
+	// terrain sampled at count heights, heights[k] at x = originX + k * spacing,
+	// returns the terrain index, UINT32_MAX if it can't be stored
+	// ------------------------------------------------------------------------
+	uint32_t addHeightfield(float originX, float spacing, const float* samples, size_t count)
+	{
+		if (count < 2 || count > TERRAIN_SEGMENT - terrainSegments || !(spacing > 0.0f))
+		{
+			std::cout << "ERROR::STATIC_GEOMETRY::HEIGHTFIELD_SIZE " << count << std::endl;
+			return UINT32_MAX;
+		}
+		float minY = samples[0], maxY = minY;
+		for (size_t k = 1; k < count; k++)
+		{
+			minY = fminf(minY, samples[k]);
+			maxY = fmaxf(maxY, samples[k]);
+		}
+		float scaleY = (maxY - minY) / 65535.0f;
+		uint32_t terrain = addTerrain(false, originX, spacing, originX + spacing * (count - 1), minY, scaleY, maxY, (uint32_t)count - 1);
+		terrainPointStart.push_back((uint32_t)heights.size());
+		for (size_t k = 0; k < count; k++)
+			heights.push_back(scaleY > 0.0f ? (uint16_t)lroundf((samples[k] - minY) / scaleY) : 0);
+		return terrain;
+	}
+
+	// terrain along count points whose x never decreases, returns the terrain
+	// index, UINT32_MAX if it can't be stored. Overhangs and closed shapes go in
+	// meshes instead.
+	// ------------------------------------------------------------------------
+	uint32_t addChain(const Vec2* points, size_t count)
+	{
+		if (count < 2 || count > TERRAIN_SEGMENT - terrainSegments)
+		{
+			std::cout << "ERROR::STATIC_GEOMETRY::CHAIN_SIZE " << count << std::endl;
+			return UINT32_MAX;
+		}
+		float minY = points[0].y, maxY = minY;
+		for (size_t k = 1; k < count; k++)
+		{
+			if (points[k].x < points[k - 1].x)
+			{
+				std::cout << "ERROR::STATIC_GEOMETRY::CHAIN_NOT_MONOTONIC " << k << std::endl;
+				return UINT32_MAX;
+			}
+			minY = fminf(minY, points[k].y);
+			maxY = fmaxf(maxY, points[k].y);
+		}
+		// about one segment per cell
+		uint32_t segments = (uint32_t)count - 1;
+		float originX = points[0].x, maxX = points[count - 1].x;
+		float cellWidth = maxX > originX ? (maxX - originX) / segments : 1.0f;
+		uint32_t terrain = addTerrain(true, originX, cellWidth, maxX, minY, 0.0f, maxY, segments);
+		terrainPointStart.push_back((uint32_t)chainPoints.size());
+		chainPoints.insert(chainPoints.end(), points, points + count);
+		terrainCellStart.back() = (uint32_t)chainCellFirst.size();
+		uint32_t k = 0;
+		for (uint32_t c = 0; c < segments; c++)
+		{
+			float cellX = originX + c * cellWidth;
+			while (k + 1 < segments && points[k + 1].x < cellX)
+				k++;
+			chainCellFirst.push_back(k);
+		}
+		return terrain;
+	}
+
+	// bake every placed segment into the tree the queries walk from now on
+	// ------------------------------------------------------------------------
+	void buildTree()
+	{
+		std::vector<BvhBounds> bounds(placedSegments);
+		for (uint32_t instance = 0; instance < instanceMesh.size(); instance++)
+		{
+			uint32_t mesh = instanceMesh[instance];
+			uint32_t first = meshSegmentStart[mesh], count = meshSegments(mesh);
+			for (uint32_t k = 0; k < count; k++)
+			{
+				Vec2 a = toWorld(instance, decode(mesh, segmentIndex[2 * (first + k)]));
+				Vec2 b = toWorld(instance, decode(mesh, segmentIndex[2 * (first + k) + 1]));
+				BvhBounds& box = bounds[instanceSegmentStart[instance] + k];
+				box.minX = fminf(a.x, b.x);
+				box.minY = fminf(a.y, b.y);
+				box.maxX = fmaxf(a.x, b.x);
+				box.maxY = fmaxf(a.y, b.y);
+			}
+		}
+		tree.build(bounds.data(), bounds.size());
+	}
+
+	bool saveTree(const char* path) const { return tree.save(path); }
+	// map a tree saved for this same geometry, false leaves the queries scanning
+	bool loadTree(const char* path) { return tree.load(path, placedSegments); }
+	bool hasTree() const { return !tree.empty(); }
+
+	size_t meshCount() const { return meshMinX.size(); }
+	size_t instanceCount() const { return instanceMesh.size(); }
+	size_t terrainCount() const { return terrainChain.size(); }
+	// placed segments, counting every instance, and terrain segments
+	size_t segmentCount() const { return placedSegments + terrainSegments; }
+
+	// bytes held by the vertex, segment and instance arrays and the tree
+	size_t memoryBytes() const
+	{
+		return vertices.size() * sizeof(QuantizedVertex) + segmentIndex.size() * sizeof(uint16_t) + tree.memoryBytes()
+			+ meshMinX.size() * (4 * sizeof(float) + 2 * sizeof(uint32_t) + 1)
+			+ instanceMesh.size() * (9 * sizeof(float) + 2 * sizeof(uint32_t))
+			+ heights.size() * sizeof(uint16_t) + chainPoints.size() * sizeof(Vec2) + chainCellFirst.size() * sizeof(uint32_t)
+			+ terrainChain.size() * (7 * sizeof(float) + 4 * sizeof(uint32_t) + 1);
+	}
+
+	// world space end points of a placed segment
+	// ------------------------------------------------------------------------
+	void segment(uint32_t id, Vec2& a, Vec2& b) const
+	{
+		if (id & TERRAIN_SEGMENT)
+		{
+			id &= ~TERRAIN_SEGMENT;
+			uint32_t terrain = (uint32_t)(std::upper_bound(terrainSegmentStart.begin(), terrainSegmentStart.end(), id) - terrainSegmentStart.begin()) - 1;
+			terrainSegment(terrain, id - terrainSegmentStart[terrain], a, b);
+			return;
+		}
+		uint32_t instance = (uint32_t)(std::upper_bound(instanceSegmentStart.begin(), instanceSegmentStart.end(), id) - instanceSegmentStart.begin()) - 1;
+		uint32_t mesh = instanceMesh[instance];
+		uint32_t s = meshSegmentStart[mesh] + (id - instanceSegmentStart[instance]);
+		a = toWorld(instance, decode(mesh, segmentIndex[2 * s]));
+		b = toWorld(instance, decode(mesh, segmentIndex[2 * s + 1]));
+	}
+
+	// call fn(id, a, b) with the world space end points of every segment whose
+	// bounds overlap the box. Without a tree the box is taken into each
+	// instance's quantized space so segments are rejected before they are decoded.
+	// ------------------------------------------------------------------------
+	template<class Fn>
+	void forEachSegment(float x0, float y0, float x1, float y1, Fn&& fn) const
+	{
+		for (uint32_t terrain = 0; terrain < terrainChain.size(); terrain++)
+			forEachTerrainSegment(terrain, x0, y0, x1, y1, fn);
+		if (!tree.empty())
+		{
+			tree.forEachOverlapping(x0, y0, x1, y1, [&](uint32_t id) {
+				Vec2 a, b;
+				segment(id, a, b);
+				fn(id, a, b);
+			});
+			return;
+		}
+		for (size_t instance = 0; instance < instanceMesh.size(); instance++)
+		{
+			if (instanceMaxX[instance] < x0 || instanceMinX[instance] > x1 || instanceMaxY[instance] < y0 || instanceMinY[instance] > y1)
+				continue;
+			forEachInstanceSegment((uint32_t)instance, x0, y0, x1, y1, fn);
+		}
+	}
+
+	// the same for the segments of one terrain, found from the cells under the
+	// box's x range without any search
+	// ------------------------------------------------------------------------
+	template<class Fn>
+	void forEachTerrainSegment(uint32_t terrain, float x0, float y0, float x1, float y1, Fn&& fn) const
+	{
+		float originX = terrainOriginX[terrain], width = terrainCellWidth[terrain];
+		if (x1 < originX || x0 > terrainMaxX[terrain] || y1 < terrainMinY[terrain] || y0 > terrainMaxY[terrain])
+			return;
+		uint32_t cells = terrainCells[terrain], start = terrainPointStart[terrain];
+		uint32_t id = TERRAIN_SEGMENT | terrainSegmentStart[terrain];
+		uint32_t c0 = (uint32_t)std::min<float>(fmaxf(floorf((x0 - originX) / width), 0.0f), (float)(cells - 1));
+		if (!terrainChain[terrain])
+		{
+			uint32_t c1 = (uint32_t)std::min<float>(fmaxf(floorf((x1 - originX) / width), 0.0f), (float)(cells - 1));
+			float minY = terrainMinY[terrain], scale = terrainScaleY[terrain];
+			int32_t qy0, qy1;
+			quantizeRange(y0 - minY, y1 - minY, scale, qy0, qy1);
+			const uint16_t* h = heights.data() + start;
+			for (uint32_t k = c0; k <= c1; k++)
+			{
+				if (std::max(h[k], h[k + 1]) < qy0 || std::min(h[k], h[k + 1]) > qy1)
+					continue;
+				fn(id + k, Vec2(originX + k * width, minY + h[k] * scale), Vec2(originX + (k + 1) * width, minY + h[k + 1] * scale));
+			}
+			return;
+		}
+		// chain segments run left to right, so stop at the first one starting past the box
+		const Vec2* p = chainPoints.data() + start;
+		for (uint32_t k = chainCellFirst[terrainCellStart[terrain] + c0]; k < cells && p[k].x <= x1; k++)
+		{
+			const Vec2& a = p[k];
+			const Vec2& b = p[k + 1];
+			if (b.x < x0 || fmaxf(a.y, b.y) < y0 || fminf(a.y, b.y) > y1)
+				continue;
+			fn(id + k, a, b);
+		}
+	}
+
+	// the same for the segments of one instance
+	// ------------------------------------------------------------------------
+	template<class Fn>
+	void forEachInstanceSegment(uint32_t instance, float x0, float y0, float x1, float y1, Fn&& fn) const
+	{
+		uint32_t mesh = instanceMesh[instance];
+		// query box corners in mesh space, then in quantized units
+		float c = instanceC[instance], s = instanceS[instance];
+		float cx = 0.5f * (x0 + x1) - instanceX[instance], cy = 0.5f * (y0 + y1) - instanceY[instance];
+		float hx = 0.5f * (x1 - x0), hy = 0.5f * (y1 - y0);
+		float lx = c * cx + s * cy, ly = -s * cx + c * cy;
+		float ex = fabsf(c) * hx + fabsf(s) * hy, ey = fabsf(s) * hx + fabsf(c) * hy;
+		int32_t qx0, qx1, qy0, qy1;
+		quantizeRange(lx - ex - meshMinX[mesh], lx + ex - meshMinX[mesh], meshScaleX[mesh], qx0, qx1);
+		quantizeRange(ly - ey - meshMinY[mesh], ly + ey - meshMinY[mesh], meshScaleY[mesh], qy0, qy1);
+		if (qx0 > qx1 || qy0 > qy1)
+			return;
+
+		const QuantizedVertex* v = vertices.data() + meshVertexStart[mesh];
+		uint32_t first = meshSegmentStart[mesh], count = meshSegments(mesh);
+		const uint16_t* index = segmentIndex.data() + 2 * first;
+		for (uint32_t k = 0; k < count; k++)
+		{
+			QuantizedVertex a = v[index[2 * k]], b = v[index[2 * k + 1]];
+			if (std::max(a.x, b.x) < qx0 || std::min(a.x, b.x) > qx1 || std::max(a.y, b.y) < qy0 || std::min(a.y, b.y) > qy1)
+				continue;
+			fn(instanceSegmentStart[instance] + k, toWorld(instance, decode(mesh, a)), toWorld(instance, decode(mesh, b)));
+		}
+	}
+
+	// closest segment crossed by origin + t * translation, t in [0, maxT]. The
+	// normal faces back along the ray, segments are hit from either side.
+	// ------------------------------------------------------------------------
+	bool raycast(const Vec2& origin, const Vec2& translation, float maxT, float& t, Vec2& normal, uint32_t& id) const
+	{
+		id = NO_SEGMENT;
+		auto test = [&](uint32_t s, const Vec2& a, const Vec2& b) {
+			Vec2 e = b - a;
+			float denom = cross(translation, e);
+			if (denom == 0.0f)
+				return;
+			Vec2 w = a - origin;
+			float ts = cross(w, e) / denom, u = cross(w, translation) / denom;
+			if (ts < 0.0f || ts > maxT || u < 0.0f || u > 1.0f)
+				return;
+			maxT = ts;
+			id = s;
+			normal = (denom > 0.0f ? -1.0f : 1.0f) * Vec2(e.y, -e.x) * (1.0f / length(e));
+		};
+		Vec2 end = origin + maxT * translation;
+		if (!tree.empty())
+		{
+			for (uint32_t terrain = 0; terrain < terrainChain.size(); terrain++)
+				forEachTerrainSegment(terrain, fminf(origin.x, end.x), fminf(origin.y, end.y), fmaxf(origin.x, end.x), fmaxf(origin.y, end.y), test);
+			tree.forEachAlongRay(origin.x, origin.y, translation.x, translation.y, maxT, [&](uint32_t s, float) {
+				Vec2 a, b;
+				segment(s, a, b);
+				test(s, a, b);
+				return maxT;
+			});
+		}
+		else
+			forEachSegment(fminf(origin.x, end.x), fminf(origin.y, end.y), fmaxf(origin.x, end.x), fmaxf(origin.y, end.y), test);
+		t = maxT;
+		return id != NO_SEGMENT;
+	}
+
+private:
+	// meshes, vertex = min + quantized * scale
+	std::vector<float> meshMinX, meshMinY, meshScaleX, meshScaleY;
+	std::vector<uint8_t> meshLoop;
+	std::vector<uint32_t> meshVertexStart, meshSegmentStart;
+	std::vector<QuantizedVertex> vertices;
+	std::vector<uint16_t> segmentIndex;   // mesh-local vertex pairs
+	std::unordered_multimap<uint64_t, uint32_t> meshByHash;
+	std::vector<QuantizedVertex> quantized;
+
+	// instances
+	std::vector<uint32_t> instanceMesh;
+	std::vector<float> instanceX, instanceY, instanceC, instanceS;
+	std::vector<uint32_t> instanceSegmentStart;
+	std::vector<float> instanceMinX, instanceMinY, instanceMaxX, instanceMaxY;
+	uint32_t placedSegments = 0;
+	StaticBvh tree;
+
+	// terrain, cell c covers x from originX + c * cellWidth, heightfields have one
+	// cell per segment and heights minY + quantized * scaleY
+	std::vector<uint8_t> terrainChain;
+	std::vector<float> terrainOriginX, terrainCellWidth;
+	std::vector<float> terrainMinY, terrainScaleY;
+	std::vector<float> terrainMaxX, terrainMaxY;
+	std::vector<uint32_t> terrainCells;
+	std::vector<uint32_t> terrainPointStart;    // into heights or chainPoints
+	std::vector<uint32_t> terrainCellStart;     // into chainCellFirst
+	std::vector<uint32_t> terrainSegmentStart;
+	std::vector<uint16_t> heights;
+	std::vector<Vec2> chainPoints;
+	std::vector<uint32_t> chainCellFirst;       // first chain segment reaching each cell
+	uint32_t terrainSegments = 0;
+
+	uint32_t addTerrain(bool chain, float originX, float cellWidth, float maxX, float minY, float scaleY, float maxY, uint32_t segments)
+	{
+		uint32_t terrain = (uint32_t)terrainChain.size();
+		terrainChain.push_back(chain);
+		terrainOriginX.push_back(originX);
+		terrainCellWidth.push_back(cellWidth);
+		terrainMaxX.push_back(maxX);
+		terrainMinY.push_back(minY);
+		terrainScaleY.push_back(scaleY);
+		terrainMaxY.push_back(maxY);
+		terrainCells.push_back(segments);
+		terrainCellStart.push_back(0);
+		terrainSegmentStart.push_back(terrainSegments);
+		terrainSegments += segments;
+		return terrain;
+	}
+
+	void terrainSegment(uint32_t terrain, uint32_t k, Vec2& a, Vec2& b) const
+	{
+		uint32_t start = terrainPointStart[terrain];
+		if (terrainChain[terrain])
+		{
+			a = chainPoints[start + k];
+			b = chainPoints[start + k + 1];
+			return;
+		}
+		float originX = terrainOriginX[terrain], width = terrainCellWidth[terrain];
+		float minY = terrainMinY[terrain], scale = terrainScaleY[terrain];
+		a = Vec2(originX + k * width, minY + heights[start + k] * scale);
+		b = Vec2(originX + (k + 1) * width, minY + heights[start + k + 1] * scale);
+	}
+
+	uint32_t meshSegments(uint32_t mesh) const
+	{
+		uint32_t end = mesh + 1 < meshSegmentStart.size() ? meshSegmentStart[mesh + 1] : (uint32_t)(segmentIndex.size() / 2);
+		return end - meshSegmentStart[mesh];
+	}
+
+	uint32_t meshVertices(uint32_t mesh) const
+	{
+		uint32_t end = mesh + 1 < meshVertexStart.size() ? meshVertexStart[mesh + 1] : (uint32_t)vertices.size();
+		return end - meshVertexStart[mesh];
+	}
+
+	bool sameMesh(uint32_t mesh, const float* bounds, bool loop) const
+	{
+		return meshMinX[mesh] == bounds[0] && meshMinY[mesh] == bounds[1] && meshScaleX[mesh] == bounds[2]
+			&& meshScaleY[mesh] == bounds[3] && (bool)meshLoop[mesh] == loop && meshVertices(mesh) == quantized.size()
+			&& memcmp(vertices.data() + meshVertexStart[mesh], quantized.data(), quantized.size() * sizeof(QuantizedVertex)) == 0;
+	}
+
+	Vec2 decode(uint32_t mesh, QuantizedVertex q) const
+	{
+		return Vec2(meshMinX[mesh] + q.x * meshScaleX[mesh], meshMinY[mesh] + q.y * meshScaleY[mesh]);
+	}
+
+	Vec2 decode(uint32_t mesh, uint16_t vertex) const
+	{
+		return decode(mesh, vertices[meshVertexStart[mesh] + vertex]);
+	}
+
+	Vec2 toWorld(uint32_t instance, const Vec2& p) const
+	{
+		float c = instanceC[instance], s = instanceS[instance];
+		return Vec2(instanceX[instance] + c * p.x - s * p.y, instanceY[instance] + s * p.x + c * p.y);
+	}
+
+	// [lo, hi] in mesh units to quantized units, widened by one step for rounding
+	static void quantizeRange(float lo, float hi, float scale, int32_t& qlo, int32_t& qhi)
+	{
+		if (scale <= 0.0f)
+		{
+			qlo = lo <= 0.0f && hi >= 0.0f ? 0 : 1;
+			qhi = 0;
+			return;
+		}
+		qlo = (int32_t)std::max(-1.0f, std::min(65536.0f, floorf(lo / scale))) - 1;
+		qhi = (int32_t)std::max(-1.0f, std::min(65536.0f, ceilf(hi / scale))) + 1;
+		qlo = std::max(qlo, 0);
+		qhi = std::min(qhi, 65535);
+	}
+};
+#endif
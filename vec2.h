@@ -0,0 +1,71 @@
+#ifndef VEC2_H
+#define VEC2_H
+
+#include <cmath>
+
+#include "scalar.h"
+
+// small 2D vector used by the collision and solver code, in the scalar type
+// the world steps in (Vec2T<Q16_16> for a Q16_16 world). Vec2 is the float
+// one the queries, level and rendering use. Scalar factors take T as given, so
+// they are never deduced from and plain literals still work.
+// ------------------------------------------------------------------------
+template<class T>
+struct Vec2T
+{
+	typedef T Scalar;
+	T x, y;
+
+	Vec2T() : x(), y() {}
+	Vec2T(T x, T y) : x(x), y(y) {}
+
+	Vec2T operator-() const { return Vec2T(-x, -y); }
+	Vec2T& operator+=(const Vec2T& v) { x += v.x; y += v.y; return *this; }
+	Vec2T& operator-=(const Vec2T& v) { x -= v.x; y -= v.y; return *this; }
+	Vec2T& operator*=(T s) { x *= s; y *= s; return *this; }
+};
+
+typedef Vec2T<float> Vec2;
+
+template<class T>
+inline Vec2T<T> operator+(const Vec2T<T>& a, const Vec2T<T>& b) { return Vec2T<T>(a.x + b.x, a.y + b.y); }
+template<class T>
+inline Vec2T<T> operator-(const Vec2T<T>& a, const Vec2T<T>& b) { return Vec2T<T>(a.x - b.x, a.y - b.y); }
+template<class T>
+inline Vec2T<T> operator*(typename Vec2T<T>::Scalar s, const Vec2T<T>& v) { return Vec2T<T>(s * v.x, s * v.y); }
+template<class T>
+inline Vec2T<T> operator*(const Vec2T<T>& v, typename Vec2T<T>::Scalar s) { return Vec2T<T>(s * v.x, s * v.y); }
+
+template<class T>
+inline T dot(const Vec2T<T>& a, const Vec2T<T>& b) { return a.x * b.x + a.y * b.y; }
+template<class T>
+inline T cross(const Vec2T<T>& a, const Vec2T<T>& b) { return a.x * b.y - a.y * b.x; }
+// cross of a scalar (angular velocity) with a vector
+template<class T>
+inline Vec2T<T> cross(typename Vec2T<T>::Scalar s, const Vec2T<T>& v) { return Vec2T<T>(-s * v.y, s * v.x); }
+// cross of a vector with a scalar, gives the tangent for a normal
+template<class T>
+inline Vec2T<T> cross(const Vec2T<T>& v, typename Vec2T<T>::Scalar s) { return Vec2T<T>(s * v.y, -s * v.x); }
+template<class T>
+inline T lengthSquared(const Vec2T<T>& v) { return v.x * v.x + v.y * v.y; }
+template<class T>
+inline T length(const Vec2T<T>& v) { return scalarSqrt(v.x * v.x + v.y * v.y); }
+
+// rotation stored as cosine/sine pair
+// ------------------------------------------------------------------------
+template<class T>
+struct RotT
+{
+	T c, s;
+
+	RotT() : c(1.0f), s(0.0f) {}
+	explicit RotT(T angle) : c(scalarCos(angle)), s(scalarSin(angle)) {}
+};
+
+typedef RotT<float> Rot;
+
+template<class T>
+inline Vec2T<T> rotate(const RotT<T>& q, const Vec2T<T>& v) { return Vec2T<T>(q.c * v.x - q.s * v.y, q.s * v.x + q.c * v.y); }
+template<class T>
+inline Vec2T<T> rotateInv(const RotT<T>& q, const Vec2T<T>& v) { return Vec2T<T>(q.c * v.x + q.s * v.y, -q.s * v.x + q.c * v.y); }
+#endif
@@ -0,0 +1,129 @@
+#ifndef WORLD_BATCH_H
+#define WORLD_BATCH_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include "job_system.h"
+#include "physics_world.h"
+
+// Many small independent worlds stepped together, for parameter sweeps and
+// training runs where each world is too small to keep several threads busy on
+// its own. The batch parallelises across worlds instead of inside them: every
+// world steps on a single thread and the job system hands out whole worlds,
+// the most expensive ones first (by their last step time), so a few large
+// worlds don't end up as the tail of the frame.
+//
+// Worlds are made as copies of a prototype that is built or loaded once.
+// Body shapes are plain extents in the body arrays, a handful of array copies
+// per world, and the level geometry (quantized meshes, terrain and the tree)
+// is held through a shared pointer, so every copy reads the prototype's level
+// instead of holding its own. A world that edits its level gets a copy of it.
+//
+// The batch holds one world type, any BasicPhysicsWorld configuration.
+// WorldBatch is the batch of PhysicsWorlds.
+// ------------------------------------------------------------------------
+struct BatchStats
+{
+	size_t worlds = 0;
+	size_t bodies = 0;
+	size_t contacts = 0;
+	size_t awakeBodies = 0;
+	uint64_t totalNs = 0;
+};
+
+template<class World>
+class BasicWorldBatch
+{
+public:
+	BatchStats stats;
+
+	// the job system is not owned and has to outlive the batch, nullptr steps
+	// every world on the calling thread
+	explicit BasicWorldBatch(JobSystem* jobs = nullptr) : jobs(jobs) {}
+
+	// add a copy of prototype and return its index
+	// ------------------------------------------------------------------------
+	size_t addWorld(const World& prototype)
+	{
+		worlds.emplace_back(new World(prototype));
+		worlds.back()->setJobSystem(nullptr);
+		return worlds.size() - 1;
+	}
+
+	// put world i back into the state of prototype, e.g. at the end of an episode
+	// ------------------------------------------------------------------------
+	void resetWorld(size_t i, const World& prototype)
+	{
+		*worlds[i] = prototype;
+		worlds[i]->setJobSystem(nullptr);
+	}
+
+	World& world(size_t i) { return *worlds[i]; }
+	const World& world(size_t i) const { return *worlds[i]; }
+	size_t size() const { return worlds.size(); }
+
+	void clear()
+	{
+		worlds.clear();
+		order.clear();
+		stats = BatchStats();
+	}
+
+	// advance every world by steps steps of dt seconds, returns once all are done
+	// ------------------------------------------------------------------------
+	void step(float dt, int steps = 1)
+	{
+		typedef std::chrono::steady_clock Clock;
+		Clock::time_point start = Clock::now();
+
+		// longest first, worlds that haven't stepped yet are guessed from their size
+		order.resize(worlds.size());
+		cost.resize(worlds.size());
+		for (size_t i = 0; i < worlds.size(); i++)
+		{
+			order[i] = (uint32_t)i;
+			const World& w = *worlds[i];
+			cost[i] = w.stats.totalNs > 0 ? w.stats.totalNs : (uint64_t)w.bodyCount() * 1000;
+		}
+		std::sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) {
+			return cost[a] > cost[b] || (cost[a] == cost[b] && a < b);
+		});
+
+		auto run = [this, dt, steps](size_t begin, size_t end, int) {
+			for (size_t k = begin; k < end; k++)
+			{
+				World& w = *worlds[order[k]];
+				for (int s = 0; s < steps; s++)
+					w.step(dt);
+			}
+		};
+		if (jobs)
+			jobs->parallelFor(order.size(), 1, run);
+		else if (!order.empty())
+			run(0, order.size(), 0);
+
+		stats.worlds = worlds.size();
+		stats.bodies = stats.contacts = stats.awakeBodies = 0;
+		for (const std::unique_ptr<World>& w : worlds)
+		{
+			stats.bodies += w->bodyCount();
+			stats.contacts += w->stats.contacts;
+			stats.awakeBodies += w->stats.awakeBodies;
+		}
+		stats.totalNs = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+	}
+
+private:
+	JobSystem* jobs;
+	std::vector<std::unique_ptr<World>> worlds;
+	std::vector<uint32_t> order;
+	std::vector<uint64_t> cost;
+};
+
+typedef BasicWorldBatch<PhysicsWorld> WorldBatch;
+#endif
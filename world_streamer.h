@@ -0,0 +1,401 @@
+#ifndef WORLD_STREAMER_H
+#define WORLD_STREAMER_H
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "physics_world.h"
+
+// Splits a world too large to keep in memory into square tiles and keeps only
+// the tiles around a set of focus points (players, cameras) in the world.
+// Every body belongs to the tile holding its centre. Tiles within loadRadius of
+// a focus are brought in, tiles further than unloadRadius from every focus have
+// their bodies and joints appended to a file per tile and removed from the
+// world, so idle regions cost neither memory nor step time. The gap between the
+// two radii keeps a focus moving along a tile border from paging the same tiles
+// in and out every frame.
+//
+// A body whose centre moves from a resident tile into one that is not resident
+// is handed off to that tile: written to its file and removed, so it turns up
+// again, with the velocity it left with, when the tile is next loaded. Bodies
+// tied together by joints always go as a group, to the tile of the group's
+// lowest index body, so no joint is ever cut by a tile border.
+//
+// Body indices change whenever bodies are written out, their handles
+// (BasicPhysicsWorld::bodyHandle) come back with them. A static body wider than
+// a tile still lives in the tile of its centre only, so long ground should be
+// built from pieces no wider than a tile. Tile files are scratch data in native
+// byte order, written on first use and deleted when read back or when the
+// streamer is cleared.
+//
+// The streamer works on any BasicPhysicsWorld configuration, tiles hold its
+// bodies in its own scalar. WorldStreamer streams a PhysicsWorld.
+// ------------------------------------------------------------------------
+struct StreamStats
+{
+	size_t residentTiles = 0;
+	size_t storedTiles = 0;
+	size_t bodiesOut = 0;    // written to disk by the last update
+	size_t bodiesIn = 0;     // read back by the last update
+	double updateMs = 0.0;
+};
+
+template<class World>
+class BasicWorldStreamer
+{
+public:
+	float tileSize = 32.0f;
+	int loadRadius = 1;      // in tiles, square around each focus
+	int unloadRadius = 2;    // in tiles, has to be at least loadRadius
+	std::string pathPrefix = "tile_";
+	StreamStats stats;
+
+	explicit BasicWorldStreamer(World& world) : world(world) {}
+
+	~BasicWorldStreamer()
+	{
+		clear();
+	}
+
+	// page tiles in and out around the focus points and hand off bodies that
+	// left the resident tiles, call between steps. The first call writes out
+	// everything outside the focus area of a freshly built world.
+	// ------------------------------------------------------------------------
+	void update(const Vec2* focus, size_t focusCount)
+	{
+		typedef std::chrono::steady_clock Clock;
+		Clock::time_point start = Clock::now();
+		stats.bodiesOut = stats.bodiesIn = 0;
+
+		wanted.clear();
+		for (size_t f = 0; f < focusCount; f++)
+		{
+			int32_t fx = tileCoord(focus[f].x), fy = tileCoord(focus[f].y);
+			for (int32_t y = fy - loadRadius; y <= fy + loadRadius; y++)
+				for (int32_t x = fx - loadRadius; x <= fx + loadRadius; x++)
+					wanted.push_back(tileKey(x, y));
+		}
+		std::sort(wanted.begin(), wanted.end());
+		wanted.erase(std::unique(wanted.begin(), wanted.end()), wanted.end());
+
+		// resident tiles stay until every focus is past the unload radius
+		keep.clear();
+		for (uint64_t key : resident)
+			if (nearFocus(key, focus, focusCount, std::max(unloadRadius, loadRadius)))
+				keep.push_back(key);
+		next.clear();
+		std::set_union(keep.begin(), keep.end(), wanted.begin(), wanted.end(), std::back_inserter(next));
+
+		writeOut();
+		for (uint64_t key : wanted)
+			if (!std::binary_search(resident.begin(), resident.end(), key))
+				readIn(key);
+		resident.swap(next);
+
+		stats.residentTiles = resident.size();
+		stats.storedTiles = stored.size();
+		stats.updateMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	}
+
+	// tile coordinates holding a world position
+	// ------------------------------------------------------------------------
+	int32_t tileCoord(float v) const
+	{
+		return (int32_t)floorf(v / tileSize);
+	}
+
+	bool isResident(int32_t tx, int32_t ty) const
+	{
+		return std::binary_search(resident.begin(), resident.end(), tileKey(tx, ty));
+	}
+
+	// delete every tile file and forget the streamed out bodies, the world keeps
+	// what is resident
+	// ------------------------------------------------------------------------
+	void clear()
+	{
+		for (uint64_t key : stored)
+			std::remove(tilePath(key).c_str());
+		stored.clear();
+		resident.clear();
+		stats = StreamStats();
+	}
+
+private:
+	static const uint32_t TILE_VERSION = 2;
+
+	World& world;
+	// sorted tile keys
+	std::vector<uint64_t> resident, stored;
+	std::vector<uint64_t> wanted, keep, next;
+
+	// scratch for writing out
+	std::vector<uint32_t> group;
+	std::vector<uint64_t> bodyTile;
+	std::vector<uint8_t> remove;
+	std::vector<uint32_t> remap, localIndex;
+	std::vector<std::pair<uint64_t, uint32_t>> outBodies, outJoints;
+	std::vector<char> buffer;
+
+	static uint64_t tileKey(int32_t x, int32_t y)
+	{
+		return ((uint64_t)(uint32_t)x << 32) | (uint32_t)y;
+	}
+
+	static int32_t keyX(uint64_t key) { return (int32_t)(uint32_t)(key >> 32); }
+	static int32_t keyY(uint64_t key) { return (int32_t)(uint32_t)key; }
+
+	std::string tilePath(uint64_t key) const
+	{
+		return pathPrefix + std::to_string(keyX(key)) + "_" + std::to_string(keyY(key)) + ".bin";
+	}
+
+	bool nearFocus(uint64_t key, const Vec2* focus, size_t focusCount, int radius) const
+	{
+		int32_t x = keyX(key), y = keyY(key);
+		for (size_t f = 0; f < focusCount; f++)
+		{
+			int32_t dx = x - tileCoord(focus[f].x), dy = y - tileCoord(focus[f].y);
+			if (std::abs(dx) <= radius && std::abs(dy) <= radius)
+				return true;
+		}
+		return false;
+	}
+
+	uint32_t findGroup(uint32_t i)
+	{
+		while (group[i] != i)
+		{
+			group[i] = group[group[i]];
+			i = group[i];
+		}
+		return i;
+	}
+
+	// write every body group whose lowest index body is outside the next
+	// resident set to that body's tile, then remove them from the world
+	// ------------------------------------------------------------------------
+	void writeOut()
+	{
+		typename World::BodyStore& bodies = world.bodies;
+		typename World::JointStore& joints = world.joints;
+		size_t n = bodies.size();
+
+		// the root of each group is its lowest index body
+		group.resize(n);
+		for (size_t i = 0; i < n; i++)
+			group[i] = (uint32_t)i;
+		for (size_t j = 0; j < joints.size(); j++)
+		{
+			if (!joints.alive[j])
+				continue;
+			uint32_t a = findGroup(joints.bodyA[j]), b = findGroup(joints.bodyB[j]);
+			if (a < b)
+				group[b] = a;
+			else if (b < a)
+				group[a] = b;
+		}
+
+		outBodies.clear();
+		bodyTile.resize(n);
+		for (size_t i = 0; i < n; i++)
+		{
+			uint32_t root = findGroup((uint32_t)i);
+			if (root == i)
+				bodyTile[i] = tileKey(tileCoord(toFloat(bodies.posX[i])), tileCoord(toFloat(bodies.posY[i])));
+			else
+				bodyTile[i] = bodyTile[root];
+			if (!std::binary_search(next.begin(), next.end(), bodyTile[i]))
+				outBodies.push_back(std::make_pair(bodyTile[i], (uint32_t)i));
+		}
+		if (outBodies.empty())
+			return;
+		outJoints.clear();
+		for (size_t j = 0; j < joints.size(); j++)
+		{
+			if (!joints.alive[j])
+				continue;
+			uint64_t key = bodyTile[joints.bodyA[j]];
+			if (!std::binary_search(next.begin(), next.end(), key))
+				outJoints.push_back(std::make_pair(key, (uint32_t)j));
+		}
+		std::sort(outBodies.begin(), outBodies.end());
+		std::sort(outJoints.begin(), outJoints.end());
+
+		remove.assign(n, 0);
+		localIndex.resize(n);
+		size_t jb = 0;
+		for (size_t b = 0; b < outBodies.size();)
+		{
+			uint64_t key = outBodies[b].first;
+			size_t be = b;
+			while (be < outBodies.size() && outBodies[be].first == key)
+				be++;
+			while (jb < outJoints.size() && outJoints[jb].first < key)
+				jb++;
+			size_t je = jb;
+			while (je < outJoints.size() && outJoints[je].first == key)
+				je++;
+
+			if (writeTile(key, b, be, jb, je))
+			{
+				for (size_t k = b; k < be; k++)
+					remove[outBodies[k].second] = 1;
+				stats.bodiesOut += be - b;
+			}
+			b = be;
+			jb = je;
+		}
+		world.removeBodies(remove, remap);
+	}
+
+	// append one chunk of bodies and their joints to a tile file:
+	// version, body count, joint count, then every field of each body and joint
+	// with joint bodies given as indices into the chunk
+	// ------------------------------------------------------------------------
+	bool writeTile(uint64_t key, size_t bodyBegin, size_t bodyEnd, size_t jointBegin, size_t jointEnd)
+	{
+		typename World::BodyStore& bodies = world.bodies;
+		typename World::JointStore& joints = world.joints;
+		buffer.clear();
+		put((uint32_t)TILE_VERSION);
+		put((uint32_t)(bodyEnd - bodyBegin));
+		put((uint32_t)(jointEnd - jointBegin));
+		for (size_t k = bodyBegin; k < bodyEnd; k++)
+		{
+			uint32_t i = outBodies[k].second;
+			localIndex[i] = (uint32_t)(k - bodyBegin);
+			bodies.forEachField([&](auto& field) { put(field[i]); });
+		}
+		for (size_t k = jointBegin; k < jointEnd; k++)
+		{
+			uint32_t j = outJoints[k].second;
+			// only index fields can be body ids, scalar fields of a fixed point
+			// world never reach the remap
+			joints.forEachField([&](auto& field) {
+				if constexpr (std::is_same<typename std::decay<decltype(field)>::type, std::vector<uint32_t>>::value)
+				{
+					if (&field == &joints.bodyA || &field == &joints.bodyB)
+					{
+						put(localIndex[field[j]]);
+						return;
+					}
+				}
+				put(field[j]);
+			});
+		}
+
+		bool append = std::binary_search(stored.begin(), stored.end(), key);
+		std::string path = tilePath(key);
+		FILE* file = fopen(path.c_str(), append ? "ab" : "wb");
+		bool ok = file && fwrite(buffer.data(), 1, buffer.size(), file) == buffer.size();
+		if (file)
+			ok = fclose(file) == 0 && ok;
+		if (!ok)
+		{
+			std::cout << "ERROR::STREAM::TILE_NOT_SUCCESFULLY_WRITTEN: " << path << std::endl;
+			return false;
+		}
+		if (!append)
+			stored.insert(std::lower_bound(stored.begin(), stored.end(), key), key);
+		return true;
+	}
+
+	template<class T>
+	void put(const T& value)
+	{
+		const char* p = (const char*)&value;
+		buffer.insert(buffer.end(), p, p + sizeof(T));
+	}
+
+	// add the bodies and joints of a stored tile back to the world and delete its file
+	// ------------------------------------------------------------------------
+	void readIn(uint64_t key)
+	{
+		auto it = std::lower_bound(stored.begin(), stored.end(), key);
+		if (it == stored.end() || *it != key)
+			return;
+		stored.erase(it);
+		std::string path = tilePath(key);
+		FILE* file = fopen(path.c_str(), "rb");
+		if (!file)
+		{
+			std::cout << "ERROR::STREAM::TILE_NOT_SUCCESFULLY_READ: " << path << std::endl;
+			return;
+		}
+		fseek(file, 0, SEEK_END);
+		long size = ftell(file);
+		fseek(file, 0, SEEK_SET);
+		buffer.resize(size > 0 ? (size_t)size : 0);
+		bool ok = fread(buffer.data(), 1, buffer.size(), file) == buffer.size();
+		fclose(file);
+		std::remove(path.c_str());
+		if (!ok)
+		{
+			std::cout << "ERROR::STREAM::TILE_NOT_SUCCESFULLY_READ: " << path << std::endl;
+			return;
+		}
+
+		typename World::BodyStore& bodies = world.bodies;
+		typename World::JointStore& joints = world.joints;
+		size_t bodyBytes = 0, jointBytes = 0;
+		bodies.forEachField([&](auto& field) { bodyBytes += sizeof(field[0]); });
+		joints.forEachField([&](auto& field) { jointBytes += sizeof(field[0]); });
+
+		const char* p = buffer.data();
+		const char* end = p + buffer.size();
+		while (p < end)
+		{
+			uint32_t version, bodyCount, jointCount;
+			if (end - p < 3 * (ptrdiff_t)sizeof(uint32_t))
+				break;
+			get(p, version);
+			get(p, bodyCount);
+			get(p, jointCount);
+			if (version != TILE_VERSION || (size_t)(end - p) < bodyCount * bodyBytes + jointCount * jointBytes)
+				break;
+
+			uint32_t base = (uint32_t)bodies.size();
+			bodies.resize(base + bodyCount);
+			for (uint32_t k = 0; k < bodyCount; k++)
+				bodies.forEachField([&](auto& field) { get(p, field[base + k]); });
+			for (uint32_t k = 0; k < jointCount; k++)
+			{
+				uint32_t j = joints.allocate();
+				joints.forEachField([&](auto& field) { get(p, field[j]); });
+				if (joints.bodyA[j] >= bodyCount || joints.bodyB[j] >= bodyCount)
+				{
+					joints.release(j);
+					continue;
+				}
+				joints.bodyA[j] += base;
+				joints.bodyB[j] += base;
+				joints.alive[j] = 1;
+			}
+			stats.bodiesIn += bodyCount;
+		}
+		if (p != end)
+			std::cout << "ERROR::STREAM::CORRUPT_TILE: " << path << std::endl;
+	}
+
+	template<class T>
+	static void get(const char*& p, T& value)
+	{
+		memcpy(&value, p, sizeof(T));
+		p += sizeof(T);
+	}
+};
+
+typedef BasicWorldStreamer<PhysicsWorld> WorldStreamer;
+#endif